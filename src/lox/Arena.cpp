@@ -0,0 +1,27 @@
+#include "Arena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+using namespace pimentel;
+
+void* Arena::allocate(size_t size, size_t alignment)
+{
+    auto address = reinterpret_cast<uintptr_t>(m_cursor);
+    auto aligned = (address + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+
+    if (!m_cursor || aligned + size > reinterpret_cast<uintptr_t>(m_end))
+    {
+        const auto blockSize = std::max(BLOCK_SIZE, size + alignment);
+        m_blocks.emplace_back(new std::byte[blockSize]);
+        m_cursor = m_blocks.back().get();
+        m_end = m_cursor + blockSize;
+
+        address = reinterpret_cast<uintptr_t>(m_cursor);
+        aligned = (address + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+    }
+
+    m_cursor = reinterpret_cast<std::byte*>(aligned + size);
+
+    return reinterpret_cast<void*>(aligned);
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace pimentel
+{
+    // Bump allocator handing out memory from large blocks. Everything is
+    // released at once when the arena is destroyed, objects placed in it
+    // must be destroyed before that (see NodeDeleter).
+    class Arena
+    {
+    public:
+        Arena() = default;
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+        ~Arena() = default;
+
+        void* allocate(size_t size, size_t alignment);
+
+        template<typename T, typename... Args>
+        T* make(Args&&... args)
+        {
+            return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        }
+
+    private:
+        static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+        std::vector<std::unique_ptr<std::byte[]>> m_blocks;
+        std::byte* m_cursor = nullptr;
+        std::byte* m_end = nullptr;
+    };
+
+    // Deleter of AST nodes: nodes placed in an arena only get destroyed, the
+    // arena owns their memory. Nodes built with plain `new` (e.g. in tests)
+    // are deleted as usual.
+    struct NodeDeleter
+    {
+        NodeDeleter() = default;
+
+        template<typename T>
+        NodeDeleter(std::default_delete<T>)
+        {}
+
+        template<typename T>
+        void operator()(T* node) const
+        {
+            if (node->inArena)
+            {
+                node->~T();
+            }
+            else
+            {
+                delete node;
+            }
+        }
+    };
+
+    template<typename T>
+    using NodePtr = std::unique_ptr<T, NodeDeleter>;
+}
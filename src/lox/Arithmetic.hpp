@@ -0,0 +1,108 @@
+#pragma once
+#include <cstdint>
+#include "Value.h"
+
+namespace pimentel
+{
+    // Operations on two number values (isNumber() is already checked). Two
+    // integers stay integers while the exact result fits in 32 bits and isn't
+    // -0, anything else is computed on doubles, so results always match what
+    // doubles alone would produce.
+
+    inline Value fromInt64(int64_t number)
+    {
+        if (number >= INT32_MIN && number <= INT32_MAX)
+        {
+            return Value{ static_cast<int32_t>(number) };
+        }
+
+        return Value{ static_cast<double>(number) };
+    }
+
+    inline Value numberAdd(const Value& left, const Value& right)
+    {
+        int32_t result;
+
+        if (left.isInt() && right.isInt() && !__builtin_add_overflow(left.asInt(), right.asInt(), &result))
+        {
+            return Value{ result };
+        }
+
+        return Value{ left.asNumber() + right.asNumber() };
+    }
+
+    inline Value numberSubtract(const Value& left, const Value& right)
+    {
+        int32_t result;
+
+        if (left.isInt() && right.isInt() && !__builtin_sub_overflow(left.asInt(), right.asInt(), &result))
+        {
+            return Value{ result };
+        }
+
+        return Value{ left.asNumber() - right.asNumber() };
+    }
+
+    inline Value numberMultiply(const Value& left, const Value& right)
+    {
+        if (left.isInt() && right.isInt())
+        {
+            const auto product = static_cast<int64_t>(left.asInt()) * right.asInt();
+
+            // 0 * -n is -0.
+            if (product != 0 || (left.asInt() >= 0 && right.asInt() >= 0))
+            {
+                return fromInt64(product);
+            }
+        }
+
+        return Value{ left.asNumber() * right.asNumber() };
+    }
+
+    inline Value numberDivide(const Value& left, const Value& right)
+    {
+        // Integers are exact as doubles and a quotient that isn't integral
+        // can't round to one, so dividing as doubles is exact enough to tell.
+        if (left.isInt() && right.isInt())
+        {
+            return Value::number(static_cast<double>(left.asInt()) / right.asInt());
+        }
+
+        return Value{ left.asNumber() / right.asNumber() };
+    }
+
+    inline Value numberNegate(const Value& value)
+    {
+        if (value.isInt() && value.asInt() != 0)
+        {
+            return fromInt64(-static_cast<int64_t>(value.asInt()));
+        }
+
+        return Value{ -value.asNumber() };
+    }
+
+    inline bool numberLess(const Value& left, const Value& right)
+    {
+        return left.isInt() && right.isInt() ? left.asInt() < right.asInt() : left.asNumber() < right.asNumber();
+    }
+
+    inline bool numberLessEqual(const Value& left, const Value& right)
+    {
+        return left.isInt() && right.isInt() ? left.asInt() <= right.asInt() : left.asNumber() <= right.asNumber();
+    }
+
+    inline bool numberGreater(const Value& left, const Value& right)
+    {
+        return numberLess(right, left);
+    }
+
+    inline bool numberGreaterEqual(const Value& left, const Value& right)
+    {
+        return numberLessEqual(right, left);
+    }
+
+    inline bool numberEqual(const Value& left, const Value& right)
+    {
+        return left.isInt() && right.isInt() ? left.asInt() == right.asInt() : left.asNumber() == right.asNumber();
+    }
+}
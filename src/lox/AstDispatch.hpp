@@ -0,0 +1,95 @@
+#pragma once
+#include <cstdlib>
+#include "Expression.h"
+#include "Statement.h"
+
+namespace pimentel
+{
+    // Calls `visitor` with the node cast to its concrete type, switching on
+    // its kind. The visitor is any callable overloaded (or generic) on the
+    // node types, so a new pass doesn't need a visitor interface nor a
+    // method on every node. Operator specialized nodes come as
+    // BinaryOp<K>/UnaryOp<K>, a visitor only overloaded on Binary/Unary
+    // still takes them through the base class.
+    template<typename Visitor>
+    decltype(auto) dispatch(Expression& expr, Visitor&& visitor)
+    {
+        switch (expr.kind)
+        {
+        case ExprKind::BINARY:
+            return visitor(static_cast<Binary&>(expr));
+        case ExprKind::ADD:
+            return visitor(static_cast<BinaryOp<ExprKind::ADD>&>(expr));
+        case ExprKind::SUBTRACT:
+            return visitor(static_cast<BinaryOp<ExprKind::SUBTRACT>&>(expr));
+        case ExprKind::MULTIPLY:
+            return visitor(static_cast<BinaryOp<ExprKind::MULTIPLY>&>(expr));
+        case ExprKind::DIVIDE:
+            return visitor(static_cast<BinaryOp<ExprKind::DIVIDE>&>(expr));
+        case ExprKind::GREATER:
+            return visitor(static_cast<BinaryOp<ExprKind::GREATER>&>(expr));
+        case ExprKind::GREATER_EQUAL:
+            return visitor(static_cast<BinaryOp<ExprKind::GREATER_EQUAL>&>(expr));
+        case ExprKind::LESS:
+            return visitor(static_cast<BinaryOp<ExprKind::LESS>&>(expr));
+        case ExprKind::LESS_EQUAL:
+            return visitor(static_cast<BinaryOp<ExprKind::LESS_EQUAL>&>(expr));
+        case ExprKind::EQUAL_EQUAL:
+            return visitor(static_cast<BinaryOp<ExprKind::EQUAL_EQUAL>&>(expr));
+        case ExprKind::BANG_EQUAL:
+            return visitor(static_cast<BinaryOp<ExprKind::BANG_EQUAL>&>(expr));
+        case ExprKind::GROUPING:
+            return visitor(static_cast<Grouping&>(expr));
+        case ExprKind::LITERAL:
+            return visitor(static_cast<Literal&>(expr));
+        case ExprKind::UNARY:
+            return visitor(static_cast<Unary&>(expr));
+        case ExprKind::NEGATE:
+            return visitor(static_cast<UnaryOp<ExprKind::NEGATE>&>(expr));
+        case ExprKind::NOT:
+            return visitor(static_cast<UnaryOp<ExprKind::NOT>&>(expr));
+        case ExprKind::VARIABLE:
+            return visitor(static_cast<Variable&>(expr));
+        case ExprKind::ASSIGNMENT:
+            return visitor(static_cast<Assignment&>(expr));
+        case ExprKind::LOGICAL:
+            return visitor(static_cast<Logical&>(expr));
+        case ExprKind::CALL:
+            return visitor(static_cast<Call&>(expr));
+        case ExprKind::INDEXING:
+            return visitor(static_cast<Indexing&>(expr));
+        }
+
+        std::abort();
+    }
+
+    template<typename Visitor>
+    decltype(auto) dispatch(Statement& stmt, Visitor&& visitor)
+    {
+        switch (stmt.kind)
+        {
+        case StmtKind::EXPRESSION:
+            return visitor(static_cast<ExpressionStmt&>(stmt));
+        case StmtKind::PRINT:
+            return visitor(static_cast<PrintStmt&>(stmt));
+        case StmtKind::VAR:
+            return visitor(static_cast<VarStmt&>(stmt));
+        case StmtKind::BLOCK:
+            return visitor(static_cast<BlockStmt&>(stmt));
+        case StmtKind::IF:
+            return visitor(static_cast<IfStmt&>(stmt));
+        case StmtKind::WHILE:
+            return visitor(static_cast<WhileStmt&>(stmt));
+        case StmtKind::BREAK:
+            return visitor(static_cast<BreakStmt&>(stmt));
+        case StmtKind::FOR:
+            return visitor(static_cast<ForStmt&>(stmt));
+        case StmtKind::FUNCTION_DECL:
+            return visitor(static_cast<FunctionDeclStmt&>(stmt));
+        case StmtKind::RETURN:
+            return visitor(static_cast<ReturnStmt&>(stmt));
+        }
+
+        std::abort();
+    }
+}
@@ -1,7 +1,8 @@
 #pragma once
-#include "ExpressionVisitor.hpp"
-
 #include "Expression.h"
+#include "Statement.h"
+#include "Program.h"
+#include "AstDispatch.hpp"
 #include <array>
 
 #include <string>
@@ -12,18 +13,38 @@
 
 namespace pimentel
 {
-    class AstPrinter : public ExprVisitorString
+    class AstPrinter
     {
     public:
+        using RetType = std::string;
+
         AstPrinter() = default;
         ~AstPrinter() = default;
 
         std::string print(Expression& expr)
         {
-            return expr.accept(*this);
+            return dispatch(expr, [this](auto& node) { return visit(node); });
+        }
+
+        std::string print(Statement& stmt)
+        {
+            return dispatch(stmt, [this](auto& node) { return printStmt(node); });
         }
 
-        RetType visit(Binary& expr) override
+        // One line per top level statement.
+        std::string print(const Program& program)
+        {
+            std::stringstream stream;
+
+            for(const auto& stmt : program.stmts)
+            {
+                stream << print(*stmt) << "\n";
+            }
+
+            return stream.str();
+        }
+
+        RetType visit(Binary& expr)
         {
             return parenthesize(expr.operatorType.getLexeme(),
                         std::array{
@@ -32,13 +53,13 @@ namespace pimentel
                         });
         }
 
-        RetType visit(Grouping& expr) override 
+        RetType visit(Grouping& expr) 
         {
             return parenthesize("group",
                 std::array{std::reference_wrapper{*expr.expr}});
         }
 
-        RetType visit(Literal& expr) override
+        RetType visit(Literal& expr)
         {
             if(std::holds_alternative<void*>(expr.value))
             {
@@ -47,39 +68,153 @@ namespace pimentel
             return literalToString(expr.value);
         }
     
-        RetType visit(Unary& expr) override
+        RetType visit(Unary& expr)
         {
             return parenthesize(expr.operatorType.getLexeme(),
                 std::array{std::reference_wrapper{*expr.right}});
         }
 
-        RetType visit(Variable& expr) override
+        RetType visit(Variable& expr)
         {
             return expr.name.getLexeme();
         }
 
-        RetType visit(Assignment& expr) override
+        RetType visit(Assignment& expr)
         {
-            return expr.name.getLexeme();
+            return parenthesize("= " + expr.name.getLexeme(),
+                std::array{std::reference_wrapper{*expr.value}});
         }
 
-        RetType visit(Logical& expr) override
+        RetType visit(Logical& expr)
         {
-            return expr.op.getLexeme();
+            return parenthesize(expr.op.getLexeme(),
+                        std::array{
+                            std::reference_wrapper{*expr.leftExpr},
+                            std::reference_wrapper{*expr.rightExpr}
+                        });
         }
 
-        RetType visit(Call& expr) override
+        RetType visit(Call& expr)
         {
-            return expr.paren.getLexeme();
+            std::stringstream stream;
+
+            stream << "(call " << print(*expr.calee);
+            for(const auto& arg : expr.arguments)
+            {
+                stream << " " << print(*arg);
+            }
+            stream << ")";
+
+            return stream.str();
         }
 
 
-        RetType visit(Indexing& expr) override
+        RetType visit(Indexing& expr)
         {
-            return expr.brackets.getLexeme();
+            return parenthesize("[]",
+                        std::array{
+                            std::reference_wrapper{*expr.indexee},
+                            std::reference_wrapper{*expr.index}
+                        });
         }
 
     private:
+        std::string printStmt(ExpressionStmt& stmt)
+        {
+            return parenthesize("expr", std::array{std::reference_wrapper{*stmt.expr}});
+        }
+
+        std::string printStmt(PrintStmt& stmt)
+        {
+            return parenthesize("print", std::array{std::reference_wrapper{*stmt.expr}});
+        }
+
+        std::string printStmt(VarStmt& stmt)
+        {
+            if(!stmt.initializer)
+            {
+                return "(var " + stmt.name.getLexeme() + ")";
+            }
+
+            return parenthesize("var " + stmt.name.getLexeme(),
+                std::array{std::reference_wrapper{*stmt.initializer}});
+        }
+
+        std::string printStmt(BlockStmt& stmt)
+        {
+            std::stringstream stream;
+
+            stream << "(block";
+            for(const auto& inner : stmt.stmts)
+            {
+                stream << " " << print(*inner);
+            }
+            stream << ")";
+
+            return stream.str();
+        }
+
+        std::string printStmt(IfStmt& stmt)
+        {
+            std::stringstream stream;
+
+            stream << "(if " << print(*stmt.expr) << " " << print(*stmt.block);
+            if(stmt.elseblock)
+            {
+                stream << " " << print(*stmt.elseblock);
+            }
+            stream << ")";
+
+            return stream.str();
+        }
+
+        std::string printStmt(WhileStmt& stmt)
+        {
+            return "(while " + print(*stmt.expr) + " " + print(*stmt.block) + ")";
+        }
+
+        std::string printStmt(BreakStmt&)
+        {
+            return "(break)";
+        }
+
+        std::string printStmt(ForStmt& stmt)
+        {
+            std::stringstream stream;
+
+            stream << "(for "
+                   << (stmt.variableDef ? print(*stmt.variableDef) : "()") << " "
+                   << (stmt.expr ? print(*stmt.expr) : "()") << " "
+                   << (stmt.incStmt ? print(*stmt.incStmt) : "()") << " "
+                   << print(*stmt.block) << ")";
+
+            return stream.str();
+        }
+
+        std::string printStmt(FunctionDeclStmt& stmt)
+        {
+            std::stringstream stream;
+
+            stream << "(fun " << stmt.name.getLexeme() << " (";
+            for(size_t i = 0; i < stmt.argList.size(); i++)
+            {
+                stream << (i ? " " : "") << stmt.argList[i].getLexeme();
+            }
+            stream << ") " << print(*stmt.block) << ")";
+
+            return stream.str();
+        }
+
+        std::string printStmt(ReturnStmt& stmt)
+        {
+            if(!stmt.expr)
+            {
+                return "(return)";
+            }
+
+            return parenthesize("return", std::array{std::reference_wrapper{*stmt.expr}});
+        }
+
         template<typename T>
         std::string parenthesize(const std::string& name, const T& exprRefWrapList)
         {
@@ -89,7 +224,7 @@ namespace pimentel
             for(const auto& expr : exprRefWrapList)
             {
                 stream << " ";
-                stream << expr.get().accept(*this);
+                stream << print(expr.get());
             }
 
             stream <<  ")";
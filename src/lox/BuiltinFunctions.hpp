@@ -1,17 +1,29 @@
 #pragma once
 #include <chrono>
 #include "Expression.h"
-#include "ExpressionVisitor.hpp"
 
 namespace pimentel
 {
-    class ClockFnc : public LoxCallable
+    // Builtins don't depend on the engine running them, so they can be
+    // shared by the tree-walking Interpreter and the bytecode VM.
+    class NativeFunction : public LoxCallable
+    {
+    public:
+        virtual Value callNative(const std::vector<Value>& argList) = 0;
+
+        Value call(Interpreter&, const std::vector<Value>& argList) override
+        {
+            return callNative(argList);
+        }
+    };
+
+    class ClockFnc : public NativeFunction
     {
     public:
         ClockFnc(){  }
         ~ClockFnc() = default;
 
-        LoxVal call(Interpreter&, const std::vector<LoxVal>&) override
+        Value callNative(const std::vector<Value>&) override
         {
             const auto now = std::chrono::system_clock::now();
             const auto duration = now.time_since_epoch();
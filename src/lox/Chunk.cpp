@@ -0,0 +1,49 @@
+#include "Chunk.h"
+
+using namespace pimentel;
+
+void Chunk::write(uint8_t byte, int line)
+{
+    code.push_back(byte);
+    lines.push_back(line);
+}
+
+void Chunk::write(OpCode op, int line)
+{
+    write(static_cast<uint8_t>(op), line);
+}
+
+size_t Chunk::addConstant(const Value& val)
+{
+    // Pooled strings are the same object, so equal bits means equal constant.
+    for (size_t i = 0; i < constants.size(); i++)
+    {
+        if (constants[i].bits() == val.bits())
+        {
+            return i;
+        }
+    }
+
+    constants.push_back(val);
+    return constants.size() - 1;
+}
+
+size_t Chunk::addName(Symbol name)
+{
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        if (names[i] == name)
+        {
+            return i;
+        }
+    }
+
+    names.push_back(name);
+    return names.size() - 1;
+}
+
+size_t Chunk::addFunction(const std::shared_ptr<VmFunction>& function)
+{
+    functions.push_back(function);
+    return functions.size() - 1;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <memory>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Symbol.h"
+#include "Value.h"
+
+namespace pimentel
+{
+    enum class OpCode : uint8_t
+    {
+        CONSTANT,       // u16 constant index
+        NIL,
+        NULL_OBJ,       // value of uninitialized variables and failed operations
+        TRUE,
+        FALSE,
+        POP,
+
+        GET_LOCAL,      // u8 slot
+        SET_LOCAL,      // u8 slot
+        GET_UPVALUE,    // u8 upvalue index
+        SET_UPVALUE,    // u8 upvalue index
+        GET_GLOBAL,     // u16 name index
+        SET_GLOBAL,     // u16 name index
+        DEFINE_GLOBAL,  // u16 name index
+
+        EQUAL,
+        NOT_EQUAL,
+        GREATER,
+        GREATER_EQUAL,
+        LESS,
+        LESS_EQUAL,
+        ADD,
+        SUBTRACT,
+        MULTIPLY,
+        DIVIDE,
+        NOT,
+        NEGATE,
+        TRUTHY,         // replaces the top of the stack by its truthiness
+        INDEX,
+
+        PRINT,
+
+        JUMP,           // u16 forward offset
+        JUMP_IF_FALSE,  // u16 forward offset, pops the condition
+        LOOP,           // u16 backward offset
+
+        CALL,           // u8 argument count
+        CLOSURE,        // u16 function index, then (u8 isLocal, u8 index) per upvalue
+        CLOSE_UPVALUE,
+        RETURN
+    };
+
+    class VmFunction;
+
+    class Chunk
+    {
+    public:
+        Chunk() = default;
+        ~Chunk() = default;
+
+        void write(uint8_t byte, int line);
+        void write(OpCode op, int line);
+
+        size_t addConstant(const Value& val);
+        size_t addName(Symbol name);
+        size_t addFunction(const std::shared_ptr<VmFunction>& function);
+
+    public:
+        std::vector<uint8_t> code;
+        std::vector<int> lines;
+        std::vector<Value> constants;
+        std::vector<Symbol> names;
+        std::vector<std::shared_ptr<VmFunction>> functions;
+    };
+}
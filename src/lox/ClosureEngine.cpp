@@ -0,0 +1,1322 @@
+#include "ClosureEngine.h"
+#include "AstDispatch.hpp"
+#include "Arithmetic.hpp"
+#include "BuiltinFunctions.hpp"
+#include "ErrorManager.h"
+#include "Resolver.h"
+#include "ValueUtils.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+
+// Programs run on a thread with a stack of the engine's own where POSIX
+// threads are available, elsewhere on the caller's stack with a smaller bound.
+#if defined(__unix__) || defined(__APPLE__)
+#define LOX_CLOSURE_WORKER 1
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace pimentel;
+
+namespace pimentel
+{
+    struct CompiledFunction
+    {
+        // Keeps the declaration, and the program it belongs to, alive.
+        std::shared_ptr<const FunctionDeclStmt> declaration;
+        size_t arity = 0;
+        // Slots of the frame: arguments, then every local of the body.
+        size_t frameSize = 0;
+        std::vector<ClosureEngine::Stmt> body;
+    };
+}
+
+namespace
+{
+    using Expr = ClosureEngine::Expr;
+    using Test = ClosureEngine::Test;
+    using Stmt = ClosureEngine::Stmt;
+
+    // Operands binary closures read in place rather than through the
+    // closure of the operand.
+    struct SlotOperand
+    {
+        size_t offset;
+
+        Value operator()(Value* frame) const
+        {
+            return frame[offset];
+        }
+    };
+
+    struct ConstantOperand
+    {
+        Value value;
+
+        Value operator()(Value*) const
+        {
+            return value;
+        }
+    };
+
+    struct GlobalOperand
+    {
+        GlobalTable* globals;
+        Symbol symbol;
+        const Token* name;
+
+        Value operator()(Value*) const
+        {
+            if (const auto global = globals->find(symbol))
+            {
+                return *global;
+            }
+
+            ErrorManager::get().report(0, "Variable does not exist: " + name->getLexeme());
+            return {};
+        }
+    };
+
+    struct ExprOperand
+    {
+        Expr expr;
+
+        Value operator()(Value* frame) const
+        {
+            return expr(frame);
+        }
+    };
+
+    // Comparisons give a bool.
+    template<ExprKind K>
+    auto numberOperation(const Value& left, const Value& right)
+    {
+        if constexpr (K == ExprKind::ADD) return numberAdd(left, right);
+        else if constexpr (K == ExprKind::SUBTRACT) return numberSubtract(left, right);
+        else if constexpr (K == ExprKind::MULTIPLY) return numberMultiply(left, right);
+        else if constexpr (K == ExprKind::DIVIDE) return numberDivide(left, right);
+        else if constexpr (K == ExprKind::GREATER) return numberGreater(left, right);
+        else if constexpr (K == ExprKind::GREATER_EQUAL) return numberGreaterEqual(left, right);
+        else if constexpr (K == ExprKind::LESS) return numberLess(left, right);
+        else if constexpr (K == ExprKind::LESS_EQUAL) return numberLessEqual(left, right);
+        else if constexpr (K == ExprKind::EQUAL_EQUAL) return numberEqual(left, right);
+        else return !numberEqual(left, right);
+    }
+
+    // Both operands, the left one rooted while the right one may run a call.
+    template<typename Left, typename Right>
+    std::pair<Value, Value> operands(const Left& left, const Right& right, Value* frame)
+    {
+        const auto leftValue = left(frame);
+
+        if constexpr (std::is_same_v<Right, ExprOperand>)
+        {
+            if (leftValue.isHeapObject())
+            {
+                TempRoots roots;
+                roots.push(leftValue);
+                return { leftValue, right(frame) };
+            }
+        }
+
+        return { leftValue, right(frame) };
+    }
+
+    template<ExprKind K, typename Left, typename Right>
+    struct Comparison
+    {
+        Left left;
+        Right right;
+        const Token* op;
+
+        bool operator()(Value* frame) const
+        {
+            const auto [leftValue, rightValue] = operands(left, right, frame);
+
+            if (leftValue.isNumber() && rightValue.isNumber())
+            {
+                return numberOperation<K>(leftValue, rightValue);
+            }
+
+            return isTruthy(binaryOperation(*op, leftValue, rightValue));
+        }
+    };
+
+    struct TestOperand
+    {
+        Test test;
+
+        bool operator()(Value* frame) const
+        {
+            return test(frame);
+        }
+    };
+
+    // Lowest address calls may reach on the caller's own stack, whose
+    // bounds aren't known: `budget` bytes below the caller's frame.
+    uintptr_t callerStackLimit(size_t budget)
+    {
+        const auto here = reinterpret_cast<uintptr_t>(&budget);
+        return here - std::min<uintptr_t>(here, budget);
+    }
+
+    ClosureFunction& runningFunction(Value* frame)
+    {
+        // The callee sits right below the frame.
+        return static_cast<ClosureFunction&>(*frame[-1].asCallable());
+    }
+
+    Completion execute(const std::vector<Stmt>& stmts, Value* frame)
+    {
+        for (const auto& stmt : stmts)
+        {
+            const auto completion = stmt(frame);
+
+            if (completion != Completion::NORMAL)
+            {
+                return completion;
+            }
+        }
+
+        return Completion::NORMAL;
+    }
+}
+
+Value ClosureFunction::call(Interpreter&, const std::vector<Value>&)
+{
+    ErrorManager::get().report(0, "Compiled functions can only be called by the closure engine.");
+    return {};
+}
+
+size_t ClosureFunction::arity() const
+{
+    return function->arity;
+}
+
+void ClosureFunction::trace(Heap& heap)
+{
+    for (const auto upvalue : upvalues)
+    {
+        heap.mark(upvalue);
+    }
+}
+
+// Interpreter::visit(ForStmt) with the parts of the loop compiled.
+struct ClosureEngine::ForLoop
+{
+    struct Counted
+    {
+        size_t offset;
+        ExprKind comparison;
+        // Null when the bound isn't defined.
+        std::function<const Value*(Value* frame)> bound;
+        double step;
+        bool observed;
+    };
+
+    Completion run(Value* frame) const
+    {
+        if (variableDef)
+        {
+            variableDef(frame);
+        }
+
+        return counted ? runCounted(frame) : runLoop(frame);
+    }
+
+    Completion runLoop(Value* frame) const
+    {
+        auto completion = Completion::NORMAL;
+
+        while (!condition || condition(frame))
+        {
+            Heap::get().safepoint();
+            completion = body(frame);
+
+            if (completion != Completion::NORMAL)
+            {
+                break;
+            }
+
+            if (increment)
+            {
+                increment(frame);
+            }
+        }
+
+        return completion;
+    }
+
+    // See Interpreter::runCountedLoop().
+    Completion runCounted(Value* frame) const
+    {
+        auto& variable = frame[counted->offset];
+
+        if (!variable.isNumber())
+        {
+            return runLoop(frame);
+        }
+
+        auto counter = variable.asNumber();
+        auto completion = Completion::NORMAL;
+
+        while (true)
+        {
+            const auto bound = counted->bound(frame);
+
+            if (!bound || !bound->isNumber())
+            {
+                variable = Value::number(counter);
+                return runLoop(frame);
+            }
+
+            const auto limit = bound->asNumber();
+            bool inside = false;
+
+            switch (counted->comparison)
+            {
+                case ExprKind::LESS: inside = counter < limit; break;
+                case ExprKind::LESS_EQUAL: inside = counter <= limit; break;
+                case ExprKind::GREATER: inside = counter > limit; break;
+                default: inside = counter >= limit; break;
+            }
+
+            if (!inside)
+            {
+                break;
+            }
+
+            if (counted->observed)
+            {
+                variable = Value::number(counter);
+            }
+
+            Heap::get().safepoint();
+            completion = body(frame);
+
+            if (completion != Completion::NORMAL)
+            {
+                break;
+            }
+
+            counter += counted->step;
+        }
+
+        variable = Value::number(counter);
+        return completion;
+    }
+
+    Stmt variableDef;
+    Test condition;
+    Expr increment;
+    Stmt body;
+    std::optional<Counted> counted;
+};
+
+#ifdef LOX_CLOSURE_WORKER
+// Thread running the programs of one engine, started with its first program
+// and joined with the engine. It runs on a stack it maps itself, so the lowest
+// address calls may reach is known exactly.
+class ClosureEngine::Worker
+{
+public:
+    ~Worker()
+    {
+        {
+            std::lock_guard lock{ m_mutex };
+            m_quit = true;
+        }
+        m_wake.notify_one();
+        pthread_join(m_thread, nullptr);
+        munmap(m_stack, m_stackSize);
+    }
+
+    // Null when the stack can't be mapped or the thread can't be created.
+    static std::unique_ptr<Worker> start(size_t stackSize)
+    {
+        std::unique_ptr<Worker> worker{ new Worker };
+        worker->m_stackSize = stackSize;
+
+        auto flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+        flags |= MAP_NORESERVE;
+#endif
+        worker->m_stack = mmap(nullptr, stackSize, PROT_READ | PROT_WRITE, flags, -1, 0);
+
+        if (worker->m_stack == MAP_FAILED)
+        {
+            return nullptr;
+        }
+
+        // Running past the limit faults on the guard page rather than writing
+        // below the stack.
+        mprotect(worker->m_stack, static_cast<size_t>(sysconf(_SC_PAGESIZE)), PROT_NONE);
+
+        pthread_attr_t attributes;
+        auto started = pthread_attr_init(&attributes) == 0;
+
+        if (started)
+        {
+            started = pthread_attr_setstack(&attributes, worker->m_stack, stackSize) == 0 &&
+                pthread_create(&worker->m_thread, &attributes, [](void* arg) -> void*
+                    {
+                        static_cast<Worker*>(arg)->loop();
+                        return nullptr;
+                    }, worker.get()) == 0;
+            pthread_attr_destroy(&attributes);
+        }
+
+        if (!started)
+        {
+            munmap(worker->m_stack, stackSize);
+            return nullptr;
+        }
+
+        return worker;
+    }
+
+    // Runs `job` on the worker, returning once it is done.
+    void run(const std::function<void()>& job)
+    {
+        std::unique_lock lock{ m_mutex };
+        m_job = &job;
+        m_wake.notify_one();
+        m_done.wait(lock, [this] { return m_job == nullptr; });
+    }
+
+    uintptr_t stackLimit(size_t reserve) const
+    {
+        return reinterpret_cast<uintptr_t>(m_stack) + reserve;
+    }
+
+private:
+    Worker() = default;
+
+    void loop()
+    {
+        std::unique_lock lock{ m_mutex };
+
+        while (true)
+        {
+            m_wake.wait(lock, [this] { return m_job || m_quit; });
+
+            if (!m_job)
+            {
+                return;
+            }
+
+            (*m_job)();
+            m_job = nullptr;
+            m_done.notify_one();
+        }
+    }
+
+private:
+    pthread_t m_thread{};
+    void* m_stack = nullptr;
+    size_t m_stackSize = 0;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    const std::function<void()>* m_job = nullptr;
+    bool m_quit = false;
+};
+#else
+class ClosureEngine::Worker
+{};
+#endif
+
+ClosureEngine::ClosureEngine(std::ostream& printStream)
+    :
+    m_stack(STACK_SLOTS),
+    m_top(m_stack.data()),
+    m_stackEnd(m_stack.data() + m_stack.size()),
+    m_printStream(printStream)
+{
+    m_globals.define(SymbolTable::get().intern("clock"), Value{ Heap::get().allocate<ClockFnc>() });
+    Heap::get().addRootSource(this);
+}
+
+ClosureEngine::~ClosureEngine()
+{
+    Heap::get().removeRootSource(this);
+}
+
+ClosureEngine::ClosureEngine()
+    :
+    ClosureEngine(std::cout)
+{}
+
+void ClosureEngine::interpret(const Program& program)
+{
+    Resolver{ m_constants }.resolve(program.stmts);
+
+#ifdef LOX_CLOSURE_WORKER
+    if (!m_worker && !m_workerFailed)
+    {
+        m_worker = Worker::start(NATIVE_STACK_SIZE);
+
+        if (!m_worker)
+        {
+            m_workerFailed = true;
+            ErrorManager::get().report(0, "Could not start the thread running programs, "
+                "calls are limited to the caller's stack.");
+        }
+    }
+
+    if (m_worker)
+    {
+        m_nativeStackLimit = m_worker->stackLimit(NATIVE_STACK_RESERVE);
+        m_worker->run([this, &program] { run(program); });
+        return;
+    }
+#endif
+
+    m_nativeStackLimit = callerStackLimit(CALLER_STACK_BUDGET);
+    run(program);
+}
+
+void ClosureEngine::run(const Program& program)
+{
+    // Top level code runs in a frame holding the variables of its blocks,
+    // below it the slot of a callee it doesn't have.
+    m_scopes = { Scope{ 0, 0 } };
+    m_frameSize = 0;
+    m_inFunction = false;
+
+    const auto script = compile(program.stmts);
+    const auto frame = m_stack.data() + 1;
+
+    std::fill(frame, frame + m_frameSize, Value{});
+    m_top = frame + m_frameSize;
+
+    for (const auto& stmt : script)
+    {
+        Heap::get().safepoint();
+        stmt(frame);
+    }
+
+    closeUpvalues(frame);
+    m_top = m_stack.data();
+}
+
+Expr ClosureEngine::compile(Expression& expr)
+{
+    return dispatch(expr, [this](auto& node) { return compileNode(node); });
+}
+
+template<typename Build>
+auto ClosureEngine::withOperand(Expression& expr, Build&& build)
+{
+    if (expr.kind == ExprKind::VARIABLE)
+    {
+        const auto& var = static_cast<Variable&>(expr);
+
+        if (var.depth >= 0)
+        {
+            return build(SlotOperand{ offsetOf(var.depth, var.slot) });
+        }
+    }
+
+    if (expr.kind == ExprKind::LITERAL)
+    {
+        return build(ConstantOperand{ static_cast<Literal&>(expr).constant });
+    }
+
+    return build(ExprOperand{ compile(expr) });
+}
+
+template<typename Build>
+auto ClosureEngine::withTest(Expression& expr, Build&& build)
+{
+    switch (expr.kind)
+    {
+    case ExprKind::GREATER:
+        return withComparison(static_cast<BinaryOp<ExprKind::GREATER>&>(expr), build);
+    case ExprKind::GREATER_EQUAL:
+        return withComparison(static_cast<BinaryOp<ExprKind::GREATER_EQUAL>&>(expr), build);
+    case ExprKind::LESS:
+        return withComparison(static_cast<BinaryOp<ExprKind::LESS>&>(expr), build);
+    case ExprKind::LESS_EQUAL:
+        return withComparison(static_cast<BinaryOp<ExprKind::LESS_EQUAL>&>(expr), build);
+    case ExprKind::EQUAL_EQUAL:
+        return withComparison(static_cast<BinaryOp<ExprKind::EQUAL_EQUAL>&>(expr), build);
+    case ExprKind::BANG_EQUAL:
+        return withComparison(static_cast<BinaryOp<ExprKind::BANG_EQUAL>&>(expr), build);
+    default:
+        return build(TestOperand{ test(expr) });
+    }
+}
+
+template<ExprKind K, typename Build>
+auto ClosureEngine::withComparison(BinaryOp<K>& expr, Build&& build)
+{
+    return withOperand(*expr.left, [&](auto left) {
+        return withOperand(*expr.right, [&](auto right) {
+            return build(Comparison<K, decltype(left), decltype(right)>{ left, right, &expr.operatorType });
+        });
+    });
+}
+
+Test ClosureEngine::test(Expression& expr)
+{
+    switch (expr.kind)
+    {
+    case ExprKind::GROUPING:
+        return test(*static_cast<Grouping&>(expr).expr);
+    case ExprKind::LITERAL:
+    {
+        const auto truthy = isTruthy(static_cast<Literal&>(expr).constant);
+        return [truthy](Value*) { return truthy; };
+    }
+    case ExprKind::NOT:
+    {
+        auto right = test(*static_cast<Unary&>(expr).right);
+        return [right](Value* frame) { return !right(frame); };
+    }
+    case ExprKind::LOGICAL:
+    {
+        auto& logical = static_cast<Logical&>(expr);
+        auto left = test(*logical.leftExpr);
+        auto right = test(*logical.rightExpr);
+
+        switch (logical.op.getType())
+        {
+        case TokenType::AND:
+            return [left, right](Value* frame) { return left(frame) && right(frame); };
+        case TokenType::OR:
+            return [left, right](Value* frame) { return left(frame) || right(frame); };
+        default:
+            return [left, op = &logical.op](Value* frame) {
+                const auto value = left(frame);
+                ErrorManager::get().report(*op, "Invalid logical type!");
+                return value;
+            };
+        }
+    }
+    case ExprKind::GREATER:
+    case ExprKind::GREATER_EQUAL:
+    case ExprKind::LESS:
+    case ExprKind::LESS_EQUAL:
+    case ExprKind::EQUAL_EQUAL:
+    case ExprKind::BANG_EQUAL:
+        return withTest(expr, [](auto condition) -> Test { return condition; });
+    default:
+    {
+        auto value = compile(expr);
+        return [value](Value* frame) { return isTruthy(value(frame)); };
+    }
+    }
+}
+
+Stmt ClosureEngine::compile(Statement& stmt)
+{
+    return dispatch(stmt, [this](auto& node) { return compileNode(node); });
+}
+
+std::vector<Stmt> ClosureEngine::compile(const std::vector<StmtPtr>& stmts)
+{
+    std::vector<Stmt> compiled;
+    compiled.reserve(stmts.size());
+
+    for (const auto& stmt : stmts)
+    {
+        compiled.push_back(compile(*stmt));
+    }
+
+    return compiled;
+}
+
+Expr ClosureEngine::compileNode(Binary& expr)
+{
+    auto left = ExprOperand{ compile(*expr.left) };
+    auto right = ExprOperand{ compile(*expr.right) };
+
+    return [left, right, op = &expr.operatorType](Value* frame) {
+        const auto [leftValue, rightValue] = operands(left, right, frame);
+        return binaryOperation(*op, leftValue, rightValue);
+    };
+}
+
+template<ExprKind K>
+Expr ClosureEngine::compileNode(BinaryOp<K>& expr)
+{
+    const auto op = &expr.operatorType;
+
+    return withOperand(*expr.left, [&](auto left) {
+        return withOperand(*expr.right, [&](auto right) -> Expr {
+            return [left, right, op](Value* frame) {
+                const auto [leftValue, rightValue] = operands(left, right, frame);
+
+                if (leftValue.isNumber() && rightValue.isNumber())
+                {
+                    return Value{ numberOperation<K>(leftValue, rightValue) };
+                }
+
+                return binaryOperation(*op, leftValue, rightValue);
+            };
+        });
+    });
+}
+
+Expr ClosureEngine::compileNode(Grouping& expr)
+{
+    return compile(*expr.expr);
+}
+
+Expr ClosureEngine::compileNode(Literal& expr)
+{
+    return ConstantOperand{ expr.constant };
+}
+
+Expr ClosureEngine::compileNode(Unary& expr)
+{
+    auto right = compile(*expr.right);
+
+    switch (expr.operatorType.getType())
+    {
+    case TokenType::MINUS:
+        return [right](Value* frame) {
+            const auto value = right(frame);
+            return value.isNumber() ? numberNegate(value) : Value{};
+        };
+    case TokenType::BANG:
+        return [right](Value* frame) { return Value{ !isTruthy(right(frame)) }; };
+    default:
+        return [right](Value* frame) {
+            right(frame);
+            return Value{};
+        };
+    }
+}
+
+template<ExprKind K>
+Expr ClosureEngine::compileNode(UnaryOp<K>& expr)
+{
+    if constexpr (K == ExprKind::NEGATE)
+    {
+        auto right = compile(*expr.right);
+
+        return [right](Value* frame) {
+            const auto value = right(frame);
+            return value.isNumber() ? numberNegate(value) : Value{};
+        };
+    }
+    else
+    {
+        auto right = test(*expr.right);
+        return [right](Value* frame) { return Value{ !right(frame) }; };
+    }
+}
+
+Expr ClosureEngine::compileNode(Variable& expr)
+{
+    if (expr.depth >= 0)
+    {
+        return SlotOperand{ offsetOf(expr.depth, expr.slot) };
+    }
+
+    if (expr.upvalue >= 0)
+    {
+        return [index = static_cast<size_t>(expr.upvalue)](Value* frame) {
+            return *runningFunction(frame).upvalues[index]->location;
+        };
+    }
+
+    return GlobalOperand{ &m_globals, expr.name.getSymbol(), &expr.name };
+}
+
+Expr ClosureEngine::compileNode(Assignment& expr)
+{
+    auto value = compile(*expr.value);
+
+    if (expr.depth >= 0)
+    {
+        return [value, offset = offsetOf(expr.depth, expr.slot)](Value* frame) {
+            const auto result = value(frame);
+            frame[offset] = result;
+            return result;
+        };
+    }
+
+    if (expr.upvalue >= 0)
+    {
+        return [value, index = static_cast<size_t>(expr.upvalue)](Value* frame) {
+            const auto result = value(frame);
+            *runningFunction(frame).upvalues[index]->location = result;
+            return result;
+        };
+    }
+
+    return [this, value, name = &expr.name](Value* frame) {
+        const auto result = value(frame);
+
+        if (const auto global = m_globals.find(name->getSymbol()))
+        {
+            *global = result;
+        }
+        else
+        {
+            ErrorManager::get().report(0, "Undefined variable '" + name->getLexeme() + "'.");
+        }
+
+        return result;
+    };
+}
+
+Expr ClosureEngine::compileNode(Logical& expr)
+{
+    auto value = test(expr);
+    return [value](Value* frame) { return Value{ value(frame) }; };
+}
+
+Expr ClosureEngine::compileNode(Call& expr)
+{
+    return compileCall(expr, false);
+}
+
+Expr ClosureEngine::compileCall(Call& call, bool tailPosition)
+{
+    std::vector<Expr> args;
+    args.reserve(call.arguments.size());
+
+    for (const auto& arg : call.arguments)
+    {
+        args.push_back(compile(*arg));
+    }
+
+    if (call.calee->kind == ExprKind::VARIABLE)
+    {
+        const auto& var = static_cast<Variable&>(*call.calee);
+
+        if (var.depth < 0 && var.upvalue < 0)
+        {
+            return compileCall(GlobalOperand{ &m_globals, var.name.getSymbol(), &var.name }, std::move(args),
+                tailPosition, call.paren.getLine());
+        }
+    }
+
+    return compileCall(ExprOperand{ compile(*call.calee) }, std::move(args), tailPosition, call.paren.getLine());
+}
+
+template<typename Callee>
+Expr ClosureEngine::compileCall(Callee callee, std::vector<Expr> args, bool tailPosition, int line)
+{
+    // Pushes the callee and the arguments, nullptr when they don't fit.
+    const auto push = [this, callee, args, line](Value* frame) -> Value* {
+        const auto base = m_top;
+
+        if (base + args.size() + 1 > m_stackEnd)
+        {
+            ErrorManager::get().report(line, "Stack overflow.");
+            return nullptr;
+        }
+
+        *base = callee(frame);
+        m_top = base + 1;
+
+        for (const auto& arg : args)
+        {
+            const auto value = arg(frame);
+            *m_top++ = value;
+        }
+
+        return base;
+    };
+
+    if (tailPosition)
+    {
+        return [this, push, argCount = args.size(), line](Value* frame) {
+            const auto base = push(frame);
+
+            if (!base)
+            {
+                return Value{};
+            }
+
+            const auto callee = *base;
+            const auto function = callee.isCallable() ? callee.asCallable()->asClosureFunction() : nullptr;
+
+            if (function && function->function->arity == argCount)
+            {
+                m_tailCall = base;
+                return Value{};
+            }
+
+            return callAt(base, argCount, line);
+        };
+    }
+
+    return [this, push, argCount = args.size(), line](Value* frame) {
+        const auto base = push(frame);
+        return base ? callAt(base, argCount, line) : Value{};
+    };
+}
+
+Expr ClosureEngine::compileNode(Indexing& expr)
+{
+    auto indexee = compile(*expr.indexee);
+    auto index = compile(*expr.index);
+
+    return [indexee, index](Value* frame) {
+        TempRoots roots;
+        const auto indexeeValue = indexee(frame);
+        roots.push(indexeeValue);
+
+        if (!indexeeValue.isString())
+        {
+            ErrorManager::get().report({}, "Trying to index non indexable obj (non string)!");
+            return Value{};
+        }
+
+        return indexOperation(indexeeValue, index(frame));
+    };
+}
+
+Stmt ClosureEngine::compileNode(ExpressionStmt& stmt)
+{
+    auto expr = compile(*stmt.expr);
+
+    return [expr](Value* frame) {
+        expr(frame);
+        return Completion::NORMAL;
+    };
+}
+
+Stmt ClosureEngine::compileNode(PrintStmt& stmt)
+{
+    auto expr = compile(*stmt.expr);
+
+    return [this, expr](Value* frame) {
+        printValue(m_printStream, expr(frame));
+        return Completion::NORMAL;
+    };
+}
+
+Stmt ClosureEngine::compileNode(VarStmt& stmt)
+{
+    auto initializer = stmt.initializer ? compile(*stmt.initializer) : Expr{ ConstantOperand{} };
+
+    if (stmt.slot < 0)
+    {
+        return [this, initializer, symbol = stmt.name.getSymbol()](Value* frame) {
+            m_globals.define(symbol, initializer(frame));
+            return Completion::NORMAL;
+        };
+    }
+
+    return [initializer, offset = offsetOf(0, stmt.slot)](Value* frame) {
+        const auto value = initializer(frame);
+        frame[offset] = value;
+        return Completion::NORMAL;
+    };
+}
+
+Stmt ClosureEngine::compileNode(BlockStmt& stmt)
+{
+    if (stmt.hasScope)
+    {
+        beginScope(stmt.localCount);
+    }
+
+    auto stmts = compile(stmt.stmts);
+    const auto closeFrom = stmt.closeFrom >= 0 ? std::optional{ offsetOf(0, stmt.closeFrom) } : std::nullopt;
+
+    if (stmt.hasScope)
+    {
+        endScope();
+    }
+
+    if (!closeFrom)
+    {
+        return [stmts](Value* frame) { return execute(stmts, frame); };
+    }
+
+    return [this, stmts, closeFrom = *closeFrom](Value* frame) {
+        const auto completion = execute(stmts, frame);
+        closeUpvalues(frame + closeFrom);
+        return completion;
+    };
+}
+
+Stmt ClosureEngine::compileNode(IfStmt& stmt)
+{
+    auto block = compile(*stmt.block);
+
+    if (!stmt.elseblock)
+    {
+        return withTest(*stmt.expr, [&](auto condition) -> Stmt {
+            return [condition, block](Value* frame) {
+                return condition(frame) ? block(frame) : Completion::NORMAL;
+            };
+        });
+    }
+
+    auto elseblock = compile(*stmt.elseblock);
+
+    return withTest(*stmt.expr, [&](auto condition) -> Stmt {
+        return [condition, block, elseblock](Value* frame) {
+            return condition(frame) ? block(frame) : elseblock(frame);
+        };
+    });
+}
+
+Stmt ClosureEngine::compileNode(WhileStmt& stmt)
+{
+    auto block = compile(*stmt.block);
+
+    return withTest(*stmt.expr, [&](auto condition) -> Stmt {
+        return [condition, block](Value* frame) {
+            while (condition(frame))
+            {
+                Heap::get().safepoint();
+                const auto completion = block(frame);
+
+                if (completion == Completion::BREAK)
+                {
+                    break;
+                }
+
+                if (completion == Completion::RETURN)
+                {
+                    return completion;
+                }
+            }
+
+            return Completion::NORMAL;
+        };
+    });
+}
+
+Stmt ClosureEngine::compileNode(BreakStmt&)
+{
+    return [](Value*) { return Completion::BREAK; };
+}
+
+Stmt ClosureEngine::compileNode(ForStmt& stmt)
+{
+    if (stmt.hasScope)
+    {
+        beginScope(stmt.localCount);
+    }
+
+    auto loop = std::make_shared<ForLoop>();
+
+    if (stmt.variableDef)
+    {
+        loop->variableDef = compile(*stmt.variableDef);
+    }
+
+    if (stmt.expr)
+    {
+        loop->condition = test(*stmt.expr);
+    }
+
+    if (stmt.incStmt)
+    {
+        loop->increment = compile(*stmt.incStmt);
+    }
+
+    loop->body = compile(*stmt.block);
+
+    if (stmt.counted)
+    {
+        const auto& counted = *stmt.counted;
+        std::function<const Value*(Value*)> bound;
+
+        if (counted.bound->kind == ExprKind::LITERAL)
+        {
+            bound = [constant = &static_cast<const Literal&>(*counted.bound).constant](Value*) { return constant; };
+        }
+        else
+        {
+            const auto& var = static_cast<const Variable&>(*counted.bound);
+
+            if (var.depth >= 0)
+            {
+                bound = [offset = offsetOf(var.depth, var.slot)](Value* frame) { return frame + offset; };
+            }
+            else if (var.upvalue >= 0)
+            {
+                bound = [index = static_cast<size_t>(var.upvalue)](Value* frame) {
+                    return static_cast<const Value*>(runningFunction(frame).upvalues[index]->location);
+                };
+            }
+            else
+            {
+                bound = [this, symbol = var.name.getSymbol()](Value*) {
+                    return static_cast<const Value*>(m_globals.find(symbol));
+                };
+            }
+        }
+
+        loop->counted = ForLoop::Counted{ offsetOf(0, counted.slot), counted.comparison, std::move(bound),
+            counted.step, counted.observed };
+    }
+
+    const auto closeFrom = stmt.closeFrom >= 0 ? std::optional{ offsetOf(0, stmt.closeFrom) } : std::nullopt;
+
+    if (stmt.hasScope)
+    {
+        endScope();
+    }
+
+    return [this, loop, closeFrom](Value* frame) {
+        const auto completion = loop->run(frame);
+
+        if (closeFrom)
+        {
+            closeUpvalues(frame + *closeFrom);
+        }
+
+        return completion == Completion::RETURN ? completion : Completion::NORMAL;
+    };
+}
+
+Stmt ClosureEngine::compileNode(FunctionDeclStmt& stmt)
+{
+    const auto function = compileFunction(stmt);
+
+    // Frame offsets of the captured locals, indexes of the captured upvalues.
+    struct Capture
+    {
+        bool isLocal;
+        size_t index;
+    };
+
+    std::vector<Capture> captures;
+
+    for (const auto& upvalue : stmt.upvalues)
+    {
+        captures.push_back({ upvalue.isLocal, upvalue.isLocal ? offsetOf(upvalue.depth, upvalue.index) : upvalue.index });
+    }
+
+    const auto make = [this, function, captures](Value* frame) {
+        std::vector<Upvalue*> upvalues;
+        upvalues.reserve(captures.size());
+
+        for (const auto& capture : captures)
+        {
+            upvalues.push_back(capture.isLocal ?
+                captureUpvalue(frame + capture.index) :
+                runningFunction(frame).upvalues[capture.index]);
+        }
+
+        return Value{ Heap::get().allocate<ClosureFunction>(function, std::move(upvalues)) };
+    };
+
+    if (stmt.slot < 0)
+    {
+        return [this, make, symbol = stmt.name.getSymbol()](Value* frame) {
+            m_globals.define(symbol, make(frame));
+            return Completion::NORMAL;
+        };
+    }
+
+    return [make, offset = offsetOf(0, stmt.slot)](Value* frame) {
+        const auto value = make(frame);
+        frame[offset] = value;
+        return Completion::NORMAL;
+    };
+}
+
+Stmt ClosureEngine::compileNode(ReturnStmt& stmt)
+{
+    Expr value;
+
+    if (!stmt.expr)
+    {
+        value = ConstantOperand{};
+    }
+    else if (m_inFunction && stmt.expr->kind == ExprKind::CALL)
+    {
+        value = compileCall(static_cast<Call&>(*stmt.expr), true);
+    }
+    else
+    {
+        return withOperand(*stmt.expr, [this](auto operand) -> Stmt {
+            return [this, operand](Value* frame) {
+                m_returnValue = operand(frame);
+                return Completion::RETURN;
+            };
+        });
+    }
+
+    return [this, value](Value* frame) {
+        m_returnValue = value(frame);
+        return Completion::RETURN;
+    };
+}
+
+std::shared_ptr<const CompiledFunction> ClosureEngine::compileFunction(FunctionDeclStmt& declaration)
+{
+    auto function = std::make_shared<CompiledFunction>();
+
+    // The declaration lives in its program's arena, keep the program alive.
+    function->declaration = std::shared_ptr<const FunctionDeclStmt>{
+        declaration.program ? declaration.program->shared_from_this() : nullptr, &declaration };
+    function->arity = declaration.argList.size();
+
+    auto scopes = std::exchange(m_scopes, { Scope{ 0, declaration.localCount } });
+    const auto frameSize = std::exchange(m_frameSize, declaration.localCount);
+    const auto inFunction = std::exchange(m_inFunction, true);
+
+    // The body runs in the frame itself.
+    function->body = compile(declaration.block->stmts);
+    function->frameSize = m_frameSize;
+
+    m_scopes = std::move(scopes);
+    m_frameSize = frameSize;
+    m_inFunction = inFunction;
+
+    return function;
+}
+
+void ClosureEngine::beginScope(size_t localCount)
+{
+    const auto& enclosing = m_scopes.back();
+    const auto base = enclosing.base + enclosing.size;
+
+    m_scopes.push_back(Scope{ base, localCount });
+    m_frameSize = std::max(m_frameSize, base + localCount);
+}
+
+void ClosureEngine::endScope()
+{
+    m_scopes.pop_back();
+}
+
+size_t ClosureEngine::offsetOf(size_t depth, size_t slot) const
+{
+    return m_scopes[m_scopes.size() - 1 - depth].base + slot;
+}
+
+Value ClosureEngine::callAt(Value* base, size_t argCount, int line)
+{
+    const auto callee = *base;
+    const auto function = callee.isCallable() ? callee.asCallable()->asClosureFunction() : nullptr;
+
+    if (function && function->function->arity == argCount)
+    {
+        return call(function, base, line);
+    }
+
+    return callValue(base, argCount);
+}
+
+Value ClosureEngine::call(ClosureFunction* function, Value* base, int line)
+{
+    const auto frame = base + 1;
+    Value result;
+
+    if (reinterpret_cast<uintptr_t>(&frame) < m_nativeStackLimit)
+    {
+        ErrorManager::get().report(line, "Stack overflow.");
+        m_top = base;
+        return result;
+    }
+
+    while (true)
+    {
+        // The callee slot keeps the function, and with it its code, alive.
+        const auto& code = *function->function;
+
+        if (frame + code.frameSize > m_stackEnd)
+        {
+            ErrorManager::get().report(line, "Stack overflow.");
+            break;
+        }
+
+        std::fill(frame + code.arity, frame + code.frameSize, Value{});
+        m_top = frame + code.frameSize;
+
+        Heap::get().safepoint();
+        const auto completion = execute(code.body, frame);
+
+        closeUpvalues(frame);
+
+        if (!m_tailCall)
+        {
+            result = completion == Completion::RETURN ? m_returnValue : Value{};
+            break;
+        }
+
+        // Nothing refers to the frame anymore, the callee and arguments
+        // waiting above it take its place.
+        function = m_tailCall->asCallable()->asClosureFunction();
+        std::copy(m_tailCall, m_tailCall + function->function->arity + 1, base);
+        m_tailCall = nullptr;
+    }
+
+    m_top = base;
+
+    return result;
+}
+
+Value ClosureEngine::callValue(Value* base, size_t argCount)
+{
+    const auto callee = *base;
+    // The arguments stay rooted on the stack during the call.
+    const std::vector<Value> args(base + 1, base + 1 + argCount);
+    Value result;
+
+    if (!callee.isCallable())
+    {
+        ErrorManager::get().report({}, "Trying to call non callable!");
+    }
+    else if (callee.asCallable()->arity() != argCount)
+    {
+        std::string err = "Wrong number of args to function: ";
+        err += "got " + std::to_string(argCount) + " expected " + std::to_string(callee.asCallable()->arity());
+        ErrorManager::get().report({}, err);
+    }
+    else if (const auto native = dynamic_cast<NativeFunction*>(callee.asCallable()))
+    {
+        result = native->callNative(args);
+    }
+    else
+    {
+        ErrorManager::get().report({}, "Trying to call non callable!");
+    }
+
+    m_top = base;
+    return result;
+}
+
+Upvalue* ClosureEngine::captureUpvalue(Value* slot)
+{
+    auto it = m_openUpvalues.end();
+    while (it != m_openUpvalues.begin() && (*(it - 1))->location >= slot)
+    {
+        --it;
+        if ((*it)->location == slot)
+        {
+            return *it;
+        }
+    }
+
+    return *m_openUpvalues.insert(it, Heap::get().allocate<Upvalue>(slot));
+}
+
+void ClosureEngine::markRoots(Heap& heap)
+{
+    for (auto value = m_stack.data(); value < m_top; value++)
+    {
+        heap.mark(*value);
+    }
+
+    m_globals.mark(heap);
+    heap.mark(m_returnValue);
+
+    for (const auto upvalue : m_openUpvalues)
+    {
+        heap.mark(upvalue);
+    }
+}
@@ -0,0 +1,203 @@
+#pragma once
+#include "Statement.h"
+#include "Program.h"
+#include "Interpreter.h"
+#include "ConstantPool.h"
+#include "GlobalTable.h"
+#include "Heap.h"
+#include "Upvalue.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+namespace pimentel
+{
+    struct CompiledFunction;
+
+    class ClosureFunction : public LoxCallable
+    {
+    public:
+        ClosureFunction(const std::shared_ptr<const CompiledFunction>& function,
+            std::vector<Upvalue*>&& upvalues)
+            :
+            function(function),
+            upvalues(std::move(upvalues))
+        {}
+        ~ClosureFunction() = default;
+
+        // Only ever invoked by the ClosureEngine running it.
+        Value call(Interpreter& interpreter, const std::vector<Value>& argList) override;
+
+        size_t arity() const override;
+
+        ClosureFunction* asClosureFunction() override
+        {
+            return this;
+        }
+
+        void trace(Heap& heap) override;
+
+        std::shared_ptr<const CompiledFunction> function;
+        std::vector<Upvalue*> upvalues;
+    };
+
+    // Runs programs compiled to trees of closures. The AST is walked once:
+    // every node becomes a callable holding its compiled children and what
+    // the Resolver found out about it, a variable's frame offset or upvalue,
+    // a global's symbol, a literal's constant, the operator. Running it
+    // takes neither a dispatch on the node's kind nor a look at its tokens.
+    //
+    // Locals live in one flat value stack like the VM's: a frame is the
+    // callee followed by its arguments and the slots of every scope of the
+    // function, so each variable is at an offset known at compile time and
+    // a call allocates nothing. Globals persist between calls to interpret,
+    // as with the other engines.
+    class ClosureEngine : public RootSource
+    {
+    public:
+        using Expr = std::function<Value(Value* frame)>;
+        // Truthiness of a condition, without boxing it.
+        using Test = std::function<bool(Value* frame)>;
+        using Stmt = std::function<Completion(Value* frame)>;
+
+        ClosureEngine(std::ostream& printStream);
+        ClosureEngine();
+        ~ClosureEngine();
+
+        ClosureEngine(const ClosureEngine&) = delete;
+        ClosureEngine& operator=(const ClosureEngine&) = delete;
+
+        void interpret(const Program& program);
+
+        void markRoots(Heap& heap) override;
+
+    private:
+        // Slots of an environment the Resolver kept, within the frame of the
+        // function being compiled.
+        struct Scope
+        {
+            size_t base;
+            size_t size;
+        };
+
+        static constexpr size_t STACK_SLOTS = 256 * 1024;
+        // Calls nest on the native stack: programs run on a worker thread the
+        // engine starts once, with a stack this size, where calls stop
+        // NATIVE_STACK_RESERVE from its end.
+        static constexpr size_t NATIVE_STACK_SIZE = 256 * 1024 * 1024;
+        static constexpr size_t NATIVE_STACK_RESERVE = 256 * 1024;
+        // Without the worker (no POSIX threads, or it failed to start) programs
+        // run on the caller's thread and calls go this far below interpret().
+        static constexpr size_t CALLER_STACK_BUDGET = 512 * 1024;
+
+        struct ForLoop;
+        class Worker;
+
+    private:
+        // Compiles and runs the resolved program on the running thread,
+        // with calls stopping at m_nativeStackLimit.
+        void run(const Program& program);
+
+        Expr compile(Expression& expr);
+        Test test(Expression& expr);
+        Stmt compile(Statement& stmt);
+        std::vector<Stmt> compile(const std::vector<StmtPtr>& stmts);
+
+        Expr compileNode(Binary& expr);
+        template<ExprKind K>
+        Expr compileNode(BinaryOp<K>& expr);
+        Expr compileNode(Grouping& expr);
+        Expr compileNode(Literal& expr);
+        Expr compileNode(Unary& expr);
+        template<ExprKind K>
+        Expr compileNode(UnaryOp<K>& expr);
+        Expr compileNode(Variable& expr);
+        Expr compileNode(Assignment& expr);
+        Expr compileNode(Logical& expr);
+        Expr compileNode(Call& expr);
+        Expr compileNode(Indexing& expr);
+
+        Stmt compileNode(ExpressionStmt& stmt);
+        Stmt compileNode(PrintStmt& stmt);
+        Stmt compileNode(VarStmt& stmt);
+        Stmt compileNode(BlockStmt& stmt);
+        Stmt compileNode(IfStmt& stmt);
+        Stmt compileNode(WhileStmt& stmt);
+        Stmt compileNode(BreakStmt& stmt);
+        Stmt compileNode(ForStmt& stmt);
+        Stmt compileNode(FunctionDeclStmt& stmt);
+        Stmt compileNode(ReturnStmt& stmt);
+
+        // Calls `build` with the cheapest operand reading `expr`: a frame
+        // slot, a constant, or else its compiled closure.
+        template<typename Build>
+        auto withOperand(Expression& expr, Build&& build);
+        // Same for a condition, comparisons of such operands are done in
+        // place.
+        template<typename Build>
+        auto withTest(Expression& expr, Build&& build);
+        template<ExprKind K, typename Build>
+        auto withComparison(BinaryOp<K>& expr, Build&& build);
+
+        // tailPosition: the call is the value of a return in a function, its
+        // frame then replaces the running one.
+        Expr compileCall(Call& call, bool tailPosition);
+        template<typename Callee>
+        Expr compileCall(Callee callee, std::vector<Expr> args, bool tailPosition, int line);
+        std::shared_ptr<const CompiledFunction> compileFunction(FunctionDeclStmt& declaration);
+
+        void beginScope(size_t localCount);
+        void endScope();
+        // Frame offset of the slot of the environment `depth` scopes up.
+        size_t offsetOf(size_t depth, size_t slot) const;
+
+        // Calls the callee at `base` with the arguments above it and pops
+        // them. Anything but a ClosureFunction taking them goes through
+        // callValue(). `line`: of the call, for errors.
+        Value callAt(Value* base, size_t argCount, int line);
+        Value call(ClosureFunction* function, Value* base, int line);
+        Value callValue(Value* base, size_t argCount);
+
+        Upvalue* captureUpvalue(Value* slot);
+        void closeUpvalues(Value* firstSlot)
+        {
+            while (!m_openUpvalues.empty() && m_openUpvalues.back()->location >= firstSlot)
+            {
+                m_openUpvalues.back()->close();
+                m_openUpvalues.pop_back();
+            }
+        }
+
+    private:
+        std::vector<Value> m_stack;
+        // Everything below is live, the rest of the stack is free.
+        Value* m_top;
+        Value* m_stackEnd;
+        // Lowest address of the native stack calls may reach.
+        uintptr_t m_nativeStackLimit = 0;
+        std::unique_ptr<Worker> m_worker;
+        // Set once starting the worker failed, so it is reported only once.
+        bool m_workerFailed = false;
+
+        // Kept sorted by slot so closing a scope only looks at the tail.
+        std::vector<Upvalue*> m_openUpvalues;
+
+        Value m_returnValue;
+        // Set by a return making a tail call: the callee and its arguments
+        // wait at this slot for the running frame to exit.
+        Value* m_tailCall = nullptr;
+
+        GlobalTable m_globals;
+        ConstantPool m_constants;
+
+        std::ostream& m_printStream;
+
+        // Compilation state of the function being compiled.
+        std::vector<Scope> m_scopes;
+        size_t m_frameSize = 0;
+        bool m_inFunction = false;
+    };
+}
@@ -0,0 +1,583 @@
+#include "Compiler.h"
+#include "AstDispatch.hpp"
+#include "CustomTraits.h"
+#include "ErrorManager.h"
+#include "ValueUtils.h"
+
+#include <limits>
+
+using namespace pimentel;
+
+namespace
+{
+    constexpr size_t MAX_LOCALS = std::numeric_limits<uint8_t>::max() + 1;
+    constexpr size_t MAX_INDEX = std::numeric_limits<uint16_t>::max();
+
+    OpCode binaryOpCode(TokenType type)
+    {
+        switch (type)
+        {
+        case TokenType::EQUAL_EQUAL:
+            return OpCode::EQUAL;
+        case TokenType::BANG_EQUAL:
+            return OpCode::NOT_EQUAL;
+        case TokenType::GREATER:
+            return OpCode::GREATER;
+        case TokenType::GREATER_EQUAL:
+            return OpCode::GREATER_EQUAL;
+        case TokenType::LESS:
+            return OpCode::LESS;
+        case TokenType::LESS_EQUAL:
+            return OpCode::LESS_EQUAL;
+        case TokenType::PLUS:
+            return OpCode::ADD;
+        case TokenType::MINUS:
+            return OpCode::SUBTRACT;
+        case TokenType::STAR:
+            return OpCode::MULTIPLY;
+        case TokenType::SLASH:
+            return OpCode::DIVIDE;
+        default:
+            return OpCode::NULL_OBJ;
+        }
+    }
+}
+
+std::shared_ptr<VmFunction> Compiler::compile(const std::vector<StmtPtr>& stmts)
+{
+    FunctionState script{ nullptr, std::make_shared<VmFunction>("script"), {}, {}, {}, 0 };
+    // Slot zero of every frame holds the callee itself.
+    script.locals.push_back(Local{ Symbol{}, 0, false });
+
+    m_current = &script;
+    m_hadError = false;
+
+    for (const auto& stmt : stmts)
+    {
+        compileStmt(*stmt);
+    }
+
+    emit(OpCode::NULL_OBJ);
+    emit(OpCode::RETURN);
+
+    m_current = nullptr;
+
+    if (m_hadError)
+    {
+        return nullptr;
+    }
+
+    return script.function;
+}
+
+Compiler::RetType_expr Compiler::visit(Binary& expr)
+{
+    compileExpr(*expr.left);
+    compileExpr(*expr.right);
+
+    m_line = expr.operatorType.getLine();
+    emit(binaryOpCode(expr.operatorType.getType()));
+}
+
+Compiler::RetType_expr Compiler::visit(Grouping& expr)
+{
+    compileExpr(*expr.expr);
+}
+
+Compiler::RetType_expr Compiler::visit(Literal& expr)
+{
+    std::visit(overloaded{
+        [this](void*) { emit(OpCode::NIL); },
+        [this](const bool& val) { emit(val ? OpCode::TRUE : OpCode::FALSE); },
+        [this, &expr](const auto&) {
+            emitShort(OpCode::CONSTANT, currentChunk().addConstant(m_constants.materialize(expr.value)));
+        },
+        }, expr.value);
+}
+
+Compiler::RetType_expr Compiler::visit(Unary& expr)
+{
+    compileExpr(*expr.right);
+
+    m_line = expr.operatorType.getLine();
+    switch (expr.operatorType.getType())
+    {
+    case TokenType::MINUS:
+        emit(OpCode::NEGATE);
+        break;
+    case TokenType::BANG:
+        emit(OpCode::NOT);
+        break;
+    default:
+        emit(OpCode::POP);
+        emit(OpCode::NULL_OBJ);
+        break;
+    }
+}
+
+Compiler::RetType_expr Compiler::visit(Variable& var)
+{
+    namedVariable(var.name, false);
+}
+
+Compiler::RetType_expr Compiler::visit(Assignment& expr)
+{
+    compileExpr(*expr.value);
+    namedVariable(expr.name, true);
+}
+
+Compiler::RetType_expr Compiler::visit(Logical& logical)
+{
+    compileExpr(*logical.leftExpr);
+
+    m_line = logical.op.getLine();
+    switch (logical.op.getType())
+    {
+    case TokenType::AND:
+    {
+        const auto shortCircuit = emitJump(OpCode::JUMP_IF_FALSE);
+        compileExpr(*logical.rightExpr);
+        emit(OpCode::TRUTHY);
+        const auto end = emitJump(OpCode::JUMP);
+        patchJump(shortCircuit);
+        emit(OpCode::FALSE);
+        patchJump(end);
+        break;
+    }
+    case TokenType::OR:
+    {
+        const auto evalRight = emitJump(OpCode::JUMP_IF_FALSE);
+        emit(OpCode::TRUE);
+        const auto end = emitJump(OpCode::JUMP);
+        patchJump(evalRight);
+        compileExpr(*logical.rightExpr);
+        emit(OpCode::TRUTHY);
+        patchJump(end);
+        break;
+    }
+    default:
+        ErrorManager::get().report(logical.op, "Invalid logical type!");
+        m_hadError = true;
+        break;
+    }
+}
+
+Compiler::RetType_expr Compiler::visit(Call& callExpr)
+{
+    compileExpr(*callExpr.calee);
+
+    for (const auto& arg : callExpr.arguments)
+    {
+        compileExpr(*arg);
+    }
+
+    m_line = callExpr.paren.getLine();
+    emit(OpCode::CALL, static_cast<uint8_t>(callExpr.arguments.size()));
+}
+
+Compiler::RetType_expr Compiler::visit(Indexing& indexing)
+{
+    compileExpr(*indexing.indexee);
+    compileExpr(*indexing.index);
+
+    m_line = indexing.brackets.getLine();
+    emit(OpCode::INDEX);
+}
+
+Compiler::RetType_stmt Compiler::visit(ExpressionStmt& exprStmt)
+{
+    compileExpr(*exprStmt.expr);
+    emit(OpCode::POP);
+}
+
+Compiler::RetType_stmt Compiler::visit(PrintStmt& printStmt)
+{
+    compileExpr(*printStmt.expr);
+    emit(OpCode::PRINT);
+}
+
+Compiler::RetType_stmt Compiler::visit(VarStmt& varStmt)
+{
+    m_line = varStmt.name.getLine();
+
+    // The initializer is compiled before the variable is declared, so it sees
+    // any variable with the same name in an enclosing scope.
+    if (varStmt.initializer)
+    {
+        compileExpr(*varStmt.initializer);
+    }
+    else
+    {
+        emit(OpCode::NULL_OBJ);
+    }
+
+    if (m_current->scopeDepth == 0)
+    {
+        emitShort(OpCode::DEFINE_GLOBAL, currentChunk().addName(varStmt.name.getSymbol()));
+        return;
+    }
+
+    addLocal(varStmt.name.getSymbol());
+}
+
+Compiler::RetType_stmt Compiler::visit(BlockStmt& blockStmt)
+{
+    beginScope();
+
+    for (const auto& stmt : blockStmt.stmts)
+    {
+        compileStmt(*stmt);
+    }
+
+    endScope();
+}
+
+Compiler::RetType_stmt Compiler::visit(IfStmt& ifStmt)
+{
+    compileExpr(*ifStmt.expr);
+
+    const auto elseJump = emitJump(OpCode::JUMP_IF_FALSE);
+    compileStmt(*ifStmt.block);
+
+    if (!ifStmt.elseblock)
+    {
+        patchJump(elseJump);
+        return;
+    }
+
+    const auto endJump = emitJump(OpCode::JUMP);
+    patchJump(elseJump);
+    compileStmt(*ifStmt.elseblock);
+    patchJump(endJump);
+}
+
+Compiler::RetType_stmt Compiler::visit(WhileStmt& whileStmt)
+{
+    const auto loopStart = currentChunk().code.size();
+    compileExpr(*whileStmt.expr);
+    const auto exitJump = emitJump(OpCode::JUMP_IF_FALSE);
+
+    m_current->loops.push_back(Loop{ m_current->scopeDepth, {} });
+    compileStmt(*whileStmt.block);
+    emitLoop(loopStart);
+
+    patchJump(exitJump);
+    for (const auto jump : m_current->loops.back().breakJumps)
+    {
+        patchJump(jump);
+    }
+    m_current->loops.pop_back();
+}
+
+Compiler::RetType_stmt Compiler::visit(BreakStmt&)
+{
+    if (m_current->loops.empty())
+    {
+        error("'break' used out of loop stmt.");
+        return;
+    }
+
+    discardLocals(m_current->loops.back().scopeDepth);
+    m_current->loops.back().breakJumps.push_back(emitJump(OpCode::JUMP));
+}
+
+Compiler::RetType_stmt Compiler::visit(ForStmt& forStmt)
+{
+    beginScope();
+
+    if (forStmt.variableDef)
+    {
+        compileStmt(*forStmt.variableDef);
+    }
+
+    const auto loopStart = currentChunk().code.size();
+    auto exitJump = std::numeric_limits<size_t>::max();
+    if (forStmt.expr)
+    {
+        compileExpr(*forStmt.expr);
+        exitJump = emitJump(OpCode::JUMP_IF_FALSE);
+    }
+
+    m_current->loops.push_back(Loop{ m_current->scopeDepth, {} });
+    compileStmt(*forStmt.block);
+
+    if (forStmt.incStmt)
+    {
+        compileExpr(*forStmt.incStmt);
+        emit(OpCode::POP);
+    }
+    emitLoop(loopStart);
+
+    if (exitJump != std::numeric_limits<size_t>::max())
+    {
+        patchJump(exitJump);
+    }
+    for (const auto jump : m_current->loops.back().breakJumps)
+    {
+        patchJump(jump);
+    }
+    m_current->loops.pop_back();
+
+    endScope();
+}
+
+Compiler::RetType_stmt Compiler::visit(FunctionDeclStmt& funDecl)
+{
+    m_line = funDecl.name.getLine();
+
+    const auto isGlobal = m_current->scopeDepth == 0;
+    if (!isGlobal)
+    {
+        // Declared before the body is compiled so the function can recurse.
+        addLocal(funDecl.name.getSymbol());
+    }
+
+    FunctionState state{ m_current, std::make_shared<VmFunction>(funDecl.name.getLexeme()), {}, {}, {}, 0 };
+    state.function->arity = funDecl.argList.size();
+    state.locals.push_back(Local{ Symbol{}, 0, false });
+
+    m_current = &state;
+    beginScope();
+
+    for (const auto& arg : funDecl.argList)
+    {
+        addLocal(arg.getSymbol());
+    }
+
+    for (const auto& stmt : funDecl.block->stmts)
+    {
+        compileStmt(*stmt);
+    }
+
+    emit(OpCode::NULL_OBJ);
+    emit(OpCode::RETURN);
+
+    m_current = state.enclosing;
+
+    state.function->upvalueCount = state.upvalues.size();
+    emitShort(OpCode::CLOSURE, currentChunk().addFunction(state.function));
+    for (const auto& upvalue : state.upvalues)
+    {
+        emit(upvalue.isLocal ? 1 : 0);
+        emit(upvalue.index);
+    }
+
+    if (isGlobal)
+    {
+        emitShort(OpCode::DEFINE_GLOBAL, currentChunk().addName(funDecl.name.getSymbol()));
+    }
+}
+
+Compiler::RetType_stmt Compiler::visit(ReturnStmt& retStmt)
+{
+    if (retStmt.expr)
+    {
+        compileExpr(*retStmt.expr);
+    }
+    else
+    {
+        emit(OpCode::NULL_OBJ);
+    }
+
+    emit(OpCode::RETURN);
+}
+
+void Compiler::compileExpr(Expression& expr)
+{
+    dispatch(expr, [this](auto& node) { visit(node); });
+}
+
+void Compiler::compileStmt(Statement& stmt)
+{
+    dispatch(stmt, [this](auto& node) { visit(node); });
+}
+
+Chunk& Compiler::currentChunk()
+{
+    return m_current->function->chunk;
+}
+
+void Compiler::emit(uint8_t byte)
+{
+    currentChunk().write(byte, m_line);
+}
+
+void Compiler::emit(OpCode op)
+{
+    currentChunk().write(op, m_line);
+}
+
+void Compiler::emit(OpCode op, uint8_t operand)
+{
+    emit(op);
+    emit(operand);
+}
+
+void Compiler::emitShort(OpCode op, size_t operand)
+{
+    if (operand > MAX_INDEX)
+    {
+        error("Too many constants in one chunk.");
+    }
+
+    emit(op);
+    emit(static_cast<uint8_t>((operand >> 8) & 0xff));
+    emit(static_cast<uint8_t>(operand & 0xff));
+}
+
+size_t Compiler::emitJump(OpCode op)
+{
+    emit(op);
+    emit(0xff);
+    emit(0xff);
+    return currentChunk().code.size() - 2;
+}
+
+void Compiler::patchJump(size_t offset)
+{
+    auto& code = currentChunk().code;
+    const auto jump = code.size() - offset - 2;
+
+    if (jump > MAX_INDEX)
+    {
+        error("Too much code to jump over.");
+    }
+
+    code[offset] = static_cast<uint8_t>((jump >> 8) & 0xff);
+    code[offset + 1] = static_cast<uint8_t>(jump & 0xff);
+}
+
+void Compiler::emitLoop(size_t loopStart)
+{
+    emit(OpCode::LOOP);
+
+    const auto offset = currentChunk().code.size() - loopStart + 2;
+    if (offset > MAX_INDEX)
+    {
+        error("Loop body too large.");
+    }
+
+    emit(static_cast<uint8_t>((offset >> 8) & 0xff));
+    emit(static_cast<uint8_t>(offset & 0xff));
+}
+
+void Compiler::beginScope()
+{
+    m_current->scopeDepth++;
+}
+
+void Compiler::endScope()
+{
+    discardLocals(m_current->scopeDepth - 1);
+    m_current->scopeDepth--;
+
+    auto& locals = m_current->locals;
+    while (!locals.empty() && locals.back().depth > m_current->scopeDepth)
+    {
+        locals.pop_back();
+    }
+}
+
+void Compiler::discardLocals(int depth)
+{
+    // Only emits the code leaving the scopes deeper than `depth`, the locals
+    // themselves stay declared since `break` jumps out of straight-line code.
+    const auto& locals = m_current->locals;
+    for (auto it = locals.rbegin(); it != locals.rend() && it->depth > depth; ++it)
+    {
+        emit(it->isCaptured ? OpCode::CLOSE_UPVALUE : OpCode::POP);
+    }
+}
+
+void Compiler::addLocal(Symbol name)
+{
+    if (m_current->locals.size() >= MAX_LOCALS)
+    {
+        error("Too many local variables in function.");
+        return;
+    }
+
+    m_current->locals.push_back(Local{ name, m_current->scopeDepth, false });
+}
+
+int Compiler::resolveLocal(FunctionState& state, Symbol name)
+{
+    for (int i = static_cast<int>(state.locals.size()) - 1; i > 0; i--)
+    {
+        if (state.locals[i].name == name)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+int Compiler::resolveUpvalue(FunctionState& state, Symbol name)
+{
+    if (!state.enclosing)
+    {
+        return -1;
+    }
+
+    const auto local = resolveLocal(*state.enclosing, name);
+    if (local != -1)
+    {
+        state.enclosing->locals[local].isCaptured = true;
+        return addUpvalue(state, static_cast<uint8_t>(local), true);
+    }
+
+    const auto upvalue = resolveUpvalue(*state.enclosing, name);
+    if (upvalue != -1)
+    {
+        return addUpvalue(state, static_cast<uint8_t>(upvalue), false);
+    }
+
+    return -1;
+}
+
+int Compiler::addUpvalue(FunctionState& state, uint8_t index, bool isLocal)
+{
+    for (size_t i = 0; i < state.upvalues.size(); i++)
+    {
+        if (state.upvalues[i].index == index && state.upvalues[i].isLocal == isLocal)
+        {
+            return static_cast<int>(i);
+        }
+    }
+
+    if (state.upvalues.size() >= MAX_LOCALS)
+    {
+        error("Too many closure variables in function.");
+        return 0;
+    }
+
+    state.upvalues.push_back(Upvalue{ index, isLocal });
+    return static_cast<int>(state.upvalues.size() - 1);
+}
+
+void Compiler::namedVariable(const Token& name, bool assign)
+{
+    m_line = name.getLine();
+    const auto symbol = name.getSymbol();
+
+    if (const auto local = resolveLocal(*m_current, symbol); local != -1)
+    {
+        emit(assign ? OpCode::SET_LOCAL : OpCode::GET_LOCAL, static_cast<uint8_t>(local));
+        return;
+    }
+
+    if (const auto upvalue = resolveUpvalue(*m_current, symbol); upvalue != -1)
+    {
+        emit(assign ? OpCode::SET_UPVALUE : OpCode::GET_UPVALUE, static_cast<uint8_t>(upvalue));
+        return;
+    }
+
+    emitShort(assign ? OpCode::SET_GLOBAL : OpCode::GET_GLOBAL, currentChunk().addName(symbol));
+}
+
+void Compiler::error(const std::string& message)
+{
+    ErrorManager::get().report(m_line, message);
+    m_hadError = true;
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include "Expression.h"
+#include "Statement.h"
+#include "VmObjects.h"
+#include "ConstantPool.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace pimentel
+{
+    // Lowers the AST produced by the Parser into bytecode for the VM.
+    class Compiler
+    {
+    public:
+        using RetType_expr = void;
+        using RetType_stmt = void;
+
+    public:
+        Compiler() = default;
+        ~Compiler() = default;
+
+        // Returns the top level script as a function taking no arguments, or
+        // nullptr when compile errors were reported.
+        std::shared_ptr<VmFunction> compile(const std::vector<StmtPtr>& stmts);
+
+    private:
+        struct Local
+        {
+            Symbol name;
+            int depth;
+            bool isCaptured;
+        };
+
+        struct Upvalue
+        {
+            uint8_t index;
+            bool isLocal;
+        };
+
+        struct Loop
+        {
+            int scopeDepth;
+            std::vector<size_t> breakJumps;
+        };
+
+        struct FunctionState
+        {
+            FunctionState* enclosing;
+            std::shared_ptr<VmFunction> function;
+            std::vector<Local> locals;
+            std::vector<Upvalue> upvalues;
+            std::vector<Loop> loops;
+            int scopeDepth;
+        };
+
+    private:
+        RetType_expr visit(Binary&);
+        RetType_expr visit(Grouping&);
+        RetType_expr visit(Literal&);
+        RetType_expr visit(Unary&);
+        RetType_expr visit(Variable&);
+        RetType_expr visit(Assignment&);
+        RetType_expr visit(Logical&);
+        RetType_expr visit(Call&);
+        RetType_expr visit(Indexing&);
+
+        RetType_stmt visit(ExpressionStmt&);
+        RetType_stmt visit(PrintStmt&);
+        RetType_stmt visit(VarStmt&);
+        RetType_stmt visit(BlockStmt&);
+        RetType_stmt visit(IfStmt&);
+        RetType_stmt visit(WhileStmt&);
+        RetType_stmt visit(BreakStmt&);
+        RetType_stmt visit(ForStmt&);
+        RetType_stmt visit(FunctionDeclStmt&);
+        RetType_stmt visit(ReturnStmt&);
+
+        void compileExpr(Expression& expr);
+        void compileStmt(Statement& stmt);
+
+        Chunk& currentChunk();
+
+        void emit(uint8_t byte);
+        void emit(OpCode op);
+        void emit(OpCode op, uint8_t operand);
+        void emitShort(OpCode op, size_t operand);
+        size_t emitJump(OpCode op);
+        void patchJump(size_t offset);
+        void emitLoop(size_t loopStart);
+
+        void beginScope();
+        void endScope();
+        void discardLocals(int depth);
+
+        void addLocal(Symbol name);
+        int resolveLocal(FunctionState& state, Symbol name);
+        int resolveUpvalue(FunctionState& state, Symbol name);
+        int addUpvalue(FunctionState& state, uint8_t index, bool isLocal);
+
+        void namedVariable(const Token& name, bool assign);
+
+        void error(const std::string& message);
+
+    private:
+        FunctionState* m_current = nullptr;
+        int m_line = 0;
+        ConstantPool m_constants;
+        bool m_hadError = false;
+    };
+}
@@ -0,0 +1,45 @@
+#include "ConstantPool.h"
+#include "LoxString.h"
+#include "ValueUtils.h"
+
+using namespace pimentel;
+
+ConstantPool::ConstantPool()
+{
+    Heap::get().addRootSource(this);
+}
+
+ConstantPool::~ConstantPool()
+{
+    Heap::get().removeRootSource(this);
+}
+
+Value ConstantPool::materialize(const Token::LiteralType& literal)
+{
+    const auto str = std::get_if<std::string>(&literal);
+
+    if (!str)
+    {
+        return literalToValue(literal);
+    }
+
+    const auto it = m_strings.find(*str);
+
+    if (it != m_strings.end())
+    {
+        return it->second;
+    }
+
+    const auto value = literalToValue(literal);
+    value.asString()->share();
+
+    return m_strings.emplace(*str, value).first->second;
+}
+
+void ConstantPool::markRoots(Heap& heap)
+{
+    for (const auto& [str, val] : m_strings)
+    {
+        heap.mark(val);
+    }
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include "Heap.h"
+#include "Token.h"
+#include "Value.h"
+
+namespace pimentel
+{
+    // Materializes literal tokens into values once per program. Equal string
+    // literals share a single LoxString, so evaluating a literal is a copy of
+    // an 8 byte value and never allocates. The pool keeps its strings alive
+    // for as long as it exists.
+    class ConstantPool : public RootSource
+    {
+    public:
+        ConstantPool();
+        ConstantPool(const ConstantPool&) = delete;
+        ConstantPool& operator=(const ConstantPool&) = delete;
+        ~ConstantPool();
+
+        Value materialize(const Token::LiteralType& literal);
+
+        void markRoots(Heap& heap) override;
+
+    private:
+        std::unordered_map<std::string, Value> m_strings;
+    };
+}
@@ -1,56 +1,47 @@
 #include "Environment.h"
-#include "ErrorManager.h"
+#include "Heap.h"
+
+#include <algorithm>
 
 using namespace pimentel;
 
-Environment::Environment(const std::shared_ptr<Environment>& enclosing)
+Environment::Environment(Environment* enclosing, size_t slotCount)
     :
-    m_enclosing(enclosing)
+    LoxObject(ObjType::ENVIRONMENT),
+    m_enclosing(enclosing),
+    m_ownedSlots(slotCount),
+    m_slots(m_ownedSlots.data()),
+    m_slotCount(slotCount)
 {}
 
 Environment::Environment()
     :
-    Environment(nullptr)
+    Environment(nullptr, 0)
 {}
 
-void Environment::define(const std::string& name, LoxVal value)
-{
-    m_vars.emplace(name, value);
-}
-
-void Environment::assign(const std::string& name, LoxVal value)
+void Environment::trace(Heap& heap)
 {
-    auto it = m_vars.find(name);
-
-    if(it != m_vars.end())
-    {
-        it->second = value;
-        return;
-    }
+    heap.mark(m_enclosing);
 
-    if(m_enclosing)
+    for (size_t i = 0; i < m_slotCount; i++)
     {
-        m_enclosing->assign(name, value);
-        return;
+        heap.mark(m_slots[i]);
     }
-
-    ErrorManager::get().report(0, "Undefined variable '" + name + "'.");
 }
 
-LoxVal Environment::get(const std::string& name) const
+void Environment::bindFrame(Environment* enclosing, Value* slots, size_t slotCount)
 {
-    const auto it = m_vars.find(name);
-    
-    if(it != m_vars.end())
-    {
-        return it->second;
-    }
+    m_enclosing = enclosing;
+    m_slots = slots;
+    m_slotCount = slotCount;
+    m_isFrame = true;
 
-    if(m_enclosing)
-    {
-        return m_enclosing->get(name);
-    }
+    std::fill(slots, slots + slotCount, Value{});
+}
 
-    ErrorManager::get().report(0, "Variable does not exist: " + name);
-    return {};
+void Environment::unbindFrame()
+{
+    m_enclosing = nullptr;
+    m_slots = nullptr;
+    m_slotCount = 0;
 }
@@ -1,53 +1,92 @@
 #pragma once
-#include <unordered_map>
-#include <string>
 #include <memory>
-#include "Token.h"
-#include "LoxVal.h"
+#include <utility>
+#include <vector>
+#include "Value.h"
+#include "LoxObject.hpp"
 
 namespace pimentel
 {
-    class Environment
+    // Local scopes store their variables in a flat slot vector addressed by
+    // the indices computed by the Resolver. Globals aren't kept here but in
+    // the engine's GlobalTable. Closures don't keep environments but the
+    // Upvalues of the variables they capture. A call frame
+    // environment doesn't own its slots but views a range of the
+    // interpreter's frame stack, see Interpreter::acquireFrame().
+    class Environment : public LoxObject
     {
     public:
         Environment();
         Environment(const Environment&) = delete;
         Environment(Environment&&) = delete;
-        Environment(const std::shared_ptr<Environment>& enclosing);
+        Environment(Environment* enclosing, size_t slotCount);
         ~Environment() = default;
 
         Environment& operator=(const Environment&) = delete;
         Environment& operator=(Environment&&) = delete;
 
-        void define(const std::string& name, LoxVal value);
-        void assign(const std::string& name, LoxVal value);
-        LoxVal get(const std::string& name) const;
+        void trace(Heap& heap) override;
 
-        bool returnFlagSet() const
+        size_t allocationSize() const override
         {
-            return m_returnFlag;
+            return sizeof(Environment) + m_ownedSlots.size() * sizeof(Value);
         }
 
-        void setReturnFlag(bool flag)
+        // Turns this environment into a view of `slotCount` values at
+        // `slots`, which it doesn't own. The slots are cleared.
+        void bindFrame(Environment* enclosing, Value* slots, size_t slotCount);
+        void unbindFrame();
+
+        bool isFrame() const
         {
-            m_returnFlag = flag;
+            return m_isFrame;
         }
 
-        LoxVal getReturnValue() const
+        size_t slotCount() const
         {
-            return m_returnVal;
+            return m_slotCount;
         }
 
-        void setReturnVal(LoxVal val)
+        void define(size_t slot, Value value)
         {
-            m_returnVal = val;
+            m_slots[slot] = std::move(value);
         }
 
-    private:
-        std::shared_ptr<Environment> m_enclosing;
-        std::unordered_map<std::string, LoxVal> m_vars;
+        void assignAt(size_t depth, size_t slot, Value value)
+        {
+            ancestor(depth).m_slots[slot] = std::move(value);
+        }
 
-        bool m_returnFlag = false;
-        LoxVal m_returnVal = {};
+        const Value& getAt(size_t depth, size_t slot) const
+        {
+            return ancestor(depth).m_slots[slot];
+        }
+
+        Value& slotAt(size_t slot)
+        {
+            return m_slots[slot];
+        }
+
+        const Environment& ancestor(size_t depth) const
+        {
+            auto env = this;
+            for (size_t i = 0; i < depth; i++)
+            {
+                env = env->m_enclosing;
+            }
+            return *env;
+        }
+
+        Environment& ancestor(size_t depth)
+        {
+            return const_cast<Environment&>(std::as_const(*this).ancestor(depth));
+        }
+
+    private:
+        Environment* m_enclosing;
+        std::vector<Value> m_ownedSlots;
+        Value* m_slots;
+        size_t m_slotCount;
+        bool m_isFrame = false;
     };
-}
\ No newline at end of file
+}
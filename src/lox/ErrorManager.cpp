@@ -23,6 +23,7 @@ void ErrorManager::report(int line, const std::string& where, const std::string&
     std::cout << "[line " << line << "] Error" << where << ": " << message << std::endl;
 
     m_hasError = true;
+    m_errorCount++;
 }
 
 void ErrorManager::report(int line, const std::string& message)
@@ -35,6 +36,11 @@ bool ErrorManager::hasError() const
     return m_hasError;
 }
 
+size_t ErrorManager::errorCount() const
+{
+    return m_errorCount;
+}
+
 void ErrorManager::resetError()
 {
     m_hasError = false;
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstddef>
 #include <functional>
 #include <string>
 
@@ -18,6 +19,8 @@ namespace pimentel
 
         bool hasError() const;
         void resetError();
+        // Errors reported so far, resetError() doesn't clear it.
+        size_t errorCount() const;
         void report(int line, const std::string& where, const std::string& message);
         void report(int line, const std::string& message);
         void report(const Token& token, const std::string& message);
@@ -27,5 +30,6 @@ namespace pimentel
 
     private:
         bool m_hasError = false;
+        size_t m_errorCount = 0;
     };
 }
\ No newline at end of file
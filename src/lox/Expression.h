@@ -1,49 +1,116 @@
 #pragma once
 #include "Token.h"
-#include "ExpressionVisitor.hpp"
-#include "VisitorUtils.hpp"
+#include "Value.h"
+#include "Arena.h"
+#include <cstdint>
 #include <memory>
 #include <vector>
 
 namespace pimentel
 {
+    // Tag of every concrete expression, passes dispatch on it with a switch
+    // (see AstDispatch.hpp).
+    enum class ExprKind : uint8_t
+    {
+        // Binary operators get a kind each, BINARY is left for the others.
+        BINARY,
+        ADD,
+        SUBTRACT,
+        MULTIPLY,
+        DIVIDE,
+        GREATER,
+        GREATER_EQUAL,
+        LESS,
+        LESS_EQUAL,
+        EQUAL_EQUAL,
+        BANG_EQUAL,
+        GROUPING,
+        LITERAL,
+        // Same for unary operators.
+        UNARY,
+        NEGATE,
+        NOT,
+        VARIABLE,
+        ASSIGNMENT,
+        LOGICAL,
+        CALL,
+        INDEXING
+    };
+
+    // Operand types the interpreter has seen at a node. A node starts
+    // UNINITIALIZED, specializes on the types of its first execution and
+    // turns GENERIC for good the first time its guard fails.
+    enum class Specialization : uint8_t
+    {
+        UNINITIALIZED,
+        NUMBERS,        // Binary: number operands
+        STRINGS,        // Binary: string operands
+        STRING_INDEX,   // Indexing: a string indexed by a number
+        MONOMORPHIC,    // Call: always the same callee
+        GENERIC
+    };
+
     struct Expression 
     {
-        Expression() = default;
+        Expression(ExprKind kind) : kind(kind) {}
         virtual ~Expression() = default;
 
-        virtual ExprVisitorString::RetType accept(ExprVisitorString& visitor) = 0;
-        virtual ExprVisitorLoxVal::RetType accept(ExprVisitorLoxVal& visitor) = 0;
+        const ExprKind kind;
+        bool inArena = false;
+    };
+
+    template<ExprKind K>
+    struct ExprNode : public Expression
+    {
+        static constexpr ExprKind KIND = K;
+
+        ExprNode() : Expression(K) {}
     };
 
-    using ExprPtr = std::unique_ptr<Expression>;
+    using ExprPtr = NodePtr<Expression>;
 
     struct Binary : public Expression
     {
-        Binary() = default;
+        static constexpr ExprKind KIND = ExprKind::BINARY;
+
+        Binary() : Expression(KIND) {}
         Binary(ExprPtr left, Token operatorType, ExprPtr right)
             :
-            left(std::move(left)), operatorType(operatorType), right(std::move(right)){}
+            Binary(KIND, std::move(left), std::move(operatorType), std::move(right)) {}
 
         ExprPtr left;
         Token operatorType;
         ExprPtr right;
 
-        ACCEPT_IMPL(ExprVisitorString);
-        ACCEPT_IMPL(ExprVisitorLoxVal);
+        Specialization specialization = Specialization::UNINITIALIZED;
+
+    protected:
+        Binary(ExprKind kind, ExprPtr left, Token operatorType, ExprPtr right)
+            :
+            Expression(kind), left(std::move(left)), operatorType(operatorType), right(std::move(right)){}
     };
 
-    struct Grouping : public Expression
+    // Binary expression whose operator is known from its type, so passes
+    // dispatching on the kind can handle each operator without a switch on
+    // the token. Built by Parser::makeBinary().
+    template<ExprKind K>
+    struct BinaryOp : public Binary
+    {
+        static constexpr ExprKind KIND = K;
+
+        BinaryOp(ExprPtr left, Token operatorType, ExprPtr right)
+            :
+            Binary(K, std::move(left), std::move(operatorType), std::move(right)) {}
+    };
+
+    struct Grouping : public ExprNode<ExprKind::GROUPING>
     {
         Grouping() = default;
         Grouping(ExprPtr expr) : expr(std::move(expr)){};
         ExprPtr expr;
-
-        ACCEPT_IMPL(ExprVisitorString);
-        ACCEPT_IMPL(ExprVisitorLoxVal);
     };
 
-    struct Literal : public Expression
+    struct Literal : public ExprNode<ExprKind::LITERAL>
     {
         Literal(double val)
             :
@@ -72,36 +139,55 @@ namespace pimentel
 
         Token::LiteralType value;
 
-        ACCEPT_IMPL(ExprVisitorString);
-        ACCEPT_IMPL(ExprVisitorLoxVal);
+        // Filled by the Resolver from the program's ConstantPool.
+        Value constant;
     };
 
     struct Unary : public Expression
     {
-        Unary() = default;
+        static constexpr ExprKind KIND = ExprKind::UNARY;
+
+        Unary() : Expression(KIND) {}
         Unary(Token operatorType, ExprPtr right)
             :
-            operatorType (operatorType), right(std::move(right)){};
+            Unary(KIND, std::move(operatorType), std::move(right)) {}
 
         Token operatorType;
         ExprPtr right;
 
-        ACCEPT_IMPL(ExprVisitorString);
-        ACCEPT_IMPL(ExprVisitorLoxVal);
+    protected:
+        Unary(ExprKind kind, Token operatorType, ExprPtr right)
+            :
+            Expression(kind), operatorType (operatorType), right(std::move(right)){};
     };
 
-    struct Variable : public Expression
+    // Unary counterpart of BinaryOp, built by Parser::makeUnary().
+    template<ExprKind K>
+    struct UnaryOp : public Unary
+    {
+        static constexpr ExprKind KIND = K;
+
+        UnaryOp(Token operatorType, ExprPtr right)
+            :
+            Unary(K, std::move(operatorType), std::move(right)) {}
+    };
+
+    struct Variable : public ExprNode<ExprKind::VARIABLE>
     {
         Variable() = default;
         Variable(const Token& name) : name(name) {};
 
         Token name;
 
-        ACCEPT_IMPL(ExprVisitorString);
-        ACCEPT_IMPL(ExprVisitorLoxVal);
+        // Filled by the Resolver: number of scopes to walk up and the slot in
+        // that scope, or the index of the running function's upvalue holding
+        // a captured variable. With neither, the name is looked up as a global.
+        int depth = -1;
+        size_t slot = 0;
+        int upvalue = -1;
     };
 
-    struct Assignment : public Expression
+    struct Assignment : public ExprNode<ExprKind::ASSIGNMENT>
     {
         Assignment() = default;
         Assignment(Token name, ExprPtr value)
@@ -112,11 +198,12 @@ namespace pimentel
         Token name;
         ExprPtr value;
 
-        ACCEPT_IMPL(ExprVisitorString);
-        ACCEPT_IMPL(ExprVisitorLoxVal);
+        int depth = -1;
+        size_t slot = 0;
+        int upvalue = -1;
     };
 
-    struct Logical : public Expression
+    struct Logical : public ExprNode<ExprKind::LOGICAL>
     {
         Logical() = default;
         Logical(ExprPtr leftExpr, Token op, ExprPtr rightExpr)
@@ -127,15 +214,12 @@ namespace pimentel
         {}
         ~Logical() = default;
 
-        ACCEPT_IMPL(ExprVisitorString);
-        ACCEPT_IMPL(ExprVisitorLoxVal);
-
         ExprPtr leftExpr;
         Token op;
         ExprPtr rightExpr;
     };
 
-    struct Call : public Expression
+    struct Call : public ExprNode<ExprKind::CALL>
     {
         Call() = default;
         Call(ExprPtr calee, Token paren, std::vector<ExprPtr>&& arguments)
@@ -146,15 +230,16 @@ namespace pimentel
         {}
         ~Call() = default;
 
-        ACCEPT_IMPL(ExprVisitorString);
-        ACCEPT_IMPL(ExprVisitorLoxVal);
-
         ExprPtr calee;
         Token paren;
         std::vector<ExprPtr> arguments;
+
+        Specialization specialization = Specialization::UNINITIALIZED;
+        // Bits of the callee seen while MONOMORPHIC.
+        uint64_t cachedCallee = 0;
     };
 
-    struct Indexing : public Expression
+    struct Indexing : public ExprNode<ExprKind::INDEXING>
     {
         Indexing() = default;
         Indexing(ExprPtr indexee, Token brackets, ExprPtr index)
@@ -165,11 +250,10 @@ namespace pimentel
         {}
         ~Indexing() = default;
 
-        ACCEPT_IMPL(ExprVisitorString);
-        ACCEPT_IMPL(ExprVisitorLoxVal);
-
         ExprPtr indexee;
         Token brackets;
         ExprPtr index;
+
+        Specialization specialization = Specialization::UNINITIALIZED;
     };
 }
\ No newline at end of file
@@ -0,0 +1,30 @@
+#include "GlobalTable.h"
+#include "Heap.h"
+
+using namespace pimentel;
+
+void GlobalTable::define(Symbol name, Value value)
+{
+    const auto id = name.id();
+
+    if (id >= m_entries.size())
+    {
+        m_entries.resize(id + 1);
+    }
+
+    auto& entry = m_entries[id];
+
+    if (!entry.defined)
+    {
+        entry.value = value;
+        entry.defined = true;
+    }
+}
+
+void GlobalTable::mark(Heap& heap) const
+{
+    for (const auto& entry : m_entries)
+    {
+        heap.mark(entry.value);
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <vector>
+#include "Symbol.h"
+#include "Value.h"
+
+namespace pimentel
+{
+    class Heap;
+
+    // Global variables of one engine, stored in a vector indexed by the
+    // symbol's id. The id is fixed when the identifier is interned by the
+    // scanner, so every use site already knows its slot and a global access
+    // is a single indexed load instead of a hash lookup.
+    class GlobalTable
+    {
+    public:
+        GlobalTable() = default;
+        ~GlobalTable() = default;
+
+        // Defining an existing global keeps the first value.
+        void define(Symbol name, Value value);
+
+        // nullptr when the global isn't defined (yet).
+        Value* find(Symbol name)
+        {
+            const auto id = name.id();
+
+            if (id >= m_entries.size() || !m_entries[id].defined)
+            {
+                return nullptr;
+            }
+
+            return &m_entries[id].value;
+        }
+
+        void mark(Heap& heap) const;
+
+    private:
+        struct Entry
+        {
+            Value value;
+            bool defined = false;
+        };
+
+        std::vector<Entry> m_entries;
+    };
+}
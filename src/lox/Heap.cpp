@@ -0,0 +1,143 @@
+#include "Heap.h"
+
+#include <algorithm>
+
+using namespace pimentel;
+
+Heap::~Heap()
+{
+    while (m_objects)
+    {
+        const auto next = m_objects->m_next;
+        delete m_objects;
+        m_objects = next;
+    }
+}
+
+Heap& Heap::get()
+{
+    static Heap heap;
+    return heap;
+}
+
+void Heap::collect()
+{
+    for (const auto source : m_rootSources)
+    {
+        source->markRoots(*this);
+    }
+
+    for (const auto& val : m_pinned)
+    {
+        mark(val);
+    }
+
+    for (const auto& val : m_tempRoots)
+    {
+        mark(val);
+    }
+
+    traceReferences();
+    sweep();
+
+    m_stats.collections++;
+    m_stats.nextCollection = std::max(static_cast<size_t>(m_stats.bytesAllocated * m_growthFactor),
+        INITIAL_COLLECTION_BYTES);
+}
+
+void Heap::mark(LoxObject* obj)
+{
+    if (!obj || obj->m_marked)
+    {
+        return;
+    }
+
+    obj->m_marked = true;
+    m_grayStack.push_back(obj);
+}
+
+void Heap::addRootSource(RootSource* source)
+{
+    m_rootSources.push_back(source);
+}
+
+void Heap::removeRootSource(RootSource* source)
+{
+    m_rootSources.erase(std::remove(m_rootSources.begin(), m_rootSources.end(), source), m_rootSources.end());
+}
+
+void Heap::pin(const Value& val)
+{
+    m_pinned.push_back(val);
+}
+
+void Heap::setGrowthFactor(double factor)
+{
+    m_growthFactor = std::max(factor, 1.0);
+}
+
+void Heap::setStressMode(bool stress)
+{
+    m_stressMode = stress;
+}
+
+const HeapStats& Heap::stats() const
+{
+    return m_stats;
+}
+
+void Heap::printStats(std::ostream& stream) const
+{
+    stream << "[GC] heap bytes: " << m_stats.bytesAllocated
+        << " objects: " << m_stats.objectCount
+        << " collections: " << m_stats.collections
+        << " freed objects: " << m_stats.freedObjects
+        << " freed bytes: " << m_stats.freedBytes
+        << " next collection at: " << m_stats.nextCollection << std::endl;
+}
+
+void Heap::track(LoxObject* obj)
+{
+    obj->m_next = m_objects;
+    m_objects = obj;
+
+    m_stats.bytesAllocated += obj->allocationSize();
+    m_stats.objectCount++;
+}
+
+void Heap::traceReferences()
+{
+    while (!m_grayStack.empty())
+    {
+        const auto obj = m_grayStack.back();
+        m_grayStack.pop_back();
+        obj->trace(*this);
+    }
+}
+
+void Heap::sweep()
+{
+    LoxObject** link = &m_objects;
+
+    while (*link)
+    {
+        const auto obj = *link;
+
+        if (obj->m_marked)
+        {
+            obj->m_marked = false;
+            link = &obj->m_next;
+            continue;
+        }
+
+        *link = obj->m_next;
+
+        const auto size = obj->allocationSize();
+        m_stats.bytesAllocated -= size;
+        m_stats.objectCount--;
+        m_stats.freedBytes += size;
+        m_stats.freedObjects++;
+
+        delete obj;
+    }
+}
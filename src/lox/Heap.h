@@ -0,0 +1,149 @@
+#pragma once
+#include <cstddef>
+#include <ostream>
+#include <utility>
+#include <vector>
+#include "LoxObject.hpp"
+#include "Value.h"
+
+namespace pimentel
+{
+    // Anything holding values outside of the heap, e.g. an engine's globals,
+    // its stack of environments or its value stack.
+    class RootSource
+    {
+    public:
+        virtual ~RootSource() = default;
+
+        virtual void markRoots(Heap& heap) = 0;
+    };
+
+    struct HeapStats
+    {
+        size_t bytesAllocated = 0;
+        size_t nextCollection = 0;
+        size_t objectCount = 0;
+        size_t collections = 0;
+        size_t freedObjects = 0;
+        size_t freedBytes = 0;
+    };
+
+    // Owns every LoxObject. Collection is a stop-the-world mark-sweep that
+    // only runs at safepoints chosen by the engines, points where every live
+    // value is reachable from a registered RootSource or a TempRoots guard.
+    class Heap
+    {
+    public:
+        ~Heap();
+
+        static Heap& get();
+
+        template<typename T, typename... Args>
+        T* allocate(Args&&... args)
+        {
+            auto obj = new T(std::forward<Args>(args)...);
+            track(obj);
+            return obj;
+        }
+
+        void safepoint()
+        {
+            if (m_stressMode || m_stats.bytesAllocated > m_stats.nextCollection)
+            {
+                collect();
+            }
+        }
+
+        void collect();
+
+        void mark(const Value& val)
+        {
+            if (val.isHeapObject())
+            {
+                mark(val.asObject());
+            }
+        }
+
+        void mark(LoxObject* obj);
+
+        void addRootSource(RootSource* source);
+        void removeRootSource(RootSource* source);
+
+        // Values that live for the rest of the process.
+        void pin(const Value& val);
+
+        // Memory objects own outside of their allocationSize(), e.g. a
+        // buffer shared by several strings, which can grow after they were
+        // allocated. It counts towards the next collection while it lives.
+        void addExternalBytes(size_t bytes)
+        {
+            m_stats.bytesAllocated += bytes;
+        }
+
+        void removeExternalBytes(size_t bytes)
+        {
+            m_stats.bytesAllocated -= bytes;
+            m_stats.freedBytes += bytes;
+        }
+
+        // After a collection the next one happens once the heap has grown by
+        // this factor.
+        void setGrowthFactor(double factor);
+        // Collects at every safepoint, used to shake out missing roots.
+        void setStressMode(bool stress);
+
+        const HeapStats& stats() const;
+        void printStats(std::ostream& stream) const;
+
+    private:
+        friend class TempRoots;
+
+        Heap() = default;
+
+        void track(LoxObject* obj);
+        void traceReferences();
+        void sweep();
+
+    private:
+        static constexpr size_t INITIAL_COLLECTION_BYTES = 1024 * 1024;
+
+        LoxObject* m_objects = nullptr;
+        std::vector<LoxObject*> m_grayStack;
+        std::vector<RootSource*> m_rootSources;
+        std::vector<Value> m_pinned;
+        std::vector<Value> m_tempRoots;
+
+        double m_growthFactor = 2.0;
+        bool m_stressMode = false;
+        HeapStats m_stats{ 0, INITIAL_COLLECTION_BYTES };
+    };
+
+    // Roots values only held by C++ locals while the engine may reach a
+    // safepoint, e.g. the left operand while the right one calls a function.
+    class TempRoots
+    {
+    public:
+        TempRoots()
+            :
+            m_base(Heap::get().m_tempRoots.size())
+        {}
+        TempRoots(const TempRoots&) = delete;
+        TempRoots& operator=(const TempRoots&) = delete;
+
+        ~TempRoots()
+        {
+            Heap::get().m_tempRoots.resize(m_base);
+        }
+
+        void push(const Value& val)
+        {
+            if (val.isHeapObject())
+            {
+                Heap::get().m_tempRoots.push_back(val);
+            }
+        }
+
+    private:
+        size_t m_base;
+    };
+}
@@ -3,10 +3,18 @@
 #include "Statement.h"
 #include "CustomTraits.h"
 #include "LiteralUtils.h"
+#include "ValueUtils.h"
 #include "ErrorManager.h"
 #include "UserFunction.h"
+#include "Resolver.h"
+#include "AstDispatch.hpp"
+#include "LoxString.h"
+#include "Arithmetic.hpp"
+#include "IrExecutor.h"
+#include "Memoizer.h"
 #include <cassert>
 #include <iostream>
+#include <utility>
 
 #include "BuiltinFunctions.hpp"
 
@@ -14,162 +22,105 @@ using namespace pimentel;
 
 namespace
 {
-    void defineBuiltinFunctions(const std::shared_ptr<Environment>& globalEnv)
+    void defineBuiltinFunctions(GlobalTable& globals)
     {
-        globalEnv->define("clock", std::shared_ptr<LoxCallableStub>(new ClockFnc{}));
+        globals.define(SymbolTable::get().intern("clock"), Value{ Heap::get().allocate<ClockFnc>() });
     }
 
-    bool isTruthy(const Interpreter::RetType_expr& literal)
+    template<ExprKind K>
+    Value numericOperation(const Value& left, const Value& right)
     {
-        return std::visit(overloaded{
-            [](const bool& val) { return val; },
-            [](const double& val) { return val != 0.0; },
-            [](void* val) { return val != nullptr; },
-            [](const std::shared_ptr<LoxObject>& obj) { return obj.get() != nullptr; },
-            [](const auto&) { return true; }
-            }, literal);
+        if constexpr (K == ExprKind::ADD) return numberAdd(left, right);
+        else if constexpr (K == ExprKind::SUBTRACT) return numberSubtract(left, right);
+        else if constexpr (K == ExprKind::MULTIPLY) return numberMultiply(left, right);
+        else if constexpr (K == ExprKind::DIVIDE) return numberDivide(left, right);
+        else if constexpr (K == ExprKind::GREATER) return Value{ numberGreater(left, right) };
+        else if constexpr (K == ExprKind::GREATER_EQUAL) return Value{ numberGreaterEqual(left, right) };
+        else if constexpr (K == ExprKind::LESS) return Value{ numberLess(left, right) };
+        else if constexpr (K == ExprKind::LESS_EQUAL) return Value{ numberLessEqual(left, right) };
+        else if constexpr (K == ExprKind::EQUAL_EQUAL) return Value{ numberEqual(left, right) };
+        else if constexpr (K == ExprKind::BANG_EQUAL) return Value{ !numberEqual(left, right) };
     }
 
-    template<typename T1>
-    Interpreter::RetType_expr treat(const Interpreter::RetType_expr& val1, const Interpreter::RetType_expr& val2,
-        const T1& literalCallback, const auto& mismatchingCallback)
+    template<ExprKind K>
+    Value stringOperation(const LoxString& left, const LoxString& right)
     {
-        if (val1.index() != val2.index())
-        {
-            return mismatchingCallback(val1, val2);
-        }
-        return literalCallback(val1, val2);
+        if constexpr (K == ExprKind::ADD) return LoxString::concat(left, right);
+        else if constexpr (K == ExprKind::EQUAL_EQUAL) return Value{ left.equals(right) };
+        else if constexpr (K == ExprKind::BANG_EQUAL) return Value{ !left.equals(right) };
+        else return Value{};
+    }
+}
 
-        /*assert(0);*/
+Interpreter::RetType_expr Interpreter::visit(Binary& expr)
+{
+    TempRoots roots;
+    auto left = evaluate(*expr.left);
+    roots.push(left);
+    auto right = evaluate(*expr.right);
 
-        return Interpreter::RetType_expr{};
-    }
+    return binaryOperation(expr.operatorType, left, right);
+}
 
-    Interpreter::RetType_expr handleMismatching(const auto& val1, const auto& val2, const auto& token)
+template<ExprKind K>
+Interpreter::RetType_expr Interpreter::visit(BinaryOp<K>& expr)
+{
+    constexpr auto takesStrings = K == ExprKind::ADD || K == ExprKind::EQUAL_EQUAL || K == ExprKind::BANG_EQUAL;
+
+    auto left = evaluate(*expr.left);
+
+    if (expr.specialization == Specialization::NUMBERS && left.isNumber())
     {
-        if (token.getType() == TokenType::EQUAL_EQUAL)
+        // Nothing to keep alive while the right operand runs.
+        const auto right = evaluate(*expr.right);
+
+        if (right.isNumber())
         {
-            return Interpreter::RetType_expr{ false };
+            return numericOperation<K>(left, right);
         }
 
-        (void)val1;
-        (void)val2;
-
-        ErrorManager::get().report(token, "Mismatch types - Could not find overloaded operator.");
-        return Interpreter::RetType_expr{};
+        deoptimize(expr.specialization);
+        return binaryOperation(expr.operatorType, left, right);
     }
-}
 
-Interpreter::RetType_expr Interpreter::visit(Binary& expr)
-{
-    auto left = evaluate(*expr.left);
-    auto right = evaluate(*expr.right);
+    TempRoots roots;
+    roots.push(left);
+    const auto right = evaluate(*expr.right);
 
-    return treat(left, right, [&expr](const auto& leftVal, const auto& rightVal)
+    switch (expr.specialization)
+    {
+    case Specialization::UNINITIALIZED:
+        if (left.isNumber() && right.isNumber())
         {
-            if (leftVal.index() != rightVal.index())
+            specialize(expr.specialization, Specialization::NUMBERS);
+        }
+        else if (takesStrings && left.isString() && right.isString())
+        {
+            specialize(expr.specialization, Specialization::STRINGS);
+        }
+        else
+        {
+            specialize(expr.specialization, Specialization::GENERIC);
+        }
+        break;
+    case Specialization::STRINGS:
+        if constexpr (takesStrings)
+        {
+            if (left.isString() && right.isString())
             {
-                return handleMismatching(leftVal, rightVal, expr.operatorType);
+                return stringOperation<K>(*left.asString(), *right.asString());
             }
+        }
+        deoptimize(expr.specialization);
+        break;
+    case Specialization::NUMBERS:
+        deoptimize(expr.specialization);
+        break;
+    default:
+        break;
+    }
 
-            const auto handleString = [&rightVal, &expr](const std::string& leftStr)
-                {
-                    using T = std::remove_cvref_t<decltype(leftStr)>;
-                    const auto& rightStr = std::get<T>(rightVal);
-
-                    switch (expr.operatorType.getType())
-                    {
-                    case TokenType::EQUAL_EQUAL:
-                        return RetType_expr{ leftStr == rightStr };
-                    case TokenType::BANG_EQUAL:
-                        return RetType_expr{ leftStr != rightStr };
-                        break;
-                    case TokenType::PLUS:
-                        return RetType_expr{ leftStr + rightStr };
-                        break;
-                    default:
-                        /*assert(0);*/
-                        return RetType_expr{};
-                        break;
-                    }
-                };
-
-            const auto handleBoolean = [&rightVal, &expr](const bool& leftV)
-                {
-                    using T = std::remove_cvref_t<decltype(leftV)>;
-                    const auto rightV = std::get<T>(rightVal);
-
-                    switch (expr.operatorType.getType())
-                    {
-                    case TokenType::BANG_EQUAL:
-                        return RetType_expr{ leftV != rightV };
-                        break;
-                    case TokenType::EQUAL_EQUAL:
-                        return RetType_expr{ leftV == rightV };
-                    default:
-                        /*assert(0);*/
-                        return RetType_expr{};
-                        break;
-                    }
-                    return RetType_expr{};
-                };
-
-            const auto handleNumeric = [&rightVal, &expr](const double& leftV)
-                {
-                    using T = std::remove_cvref_t<decltype(leftV)>;
-                    const auto rightV = std::get<T>(rightVal);
-
-                    switch (expr.operatorType.getType())
-                    {
-                    case TokenType::MINUS:
-                        return RetType_expr{ leftV - rightV };
-                        break;
-                    case TokenType::PLUS:
-                        return RetType_expr{ leftV + rightV };
-                        break;
-                    case TokenType::SLASH:
-                        return RetType_expr{ leftV / rightV };
-                        break;
-                    case TokenType::STAR:
-                        return RetType_expr{ leftV * rightV };
-                        break;
-                    case TokenType::GREATER:
-                        return RetType_expr{ leftV > rightV };
-                        break;
-                    case TokenType::GREATER_EQUAL:
-                        return RetType_expr{ leftV >= rightV };
-                        break;
-                    case TokenType::LESS:
-                        return RetType_expr{ leftV < rightV };
-                        break;
-                    case TokenType::LESS_EQUAL:
-                        return RetType_expr{ leftV <= rightV };
-                        break;
-                    case TokenType::BANG_EQUAL:
-                        return RetType_expr{ leftV != rightV };
-                        break;
-                    case TokenType::EQUAL_EQUAL:
-                        return RetType_expr{ leftV == rightV };
-                        break;
-                    default:
-                        /*assert(0);*/
-                        return RetType_expr{};
-                        break;
-                    }
-                };
-
-            return std::visit(overloaded{
-                [](void*) { return RetType_expr{}; },
-                [](const std::shared_ptr<LoxCallableStub>&) { return RetType_expr{}; },
-                [](const std::shared_ptr<LoxObject>&) { return RetType_expr{}; },
-                handleString,
-                handleBoolean,
-                handleNumeric,
-                }, leftVal);
-        },
-        [&expr](const auto& lhs, const auto& rhs) {
-            return handleMismatching(lhs, rhs, expr.operatorType);
-        });
+    return binaryOperation(expr.operatorType, left, right);
 }
 
 Interpreter::RetType_expr Interpreter::visit(Grouping& expr)
@@ -179,8 +130,7 @@ Interpreter::RetType_expr Interpreter::visit(Grouping& expr)
 
 Interpreter::RetType_expr Interpreter::visit(Literal& expr)
 {
-    return std::visit([](const auto& val)
-        { return RetType_expr{ val };}, expr.value);
+    return expr.constant;
 }
 
 Interpreter::RetType_expr Interpreter::visit(Unary& expr)
@@ -190,10 +140,7 @@ Interpreter::RetType_expr Interpreter::visit(Unary& expr)
     switch (expr.operatorType.getType())
     {
     case TokenType::MINUS:
-        return std::visit(overloaded{
-            [](const double& rhs) { return RetType_expr{-rhs}; },
-            [](const auto& rhs) { (void)rhs; /*assert(0);*/ return RetType_expr{};}
-            }, rhs);
+        return rhs.isNumber() ? numberNegate(rhs) : RetType_expr{};
         break;
     case TokenType::BANG:
         return RetType_expr{ !isTruthy(rhs) };
@@ -205,16 +152,62 @@ Interpreter::RetType_expr Interpreter::visit(Unary& expr)
     }
 }
 
+template<ExprKind K>
+Interpreter::RetType_expr Interpreter::visit(UnaryOp<K>& expr)
+{
+    const auto rhs = evaluate(*expr.right);
+
+    if constexpr (K == ExprKind::NEGATE)
+    {
+        return rhs.isNumber() ? numberNegate(rhs) : RetType_expr{};
+    }
+    else
+    {
+        return RetType_expr{ !isTruthy(rhs) };
+    }
+}
+
 Interpreter::RetType_expr Interpreter::visit(Variable& var)
 {
-    return m_currEnv->get(var.name.getLexeme());
+    if (var.depth >= 0)
+    {
+        return m_currEnv->getAt(var.depth, var.slot);
+    }
+
+    if (var.upvalue >= 0)
+    {
+        return m_function->upvalue(var.upvalue)->get();
+    }
+
+    if (const auto global = m_globals.find(var.name.getSymbol()))
+    {
+        return *global;
+    }
+
+    ErrorManager::get().report(0, "Variable does not exist: " + var.name.getLexeme());
+    return RetType_expr{};
 }
 
 Interpreter::RetType_expr Interpreter::visit(Assignment& expr)
 {
     auto value = evaluate(*expr.value);
 
-    m_currEnv->assign(expr.name.getLexeme(), value);
+    if (expr.depth >= 0)
+    {
+        m_currEnv->assignAt(expr.depth, expr.slot, value);
+    }
+    else if (expr.upvalue >= 0)
+    {
+        m_function->upvalue(expr.upvalue)->get() = value;
+    }
+    else if (const auto global = m_globals.find(expr.name.getSymbol()))
+    {
+        *global = value;
+    }
+    else
+    {
+        ErrorManager::get().report(0, "Undefined variable '" + expr.name.getLexeme() + "'.");
+    }
 
     return value;
 }
@@ -243,22 +236,72 @@ Interpreter::RetType_expr Interpreter::visit(Logical& logical)
 
 Interpreter::RetType_expr Interpreter::visit(Call& callExpr)
 {
+    return call(callExpr, false);
+}
+
+Interpreter::RetType_expr Interpreter::call(Call& callExpr, bool tailPosition)
+{
+    TempRoots roots;
     auto caleeEvaluated = evaluate(*callExpr.calee);
+    roots.push(caleeEvaluated);
+
+    const auto function = caleeEvaluated.isCallable() ? caleeEvaluated.asCallable()->asUserFunction() : nullptr;
+
+    // The arguments are evaluated straight into the callee's parameter slots.
+    if (function && function->arity() == callExpr.arguments.size())
+    {
+        auto frame = acquireFrame(*function);
+        roots.push(Value{ frame });
+
+        for (size_t i = 0; i < callExpr.arguments.size(); i++)
+        {
+            frame->define(i, evaluate(*callExpr.arguments[i]));
+        }
+
+        checkCallee(callExpr, caleeEvaluated);
+
+        if (tailPosition)
+        {
+            m_tailCall.function = function;
+            m_tailCall.args.clear();
+
+            for (size_t i = 0; i < callExpr.arguments.size(); i++)
+            {
+                m_tailCall.args.push_back(frame->getAt(0, i));
+            }
+
+            releaseFrame(frame);
+            return {};
+        }
+
+        return callFunction(*function, frame);
+    }
 
     std::vector<Interpreter::RetType_expr> args;
 
     for (const auto& arg : callExpr.arguments)
     {
         args.push_back(evaluate(*arg));
+        roots.push(args.back());
     }
 
-    if (!std::holds_alternative<std::shared_ptr<LoxCallableStub>>(caleeEvaluated))
+    if (!checkCallee(callExpr, caleeEvaluated))
+    {
+        return {};
+    }
+
+    return callValue(caleeEvaluated, args);
+}
+
+Interpreter::RetType_expr Interpreter::callValue(const Value& callee, const std::vector<Value>& args)
+{
+    if (!callee.isCallable())
     {
         ErrorManager::get().report({}, "Trying to call non callable!");
         return {};
     }
 
-    auto& callable = std::get<std::shared_ptr<LoxCallableStub>>(caleeEvaluated)->get();
+    auto& callable = *callee.asCallable();
 
     if (callable.arity() != args.size())
     {
@@ -271,81 +314,162 @@ Interpreter::RetType_expr Interpreter::visit(Call& callExpr)
     return callable.call(*this, args);
 }
 
+bool Interpreter::checkCallee(Call& callExpr, const Value& callee)
+{
+    // The cached callee is only compared, never dereferenced: once collected
+    // its address may be reused, so arity is still checked by the caller.
+    if (callExpr.specialization == Specialization::MONOMORPHIC && callee.bits() == callExpr.cachedCallee)
+    {
+        return true;
+    }
+
+    if (callExpr.specialization == Specialization::MONOMORPHIC)
+    {
+        deoptimize(callExpr.specialization);
+    }
+
+    if (!callee.isCallable())
+    {
+        if (callExpr.specialization == Specialization::UNINITIALIZED)
+        {
+            specialize(callExpr.specialization, Specialization::GENERIC);
+        }
+
+        ErrorManager::get().report({}, "Trying to call non callable!");
+        return false;
+    }
+
+    if (callExpr.specialization == Specialization::UNINITIALIZED)
+    {
+        specialize(callExpr.specialization, Specialization::MONOMORPHIC);
+        callExpr.cachedCallee = callee.bits();
+    }
+
+    return true;
+}
+
 Interpreter::RetType_expr Interpreter::visit(Indexing& indexing)
 {
+    TempRoots roots;
     auto indexee = evaluate(*indexing.indexee);
+    roots.push(indexee);
 
-    if(!std::holds_alternative<std::string>(indexee))
+    if(!indexee.isString())
     {
+        if (indexing.specialization == Specialization::STRING_INDEX)
+        {
+            deoptimize(indexing.specialization);
+        }
+        else if (indexing.specialization == Specialization::UNINITIALIZED)
+        {
+            specialize(indexing.specialization, Specialization::GENERIC);
+        }
+
         ErrorManager::get().report({}, "Trying to index non indexable obj (non string)!");
         return {};
     }
 
-    auto indexVal = evaluate(*indexing.index);
+    const auto index = evaluate(*indexing.index);
 
-    if(!std::holds_alternative<double>(indexVal))
+    switch (indexing.specialization)
     {
-        ErrorManager::get().report({}, "Trying to index with non index value (non double)!");
-        return {};
-    }
+    case Specialization::STRING_INDEX:
+        if (index.isInt())
+        {
+            const auto i = index.asInt();
+            const auto str = indexee.asString()->str();
 
-    auto i = std::get<double>(indexVal);
-    std::string& str = std::get<std::string>(indexee);
+            if (i >= 0 && static_cast<size_t>(i) < str.size())
+            {
+                return singleCharString(static_cast<unsigned char>(str[i]));
+            }
 
-    if(i > str.size())
-    {
-        std::string err = "Trying to access out of bounds!";
-        err += "i " + std::to_string(i) + " max val " + std::to_string(str.size());
-        ErrorManager::get().report({}, err);
-        return {};
+            // Out of bounds, let indexOperation report it.
+            break;
+        }
+        deoptimize(indexing.specialization);
+        break;
+    case Specialization::UNINITIALIZED:
+        specialize(indexing.specialization,
+            index.isNumber() ? Specialization::STRING_INDEX : Specialization::GENERIC);
+        break;
+    default:
+        break;
     }
 
-    return std::string{str[i]};
+    return indexOperation(indexee, index);
 }
 
 Interpreter::RetType_stmt Interpreter::visit(ExpressionStmt& exprStmt)
 {
     evaluate(*exprStmt.expr);
+
+    return Completion::NORMAL;
 }
 
 Interpreter::RetType_stmt Interpreter::visit(PrintStmt& printStmt)
 {
     auto val = evaluate(*printStmt.expr);
 
-    std::visit(overloaded{
-        [this](const std::shared_ptr<LoxObject>& obj) {
-            m_printStream << "[Lox obj] = " << obj.get() << std::endl;
-        },
-        [this](const std::string& arg) { m_printStream << arg << std::endl; },
-        [this](void* unused_) { (void)unused_; m_printStream << std::string{"NULL"} << std::endl; },
-        [this](const std::shared_ptr<LoxCallableStub>& unused_) { (void)unused_; m_printStream << std::string{"[LoxCallable]"} << std::endl; },
-        [this](const bool& arg) { m_printStream << std::string{arg ? "true" : "false"} << std::endl; },
-        [this](const auto& arg) { m_printStream << std::to_string(arg) << std::endl; },
-        }, val);
+    printValue(m_printStream, val);
+
+    return Completion::NORMAL;
 }
 
 Interpreter::RetType_stmt pimentel::Interpreter::visit(VarStmt& varStmt)
 {
-    m_currEnv->define(varStmt.name.getLexeme(),
-        varStmt.initializer ? evaluate(*varStmt.initializer) : LoxVal{});
+    auto value = varStmt.initializer ? evaluate(*varStmt.initializer) : Value{};
+
+    if (varStmt.slot < 0)
+    {
+        m_globals.define(varStmt.name.getSymbol(), value);
+        return Completion::NORMAL;
+    }
+
+    m_currEnv->define(varStmt.slot, value);
+
+    return Completion::NORMAL;
 }
 
 Interpreter::RetType_stmt Interpreter::visit(ReturnStmt& retStmt)
 {
-    m_currEnv->setReturnFlag(true);
-
-    if(retStmt.expr)
+    if (!retStmt.expr)
+    {
+        m_returnValue = {};
+    }
+    else if (m_callDepth > 0 && retStmt.expr->kind == ExprKind::CALL)
     {
-        auto resVal = evaluate(*retStmt.expr); // evaluate might set the return flag to false.
-        m_currEnv->setReturnFlag(true);
-        m_currEnv->setReturnVal(resVal);
+        m_returnValue = call(static_cast<Call&>(*retStmt.expr), true);
     }
+    else
+    {
+        m_returnValue = evaluate(*retStmt.expr);
+    }
+
+    return Completion::RETURN;
 }
 
 Interpreter::RetType_stmt Interpreter::visit(BlockStmt& blockStmt)
 {
-    auto env = std::make_shared<Environment>(m_currEnv);
-    executeBlock(blockStmt.stmts, env);
+    auto env = m_currEnv;
+    Completion completion;
+
+    if (blockStmt.hasScope)
+    {
+        env = Heap::get().allocate<Environment>(m_currEnv, blockStmt.localCount);
+        completion = executeBlock(blockStmt.stmts, env);
+    }
+    else
+    {
+        completion = executeStatements(blockStmt.stmts);
+    }
+
+    if (blockStmt.closeFrom >= 0)
+    {
+        closeUpvalues(env, static_cast<size_t>(blockStmt.closeFrom));
+    }
+
+    return completion;
 }
 
 Interpreter::RetType_stmt Interpreter::visit(IfStmt& ifStmt)
@@ -354,111 +478,424 @@ Interpreter::RetType_stmt Interpreter::visit(IfStmt& ifStmt)
 
     if (isTruthy(exprVal))
     {
-        ifStmt.block->accept(*this);
+        return execute(*ifStmt.block);
     }
-    else if (ifStmt.elseblock)
+
+    if (ifStmt.elseblock)
     {
-        ifStmt.elseblock->accept(*this);
+        return execute(*ifStmt.elseblock);
     }
+
+    return Completion::NORMAL;
 }
 
 Interpreter::RetType_stmt Interpreter::visit(WhileStmt& whileStmt)
 {
-    while (isTruthy(evaluate(*whileStmt.expr)) && !m_foundBreakStmt && !m_currEnv->returnFlagSet())
+    while (isTruthy(evaluate(*whileStmt.expr)))
     {
-        whileStmt.block->accept(*this);
+        const auto completion = execute(*whileStmt.block);
+
+        if (completion == Completion::BREAK)
+        {
+            break;
+        }
+
+        if (completion == Completion::RETURN)
+        {
+            return completion;
+        }
     }
 
-    m_foundBreakStmt = false;
+    return Completion::NORMAL;
 }
 
 Interpreter::RetType_stmt Interpreter::visit(BreakStmt&)
 {
-    m_foundBreakStmt = true;
+    return Completion::BREAK;
 }
 
 Interpreter::RetType_stmt pimentel::Interpreter::visit(ForStmt& forStmt)
 {
-    auto env = std::make_shared<Environment>(m_currEnv);
     auto previous = m_currEnv;
 
-    m_currEnv = env;
+    if (forStmt.hasScope)
+    {
+        m_envStack.push_back(previous);
+        m_currEnv = Heap::get().allocate<Environment>(m_currEnv, forStmt.localCount);
+    }
 
     if (forStmt.variableDef)
     {
-        forStmt.variableDef->accept(*this);
+        execute(*forStmt.variableDef);
+    }
+
+    const auto completion = forStmt.counted ? runCountedLoop(forStmt) : runLoop(forStmt);
+
+    if (forStmt.closeFrom >= 0)
+    {
+        closeUpvalues(m_currEnv, static_cast<size_t>(forStmt.closeFrom));
     }
 
+    if (forStmt.hasScope)
+    {
+        m_currEnv = previous;
+        m_envStack.pop_back();
+    }
+
+    return completion == Completion::RETURN ? completion : Completion::NORMAL;
+}
+
+Completion Interpreter::runLoop(ForStmt& forStmt)
+{
+    auto completion = Completion::NORMAL;
     const auto hasExpr = forStmt.expr != nullptr;
-    while ((!hasExpr || isTruthy(evaluate(*forStmt.expr))) && !m_foundBreakStmt && !m_currEnv->returnFlagSet())
+
+    while (!hasExpr || isTruthy(evaluate(*forStmt.expr)))
     {
-        forStmt.block->accept(*this);
+        completion = execute(*forStmt.block);
+
+        if (completion != Completion::NORMAL)
+        {
+            break;
+        }
+
         if (forStmt.incStmt)
         {
-            forStmt.incStmt->accept(*this);
+            evaluate(*forStmt.incStmt);
         }
     }
 
-    m_foundBreakStmt = false;
+    return completion;
+}
 
-    m_currEnv = previous;
+Completion Interpreter::runCountedLoop(ForStmt& forStmt)
+{
+    const auto& counted = *forStmt.counted;
+    // Slots of an environment never move.
+    auto& variable = m_currEnv->slotAt(counted.slot);
+
+    if (!variable.isNumber())
+    {
+        return runLoop(forStmt);
+    }
+
+    // Adding in doubles gives the same numbers as numberAdd(), which only
+    // keeps integers apart as a representation.
+    auto counter = variable.asNumber();
+    auto completion = Completion::NORMAL;
+
+    while (true)
+    {
+        const auto bound = loopBound(counted);
+
+        if (!bound)
+        {
+            variable = Value::number(counter);
+            return runLoop(forStmt);
+        }
+
+        const auto limit = bound->asNumber();
+        bool inside = false;
+
+        switch (counted.comparison)
+        {
+            case ExprKind::LESS: inside = counter < limit; break;
+            case ExprKind::LESS_EQUAL: inside = counter <= limit; break;
+            case ExprKind::GREATER: inside = counter > limit; break;
+            default: inside = counter >= limit; break;
+        }
+
+        if (!inside)
+        {
+            break;
+        }
+
+        if (counted.observed)
+        {
+            variable = Value::number(counter);
+        }
+
+        completion = execute(*forStmt.block);
+
+        if (completion != Completion::NORMAL)
+        {
+            break;
+        }
+
+        counter += counted.step;
+    }
+
+    variable = Value::number(counter);
+    return completion;
+}
+
+const Value* Interpreter::loopBound(const ForStmt::CountedLoop& counted)
+{
+    const Value* bound = nullptr;
+
+    if (counted.bound->kind == ExprKind::LITERAL)
+    {
+        bound = &static_cast<const Literal&>(*counted.bound).constant;
+    }
+    else
+    {
+        const auto& var = static_cast<const Variable&>(*counted.bound);
+
+        if (var.depth >= 0)
+        {
+            bound = &m_currEnv->getAt(var.depth, var.slot);
+        }
+        else if (var.upvalue >= 0)
+        {
+            bound = &m_function->upvalue(var.upvalue)->get();
+        }
+        else
+        {
+            bound = m_globals.find(var.name.getSymbol());
+        }
+    }
+
+    return bound && bound->isNumber() ? bound : nullptr;
 }
 
 Interpreter::RetType_stmt Interpreter::visit(FunctionDeclStmt& funDecl)
 {
-    auto funcName = funDecl.name;
-    std::vector<std::string> argList;
+    // The declaration lives in its program's arena, keep the program alive.
+    std::shared_ptr<const FunctionDeclStmt> declaration{ funDecl.program ? funDecl.program->shared_from_this() : nullptr,
+        &funDecl };
+
+    std::vector<Upvalue*> upvalues;
+    upvalues.reserve(funDecl.upvalues.size());
+
+    for (const auto& upvalue : funDecl.upvalues)
+    {
+        upvalues.push_back(upvalue.isLocal ?
+            captureUpvalue(upvalue.depth, upvalue.index) :
+            m_function->upvalue(upvalue.index));
+    }
 
-    std::transform(funDecl.argList.begin(), funDecl.argList.end(),
-        std::back_inserter(argList),
-        [](const auto& arg) { return arg.getLexeme(); });
+    auto uFun = Value{ Heap::get().allocate<UserFunction>(declaration, std::move(upvalues)) };
 
-    auto uFun = new UserFunction{ std::move(funDecl.block), std::move(argList), m_currEnv};
-    m_env->define(funcName.getLexeme(), std::unique_ptr<LoxCallableStub>(uFun));
+    if (funDecl.slot < 0)
+    {
+        m_globals.define(funDecl.name.getSymbol(), uFun);
+        return Completion::NORMAL;
+    }
+
+    m_currEnv->define(funDecl.slot, uFun);
+
+    return Completion::NORMAL;
 }
 
 Interpreter::RetType_expr Interpreter::evaluate(Expression& expr)
 {
-    return expr.accept(*this);
+    return dispatch(expr, [this](auto& node) { return visit(node); });
 }
 
-void pimentel::Interpreter::executeBlock(const std::vector<StmtPtr>& stmts, const std::shared_ptr<Environment>& env)
+Completion Interpreter::executeBlock(const std::vector<StmtPtr>& stmts, Environment* env)
 {
     auto previous = m_currEnv;
 
+    m_envStack.push_back(previous);
     m_currEnv = env;
 
+    const auto completion = executeStatements(stmts);
+
+    m_currEnv = previous;
+    m_envStack.pop_back();
+
+    return completion;
+}
+
+Completion Interpreter::executeStatements(const std::vector<StmtPtr>& stmts)
+{
     for (const auto& stmt : stmts)
     {
-        execute(*stmt);
-        if (m_foundBreakStmt || m_currEnv->returnFlagSet())
+        const auto completion = execute(*stmt);
+
+        if (completion != Completion::NORMAL)
         {
+            return completion;
+        }
+    }
+
+    return Completion::NORMAL;
+}
+
+void Interpreter::specialize(Specialization& state, Specialization to)
+{
+    state = to;
+
+    if (to != Specialization::GENERIC)
+    {
+        m_specializationStats.specialized++;
+    }
+}
+
+void Interpreter::deoptimize(Specialization& state)
+{
+    state = Specialization::GENERIC;
+    m_specializationStats.deoptimized++;
+}
+
+Environment* Interpreter::acquireFrame(const UserFunction& function)
+{
+    const auto slotCount = function.localCount();
+
+    // Everything outside the function is either global or an upvalue.
+    if (m_frameTop + slotCount > m_frameSlots.size())
+    {
+        return Heap::get().allocate<Environment>(nullptr, slotCount);
+    }
+
+    if (m_frameCount == m_frames.size())
+    {
+        m_frames.push_back(Heap::get().allocate<Environment>());
+    }
+
+    auto frame = m_frames[m_frameCount++];
+    frame->bindFrame(nullptr, m_frameSlots.data() + m_frameTop, slotCount);
+    m_frameTop += slotCount;
+
+    return frame;
+}
+
+Upvalue* Interpreter::captureUpvalue(size_t depth, size_t slot)
+{
+    // The environments around the running one are the ones suspended last.
+    const auto env = &m_currEnv->ancestor(depth);
+    const auto position = m_envStack.size() - depth;
+
+    auto it = m_openUpvalues.end();
+    while (it != m_openUpvalues.begin() && ((it - 1)->position > position ||
+        ((it - 1)->position == position && (it - 1)->slot >= slot)))
+    {
+        --it;
+        if (it->env == env && it->slot == slot)
+        {
+            return it->upvalue;
+        }
+    }
+
+    const auto upvalue = Heap::get().allocate<Upvalue>(&env->slotAt(slot));
+    m_openUpvalues.insert(it, OpenUpvalue{ env, position, slot, upvalue });
+    return upvalue;
+}
+
+void Interpreter::closeUpvalues(Environment* env, size_t firstSlot)
+{
+    // Scopes exit in the reverse order they were entered, the upvalues of
+    // the ones entered after `env` are closed already.
+    while (!m_openUpvalues.empty() && m_openUpvalues.back().env == env &&
+        m_openUpvalues.back().slot >= firstSlot)
+    {
+        m_openUpvalues.back().upvalue->close();
+        m_openUpvalues.pop_back();
+    }
+}
+
+void Interpreter::releaseFrame(Environment* env)
+{
+    if (!env->isFrame())
+    {
+        return;
+    }
+
+    m_frameTop -= env->slotCount();
+    m_frameCount--;
+    env->unbindFrame();
+}
+
+Value Interpreter::callFunction(UserFunction& function, Environment* frame)
+{
+    std::optional<std::string> memoKey;
+
+    if (m_memo && (memoKey = m_memo->keyFor(function, frame)))
+    {
+        if (const auto cached = m_memo->find(*memoKey))
+        {
+            releaseFrame(frame);
+            return *cached;
+        }
+    }
+
+    // A call reporting errors is run again, so they are reported again.
+    const auto errors = ErrorManager::get().errorCount();
+
+    m_callDepth++;
+
+    const auto caller = m_function;
+    auto current = &function;
+    Value result;
+
+    while (true)
+    {
+        // Keeps the function, and with it the body being run, alive.
+        TempRoots roots;
+        roots.push(Value{ current });
+
+        m_function = current;
+        auto completion = Completion::RETURN;
+
+        if (!m_ir || !m_ir->run(*current, frame, m_returnValue))
+        {
+            completion = executeBlock(current->body().stmts, frame);
+        }
+
+        closeUpvalues(frame, 0);
+        releaseFrame(frame);
+
+        if (!m_tailCall.function)
+        {
+            result = completion == Completion::RETURN ? m_returnValue : Value{};
             break;
         }
+
+        // Closures only keep upvalues, nothing refers to the previous
+        // frame from here on.
+        current = std::exchange(m_tailCall.function, nullptr);
+        frame = acquireFrame(*current);
+
+        for (size_t i = 0; i < m_tailCall.args.size(); i++)
+        {
+            frame->define(i, m_tailCall.args[i]);
+        }
+
+        m_tailCall.args.clear();
     }
 
-    if(m_currEnv->returnFlagSet())
+    m_function = caller;
+    m_callDepth--;
+
+    if (memoKey && ErrorManager::get().errorCount() == errors)
     {
-        previous->setReturnFlag(true);
-        previous->setReturnVal(m_currEnv->getReturnValue());
+        m_memo->insert(std::move(*memoKey), result);
     }
 
-    m_currEnv = previous;
+    return result;
 }
 
-void Interpreter::execute(Statement& stmt)
+Completion Interpreter::execute(Statement& stmt)
 {
-    stmt.accept(*this);
+    Heap::get().safepoint();
+
+    return dispatch(stmt, [this](auto& node) { return visit(node); });
 }
 
 Interpreter::Interpreter(std::ostream& printStream)
     :
-    m_env(std::make_shared<Environment>()),
+    m_env(Heap::get().allocate<Environment>()),
     m_currEnv(m_env),
-    m_printStream(printStream),
-    m_foundBreakStmt(false)
+    m_frameSlots(FRAME_STACK_SLOTS),
+    m_printStream(printStream)
 {
-    defineBuiltinFunctions(m_env);
+    defineBuiltinFunctions(m_globals);
+    Heap::get().addRootSource(this);
+}
+
+Interpreter::~Interpreter()
+{
+    Heap::get().removeRootSource(this);
 }
 
 Interpreter::Interpreter()
@@ -466,10 +903,96 @@ Interpreter::Interpreter()
     Interpreter(std::cout)
 {}
 
-void Interpreter::interpret(const std::vector<StmtPtr>& stmts)
+void Interpreter::interpret(const Program& program)
 {
-    for (const auto& stmt : stmts)
+    Resolver{ m_constants }.resolve(program.stmts);
+
+    if (m_ir)
+    {
+        m_ir->addProgram(program);
+    }
+
+    if (m_memo)
+    {
+        m_memo->addProgram(program);
+    }
+
+    for (const auto& stmt : program.stmts)
     {
         execute(*stmt);
     }
 }
+
+bool Interpreter::enableIr(bool dump, const JitOptions& jit)
+{
+    m_ir = std::make_unique<IrExecutor>(*this, m_globals, m_printStream);
+    m_ir->setDump(dump);
+    return m_ir->setJit(jit);
+}
+
+void Interpreter::enableMemoization(size_t capacity)
+{
+    m_memo = std::make_unique<Memoizer>(m_globals, capacity);
+}
+
+bool Interpreter::memoizes(const UserFunction& function)
+{
+    return m_memo && m_memo->isPure(function);
+}
+
+const MemoStats& Interpreter::memoStats() const
+{
+    return m_memo->stats();
+}
+
+void Interpreter::printMemoStats(std::ostream& stream) const
+{
+    if (m_memo)
+    {
+        m_memo->printStats(stream);
+    }
+}
+
+void Interpreter::printIrStats(std::ostream& stream) const
+{
+    if (m_ir)
+    {
+        m_ir->printStats(stream);
+    }
+}
+
+void Interpreter::printSpecializationStats(std::ostream& stream) const
+{
+    stream << "[Specialization] specialized nodes: " << m_specializationStats.specialized
+        << " deoptimized nodes: " << m_specializationStats.deoptimized << std::endl;
+}
+
+void Interpreter::markRoots(Heap& heap)
+{
+    heap.mark(m_env);
+    heap.mark(m_currEnv);
+    m_globals.mark(heap);
+
+    for (const auto env : m_envStack)
+    {
+        heap.mark(env);
+    }
+
+    for (const auto frame : m_frames)
+    {
+        heap.mark(frame);
+    }
+
+    for (const auto& open : m_openUpvalues)
+    {
+        heap.mark(open.upvalue);
+    }
+
+    heap.mark(m_returnValue);
+    heap.mark(m_tailCall.function);
+
+    for (const auto& arg : m_tailCall.args)
+    {
+        heap.mark(arg);
+    }
+}
@@ -1,70 +1,222 @@
 #pragma once
-#include "ExpressionVisitor.hpp"
-#include "StmtVisitor.hpp"
+#include "Value.h"
 #include <memory>
 #include <vector>
 #include <variant>
 #include "Token.h"
 #include "Environment.h"
+#include "GlobalTable.h"
+#include "Program.h"
+#include "ConstantPool.h"
+#include "Heap.h"
+#include "Jit.h"
 
 #include <sstream>
 
 namespace pimentel
 {
     class LoxObject;
+    struct UserFunction;
+    class Upvalue;
+    class IrExecutor;
+    class Memoizer;
+    struct MemoStats;
 }
 
 namespace pimentel
 {
+    // Self-specialization counters, see Specialization.
+    struct SpecializationStats
+    {
+        size_t specialized = 0;
+        size_t deoptimized = 0;
+    };
 
-    class Interpreter : public ExprVisitorLoxVal, public StmtVisitor
+    // How a statement finished. A break or return unwinds the statements
+    // around it up to the loop or call it leaves, the returned value is
+    // kept in the interpreter's m_returnValue.
+    enum class Completion : uint8_t
+    {
+        NORMAL,
+        BREAK,
+        RETURN
+    };
+
+    class Interpreter : public RootSource
     {
     public:
-        using RetType_expr = ExprVisitorLoxVal::RetType;
-        using RetType_stmt = StmtVisitor::RetType;
+        using RetType_expr = Value;
+        using RetType_stmt = Completion;
 
     public:
         Interpreter(std::ostream& printStream);
         Interpreter();
-        ~Interpreter() = default;
+        ~Interpreter();
+
+        void interpret(const Program& program);
+
+        void markRoots(Heap& heap) override;
 
-        void interpret(const std::vector<std::unique_ptr<Statement>>& stmts);
+        const SpecializationStats& specializationStats() const
+        {
+            return m_specializationStats;
+        }
+
+        void printSpecializationStats(std::ostream& stream) const;
+
+        // Runs the functions it can lower as optimized IR from now on, see
+        // IrExecutor. `dump` prints their IR once optimized, `jit` compiles
+        // the fully numeric ones to native code. False when the platform has
+        // no JIT, the IR then runs without.
+        bool enableIr(bool dump, const JitOptions& jit = {});
+        void printIrStats(std::ostream& stream) const;
+
+        // Caches the results of calls to pure functions from now on, see
+        // Memoizer. Holds up to `capacity` results.
+        void enableMemoization(size_t capacity);
+        // Whether calls to `function` go through the cache.
+        bool memoizes(const UserFunction& function);
+        // Only valid once enableMemoization() was called.
+        const MemoStats& memoStats() const;
+        void printMemoStats(std::ostream& stream) const;
+
+        // Calls `callee` with the already evaluated `args`, reporting what
+        // can't be called.
+        RetType_expr callValue(const Value& callee, const std::vector<Value>& args);
 
     private:
 
-        void execute(Statement& stmt);
-
-        RetType_expr visit(Binary&) override;
-        RetType_expr visit(Grouping&) override;
-        RetType_expr visit(Literal&) override;
-        RetType_expr visit(Unary&) override;
-        RetType_expr visit(Variable&) override;
-        RetType_expr visit(Assignment&) override;
-        RetType_expr visit(Logical&) override;
-        RetType_expr visit(Call&) override;
-        RetType_expr visit(Indexing&) override;
-
-        RetType_stmt visit(ExpressionStmt&) override;
-        RetType_stmt visit(PrintStmt&) override;
-        RetType_stmt visit(VarStmt&) override;
-        RetType_stmt visit(BlockStmt&) override;
-        RetType_stmt visit(IfStmt&) override;
-        RetType_stmt visit(WhileStmt&) override;
-        RetType_stmt visit(BreakStmt&) override;
-        RetType_stmt visit(ForStmt&) override;
-        RetType_stmt visit(FunctionDeclStmt&) override;
-        RetType_stmt visit(ReturnStmt&) override;
+        Completion execute(Statement& stmt);
+
+        RetType_expr visit(Binary&);
+        RetType_expr visit(Grouping&);
+        RetType_expr visit(Literal&);
+        RetType_expr visit(Unary&);
+        RetType_expr visit(Variable&);
+        RetType_expr visit(Assignment&);
+        RetType_expr visit(Logical&);
+        RetType_expr visit(Call&);
+        RetType_expr visit(Indexing&);
+
+        // Operator specialized nodes, picked by dispatch() over the generic
+        // Binary/Unary visits above.
+        template<ExprKind K>
+        RetType_expr visit(BinaryOp<K>&);
+        template<ExprKind K>
+        RetType_expr visit(UnaryOp<K>&);
+
+        RetType_stmt visit(ExpressionStmt&);
+        RetType_stmt visit(PrintStmt&);
+        RetType_stmt visit(VarStmt&);
+        RetType_stmt visit(BlockStmt&);
+        RetType_stmt visit(IfStmt&);
+        RetType_stmt visit(WhileStmt&);
+        RetType_stmt visit(BreakStmt&);
+        RetType_stmt visit(ForStmt&);
+        RetType_stmt visit(FunctionDeclStmt&);
+        RetType_stmt visit(ReturnStmt&);
 
         RetType_expr evaluate(Expression&);
+
+        // Runs a for loop from its condition on, its variable defined.
+        Completion runLoop(ForStmt& forStmt);
+        // Same for a counted loop, in a native counter synchronized with the
+        // variable when the body reads it and on exit. Goes on as runLoop()
+        // once the counter or the bound isn't a number.
+        Completion runCountedLoop(ForStmt& forStmt);
+        // The bound of a counted loop, null when it isn't a number or needs
+        // the generic path to report an error.
+        const Value* loopBound(const ForStmt::CountedLoop& counted);
+
+        void specialize(Specialization& state, Specialization to);
+        void deoptimize(Specialization& state);
+        // tailPosition: the call is the value of a return, a UserFunction
+        // callee is then left in m_tailCall for the running call to make.
+        RetType_expr call(Call& callExpr, bool tailPosition);
+        // Specialization bookkeeping for a call, reports an error and
+        // returns false when the callee can't be called.
+        bool checkCallee(Call& callExpr, const Value& callee);
+
     public:
-        void executeBlock(const std::vector<std::unique_ptr<Statement>>& stmts, const std::shared_ptr<Environment>& env);
+        Completion executeBlock(const std::vector<StmtPtr>& stmts, Environment* env);
+        // Runs `stmts` in the current environment until a break or return.
+        Completion executeStatements(const std::vector<StmtPtr>& stmts);
+
+        // Environment for a call to `function`, its parameters are the
+        // first slots. Functions that can't leak it get a frame on the
+        // frame stack, which costs no allocation; the rest, and calls made
+        // once the stack is full, get a heap environment.
+        Environment* acquireFrame(const UserFunction& function);
+        // Frames are released in the reverse order they were acquired.
+        void releaseFrame(Environment* env);
+
+        // The open upvalue of `slot` in the environment `depth` scopes up,
+        // shared by every closure capturing the variable while its scope is
+        // alive.
+        Upvalue* captureUpvalue(size_t depth, size_t slot);
+        // Closes the upvalues of `env`'s slots from `firstSlot` on, when the
+        // scope declaring those variables exits.
+        void closeUpvalues(Environment* env, size_t firstSlot);
+
+        // Runs `function` in `frame`, which holds the arguments, and every
+        // call it makes in tail position in a loop, so tail recursion grows
+        // neither the environment chain nor the C++ stack. Releases `frame`.
+        Value callFunction(UserFunction& function, Environment* frame);
 
     private:
-        std::shared_ptr<Environment> m_env;
-        std::shared_ptr<Environment> m_currEnv;
+        // Outermost environment, has no slots: globals live in m_globals.
+        Environment* m_env;
+        Environment* m_currEnv;
+        GlobalTable m_globals;
+        // Environments suspended by a block or call that is still running.
+        std::vector<Environment*> m_envStack;
+        ConstantPool m_constants;
+
+        static constexpr size_t FRAME_STACK_SLOTS = 64 * 1024;
+
+        // Slots of the frames in use, from m_frameSlots[0] to m_frameTop.
+        std::vector<Value> m_frameSlots;
+        size_t m_frameTop = 0;
+        // One environment per frame depth reached so far, reused by every
+        // later call at that depth.
+        std::vector<Environment*> m_frames;
+        size_t m_frameCount = 0;
 
         std::ostream& m_printStream;
 
-        bool m_foundBreakStmt;
+        // Function whose body is running, null at top level.
+        UserFunction* m_function = nullptr;
+        struct OpenUpvalue
+        {
+            Environment* env;
+            // Of `env` in m_envStack, or its size for the running one.
+            size_t position;
+            size_t slot;
+            Upvalue* upvalue;
+        };
+
+        // Kept sorted by position and slot, so closing a scope only looks at
+        // the tail.
+        std::vector<OpenUpvalue> m_openUpvalues;
+
+        // Value of the last return statement run.
+        Value m_returnValue;
+
+        struct TailCall
+        {
+            UserFunction* function = nullptr;
+            std::vector<Value> args;
+        };
+
+        TailCall m_tailCall;
+        // UserFunction calls running, a return outside of them isn't a tail call.
+        size_t m_callDepth = 0;
+
+        SpecializationStats m_specializationStats;
+
+        // Null unless enableIr() was called.
+        std::unique_ptr<IrExecutor> m_ir;
+        // Null unless enableMemoization() was called.
+        std::unique_ptr<Memoizer> m_memo;
     };
 }
@@ -0,0 +1,556 @@
+#include "Ir.h"
+#include "ValueUtils.h"
+#include "LoxString.h"
+
+#include <algorithm>
+#include <sstream>
+
+using namespace pimentel;
+
+namespace
+{
+    void printConstant(std::ostream& stream, const Value& value)
+    {
+        if (value.isString())
+        {
+            stream << '"' << value.asString()->str() << '"';
+            return;
+        }
+
+        std::ostringstream printed;
+        printValue(printed, value);
+
+        auto text = printed.str();
+        text.pop_back();
+        stream << text;
+    }
+}
+
+const char* pimentel::irOpName(IrOp op)
+{
+    switch (op)
+    {
+    case IrOp::CONSTANT: return "const";
+    case IrOp::PARAMETER: return "param";
+    case IrOp::PHI: return "phi";
+    case IrOp::ADD: return "add";
+    case IrOp::SUBTRACT: return "sub";
+    case IrOp::MULTIPLY: return "mul";
+    case IrOp::DIVIDE: return "div";
+    case IrOp::GREATER: return "gt";
+    case IrOp::GREATER_EQUAL: return "ge";
+    case IrOp::LESS: return "lt";
+    case IrOp::LESS_EQUAL: return "le";
+    case IrOp::EQUAL: return "eq";
+    case IrOp::NOT_EQUAL: return "ne";
+    case IrOp::NEGATE: return "neg";
+    case IrOp::NOT: return "not";
+    case IrOp::TRUTHY: return "truthy";
+    case IrOp::SAME: return "same";
+    case IrOp::IS_STRING: return "is_string";
+    case IrOp::INDEX: return "index";
+    case IrOp::LOAD_GLOBAL: return "load_global";
+    case IrOp::STORE_GLOBAL: return "store_global";
+    case IrOp::CALL: return "call";
+    case IrOp::PRINT: return "print";
+    case IrOp::JUMP: return "jump";
+    case IrOp::BRANCH: return "branch";
+    case IrOp::RETURN: return "return";
+    case IrOp::MOVE: return "move";
+    }
+
+    return "?";
+}
+
+bool pimentel::isTerminator(IrOp op)
+{
+    return op == IrOp::JUMP || op == IrOp::BRANCH || op == IrOp::RETURN;
+}
+
+bool pimentel::hasSideEffects(IrOp op)
+{
+    return op == IrOp::STORE_GLOBAL || op == IrOp::CALL || op == IrOp::PRINT || isTerminator(op);
+}
+
+const std::vector<IrBlock*>& IrBlock::succs() const
+{
+    static const std::vector<IrBlock*> none;
+    const auto term = terminator();
+
+    return term ? term->targets : none;
+}
+
+IrFunction::IrFunction(std::string name, size_t arity)
+    :
+    m_name(std::move(name)),
+    m_arity(arity)
+{}
+
+IrBlock* IrFunction::addBlock()
+{
+    auto& block = m_blocks.emplace_back(std::make_unique<IrBlock>());
+    block->id = m_blocks.size() - 1;
+
+    return block.get();
+}
+
+IrInstr* IrFunction::create(IrOp op, std::vector<IrInstr*> operands)
+{
+    auto& instr = m_instrs.emplace_back(std::make_unique<IrInstr>());
+    instr->op = op;
+    instr->id = m_instrs.size() - 1;
+    instr->operands = std::move(operands);
+
+    return instr.get();
+}
+
+IrInstr* IrFunction::append(IrBlock* block, IrOp op, std::vector<IrInstr*> operands)
+{
+    auto instr = create(op, std::move(operands));
+    instr->block = block;
+    block->instrs.push_back(instr);
+
+    return instr;
+}
+
+IrInstr* IrFunction::insertBeforeEnd(IrBlock* block, IrOp op, std::vector<IrInstr*> operands)
+{
+    auto instr = create(op, std::move(operands));
+    instr->block = block;
+
+    auto position = block->terminator() ? block->instrs.end() - 1 : block->instrs.end();
+    block->instrs.insert(position, instr);
+
+    return instr;
+}
+
+IrInstr* IrFunction::addPhi(IrBlock* block)
+{
+    auto phi = create(IrOp::PHI);
+    phi->block = block;
+
+    const auto position = std::find_if(block->instrs.begin(), block->instrs.end(),
+        [](const IrInstr* instr) { return instr->op != IrOp::PHI; });
+    block->instrs.insert(position, phi);
+
+    return phi;
+}
+
+void IrFunction::addEdge(IrBlock* from, IrBlock* to)
+{
+    to->preds.push_back(from);
+}
+
+void IrFunction::redirectEdge(IrBlock* from, IrBlock* oldTarget, IrBlock* newTarget)
+{
+    for (auto& target : from->terminator()->targets)
+    {
+        if (target == oldTarget)
+        {
+            target = newTarget;
+        }
+    }
+
+    for (auto& pred : oldTarget->preds)
+    {
+        if (pred == from)
+        {
+            pred = newTarget;
+        }
+    }
+}
+
+void IrFunction::removeEdge(IrBlock* from, IrBlock* to)
+{
+    const auto position = std::find(to->preds.begin(), to->preds.end(), from);
+
+    if (position == to->preds.end())
+    {
+        return;
+    }
+
+    const auto index = static_cast<size_t>(position - to->preds.begin());
+    to->preds.erase(position);
+
+    for (auto instr : to->instrs)
+    {
+        if (instr->op != IrOp::PHI)
+        {
+            break;
+        }
+
+        instr->operands.erase(instr->operands.begin() + index);
+    }
+}
+
+void IrFunction::replaceUses(IrInstr* of, IrInstr* with)
+{
+    for (const auto& block : m_blocks)
+    {
+        for (auto instr : block->instrs)
+        {
+            std::replace(instr->operands.begin(), instr->operands.end(), of, with);
+        }
+    }
+}
+
+void IrFunction::remove(IrInstr* instr)
+{
+    std::erase(instr->block->instrs, instr);
+    instr->block = nullptr;
+}
+
+std::vector<IrBlock*> IrFunction::reversePostorder() const
+{
+    std::vector<IrBlock*> order;
+    std::vector<bool> visited(m_blocks.size());
+    // Block and index of the next successor to visit.
+    std::vector<std::pair<IrBlock*, size_t>> stack{ { entry(), 0 } };
+    visited[entry()->id] = true;
+
+    while (!stack.empty())
+    {
+        auto& [block, next] = stack.back();
+        const auto& succs = block->succs();
+
+        if (next < succs.size())
+        {
+            const auto succ = succs[next++];
+
+            if (!visited[succ->id])
+            {
+                visited[succ->id] = true;
+                stack.emplace_back(succ, 0);
+            }
+
+            continue;
+        }
+
+        order.push_back(block);
+        stack.pop_back();
+    }
+
+    std::reverse(order.begin(), order.end());
+
+    return order;
+}
+
+void IrFunction::removeUnreachableBlocks()
+{
+    const auto order = reversePostorder();
+    std::vector<bool> reachable(m_blocks.size());
+
+    for (const auto block : order)
+    {
+        reachable[block->id] = true;
+    }
+
+    for (const auto& block : m_blocks)
+    {
+        if (reachable[block->id])
+        {
+            continue;
+        }
+
+        for (const auto succ : block->succs())
+        {
+            if (reachable[succ->id])
+            {
+                removeEdge(block.get(), succ);
+            }
+        }
+
+        for (auto instr : block->instrs)
+        {
+            instr->block = nullptr;
+        }
+    }
+
+    std::erase_if(m_blocks, [&reachable](const std::unique_ptr<IrBlock>& block) { return !reachable[block->id]; });
+
+    for (size_t i = 0; i < m_blocks.size(); i++)
+    {
+        m_blocks[i]->id = i;
+    }
+}
+
+size_t IrFunction::mergeBlocks()
+{
+    size_t merged = 0;
+
+    for (const auto& block : m_blocks)
+    {
+        while (true)
+        {
+            const auto jump = block->terminator();
+
+            if (!jump || jump->op != IrOp::JUMP)
+            {
+                break;
+            }
+
+            const auto next = jump->targets[0];
+
+            if (next == block.get() || next == entry() || next->preds.size() != 1)
+            {
+                break;
+            }
+
+            remove(jump);
+
+            for (const auto instr : std::vector<IrInstr*>{ next->instrs })
+            {
+                if (instr->op == IrOp::PHI)
+                {
+                    replaceUses(instr, instr->operands[0]);
+                    remove(instr);
+                    continue;
+                }
+
+                instr->block = block.get();
+                block->instrs.push_back(instr);
+            }
+
+            for (const auto succ : block->succs())
+            {
+                std::replace(succ->preds.begin(), succ->preds.end(), next, block.get());
+            }
+
+            next->instrs.clear();
+            next->preds.clear();
+            merged++;
+        }
+    }
+
+    if (merged)
+    {
+        removeUnreachableBlocks();
+    }
+
+    return merged;
+}
+
+void IrFunction::splitCriticalEdges()
+{
+    const auto blockCount = m_blocks.size();
+
+    for (size_t i = 0; i < blockCount; i++)
+    {
+        const auto from = m_blocks[i].get();
+
+        if (from->succs().size() < 2)
+        {
+            continue;
+        }
+
+        // One edge at a time, both targets of a branch may be the same block.
+        for (auto& target : from->terminator()->targets)
+        {
+            const auto to = target;
+
+            if (to->preds.size() < 2)
+            {
+                continue;
+            }
+
+            const auto split = addBlock();
+            *std::find(to->preds.begin(), to->preds.end(), from) = split;
+            split->preds.push_back(from);
+            target = split;
+            append(split, IrOp::JUMP)->targets.push_back(to);
+        }
+    }
+}
+
+size_t IrFunction::instructionCount() const
+{
+    size_t count = 0;
+
+    for (const auto& block : m_blocks)
+    {
+        count += block->instrs.size();
+    }
+
+    return count;
+}
+
+std::vector<Value> IrFunction::constants() const
+{
+    std::vector<Value> values;
+
+    for (const auto& block : m_blocks)
+    {
+        for (const auto instr : block->instrs)
+        {
+            if (instr->op == IrOp::CONSTANT)
+            {
+                values.push_back(instr->constant);
+            }
+        }
+    }
+
+    return values;
+}
+
+void IrFunction::dump(std::ostream& stream) const
+{
+    stream << "function " << m_name << "(" << m_arity << ")" << std::endl;
+
+    for (const auto block : reversePostorder())
+    {
+        stream << "b" << block->id << ":";
+
+        if (!block->preds.empty())
+        {
+            stream << " ; preds";
+
+            for (const auto pred : block->preds)
+            {
+                stream << " b" << pred->id;
+            }
+        }
+
+        stream << std::endl;
+
+        for (const auto instr : block->instrs)
+        {
+            stream << "    ";
+
+            if (!isTerminator(instr->op) && instr->op != IrOp::PRINT && instr->op != IrOp::STORE_GLOBAL)
+            {
+                stream << "v" << instr->id << " = ";
+            }
+
+            stream << irOpName(instr->op);
+
+            switch (instr->op)
+            {
+            case IrOp::CONSTANT:
+                stream << " ";
+                printConstant(stream, instr->constant);
+                break;
+            case IrOp::PARAMETER:
+                stream << " " << instr->parameter;
+                break;
+            case IrOp::LOAD_GLOBAL:
+            case IrOp::STORE_GLOBAL:
+                stream << " " << instr->symbol.name();
+                break;
+            default:
+                break;
+            }
+
+            for (size_t i = 0; i < instr->operands.size(); i++)
+            {
+                stream << (i == 0 && instr->op != IrOp::STORE_GLOBAL ? " " : ", ") << "v" << instr->operands[i]->id;
+            }
+
+            for (size_t i = 0; i < instr->targets.size(); i++)
+            {
+                stream << (i == 0 && instr->operands.empty() ? " " : ", ") << "b" << instr->targets[i]->id;
+            }
+
+            if ((instr->op == IrOp::INDEX || instr->op == IrOp::LOAD_GLOBAL) && !instr->checked)
+            {
+                stream << " unchecked";
+            }
+
+            if (instr->op == IrOp::CALL && instr->tail)
+            {
+                stream << " tail";
+            }
+
+            stream << std::endl;
+        }
+    }
+}
+
+IrDominators::IrDominators(const IrFunction& function)
+    :
+    m_idom(function.blocks().size(), nullptr),
+    m_children(function.blocks().size())
+{
+    // Cooper, Harvey and Kennedy's iterative algorithm over the reverse
+    // postorder.
+    const auto order = function.reversePostorder();
+    std::vector<size_t> position(function.blocks().size());
+
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        position[order[i]->id] = i;
+    }
+
+    const auto entry = function.entry();
+    m_idom[entry->id] = entry;
+
+    const auto intersect = [this, &position](const IrBlock* a, const IrBlock* b) {
+        while (a != b)
+        {
+            while (position[a->id] > position[b->id])
+            {
+                a = m_idom[a->id];
+            }
+
+            while (position[b->id] > position[a->id])
+            {
+                b = m_idom[b->id];
+            }
+        }
+
+        return a;
+    };
+
+    bool changed = true;
+
+    while (changed)
+    {
+        changed = false;
+
+        for (size_t i = 1; i < order.size(); i++)
+        {
+            const auto block = order[i];
+            const IrBlock* idom = nullptr;
+
+            for (const auto pred : block->preds)
+            {
+                if (!m_idom[pred->id])
+                {
+                    continue;
+                }
+
+                idom = idom ? intersect(pred, idom) : pred;
+            }
+
+            if (idom != m_idom[block->id])
+            {
+                m_idom[block->id] = idom;
+                changed = true;
+            }
+        }
+    }
+
+    for (const auto block : order)
+    {
+        if (block != entry)
+        {
+            m_children[m_idom[block->id]->id].push_back(block);
+        }
+    }
+
+    m_idom[entry->id] = nullptr;
+}
+
+bool IrDominators::dominates(const IrBlock* dominator, const IrBlock* block) const
+{
+    while (block)
+    {
+        if (block == dominator)
+        {
+            return true;
+        }
+
+        block = m_idom[block->id];
+    }
+
+    return false;
+}
@@ -0,0 +1,193 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "Value.h"
+#include "Symbol.h"
+#include "Token.h"
+
+namespace pimentel
+{
+    // Mid-level representation of a function in SSA form: every instruction
+    // defines at most one value, locals become the values assigned to them
+    // and merge points pick between them with phis. Built by IrBuilder,
+    // rewritten by the passes in IrPasses.h and run by IrExecutor.
+    enum class IrOp : uint8_t
+    {
+        CONSTANT,
+        PARAMETER,
+        PHI,
+        ADD,
+        SUBTRACT,
+        MULTIPLY,
+        DIVIDE,
+        GREATER,
+        GREATER_EQUAL,
+        LESS,
+        LESS_EQUAL,
+        EQUAL,
+        NOT_EQUAL,
+        NEGATE,
+        NOT,
+        TRUTHY,
+        // Whether both operands are the very same value, guards inlined calls.
+        SAME,
+        IS_STRING,
+        INDEX,
+        LOAD_GLOBAL,
+        STORE_GLOBAL,
+        CALL,
+        PRINT,
+        JUMP,
+        BRANCH,
+        RETURN,
+        // Only emitted by IrExecutor, copies the values phis pick.
+        MOVE
+    };
+
+    const char* irOpName(IrOp op);
+    bool isTerminator(IrOp op);
+    // Observable by the program no matter what the result is used for.
+    bool hasSideEffects(IrOp op);
+
+    struct IrBlock;
+
+    struct IrInstr
+    {
+        IrOp op;
+        size_t id;
+        IrBlock* block = nullptr;
+        // PHI: one per predecessor of the block, in the same order.
+        // CALL: the callee, then the arguments.
+        std::vector<IrInstr*> operands;
+        // JUMP: the target. BRANCH: taken when truthy, then when falsy.
+        std::vector<IrBlock*> targets;
+
+        Value constant;
+        size_t parameter = 0;
+        Symbol symbol;
+        // Reported by operations failing on their operand types.
+        Token token;
+        // INDEX: the string and bounds checks are still needed.
+        // LOAD_GLOBAL, STORE_GLOBAL: the global may be undefined.
+        bool checked = true;
+        // CALL: the value of a return, the callee may reuse the caller's frame.
+        bool tail = false;
+    };
+
+    struct IrBlock
+    {
+        size_t id;
+        // Phis come first, the last instruction is the terminator.
+        std::vector<IrInstr*> instrs;
+        std::vector<IrBlock*> preds;
+
+        IrInstr* terminator() const
+        {
+            return instrs.empty() || !isTerminator(instrs.back()->op) ? nullptr : instrs.back();
+        }
+
+        const std::vector<IrBlock*>& succs() const;
+    };
+
+    class IrFunction
+    {
+    public:
+        IrFunction(std::string name, size_t arity);
+        IrFunction(const IrFunction&) = delete;
+        IrFunction& operator=(const IrFunction&) = delete;
+        ~IrFunction() = default;
+
+        IrBlock* addBlock();
+        // Creates an instruction without placing it in a block.
+        IrInstr* create(IrOp op, std::vector<IrInstr*> operands = {});
+        IrInstr* append(IrBlock* block, IrOp op, std::vector<IrInstr*> operands = {});
+        // Inserts before the terminator of `block`.
+        IrInstr* insertBeforeEnd(IrBlock* block, IrOp op, std::vector<IrInstr*> operands = {});
+        IrInstr* addPhi(IrBlock* block);
+
+        void addEdge(IrBlock* from, IrBlock* to);
+        // Replaces `oldTarget` in the terminator of `from` as well.
+        void redirectEdge(IrBlock* from, IrBlock* oldTarget, IrBlock* newTarget);
+        // Drops `from` from the predecessors of `to` and its phi operands.
+        void removeEdge(IrBlock* from, IrBlock* to);
+
+        void replaceUses(IrInstr* of, IrInstr* with);
+        void remove(IrInstr* instr);
+
+        std::vector<IrBlock*> reversePostorder() const;
+        // Drops blocks not reachable from the entry and renumbers the rest.
+        void removeUnreachableBlocks();
+        // Appends every block to the one jumping to it when it has no other
+        // predecessor. Returns the number of blocks merged.
+        size_t mergeBlocks();
+        // Puts a block on every edge from a block with several successors to
+        // one with several predecessors, so phi moves have a place to go.
+        void splitCriticalEdges();
+
+        size_t instructionCount() const;
+
+        // Upper bound of the instruction ids, for tables indexed by them.
+        size_t idBound() const
+        {
+            return m_instrs.size();
+        }
+
+        void dump(std::ostream& stream) const;
+
+        const std::string& name() const
+        {
+            return m_name;
+        }
+
+        size_t arity() const
+        {
+            return m_arity;
+        }
+
+        IrBlock* entry() const
+        {
+            return m_blocks.front().get();
+        }
+
+        const std::vector<std::unique_ptr<IrBlock>>& blocks() const
+        {
+            return m_blocks;
+        }
+
+        // Constant values, which the owner has to keep alive.
+        std::vector<Value> constants() const;
+
+    private:
+        std::string m_name;
+        size_t m_arity;
+        std::vector<std::unique_ptr<IrBlock>> m_blocks;
+        // Every instruction ever created, removed ones included.
+        std::vector<std::unique_ptr<IrInstr>> m_instrs;
+    };
+
+    // Immediate dominators over the blocks reachable from the entry.
+    class IrDominators
+    {
+    public:
+        IrDominators(const IrFunction& function);
+
+        bool dominates(const IrBlock* dominator, const IrBlock* block) const;
+
+        const IrBlock* idom(const IrBlock* block) const
+        {
+            return m_idom[block->id];
+        }
+
+        const std::vector<IrBlock*>& children(const IrBlock* block) const
+        {
+            return m_children[block->id];
+        }
+
+    private:
+        std::vector<const IrBlock*> m_idom;
+        std::vector<std::vector<IrBlock*>> m_children;
+    };
+}
@@ -0,0 +1,656 @@
+#include "IrBuilder.h"
+#include "AstDispatch.hpp"
+
+using namespace pimentel;
+
+namespace
+{
+    IrOp binaryOp(TokenType type)
+    {
+        switch (type)
+        {
+        case TokenType::PLUS: return IrOp::ADD;
+        case TokenType::MINUS: return IrOp::SUBTRACT;
+        case TokenType::STAR: return IrOp::MULTIPLY;
+        case TokenType::SLASH: return IrOp::DIVIDE;
+        case TokenType::GREATER: return IrOp::GREATER;
+        case TokenType::GREATER_EQUAL: return IrOp::GREATER_EQUAL;
+        case TokenType::LESS: return IrOp::LESS;
+        case TokenType::LESS_EQUAL: return IrOp::LESS_EQUAL;
+        case TokenType::EQUAL_EQUAL: return IrOp::EQUAL;
+        case TokenType::BANG_EQUAL: return IrOp::NOT_EQUAL;
+        default: return IrOp::RETURN;
+        }
+    }
+
+    // An index the tree-walker may skip evaluating without it showing.
+    bool isTrivialIndex(const Expression& expr)
+    {
+        if (expr.kind == ExprKind::LITERAL)
+        {
+            return true;
+        }
+
+        return expr.kind == ExprKind::VARIABLE && static_cast<const Variable&>(expr).depth == 0;
+    }
+
+    class AssignedGlobals
+    {
+    public:
+        AssignedGlobals(std::unordered_set<Symbol>& globals)
+            :
+            m_globals(globals)
+        {}
+
+        void walk(const std::vector<StmtPtr>& stmts)
+        {
+            for (const auto& stmt : stmts)
+            {
+                walk(stmt);
+            }
+        }
+
+        void walk(const StmtPtr& stmt)
+        {
+            if (stmt)
+            {
+                dispatch(*stmt, [this](auto& node) { visit(node); });
+            }
+        }
+
+        void walk(const ExprPtr& expr)
+        {
+            if (expr)
+            {
+                dispatch(*expr, [this](auto& node) { visit(node); });
+            }
+        }
+
+    private:
+        void visit(Binary& expr) { walk(expr.left); walk(expr.right); }
+        void visit(Grouping& expr) { walk(expr.expr); }
+        void visit(Literal&) {}
+        void visit(Unary& expr) { walk(expr.right); }
+        void visit(Variable&) {}
+        void visit(Logical& expr) { walk(expr.leftExpr); walk(expr.rightExpr); }
+        void visit(Indexing& expr) { walk(expr.indexee); walk(expr.index); }
+
+        void visit(Assignment& expr)
+        {
+            if (expr.depth < 0 && expr.upvalue < 0)
+            {
+                m_globals.insert(expr.name.getSymbol());
+            }
+
+            walk(expr.value);
+        }
+
+        void visit(Call& expr)
+        {
+            walk(expr.calee);
+
+            for (const auto& arg : expr.arguments)
+            {
+                walk(arg);
+            }
+        }
+
+        void visit(ExpressionStmt& stmt) { walk(stmt.expr); }
+        void visit(PrintStmt& stmt) { walk(stmt.expr); }
+        void visit(VarStmt& stmt) { walk(stmt.initializer); }
+        void visit(BlockStmt& stmt) { walk(stmt.stmts); }
+        void visit(IfStmt& stmt) { walk(stmt.expr); walk(stmt.block); walk(stmt.elseblock); }
+        void visit(WhileStmt& stmt) { walk(stmt.expr); walk(stmt.block); }
+        void visit(BreakStmt&) {}
+        void visit(ForStmt& stmt) { walk(stmt.variableDef); walk(stmt.expr); walk(stmt.incStmt); walk(stmt.block); }
+        void visit(FunctionDeclStmt& stmt) { walk(stmt.block->stmts); }
+        void visit(ReturnStmt& stmt) { walk(stmt.expr); }
+
+    private:
+        std::unordered_set<Symbol>& m_globals;
+    };
+}
+
+IrBuilder::IrBuilder(const FunctionDeclStmt& declaration)
+    :
+    m_declaration(declaration)
+{}
+
+std::unique_ptr<IrFunction> IrBuilder::build()
+{
+    m_function = std::make_unique<IrFunction>(m_declaration.name.getLexeme(), m_declaration.argList.size());
+
+    m_current = newBlock();
+    seal(m_current);
+
+    for (size_t i = 0; i < m_declaration.argList.size(); i++)
+    {
+        auto param = emit(IrOp::PARAMETER);
+        param->parameter = i;
+        writeVariable(i, m_current, param);
+    }
+
+    lower(m_declaration.block->stmts);
+
+    if (!m_current->terminator())
+    {
+        emit(IrOp::RETURN, { constant(Value{}) });
+    }
+
+    if (m_failed)
+    {
+        return nullptr;
+    }
+
+    m_function->removeUnreachableBlocks();
+
+    return std::move(m_function);
+}
+
+void IrBuilder::lower(const std::vector<StmtPtr>& stmts)
+{
+    for (const auto& stmt : stmts)
+    {
+        lower(*stmt);
+    }
+}
+
+void IrBuilder::lower(Statement& stmt)
+{
+    dispatch(stmt, [this](auto& node) { visit(node); });
+}
+
+IrInstr* IrBuilder::lower(Expression& expr)
+{
+    return dispatch(expr, [this](auto& node) { return visit(node); });
+}
+
+void IrBuilder::visit(ExpressionStmt& stmt)
+{
+    lower(*stmt.expr);
+}
+
+void IrBuilder::visit(PrintStmt& stmt)
+{
+    emit(IrOp::PRINT, { lower(*stmt.expr) });
+}
+
+void IrBuilder::visit(VarStmt& stmt)
+{
+    const auto value = stmt.initializer ? lower(*stmt.initializer) : constant(Value{});
+
+    if (stmt.slot < 0)
+    {
+        fail();
+        return;
+    }
+
+    writeVariable(static_cast<size_t>(stmt.slot), m_current, value);
+}
+
+void IrBuilder::visit(BlockStmt& stmt)
+{
+    if (stmt.hasScope || stmt.closeFrom >= 0)
+    {
+        fail();
+        return;
+    }
+
+    lower(stmt.stmts);
+}
+
+void IrBuilder::visit(IfStmt& stmt)
+{
+    const auto condition = lower(*stmt.expr);
+    const auto thenBlock = newBlock();
+    const auto elseBlock = stmt.elseblock ? newBlock() : nullptr;
+    const auto join = newBlock();
+
+    branch(condition, thenBlock, elseBlock ? elseBlock : join);
+
+    seal(thenBlock);
+    m_current = thenBlock;
+    lower(*stmt.block);
+    jump(join);
+
+    if (elseBlock)
+    {
+        seal(elseBlock);
+        m_current = elseBlock;
+        lower(*stmt.elseblock);
+        jump(join);
+    }
+
+    seal(join);
+    m_current = join;
+}
+
+void IrBuilder::visit(WhileStmt& stmt)
+{
+    const auto header = newBlock();
+    jump(header);
+    m_current = header;
+
+    const auto condition = lower(*stmt.expr);
+    const auto body = newBlock();
+    const auto exit = newBlock();
+
+    branch(condition, body, exit);
+
+    seal(body);
+    m_current = body;
+    m_breakTargets.push_back(exit);
+    lower(*stmt.block);
+    m_breakTargets.pop_back();
+    jump(header);
+
+    seal(header);
+    seal(exit);
+    m_current = exit;
+}
+
+void IrBuilder::visit(BreakStmt&)
+{
+    if (m_breakTargets.empty())
+    {
+        fail();
+        return;
+    }
+
+    jump(m_breakTargets.back());
+    startUnreachable();
+}
+
+void IrBuilder::visit(ForStmt& stmt)
+{
+    if (stmt.hasScope || stmt.closeFrom >= 0)
+    {
+        fail();
+        return;
+    }
+
+    if (stmt.variableDef)
+    {
+        lower(*stmt.variableDef);
+    }
+
+    const auto header = newBlock();
+    jump(header);
+    m_current = header;
+
+    const auto body = newBlock();
+    const auto exit = newBlock();
+
+    if (stmt.expr)
+    {
+        branch(lower(*stmt.expr), body, exit);
+    }
+    else
+    {
+        jump(body);
+    }
+
+    seal(body);
+    m_current = body;
+    m_breakTargets.push_back(exit);
+    lower(*stmt.block);
+    m_breakTargets.pop_back();
+
+    if (stmt.incStmt)
+    {
+        lower(*stmt.incStmt);
+    }
+
+    jump(header);
+
+    seal(header);
+    seal(exit);
+    m_current = exit;
+}
+
+void IrBuilder::visit(FunctionDeclStmt&)
+{
+    fail();
+}
+
+void IrBuilder::visit(ReturnStmt& stmt)
+{
+    IrInstr* value;
+
+    if (!stmt.expr)
+    {
+        value = constant(Value{});
+    }
+    else if (stmt.expr->kind == ExprKind::CALL)
+    {
+        value = lowerCall(static_cast<Call&>(*stmt.expr), true);
+    }
+    else
+    {
+        value = lower(*stmt.expr);
+    }
+
+    emit(IrOp::RETURN, { value });
+    startUnreachable();
+}
+
+IrInstr* IrBuilder::visit(Binary& expr)
+{
+    const auto op = binaryOp(expr.operatorType.getType());
+
+    if (op == IrOp::RETURN)
+    {
+        return fail();
+    }
+
+    const auto left = lower(*expr.left);
+    const auto right = lower(*expr.right);
+
+    auto instr = emit(op, { left, right });
+    instr->token = expr.operatorType;
+
+    return instr;
+}
+
+IrInstr* IrBuilder::visit(Grouping& expr)
+{
+    return lower(*expr.expr);
+}
+
+IrInstr* IrBuilder::visit(Literal& expr)
+{
+    return constant(expr.constant);
+}
+
+IrInstr* IrBuilder::visit(Unary& expr)
+{
+    const auto right = lower(*expr.right);
+
+    switch (expr.operatorType.getType())
+    {
+    case TokenType::MINUS:
+        return emit(IrOp::NEGATE, { right });
+    case TokenType::BANG:
+        return emit(IrOp::NOT, { right });
+    default:
+        return fail();
+    }
+}
+
+IrInstr* IrBuilder::visit(Variable& expr)
+{
+    if (expr.depth == 0)
+    {
+        return readVariable(expr.slot, m_current);
+    }
+
+    if (expr.depth > 0 || expr.upvalue >= 0)
+    {
+        return fail();
+    }
+
+    auto load = emit(IrOp::LOAD_GLOBAL);
+    load->symbol = expr.name.getSymbol();
+
+    return load;
+}
+
+IrInstr* IrBuilder::visit(Assignment& expr)
+{
+    const auto value = lower(*expr.value);
+
+    if (expr.depth == 0)
+    {
+        writeVariable(expr.slot, m_current, value);
+        return value;
+    }
+
+    if (expr.depth > 0 || expr.upvalue >= 0)
+    {
+        return fail();
+    }
+
+    emit(IrOp::STORE_GLOBAL, { value })->symbol = expr.name.getSymbol();
+
+    return value;
+}
+
+IrInstr* IrBuilder::visit(Logical& expr)
+{
+    const auto type = expr.op.getType();
+
+    if (type != TokenType::AND && type != TokenType::OR)
+    {
+        return fail();
+    }
+
+    const auto isAnd = type == TokenType::AND;
+    const auto left = lower(*expr.leftExpr);
+    // The value when the left operand decides.
+    const auto shortCircuit = constant(Value{ !isAnd });
+    const auto right = newBlock();
+    const auto join = newBlock();
+
+    if (isAnd)
+    {
+        branch(left, right, join);
+    }
+    else
+    {
+        branch(left, join, right);
+    }
+
+    seal(right);
+    m_current = right;
+    const auto rightValue = emit(IrOp::TRUTHY, { lower(*expr.rightExpr) });
+    jump(join);
+
+    seal(join);
+    m_current = join;
+
+    auto phi = m_function->addPhi(join);
+    phi->operands = { shortCircuit, rightValue };
+
+    return phi;
+}
+
+IrInstr* IrBuilder::visit(Call& expr)
+{
+    return lowerCall(expr, false);
+}
+
+IrInstr* IrBuilder::lowerCall(Call& expr, bool tail)
+{
+    std::vector<IrInstr*> operands{ lower(*expr.calee) };
+
+    for (const auto& arg : expr.arguments)
+    {
+        operands.push_back(lower(*arg));
+    }
+
+    auto call = emit(IrOp::CALL, std::move(operands));
+    call->tail = tail;
+
+    return call;
+}
+
+IrInstr* IrBuilder::visit(Indexing& expr)
+{
+    const auto indexee = lower(*expr.indexee);
+
+    if (isTrivialIndex(*expr.index))
+    {
+        return emit(IrOp::INDEX, { indexee, lower(*expr.index) });
+    }
+
+    // The tree-walker only evaluates the index of a string, anything else
+    // is reported without running it.
+    const auto indexString = newBlock();
+    const auto notString = newBlock();
+    const auto join = newBlock();
+
+    branch(emit(IrOp::IS_STRING, { indexee }), indexString, notString);
+
+    seal(indexString);
+    m_current = indexString;
+    const auto indexed = emit(IrOp::INDEX, { indexee, lower(*expr.index) });
+    jump(join);
+
+    seal(notString);
+    m_current = notString;
+    const auto failed = emit(IrOp::INDEX, { indexee, constant(Value{}) });
+    jump(join);
+
+    seal(join);
+    m_current = join;
+
+    auto phi = m_function->addPhi(join);
+    phi->operands = { indexed, failed };
+
+    return phi;
+}
+
+IrInstr* IrBuilder::emit(IrOp op, std::vector<IrInstr*> operands)
+{
+    return m_function->append(m_current, op, std::move(operands));
+}
+
+IrInstr* IrBuilder::constant(Value value)
+{
+    if (const auto found = m_constants.find(value.bits()); found != m_constants.end())
+    {
+        return found->second;
+    }
+
+    const auto entry = m_function->entry();
+    auto instr = m_function->create(IrOp::CONSTANT);
+    instr->constant = value;
+    instr->block = entry;
+    entry->instrs.insert(entry->instrs.begin(), instr);
+
+    m_constants.emplace(value.bits(), instr);
+
+    return instr;
+}
+
+IrBlock* IrBuilder::newBlock()
+{
+    auto& state = m_blocks.emplace_back();
+    state.defs.resize(m_declaration.localCount, nullptr);
+
+    return m_function->addBlock();
+}
+
+void IrBuilder::branch(IrInstr* condition, IrBlock* ifTrue, IrBlock* ifFalse)
+{
+    emit(IrOp::BRANCH, { condition })->targets = { ifTrue, ifFalse };
+    m_function->addEdge(m_current, ifTrue);
+    m_function->addEdge(m_current, ifFalse);
+}
+
+void IrBuilder::jump(IrBlock* target)
+{
+    emit(IrOp::JUMP)->targets = { target };
+    m_function->addEdge(m_current, target);
+}
+
+void IrBuilder::startUnreachable()
+{
+    m_current = newBlock();
+    seal(m_current);
+}
+
+void IrBuilder::writeVariable(size_t slot, IrBlock* block, IrInstr* value)
+{
+    if (slot >= m_blocks[block->id].defs.size())
+    {
+        fail();
+        return;
+    }
+
+    m_blocks[block->id].defs[slot] = value;
+}
+
+IrInstr* IrBuilder::readVariable(size_t slot, IrBlock* block)
+{
+    if (slot >= m_blocks[block->id].defs.size())
+    {
+        return fail();
+    }
+
+    if (const auto value = m_blocks[block->id].defs[slot])
+    {
+        return value;
+    }
+
+    return readVariableRecursive(slot, block);
+}
+
+IrInstr* IrBuilder::readVariableRecursive(size_t slot, IrBlock* block)
+{
+    auto& state = m_blocks[block->id];
+    IrInstr* value;
+
+    if (!state.sealed)
+    {
+        value = m_function->addPhi(block);
+        state.incompletePhis.emplace_back(slot, value);
+    }
+    else if (block->preds.empty())
+    {
+        // Read before any assignment, frames start out cleared.
+        value = constant(Value{});
+    }
+    else if (block->preds.size() == 1)
+    {
+        value = readVariable(slot, block->preds.front());
+    }
+    else
+    {
+        // Breaks cycles through loops.
+        value = m_function->addPhi(block);
+        writeVariable(slot, block, value);
+        addPhiOperands(slot, value);
+    }
+
+    writeVariable(slot, block, value);
+
+    return value;
+}
+
+void IrBuilder::addPhiOperands(size_t slot, IrInstr* phi)
+{
+    // Trivial phis are left to the passes to clean up.
+    for (const auto pred : phi->block->preds)
+    {
+        phi->operands.push_back(readVariable(slot, pred));
+    }
+}
+
+void IrBuilder::seal(IrBlock* block)
+{
+    // Filling the operands may read through loops back into `block`.
+    while (!m_blocks[block->id].incompletePhis.empty())
+    {
+        const auto phis = std::exchange(m_blocks[block->id].incompletePhis, {});
+
+        for (const auto& [slot, phi] : phis)
+        {
+            addPhiOperands(slot, phi);
+        }
+    }
+
+    m_blocks[block->id].sealed = true;
+}
+
+IrInstr* IrBuilder::fail()
+{
+    m_failed = true;
+
+    return constant(Value{});
+}
+
+void pimentel::collectAssignedGlobals(const std::vector<StmtPtr>& stmts, std::unordered_set<Symbol>& globals)
+{
+    AssignedGlobals{ globals }.walk(stmts);
+}
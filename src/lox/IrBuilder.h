@@ -0,0 +1,99 @@
+#pragma once
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "Ir.h"
+#include "Expression.h"
+#include "Statement.h"
+
+namespace pimentel
+{
+    // Lowers the body of a resolved function declaration to SSA IR. The SSA
+    // form is built on the fly from the local slots, following Braun et al.,
+    // "Simple and Efficient Construction of Static Single Assignment Form".
+    // Functions using what the IR doesn't model (closures, upvalues, scopes
+    // that need an environment of their own) are left to the tree-walker.
+    class IrBuilder
+    {
+    public:
+        IrBuilder(const FunctionDeclStmt& declaration);
+        ~IrBuilder() = default;
+
+        // Null when the function can't be lowered.
+        std::unique_ptr<IrFunction> build();
+
+    private:
+        void lower(const std::vector<StmtPtr>& stmts);
+        void lower(Statement& stmt);
+        IrInstr* lower(Expression& expr);
+
+        void visit(ExpressionStmt& stmt);
+        void visit(PrintStmt& stmt);
+        void visit(VarStmt& stmt);
+        void visit(BlockStmt& stmt);
+        void visit(IfStmt& stmt);
+        void visit(WhileStmt& stmt);
+        void visit(BreakStmt& stmt);
+        void visit(ForStmt& stmt);
+        void visit(FunctionDeclStmt& stmt);
+        void visit(ReturnStmt& stmt);
+
+        IrInstr* visit(Binary& expr);
+        IrInstr* visit(Grouping& expr);
+        IrInstr* visit(Literal& expr);
+        IrInstr* visit(Unary& expr);
+        IrInstr* visit(Variable& expr);
+        IrInstr* visit(Assignment& expr);
+        IrInstr* visit(Logical& expr);
+        IrInstr* visit(Call& expr);
+        IrInstr* visit(Indexing& expr);
+
+        IrInstr* lowerCall(Call& expr, bool tail);
+
+        IrInstr* emit(IrOp op, std::vector<IrInstr*> operands = {});
+        // Constants all live at the top of the entry block, which dominates
+        // every use.
+        IrInstr* constant(Value value);
+
+        IrBlock* newBlock();
+        void branch(IrInstr* condition, IrBlock* ifTrue, IrBlock* ifFalse);
+        void jump(IrBlock* target);
+        // Code after a return or break goes to a block nothing jumps to.
+        void startUnreachable();
+
+        void writeVariable(size_t slot, IrBlock* block, IrInstr* value);
+        IrInstr* readVariable(size_t slot, IrBlock* block);
+        IrInstr* readVariableRecursive(size_t slot, IrBlock* block);
+        void addPhiOperands(size_t slot, IrInstr* phi);
+        // No predecessor will be added to `block` anymore.
+        void seal(IrBlock* block);
+
+        // Marks the function as not lowerable.
+        IrInstr* fail();
+
+    private:
+        struct BlockState
+        {
+            bool sealed = false;
+            // Value of each slot at the end of the block, if assigned in it.
+            std::vector<IrInstr*> defs;
+            std::vector<std::pair<size_t, IrInstr*>> incompletePhis;
+        };
+
+        const FunctionDeclStmt& m_declaration;
+        std::unique_ptr<IrFunction> m_function;
+        IrBlock* m_current = nullptr;
+        std::vector<BlockState> m_blocks;
+        std::unordered_map<uint64_t, IrInstr*> m_constants;
+        size_t m_constantCount = 0;
+        // Exit block of each loop being lowered.
+        std::vector<IrBlock*> m_breakTargets;
+        bool m_failed = false;
+    };
+
+    // Adds the globals `stmts` assign to, the others keep the value they are
+    // first defined with.
+    void collectAssignedGlobals(const std::vector<StmtPtr>& stmts, std::unordered_set<Symbol>& globals);
+}
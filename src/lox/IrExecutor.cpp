@@ -0,0 +1,987 @@
+#include "IrExecutor.h"
+#include "IrBuilder.h"
+#include "Interpreter.h"
+#include "UserFunction.h"
+#include "ValueUtils.h"
+#include "ErrorManager.h"
+#include "LoxString.h"
+#include "Arithmetic.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+
+using namespace pimentel;
+
+namespace
+{
+    bool hasValue(IrOp op)
+    {
+        return !isTerminator(op) && op != IrOp::PRINT && op != IrOp::STORE_GLOBAL;
+    }
+
+    // Unboxed code keeps numbers as doubles, the rest of the engine expects
+    // integral ones as integers.
+    Value box(const Value& value)
+    {
+        return value.isDouble() ? Value::number(value.asDouble()) : value;
+    }
+
+    double secondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+IrExecutor::IrExecutor(Interpreter& interpreter, GlobalTable& globals, std::ostream& printStream)
+    :
+    m_interpreter(interpreter),
+    m_globals(globals),
+    m_printStream(printStream),
+    m_registers(REGISTER_STACK_SIZE)
+{
+    Heap::get().addRootSource(this);
+}
+
+IrExecutor::~IrExecutor()
+{
+    Heap::get().removeRootSource(this);
+}
+
+bool IrExecutor::setJit(const JitOptions& options)
+{
+    m_jit.reset();
+
+    if (options.mode == JitMode::OFF)
+    {
+        return true;
+    }
+
+    if (!Jit::supported())
+    {
+        return false;
+    }
+
+    m_jit = std::make_unique<Jit>(*this, options);
+    return true;
+}
+
+void IrExecutor::addProgram(const Program& program)
+{
+    std::unordered_set<Symbol> assigned;
+    collectAssignedGlobals(program.stmts, assigned);
+
+    std::vector<const FunctionDeclStmt*> stale;
+
+    for (const auto symbol : assigned)
+    {
+        if (!m_assigned.insert(symbol).second)
+        {
+            continue;
+        }
+
+        for (const auto& [declaration, entry] : m_entries)
+        {
+            if (entry->constantGlobals.contains(symbol))
+            {
+                stale.push_back(declaration);
+            }
+        }
+    }
+
+    while (!stale.empty())
+    {
+        const auto found = m_entries.find(stale.back());
+        stale.pop_back();
+
+        if (found != m_entries.end())
+        {
+            stale.insert(stale.end(), found->second->dependents.begin(), found->second->dependents.end());
+            m_entries.erase(found);
+        }
+    }
+
+    // Native code of dropped functions stays in the cache until nothing
+    // compiled is left.
+    if (m_jit && m_entries.empty())
+    {
+        m_jit->reset();
+    }
+}
+
+bool IrExecutor::run(UserFunction& function, Environment* frame, Value& result)
+{
+    const auto& entry = entryFor(function);
+
+    if (!entry.code || m_top + entry.code->registerCount > m_registers.size())
+    {
+        return false;
+    }
+
+    // Native code checks the arguments itself.
+    if (entry.code->unboxed && entry.code->unboxed->boxedNative)
+    {
+        for (size_t i = 0; i < function.arity(); i++)
+        {
+            m_registers[m_top + i] = frame->getAt(0, i);
+        }
+
+        const auto bits = runNative(entry.code->unboxed->boxedNative);
+
+        if (bits != Jit::BAIL)
+        {
+            result = box(Value::fromBits(bits));
+            return true;
+        }
+    }
+
+    // Numbers run the unboxed code, when there is some.
+    auto unbox = entry.code->unboxed != nullptr;
+
+    for (size_t i = 0; unbox && i < function.arity(); i++)
+    {
+        unbox = frame->getAt(0, i).isNumber();
+    }
+
+    for (size_t i = 0; i < function.arity(); i++)
+    {
+        const auto arg = frame->getAt(0, i);
+        m_registers[m_top + i] = unbox ? Value{ arg.asNumber() } : arg;
+    }
+
+    result = unbox ? box(execute<true>(*entry.code->unboxed)) : execute<false>(*entry.code);
+
+    return true;
+}
+
+std::optional<Value> IrExecutor::globalValue(Symbol name)
+{
+    if (m_compiling)
+    {
+        m_compiling->constantGlobals.insert(name);
+    }
+
+    if (const auto value = m_globals.find(name))
+    {
+        return *value;
+    }
+
+    return std::nullopt;
+}
+
+bool IrExecutor::isAssigned(Symbol name)
+{
+    if (m_assigned.contains(name))
+    {
+        return true;
+    }
+
+    if (m_compiling)
+    {
+        m_compiling->constantGlobals.insert(name);
+    }
+
+    return false;
+}
+
+const IrFunction* IrExecutor::inlineCandidate(const Value& callee)
+{
+    const auto function = callee.isCallable() ? callee.asCallable()->asUserFunction() : nullptr;
+
+    if (!function)
+    {
+        return nullptr;
+    }
+
+    auto& entry = entryFor(*function);
+
+    if (entry.compiling || m_interpreter.memoizes(*function))
+    {
+        return nullptr;
+    }
+
+    addDependent(entry, m_compiling ? m_compiling->declaration.get() : nullptr);
+    return entry.ir.get();
+}
+
+std::optional<IrType> IrExecutor::numericResult(const Value& callee)
+{
+    const auto function = callee.isCallable() ? callee.asCallable()->asUserFunction() : nullptr;
+
+    if (!function)
+    {
+        return std::nullopt;
+    }
+
+    auto& entry = entryFor(*function);
+
+    // While being specialized a function assumes its own return type, a
+    // wrong guess fails its specialization.
+    if (&entry == m_specializing || entry.unboxed)
+    {
+        addDependent(entry, m_compiling ? m_compiling->declaration.get() : nullptr);
+        return entry.returnType;
+    }
+
+    return std::nullopt;
+}
+
+const IrCode* IrExecutor::callTarget(const IrCode& code, uint32_t instr)
+{
+    // Unboxed code only calls constants.
+    const auto& call = code.instrs[instr];
+    return resolve(code, code.callSites[call.c], code.constants[call.a - code.arity], true, call.flag);
+}
+
+uint64_t IrExecutor::call(const IrCode& code, uint32_t instr, const uint64_t* args)
+{
+    const auto& call = code.instrs[instr];
+    const auto& site = code.callSites[call.c];
+    const auto& callee = code.constants[call.a - code.arity];
+    const auto target = resolve(code, site, callee, true, call.flag);
+
+    if (target && m_top + target->registerCount <= m_registers.size())
+    {
+        for (size_t i = 0; i < site.argCount; i++)
+        {
+            m_registers[m_top + i] = Value::fromBits(args[i]);
+        }
+
+        return target->native ? runNative(target->native) : execute<true>(*target).bits();
+    }
+
+    std::vector<Value> argValues(site.argCount);
+
+    for (size_t i = 0; i < site.argCount; i++)
+    {
+        argValues[i] = box(Value::fromBits(args[i]));
+    }
+
+    const auto result = m_interpreter.callValue(callee, argValues);
+    return (result.isNumber() ? Value{ result.asNumber() } : result).bits();
+}
+
+uint64_t IrExecutor::interpret(const IrCode& code, const uint64_t* args)
+{
+    if (m_top + code.registerCount > m_registers.size())
+    {
+        ErrorManager::get().report(0, "Stack overflow.");
+        return Value{}.bits();
+    }
+
+    for (size_t i = 0; i < code.arity; i++)
+    {
+        m_registers[m_top + i] = Value::fromBits(args[i]);
+    }
+
+    return execute<true>(code).bits();
+}
+
+void IrExecutor::print(uint64_t value)
+{
+    printValue(m_printStream, box(Value::fromBits(value)));
+}
+
+void IrExecutor::storeGlobal(const IrCode& code, uint32_t instr, uint64_t value)
+{
+    const auto& symbol = code.symbols[code.instrs[instr].c];
+
+    if (const auto global = m_globals.find(symbol))
+    {
+        *global = box(Value::fromBits(value));
+        return;
+    }
+
+    ErrorManager::get().report(0, "Undefined variable '" + symbol.name() + "'.");
+}
+
+void IrExecutor::markRoots(Heap& heap)
+{
+    for (size_t i = 0; i < m_top; i++)
+    {
+        heap.mark(m_registers[i]);
+    }
+
+    // The IR is kept for inlining, its constants may not all be in the code.
+    for (const auto& [declaration, entry] : m_entries)
+    {
+        if (entry->ir)
+        {
+            for (const auto& constant : entry->ir->constants())
+            {
+                heap.mark(constant);
+            }
+
+            for (const auto& constant : entry->code->constants)
+            {
+                heap.mark(constant);
+            }
+        }
+    }
+}
+
+void IrExecutor::printStats(std::ostream& stream) const
+{
+    stream << "[IR] functions compiled: " << m_compiled << " left to the tree-walker: " << m_notLowered << std::endl;
+    stream << "[IR] fully numeric functions:";
+
+    for (const auto& name : m_numeric)
+    {
+        stream << " " << name;
+    }
+
+    stream << std::endl;
+    m_pipeline.printStats(stream);
+
+    if (m_jit)
+    {
+        m_jit->printStats(stream);
+    }
+}
+
+void IrExecutor::addDependent(Entry& entry, const FunctionDeclStmt* dependent)
+{
+    if (dependent && dependent != entry.declaration.get())
+    {
+        entry.dependents.insert(dependent);
+    }
+}
+
+IrExecutor::Entry& IrExecutor::entryFor(UserFunction& function)
+{
+    const auto& declaration = function.declaration();
+    auto& entry = m_entries[declaration.get()];
+
+    if (!entry)
+    {
+        entry = std::make_unique<Entry>();
+        entry->declaration = declaration;
+        compile(*entry);
+    }
+
+    return *entry;
+}
+
+void IrExecutor::compile(Entry& entry)
+{
+    entry.compiling = true;
+    const auto previous = std::exchange(m_compiling, &entry);
+
+    auto start = std::chrono::steady_clock::now();
+    auto ir = IrBuilder{ *entry.declaration }.build();
+    m_pipeline.record("lower", secondsSince(start), ir ? ir->instructionCount() : 0);
+
+    if (!ir)
+    {
+        m_notLowered++;
+        entry.compiling = false;
+        m_compiling = previous;
+        return;
+    }
+
+    m_pipeline.run(*ir, *this);
+
+    start = std::chrono::steady_clock::now();
+    entry.code = generate(*ir, nullptr);
+    m_pipeline.record("codegen", secondsSince(start), entry.code->instrs.size());
+
+    start = std::chrono::steady_clock::now();
+    specialize(entry, *ir);
+    m_pipeline.record("numeric", secondsSince(start), entry.unboxed ? 1 : 0);
+
+    if (m_dump)
+    {
+        ir->dump(m_printStream);
+
+        if (entry.unboxed)
+        {
+            m_printStream << "; fully numeric, returns " << (entry.returnType == IrType::NUMBER ? "number" : "bool")
+                << std::endl;
+        }
+    }
+
+    entry.ir = std::move(ir);
+    entry.compiling = false;
+    m_compiling = previous;
+    m_compiled++;
+}
+
+void IrExecutor::specialize(Entry& entry, IrFunction& function)
+{
+    const auto previous = std::exchange(m_specializing, &entry);
+
+    for (const auto assumed : { IrType::NUMBER, IrType::BOOL })
+    {
+        entry.returnType = assumed;
+        const auto numeric = inferNumeric(function, *this);
+
+        if (numeric && numeric->returnType == assumed)
+        {
+            entry.unboxed = generate(function, &numeric->types);
+            entry.code->unboxed = entry.unboxed.get();
+            m_numeric.push_back(function.name());
+
+            if (m_jit && m_jit->mode() == JitMode::EAGER)
+            {
+                compileNative(*entry.unboxed);
+            }
+
+            break;
+        }
+    }
+
+    m_specializing = previous;
+}
+
+std::unique_ptr<IrCode> IrExecutor::generate(IrFunction& function, const std::vector<IrType>* numericTypes)
+{
+    function.splitCriticalEdges();
+
+    auto code = std::make_unique<IrCode>();
+    code->arity = function.arity();
+    code->name = function.name();
+    code->declaration = m_compiling ? m_compiling->declaration.get() : nullptr;
+    const auto unboxed = numericTypes != nullptr;
+
+    const auto order = function.reversePostorder();
+    std::vector<uint32_t> registers(function.idBound());
+    auto next = static_cast<uint32_t>(function.arity());
+
+    for (const auto block : order)
+    {
+        for (const auto instr : block->instrs)
+        {
+            if (instr->op == IrOp::PARAMETER)
+            {
+                registers[instr->id] = static_cast<uint32_t>(instr->parameter);
+            }
+            else if (instr->op == IrOp::CONSTANT)
+            {
+                registers[instr->id] = next++;
+                code->constants.push_back(unboxed && instr->constant.isNumber() ?
+                    Value{ instr->constant.asNumber() } : instr->constant);
+            }
+        }
+    }
+
+    for (const auto block : order)
+    {
+        for (const auto instr : block->instrs)
+        {
+            if (hasValue(instr->op) && instr->op != IrOp::PARAMETER && instr->op != IrOp::CONSTANT)
+            {
+                registers[instr->id] = next++;
+            }
+        }
+    }
+
+    // Breaks cycles among the moves of phis.
+    const auto temp = next++;
+    code->registerCount = next;
+
+    const auto reg = [&registers](const IrInstr* instr) { return registers[instr->id]; };
+    const auto isBoolean = [unboxed, numericTypes](const IrInstr* instr) {
+        return unboxed && (*numericTypes)[instr->id] == IrType::BOOL;
+    };
+    const auto emit = [&code](IrOp op, uint32_t dst = 0, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0, bool flag = false) {
+        code->instrs.push_back(IrCode::Instr{ op, flag, dst, a, b, c });
+    };
+
+    // Copies the values `to`'s phis take when coming from `from`, all at once.
+    const auto emitPhiMoves = [&](const IrBlock* from, const IrBlock* to) {
+        const auto predIndex = static_cast<size_t>(std::find(to->preds.begin(), to->preds.end(), from) - to->preds.begin());
+        std::vector<std::pair<uint32_t, uint32_t>> moves;
+
+        for (const auto instr : to->instrs)
+        {
+            if (instr->op != IrOp::PHI)
+            {
+                break;
+            }
+
+            if (reg(instr) != reg(instr->operands[predIndex]))
+            {
+                moves.emplace_back(reg(instr), reg(instr->operands[predIndex]));
+            }
+        }
+
+        while (!moves.empty())
+        {
+            const auto ready = std::find_if(moves.begin(), moves.end(), [&moves](const auto& move) {
+                return std::none_of(moves.begin(), moves.end(), [&move](const auto& other) { return other.second == move.first; });
+            });
+
+            if (ready != moves.end())
+            {
+                emit(IrOp::MOVE, ready->first, ready->second);
+                moves.erase(ready);
+                continue;
+            }
+
+            // Every destination is still to be read: save one of them.
+            const auto saved = moves.front().first;
+            emit(IrOp::MOVE, temp, saved);
+
+            for (auto& move : moves)
+            {
+                if (move.second == saved)
+                {
+                    move.second = temp;
+                }
+            }
+        }
+    };
+
+    std::vector<uint32_t> blockStart(function.blocks().size());
+    // Jumps and branches to patch once every block has a start.
+    std::vector<std::pair<size_t, const IrInstr*>> pending;
+
+    for (size_t position = 0; position < order.size(); position++)
+    {
+        const auto block = order[position];
+        const auto following = position + 1 < order.size() ? order[position + 1] : nullptr;
+        blockStart[block->id] = static_cast<uint32_t>(code->instrs.size());
+
+        if (block->preds.size() == 1)
+        {
+            emitPhiMoves(block->preds.front(), block);
+        }
+
+        for (size_t i = 0; i < block->instrs.size(); i++)
+        {
+            const auto instr = block->instrs[i];
+
+            switch (instr->op)
+            {
+            case IrOp::CONSTANT:
+            case IrOp::PARAMETER:
+            case IrOp::PHI:
+            case IrOp::MOVE:
+                break;
+            case IrOp::NEGATE:
+            case IrOp::IS_STRING:
+                emit(instr->op, reg(instr), reg(instr->operands[0]));
+                break;
+            case IrOp::NOT:
+            case IrOp::TRUTHY:
+                emit(instr->op, reg(instr), reg(instr->operands[0]), 0, 0, isBoolean(instr->operands[0]));
+                break;
+            case IrOp::SAME:
+                emit(instr->op, reg(instr), reg(instr->operands[0]), reg(instr->operands[1]));
+                break;
+            case IrOp::INDEX:
+                emit(instr->op, reg(instr), reg(instr->operands[0]), reg(instr->operands[1]), 0, !instr->checked);
+                break;
+            case IrOp::LOAD_GLOBAL:
+                emit(instr->op, reg(instr), 0, 0, static_cast<uint32_t>(code->symbols.size()), !instr->checked);
+                code->symbols.push_back(instr->symbol);
+                break;
+            case IrOp::STORE_GLOBAL:
+                emit(instr->op, 0, reg(instr->operands[0]), 0, static_cast<uint32_t>(code->symbols.size()), !instr->checked);
+                code->symbols.push_back(instr->symbol);
+                break;
+            case IrOp::CALL:
+            {
+                const auto argCount = static_cast<uint32_t>(instr->operands.size() - 1);
+                code->callSites.push_back(IrCode::CallSite{ static_cast<uint32_t>(code->callArgs.size()), argCount,
+                    instr->operands[0]->op == IrOp::CONSTANT });
+
+                for (size_t arg = 1; arg < instr->operands.size(); arg++)
+                {
+                    code->callArgs.push_back(reg(instr->operands[arg]));
+                }
+
+                // Only a call whose value is returned right away may replace
+                // the caller's frame.
+                const auto tail = instr->tail && i + 1 < block->instrs.size() &&
+                    block->instrs[i + 1]->op == IrOp::RETURN && block->instrs[i + 1]->operands[0] == instr;
+
+                emit(instr->op, reg(instr), reg(instr->operands[0]), 0,
+                    static_cast<uint32_t>(code->callSites.size() - 1), tail);
+                break;
+            }
+            case IrOp::PRINT:
+                emit(instr->op, 0, reg(instr->operands[0]));
+                break;
+            case IrOp::JUMP:
+            {
+                const auto target = instr->targets[0];
+
+                if (target->preds.size() > 1)
+                {
+                    emitPhiMoves(block, target);
+                }
+
+                if (target != following)
+                {
+                    pending.emplace_back(code->instrs.size(), instr);
+                    emit(IrOp::JUMP);
+                }
+                break;
+            }
+            case IrOp::BRANCH:
+                pending.emplace_back(code->instrs.size(), instr);
+                emit(IrOp::BRANCH, 0, reg(instr->operands[0]), 0, 0, isBoolean(instr->operands[0]));
+                break;
+            case IrOp::RETURN:
+                emit(instr->op, 0, reg(instr->operands[0]));
+                break;
+            default:
+            {
+                // Binary operators. Unboxed code compares booleans by bits.
+                emit(instr->op, reg(instr), reg(instr->operands[0]), reg(instr->operands[1]),
+                    static_cast<uint32_t>(code->tokens.size()), isBoolean(instr->operands[0]));
+                code->tokens.push_back(instr->token);
+                break;
+            }
+            }
+        }
+    }
+
+    for (const auto& [index, instr] : pending)
+    {
+        auto& emitted = code->instrs[index];
+        emitted.dst = blockStart[instr->targets[0]->id];
+
+        if (instr->op == IrOp::BRANCH)
+        {
+            emitted.b = blockStart[instr->targets[1]->id];
+        }
+    }
+
+    return code;
+}
+
+const IrCode* IrExecutor::resolve(const IrCode& caller, const IrCode::CallSite& site, const Value& callee,
+    bool unboxed, bool tail)
+{
+    if (site.target)
+    {
+        return site.target;
+    }
+
+    const auto function = callee.isCallable() ? callee.asCallable()->asUserFunction() : nullptr;
+
+    // Memoized functions are called through the interpreter, which
+    // caches their results. Tail calls aren't cached, as in the
+    // interpreter, and replace the caller's frame instead of nesting.
+    if (!function || function->arity() != site.argCount || (!tail && m_interpreter.memoizes(*function)))
+    {
+        return nullptr;
+    }
+
+    auto& entry = entryFor(*function);
+    const auto code = unboxed ? entry.unboxed.get() : entry.code.get();
+
+    // Constants are roots, the callee can't be collected and its address
+    // reused. Native code calls the target it was compiled with too.
+    if (site.constantCallee)
+    {
+        site.target = code;
+        addDependent(entry, caller.declaration);
+    }
+
+    return code;
+}
+
+void IrExecutor::warmUp(const IrCode& code)
+{
+    if (m_jit && m_jit->mode() == JitMode::ON && ++code.hotness == Jit::HOT_THRESHOLD)
+    {
+        compileNative(code);
+    }
+}
+
+void IrExecutor::compileNative(const IrCode& code)
+{
+    const auto start = std::chrono::steady_clock::now();
+    const auto compiled = m_jit->compile(code);
+    m_pipeline.record("native", secondsSince(start), compiled ? 1 : 0);
+}
+
+uint64_t IrExecutor::runNative(JitEntry native)
+{
+    return native(reinterpret_cast<const uint64_t*>(m_registers.data() + m_top), m_jit->runtime());
+}
+
+template<bool Unboxed>
+Value IrExecutor::execute(const IrCode& entryCode)
+{
+    auto code = &entryCode;
+    const auto base = m_top;
+    const auto regs = m_registers.data() + base;
+
+    const auto enter = [&]() {
+        std::copy(code->constants.begin(), code->constants.end(), regs + code->arity);
+        std::fill(regs + code->arity + code->constants.size(), regs + code->registerCount, Value{});
+        m_top = base + code->registerCount;
+        Heap::get().safepoint();
+
+        if constexpr (Unboxed)
+        {
+            warmUp(*code);
+        }
+    };
+
+    enter();
+
+    const IrCode::Instr* instrs = code->instrs.data();
+    size_t pc = 0;
+
+    while (true)
+    {
+        const auto& instr = instrs[pc++];
+
+        // Unboxed code only sees numbers where it computes them.
+        const auto binary = [&](auto unboxedOp, auto numberOp) {
+            const auto& left = regs[instr.a];
+            const auto& right = regs[instr.b];
+
+            if constexpr (Unboxed)
+            {
+                regs[instr.dst] = Value{ unboxedOp(left.asDouble(), right.asDouble()) };
+            }
+            else
+            {
+                regs[instr.dst] = left.isNumber() && right.isNumber() ?
+                    Value{ numberOp(left, right) } : binaryOperation(code->tokens[instr.c], left, right);
+            }
+        };
+
+        switch (instr.op)
+        {
+        case IrOp::ADD:
+            binary(std::plus<>{}, [](const Value& l, const Value& r) { return numberAdd(l, r); });
+            break;
+        case IrOp::SUBTRACT:
+            binary(std::minus<>{}, [](const Value& l, const Value& r) { return numberSubtract(l, r); });
+            break;
+        case IrOp::MULTIPLY:
+            binary(std::multiplies<>{}, [](const Value& l, const Value& r) { return numberMultiply(l, r); });
+            break;
+        case IrOp::DIVIDE:
+            binary(std::divides<>{}, [](const Value& l, const Value& r) { return numberDivide(l, r); });
+            break;
+        case IrOp::GREATER:
+            binary(std::greater<>{}, [](const Value& l, const Value& r) { return numberGreater(l, r); });
+            break;
+        case IrOp::GREATER_EQUAL:
+            binary(std::greater_equal<>{}, [](const Value& l, const Value& r) { return numberGreaterEqual(l, r); });
+            break;
+        case IrOp::LESS:
+            binary(std::less<>{}, [](const Value& l, const Value& r) { return numberLess(l, r); });
+            break;
+        case IrOp::LESS_EQUAL:
+            binary(std::less_equal<>{}, [](const Value& l, const Value& r) { return numberLessEqual(l, r); });
+            break;
+        case IrOp::EQUAL:
+            if (Unboxed && instr.flag)
+            {
+                regs[instr.dst] = Value{ regs[instr.a].bits() == regs[instr.b].bits() };
+                break;
+            }
+            binary(std::equal_to<>{}, [](const Value& l, const Value& r) { return numberEqual(l, r); });
+            break;
+        case IrOp::NOT_EQUAL:
+            if (Unboxed && instr.flag)
+            {
+                regs[instr.dst] = Value{ regs[instr.a].bits() != regs[instr.b].bits() };
+                break;
+            }
+            binary(std::not_equal_to<>{}, [](const Value& l, const Value& r) { return !numberEqual(l, r); });
+            break;
+        case IrOp::NEGATE:
+            if constexpr (Unboxed)
+            {
+                regs[instr.dst] = Value{ -regs[instr.a].asDouble() };
+            }
+            else
+            {
+                regs[instr.dst] = regs[instr.a].isNumber() ? numberNegate(regs[instr.a]) : Value{};
+            }
+            break;
+        case IrOp::NOT:
+            regs[instr.dst] = Value{ !isTruthy(regs[instr.a]) };
+            break;
+        case IrOp::TRUTHY:
+            regs[instr.dst] = Value{ isTruthy(regs[instr.a]) };
+            break;
+        case IrOp::SAME:
+            regs[instr.dst] = Value{ regs[instr.a].bits() == regs[instr.b].bits() };
+            break;
+        case IrOp::IS_STRING:
+            regs[instr.dst] = Value{ regs[instr.a].isString() };
+            break;
+        case IrOp::INDEX:
+        {
+            const auto& indexee = regs[instr.a];
+            const auto& index = regs[instr.b];
+
+            if (instr.flag)
+            {
+                regs[instr.dst] = singleCharString(static_cast<unsigned char>(indexee.asString()->str()[index.asInt()]));
+            }
+            else if (indexee.isString() && index.isInt() && index.asInt() >= 0 &&
+                static_cast<size_t>(index.asInt()) < indexee.asString()->str().size())
+            {
+                regs[instr.dst] = singleCharString(static_cast<unsigned char>(indexee.asString()->str()[index.asInt()]));
+            }
+            else
+            {
+                regs[instr.dst] = indexOperation(indexee, index);
+            }
+            break;
+        }
+        case IrOp::LOAD_GLOBAL:
+        {
+            const auto& symbol = code->symbols[instr.c];
+
+            if (const auto global = m_globals.find(symbol))
+            {
+                regs[instr.dst] = *global;
+                break;
+            }
+
+            ErrorManager::get().report(0, "Variable does not exist: " + symbol.name());
+            regs[instr.dst] = Value{};
+            break;
+        }
+        case IrOp::STORE_GLOBAL:
+        {
+            const auto& symbol = code->symbols[instr.c];
+
+            if (const auto global = m_globals.find(symbol))
+            {
+                *global = Unboxed ? box(regs[instr.a]) : regs[instr.a];
+                break;
+            }
+
+            ErrorManager::get().report(0, "Undefined variable '" + symbol.name() + "'.");
+            break;
+        }
+        case IrOp::CALL:
+        {
+            const auto& site = code->callSites[instr.c];
+            const auto callee = regs[instr.a];
+            const auto args = code->callArgs.data() + site.firstArg;
+            const auto target = resolve(*code, site, callee, Unboxed, instr.flag);
+
+            if (target && instr.flag && m_top + site.argCount <= m_registers.size() &&
+                base + target->registerCount <= m_registers.size())
+            {
+                // The arguments may be in the registers they are moved to.
+                for (size_t i = 0; i < site.argCount; i++)
+                {
+                    m_registers[m_top + i] = regs[args[i]];
+                }
+
+                std::copy_n(m_registers.begin() + static_cast<std::ptrdiff_t>(m_top), site.argCount, regs);
+
+                code = target;
+                instrs = code->instrs.data();
+                pc = 0;
+                enter();
+                break;
+            }
+
+            if (target && m_top + target->registerCount <= m_registers.size())
+            {
+                // Native code checks boxed arguments itself.
+                const auto native = Unboxed ? target->native : (target->unboxed ? target->unboxed->boxedNative : nullptr);
+
+                if (native)
+                {
+                    for (size_t i = 0; i < site.argCount; i++)
+                    {
+                        m_registers[m_top + i] = regs[args[i]];
+                    }
+
+                    const auto bits = runNative(native);
+
+                    if (bits != Jit::BAIL)
+                    {
+                        regs[instr.dst] = Unboxed ? Value::fromBits(bits) : box(Value::fromBits(bits));
+                        break;
+                    }
+                }
+
+                bool unbox = false;
+
+                if constexpr (!Unboxed)
+                {
+                    // Numbers run the callee's unboxed code, when it has some.
+                    unbox = target->unboxed != nullptr;
+
+                    for (size_t i = 0; unbox && i < site.argCount; i++)
+                    {
+                        unbox = regs[args[i]].isNumber();
+                    }
+                }
+
+                for (size_t i = 0; i < site.argCount; i++)
+                {
+                    const auto& arg = regs[args[i]];
+                    m_registers[m_top + i] = unbox ? Value{ arg.asNumber() } : arg;
+                }
+
+                const auto result = unbox ? box(execute<true>(*target->unboxed)) : execute<Unboxed>(*target);
+                regs[instr.dst] = result;
+                break;
+            }
+
+            std::vector<Value> argValues(site.argCount);
+
+            for (size_t i = 0; i < site.argCount; i++)
+            {
+                argValues[i] = Unboxed ? box(regs[args[i]]) : regs[args[i]];
+            }
+
+            const auto result = m_interpreter.callValue(callee, argValues);
+            regs[instr.dst] = Unboxed && result.isNumber() ? Value{ result.asNumber() } : result;
+            break;
+        }
+        case IrOp::PRINT:
+            printValue(m_printStream, Unboxed ? box(regs[instr.a]) : regs[instr.a]);
+            break;
+        case IrOp::JUMP:
+            if (instr.dst < pc)
+            {
+                Heap::get().safepoint();
+
+                if constexpr (Unboxed)
+                {
+                    warmUp(*code);
+                }
+            }
+            pc = instr.dst;
+            break;
+        case IrOp::BRANCH:
+        {
+            const auto target = isTruthy(regs[instr.a]) ? instr.dst : instr.b;
+
+            if (target < pc)
+            {
+                Heap::get().safepoint();
+
+                if constexpr (Unboxed)
+                {
+                    warmUp(*code);
+                }
+            }
+            pc = target;
+            break;
+        }
+        case IrOp::RETURN:
+        {
+            const auto result = regs[instr.a];
+            m_top = base;
+            return result;
+        }
+        case IrOp::MOVE:
+            regs[instr.dst] = regs[instr.a];
+            break;
+        default:
+            break;
+        }
+    }
+}
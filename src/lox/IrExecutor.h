@@ -0,0 +1,206 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "Ir.h"
+#include "IrPasses.h"
+#include "Jit.h"
+#include "Heap.h"
+#include "GlobalTable.h"
+#include "Program.h"
+
+namespace pimentel
+{
+    class Interpreter;
+    class Environment;
+    struct UserFunction;
+
+    // Optimized IR of a function laid out for IrExecutor: every SSA value
+    // gets a register of the frame (the parameters first, then the
+    // constants), phis become moves at the end of their predecessors and
+    // blocks follow each other in reverse postorder.
+    struct IrCode
+    {
+        struct Instr
+        {
+            IrOp op;
+            // INDEX, LOAD_GLOBAL, STORE_GLOBAL: the checks can be skipped.
+            // CALL: a tail call, made in the caller's frame.
+            // EQUAL, NOT_EQUAL, NOT, TRUTHY, BRANCH in unboxed code: the
+            // operands are booleans, else numbers.
+            bool flag;
+            // Register written. JUMP: target. BRANCH: target when truthy.
+            uint32_t dst;
+            uint32_t a;
+            // BRANCH: target when falsy.
+            uint32_t b;
+            // Binary operators: index of the token. Globals: index of the
+            // symbol. CALL: index of the call site.
+            uint32_t c;
+        };
+
+        struct CallSite
+        {
+            uint32_t firstArg;
+            uint32_t argCount;
+            // The callee is a constant, the code it resolves to never changes.
+            bool constantCallee;
+            mutable const IrCode* target = nullptr;
+        };
+
+        std::vector<Instr> instrs;
+        // Loaded in the registers following the parameters.
+        std::vector<Value> constants;
+        std::vector<CallSite> callSites;
+        // Registers of the arguments of every call site.
+        std::vector<uint32_t> callArgs;
+        std::vector<Symbol> symbols;
+        std::vector<Token> tokens;
+        size_t arity = 0;
+        size_t registerCount = 0;
+        // Code of the same function running on unboxed numbers, for calls
+        // whose arguments are all numbers. Registers then hold doubles.
+        const IrCode* unboxed = nullptr;
+
+        // Of the function.
+        std::string name;
+        // Keys the function's entry in the IrExecutor.
+        const FunctionDeclStmt* declaration = nullptr;
+        // Unboxed code: calls and backward jumps run so far, see
+        // Jit::HOT_THRESHOLD.
+        mutable uint32_t hotness = 0;
+        // Unboxed code once the Jit compiled it, see there.
+        mutable JitEntry native = nullptr;
+        mutable JitEntry boxedNative = nullptr;
+    };
+
+    // Runs the bodies of UserFunctions as optimized IR for the Interpreter.
+    // A function is lowered, optimized and laid out the first time it is
+    // called; functions the IR can't express keep running on the tree-walker.
+    // Values live in a fixed stack of registers, one window per active call,
+    // which is a root of the heap.
+    //
+    // With a Jit, unboxed code goes native once hot; native frames only hold
+    // numbers and booleans and live on the machine stack.
+    class IrExecutor : public IrContext, public RootSource, public JitHost
+    {
+    public:
+        IrExecutor(Interpreter& interpreter, GlobalTable& globals, std::ostream& printStream);
+        IrExecutor(const IrExecutor&) = delete;
+        IrExecutor& operator=(const IrExecutor&) = delete;
+        ~IrExecutor();
+
+        // Prints the IR of every function once optimized.
+        void setDump(bool dump)
+        {
+            m_dump = dump;
+        }
+
+        // False when the mode isn't OFF but the platform has no JIT.
+        bool setJit(const JitOptions& options);
+
+        // Records the globals `program` assigns. Code compiled so far that
+        // took one of them for a constant is dropped, along with the code
+        // built on it, the rest is kept. Called before the program runs,
+        // never while IR is.
+        void addProgram(const Program& program);
+
+        // Runs `function` with the arguments in `frame`'s first slots. False
+        // when it has no IR, or no room left on the register stack.
+        bool run(UserFunction& function, Environment* frame, Value& result);
+
+        std::optional<Value> globalValue(Symbol name) override;
+        bool isAssigned(Symbol name) override;
+        const IrFunction* inlineCandidate(const Value& callee) override;
+        std::optional<IrType> numericResult(const Value& callee) override;
+
+        const IrCode* callTarget(const IrCode& code, uint32_t instr) override;
+        uint64_t call(const IrCode& code, uint32_t instr, const uint64_t* args) override;
+        uint64_t interpret(const IrCode& code, const uint64_t* args) override;
+        void print(uint64_t value) override;
+        void storeGlobal(const IrCode& code, uint32_t instr, uint64_t value) override;
+
+        void markRoots(Heap& heap) override;
+
+        void printStats(std::ostream& stream) const;
+
+    private:
+        struct Entry
+        {
+            // Keeps the declaration, and the program it belongs to, alive.
+            std::shared_ptr<const FunctionDeclStmt> declaration;
+            // Both null when the function can't be lowered.
+            std::unique_ptr<IrFunction> ir;
+            std::unique_ptr<IrCode> code;
+            // Set when the function is fully numeric.
+            std::unique_ptr<IrCode> unboxed;
+            IrType returnType = IrType::NONE;
+            bool compiling = false;
+            // Globals the passes took for constants while compiling it.
+            std::unordered_set<Symbol> constantGlobals;
+            // Functions whose code was built on this one's: they inlined it,
+            // relied on its return type or call its code directly.
+            std::unordered_set<const FunctionDeclStmt*> dependents;
+        };
+
+        // Compiles the function on first use.
+        Entry& entryFor(UserFunction& function);
+        // Records that the code of `dependent`, when there is one, is built on
+        // `entry`'s.
+        void addDependent(Entry& entry, const FunctionDeclStmt* dependent);
+        void compile(Entry& entry);
+        // Adds unboxed code to `entry` when inferNumeric() proves `function`
+        // fully numeric.
+        void specialize(Entry& entry, IrFunction& function);
+        // Unboxed code when given the types of a fully numeric function.
+        std::unique_ptr<IrCode> generate(IrFunction& function, const std::vector<IrType>* numericTypes);
+
+        // Code to run for a call of `callee` from `site` in `caller`, null to
+        // go through the interpreter. `tail`: the call is a tail call.
+        const IrCode* resolve(const IrCode& caller, const IrCode::CallSite& site, const Value& callee,
+            bool unboxed, bool tail);
+
+        // Runs `code` in a frame starting at m_top, where the caller put the
+        // arguments. Unboxed code returns unboxed values.
+        template<bool Unboxed>
+        Value execute(const IrCode& code);
+
+        // Counts a call or backward jump of unboxed code, compiles it once
+        // hot.
+        void warmUp(const IrCode& code);
+        void compileNative(const IrCode& code);
+        // Runs native code with the Values at m_top as arguments.
+        uint64_t runNative(JitEntry native);
+
+    private:
+        Interpreter& m_interpreter;
+        GlobalTable& m_globals;
+        std::ostream& m_printStream;
+        bool m_dump = false;
+
+        std::unordered_map<const FunctionDeclStmt*, std::unique_ptr<Entry>> m_entries;
+        std::unordered_set<Symbol> m_assigned;
+
+        static constexpr size_t REGISTER_STACK_SIZE = 256 * 1024;
+
+        std::vector<Value> m_registers;
+        size_t m_top = 0;
+
+        IrPipeline m_pipeline;
+        size_t m_compiled = 0;
+        size_t m_notLowered = 0;
+
+        // Entry whose function the passes are working on.
+        Entry* m_compiling = nullptr;
+        Entry* m_specializing = nullptr;
+        std::vector<std::string> m_numeric;
+
+        // Null unless setJit() enabled one.
+        std::unique_ptr<Jit> m_jit;
+    };
+}
@@ -0,0 +1,1456 @@
+#include "IrPasses.h"
+#include "ValueUtils.h"
+#include "LoxString.h"
+#include "Arithmetic.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace pimentel;
+
+namespace
+{
+    // Callees with more instructions aren't inlined.
+    constexpr size_t INLINE_BUDGET = 200;
+    // Nor into callers that grew past this.
+    constexpr size_t MAX_INLINED_SIZE = 2000;
+
+    bool isBinary(IrOp op)
+    {
+        return op >= IrOp::ADD && op <= IrOp::NOT_EQUAL;
+    }
+
+    bool isKnown(IrType type)
+    {
+        return type != IrType::NONE && type != IrType::ANY;
+    }
+
+    IrType typeOf(const Value& value)
+    {
+        switch (value.type())
+        {
+        case ValueType::NUMBER: return IrType::NUMBER;
+        case ValueType::STRING: return IrType::STRING;
+        case ValueType::BOOL: return IrType::BOOL;
+        case ValueType::NIL: return IrType::NIL;
+        default: return IrType::ANY;
+        }
+    }
+
+    IrType join(IrType a, IrType b)
+    {
+        if (a == IrType::NONE)
+        {
+            return b;
+        }
+
+        if (b == IrType::NONE)
+        {
+            return a;
+        }
+
+        return a == b ? a : IrType::ANY;
+    }
+
+    // Mirrors binaryOperation(): same typed numbers, strings and booleans
+    // give a value of a known type, other operands may give the null object.
+    IrType binaryType(IrOp op, IrType left, IrType right)
+    {
+        if (left == IrType::NONE || right == IrType::NONE)
+        {
+            return IrType::NONE;
+        }
+
+        const auto same = left == right;
+        const auto comparable = same && (left == IrType::NUMBER || left == IrType::STRING || left == IrType::BOOL);
+
+        switch (op)
+        {
+        case IrOp::ADD:
+            return same && (left == IrType::NUMBER || left == IrType::STRING) ? left : IrType::ANY;
+        case IrOp::SUBTRACT:
+        case IrOp::MULTIPLY:
+        case IrOp::DIVIDE:
+            return same && left == IrType::NUMBER ? IrType::NUMBER : IrType::ANY;
+        case IrOp::GREATER:
+        case IrOp::GREATER_EQUAL:
+        case IrOp::LESS:
+        case IrOp::LESS_EQUAL:
+            return same && left == IrType::NUMBER ? IrType::BOOL : IrType::ANY;
+        case IrOp::EQUAL:
+            return comparable || (isKnown(left) && isKnown(right) && !same) ? IrType::BOOL : IrType::ANY;
+        case IrOp::NOT_EQUAL:
+            return comparable ? IrType::BOOL : IrType::ANY;
+        default:
+            return IrType::ANY;
+        }
+    }
+
+    IrType resultType(const IrInstr& instr, const std::vector<IrType>& types, const IrTypeAssumptions& assumptions)
+    {
+        const auto operand = [&instr, &types](size_t i) {
+            const auto id = instr.operands[i]->id;
+            return id < types.size() ? types[id] : IrType::ANY;
+        };
+
+        switch (instr.op)
+        {
+        case IrOp::CONSTANT:
+            return typeOf(instr.constant);
+        case IrOp::PHI:
+        {
+            auto type = IrType::NONE;
+
+            for (size_t i = 0; i < instr.operands.size(); i++)
+            {
+                type = join(type, operand(i));
+            }
+
+            return type;
+        }
+        case IrOp::NEGATE:
+            if (operand(0) == IrType::NONE)
+            {
+                return IrType::NONE;
+            }
+            return operand(0) == IrType::NUMBER ? IrType::NUMBER : IrType::ANY;
+        case IrOp::NOT:
+        case IrOp::TRUTHY:
+        case IrOp::SAME:
+        case IrOp::IS_STRING:
+            return IrType::BOOL;
+        case IrOp::INDEX:
+            return instr.checked ? IrType::ANY : IrType::STRING;
+        case IrOp::PARAMETER:
+            return instr.parameter < assumptions.parameters.size() ? assumptions.parameters[instr.parameter] : IrType::ANY;
+        case IrOp::CALL:
+            return assumptions.call ? assumptions.call(instr, types) : IrType::ANY;
+        case IrOp::LOAD_GLOBAL:
+            return IrType::ANY;
+        default:
+            if (isBinary(instr.op))
+            {
+                return binaryType(instr.op, operand(0), operand(1));
+            }
+
+            // No value.
+            return IrType::NONE;
+        }
+    }
+
+    IrType typeAt(const IrInstr& instr, const std::vector<IrType>& types)
+    {
+        return instr.id < types.size() ? types[instr.id] : IrType::ANY;
+    }
+
+    // Can be computed any number of times, or not at all, without it showing.
+    bool isPure(const IrInstr& instr, const std::vector<IrType>& types)
+    {
+        switch (instr.op)
+        {
+        case IrOp::NEGATE:
+        case IrOp::NOT:
+        case IrOp::TRUTHY:
+        case IrOp::SAME:
+        case IrOp::IS_STRING:
+        case IrOp::INDEX:
+            return !canFault(instr, types);
+        default:
+            return isBinary(instr.op) && !canFault(instr, types);
+        }
+    }
+
+    bool isIntConstant(const IrInstr* instr)
+    {
+        return instr->op == IrOp::CONSTANT && instr->constant.isInt();
+    }
+
+    IrInstr* constantOf(IrFunction& function, const Value& value)
+    {
+        const auto entry = function.entry();
+
+        for (const auto instr : entry->instrs)
+        {
+            if (instr->op == IrOp::CONSTANT && instr->constant.bits() == value.bits())
+            {
+                return instr;
+            }
+        }
+
+        auto instr = function.create(IrOp::CONSTANT);
+        instr->constant = value;
+        instr->block = entry;
+        entry->instrs.insert(entry->instrs.begin(), instr);
+
+        return instr;
+    }
+
+    void replace(IrFunction& function, IrInstr* instr, IrInstr* with)
+    {
+        function.replaceUses(instr, with);
+        function.remove(instr);
+    }
+
+    // The value of `instr` when it can be computed now.
+    std::optional<Value> fold(const IrInstr& instr, IrContext& context, const std::vector<IrType>& types)
+    {
+        const auto constant = [&instr](size_t i) -> const Value* {
+            return instr.operands[i]->op == IrOp::CONSTANT ? &instr.operands[i]->constant : nullptr;
+        };
+
+        switch (instr.op)
+        {
+        case IrOp::LOAD_GLOBAL:
+            if (!context.isAssigned(instr.symbol))
+            {
+                return context.globalValue(instr.symbol);
+            }
+            return std::nullopt;
+        case IrOp::NEGATE:
+            if (const auto value = constant(0))
+            {
+                return value->isNumber() ? numberNegate(*value) : Value{};
+            }
+            return std::nullopt;
+        case IrOp::NOT:
+            if (const auto value = constant(0))
+            {
+                return Value{ !isTruthy(*value) };
+            }
+            return std::nullopt;
+        case IrOp::TRUTHY:
+            if (const auto value = constant(0))
+            {
+                return Value{ isTruthy(*value) };
+            }
+            return std::nullopt;
+        case IrOp::SAME:
+            if (instr.operands[0] == instr.operands[1])
+            {
+                return Value{ true };
+            }
+            if (constant(0) && constant(1))
+            {
+                return Value{ constant(0)->bits() == constant(1)->bits() };
+            }
+            return std::nullopt;
+        case IrOp::IS_STRING:
+        {
+            if (const auto value = constant(0))
+            {
+                return Value{ value->isString() };
+            }
+
+            const auto type = typeAt(*instr.operands[0], types);
+
+            if (isKnown(type))
+            {
+                return Value{ type == IrType::STRING };
+            }
+            return std::nullopt;
+        }
+        case IrOp::INDEX:
+        {
+            const auto indexee = constant(0);
+            const auto index = constant(1);
+
+            if (indexee && index && indexee->isString() && index->isInt() && index->asInt() >= 0 &&
+                static_cast<size_t>(index->asInt()) < indexee->asString()->str().size())
+            {
+                return singleCharString(static_cast<unsigned char>(indexee->asString()->str()[index->asInt()]));
+            }
+            return std::nullopt;
+        }
+        default:
+            break;
+        }
+
+        if (!isBinary(instr.op) || !constant(0) || !constant(1))
+        {
+            return std::nullopt;
+        }
+
+        const auto& left = *constant(0);
+        const auto& right = *constant(1);
+
+        // Leaves type errors to be reported when the code runs.
+        if (instr.op != IrOp::EQUAL && left.type() != right.type())
+        {
+            return std::nullopt;
+        }
+
+        return binaryOperation(instr.token, left, right);
+    }
+
+    // The operand all the operands of `phi` other than itself are, if any.
+    IrInstr* trivialPhiValue(IrInstr* phi)
+    {
+        IrInstr* value = nullptr;
+
+        for (const auto operand : phi->operands)
+        {
+            if (operand == phi || operand == value)
+            {
+                continue;
+            }
+
+            if (value)
+            {
+                return nullptr;
+            }
+
+            value = operand;
+        }
+
+        return value;
+    }
+
+    // Which branch target a condition of type `type` always takes, if any.
+    std::optional<bool> knownCondition(const IrInstr& condition, IrType type)
+    {
+        if (condition.op == IrOp::CONSTANT)
+        {
+            return isTruthy(condition.constant);
+        }
+
+        if (type == IrType::STRING)
+        {
+            return true;
+        }
+
+        if (type == IrType::NIL)
+        {
+            return false;
+        }
+
+        return std::nullopt;
+    }
+
+    void inlineCall(IrFunction& function, IrInstr* call, const Value& calleeValue, const IrFunction& callee)
+    {
+        const auto block = call->block;
+        const auto position = std::find(block->instrs.begin(), block->instrs.end(), call);
+
+        // The rest of the block runs once the call, or its inlined body, returns.
+        const auto cont = function.addBlock();
+        cont->instrs.assign(position + 1, block->instrs.end());
+        block->instrs.erase(position, block->instrs.end());
+
+        for (const auto instr : cont->instrs)
+        {
+            instr->block = cont;
+        }
+
+        for (const auto succ : cont->succs())
+        {
+            std::replace(succ->preds.begin(), succ->preds.end(), block, cont);
+        }
+
+        // The original call, taken when the callee isn't the inlined one.
+        const auto slow = function.addBlock();
+        call->block = slow;
+        call->tail = false;
+        slow->instrs.push_back(call);
+        slow->preds.push_back(block);
+        function.append(slow, IrOp::JUMP)->targets = { cont };
+
+        const auto guard = function.append(block, IrOp::SAME, { call->operands[0], constantOf(function, calleeValue) });
+
+        std::unordered_map<const IrBlock*, IrBlock*> blocks;
+        std::unordered_map<const IrInstr*, IrInstr*> values;
+        std::vector<std::pair<IrInstr*, const IrInstr*>> cloned;
+        std::vector<std::pair<IrBlock*, const IrInstr*>> returns;
+
+        for (const auto& calleeBlock : callee.blocks())
+        {
+            blocks[calleeBlock.get()] = function.addBlock();
+        }
+
+        for (const auto& calleeBlock : callee.blocks())
+        {
+            const auto copy = blocks[calleeBlock.get()];
+
+            for (const auto pred : calleeBlock->preds)
+            {
+                copy->preds.push_back(blocks[pred]);
+            }
+
+            for (const auto instr : calleeBlock->instrs)
+            {
+                switch (instr->op)
+                {
+                case IrOp::PARAMETER:
+                    values[instr] = call->operands[1 + instr->parameter];
+                    break;
+                case IrOp::CONSTANT:
+                    values[instr] = constantOf(function, instr->constant);
+                    break;
+                case IrOp::RETURN:
+                    function.append(copy, IrOp::JUMP)->targets = { cont };
+                    returns.emplace_back(copy, instr->operands[0]);
+                    break;
+                default:
+                {
+                    const auto clone = function.append(copy, instr->op);
+                    clone->constant = instr->constant;
+                    clone->parameter = instr->parameter;
+                    clone->symbol = instr->symbol;
+                    clone->token = instr->token;
+                    clone->checked = instr->checked;
+
+                    for (const auto target : instr->targets)
+                    {
+                        clone->targets.push_back(blocks[target]);
+                    }
+
+                    values[instr] = clone;
+                    cloned.emplace_back(clone, instr);
+                    break;
+                }
+                }
+            }
+        }
+
+        for (const auto& [clone, instr] : cloned)
+        {
+            for (const auto operand : instr->operands)
+            {
+                clone->operands.push_back(values.at(operand));
+            }
+        }
+
+        const auto inlinedEntry = blocks[callee.entry()];
+        inlinedEntry->preds.push_back(block);
+
+        const auto branch = function.append(block, IrOp::BRANCH, { guard });
+        branch->targets = { inlinedEntry, slow };
+
+        cont->preds.push_back(slow);
+
+        for (const auto& [returnBlock, value] : returns)
+        {
+            cont->preds.push_back(returnBlock);
+        }
+
+        const auto result = function.addPhi(cont);
+        function.replaceUses(call, result);
+        result->operands.push_back(call);
+
+        for (const auto& [returnBlock, value] : returns)
+        {
+            result->operands.push_back(values.at(value));
+        }
+    }
+
+    struct ValueKey
+    {
+        IrOp op;
+        uint64_t first;
+        uint64_t second;
+
+        bool operator==(const ValueKey&) const = default;
+    };
+
+    struct ValueKeyHash
+    {
+        size_t operator()(const ValueKey& key) const
+        {
+            return std::hash<uint64_t>{}(key.first * 31 + key.second) ^ static_cast<size_t>(key.op);
+        }
+    };
+
+    ValueKey keyOf(const IrInstr& instr)
+    {
+        return ValueKey{ instr.op, instr.operands[0]->id,
+            instr.operands.size() > 1 ? instr.operands[1]->id : SIZE_MAX };
+    }
+
+    // Calls and stores to globals.
+    struct Clobbers
+    {
+        bool call = false;
+        std::unordered_set<Symbol> stores;
+    };
+
+    std::vector<Clobbers> clobbersOf(const IrFunction& function)
+    {
+        std::vector<Clobbers> clobbers(function.blocks().size());
+
+        for (const auto& block : function.blocks())
+        {
+            for (const auto instr : block->instrs)
+            {
+                if (instr->op == IrOp::CALL)
+                {
+                    clobbers[block->id].call = true;
+                }
+                else if (instr->op == IrOp::STORE_GLOBAL)
+                {
+                    clobbers[block->id].stores.insert(instr->symbol);
+                }
+            }
+        }
+
+        return clobbers;
+    }
+
+    // Drops the loads that a path from the end of `from` to the start of
+    // `to`, its immediate dominatee, may clobber.
+    void killLoads(std::unordered_map<Symbol, IrInstr*>& loads, const IrBlock* from, const IrBlock* to,
+        const std::vector<Clobbers>& clobbers)
+    {
+        if (loads.empty() || (to->preds.size() == 1 && to->preds.front() == from))
+        {
+            return;
+        }
+
+        std::vector<bool> visited(clobbers.size());
+        std::vector<const IrBlock*> worklist(to->preds.begin(), to->preds.end());
+
+        while (!worklist.empty())
+        {
+            const auto block = worklist.back();
+            worklist.pop_back();
+
+            if (block == from || visited[block->id])
+            {
+                continue;
+            }
+
+            visited[block->id] = true;
+
+            if (clobbers[block->id].call)
+            {
+                loads.clear();
+                return;
+            }
+
+            for (const auto symbol : clobbers[block->id].stores)
+            {
+                loads.erase(symbol);
+            }
+
+            worklist.insert(worklist.end(), block->preds.begin(), block->preds.end());
+        }
+    }
+
+    struct Loop
+    {
+        IrBlock* header;
+        std::vector<bool> contains;
+        std::vector<IrBlock*> blocks;
+    };
+
+    std::vector<Loop> findLoops(const IrFunction& function, const IrDominators& dominators)
+    {
+        std::vector<Loop> loops;
+
+        for (const auto block : function.reversePostorder())
+        {
+            for (const auto header : block->succs())
+            {
+                if (!dominators.dominates(header, block))
+                {
+                    continue;
+                }
+
+                auto loop = std::find_if(loops.begin(), loops.end(), [header](const Loop& loop) { return loop.header == header; });
+
+                if (loop == loops.end())
+                {
+                    loops.push_back(Loop{ header, std::vector<bool>(function.blocks().size()), { header } });
+                    loop = loops.end() - 1;
+                    loop->contains[header->id] = true;
+                }
+
+                // Everything reaching the back edge without going through the header.
+                std::vector<IrBlock*> worklist{ block };
+
+                while (!worklist.empty())
+                {
+                    const auto member = worklist.back();
+                    worklist.pop_back();
+
+                    if (loop->contains[member->id])
+                    {
+                        continue;
+                    }
+
+                    loop->contains[member->id] = true;
+                    loop->blocks.push_back(member);
+                    worklist.insert(worklist.end(), member->preds.begin(), member->preds.end());
+                }
+            }
+        }
+
+        std::sort(loops.begin(), loops.end(), [](const Loop& a, const Loop& b) { return a.blocks.size() < b.blocks.size(); });
+
+        return loops;
+    }
+
+    // Gives the loop a single block entering it, which jumps to the header.
+    void addPreheader(IrFunction& function, const Loop& loop)
+    {
+        const auto header = loop.header;
+        std::vector<size_t> inside;
+        std::vector<size_t> outside;
+
+        for (size_t i = 0; i < header->preds.size(); i++)
+        {
+            (loop.contains[header->preds[i]->id] ? inside : outside).push_back(i);
+        }
+
+        if (outside.empty() || (outside.size() == 1 && header->preds[outside.front()]->succs().size() == 1))
+        {
+            return;
+        }
+
+        const auto preheader = function.addBlock();
+
+        for (const auto i : outside)
+        {
+            const auto pred = header->preds[i];
+
+            for (auto& target : pred->terminator()->targets)
+            {
+                if (target == header)
+                {
+                    target = preheader;
+                }
+            }
+
+            preheader->preds.push_back(pred);
+        }
+
+        function.append(preheader, IrOp::JUMP)->targets = { header };
+
+        for (const auto instr : header->instrs)
+        {
+            if (instr->op != IrOp::PHI)
+            {
+                break;
+            }
+
+            std::vector<IrInstr*> operands;
+
+            for (const auto i : inside)
+            {
+                operands.push_back(instr->operands[i]);
+            }
+
+            if (outside.size() == 1)
+            {
+                operands.push_back(instr->operands[outside.front()]);
+            }
+            else
+            {
+                const auto merged = function.addPhi(preheader);
+
+                for (const auto i : outside)
+                {
+                    merged->operands.push_back(instr->operands[i]);
+                }
+
+                operands.push_back(merged);
+            }
+
+            instr->operands = std::move(operands);
+        }
+
+        std::vector<IrBlock*> preds;
+
+        for (const auto i : inside)
+        {
+            preds.push_back(header->preds[i]);
+        }
+
+        preds.push_back(preheader);
+        header->preds = std::move(preds);
+    }
+
+    struct Range
+    {
+        int64_t low;
+        int64_t high;
+    };
+
+    std::optional<Range> rangeOf(const IrInstr* value, const IrBlock* at, const IrDominators& dominators, int depth);
+
+    // Range of an increasing induction variable `phi` where `at` runs, as
+    // bounded by the loop condition dominating it.
+    std::optional<Range> inductionRange(const IrInstr* phi, const IrBlock* at, const IrDominators& dominators, int depth)
+    {
+        if (phi->operands.size() != 2)
+        {
+            return std::nullopt;
+        }
+
+        const IrInstr* init = nullptr;
+
+        for (size_t i = 0; i < 2; i++)
+        {
+            const auto step = phi->operands[i];
+
+            if (step->op != IrOp::ADD)
+            {
+                continue;
+            }
+
+            const auto& operands = step->operands;
+            const auto increment = operands[0] == phi ? operands[1] : operands[1] == phi ? operands[0] : nullptr;
+
+            if (increment && isIntConstant(increment) && increment->constant.asInt() >= 0)
+            {
+                init = phi->operands[1 - i];
+            }
+        }
+
+        if (!init)
+        {
+            return std::nullopt;
+        }
+
+        const auto initRange = rangeOf(init, at, dominators, depth + 1);
+
+        if (!initRange)
+        {
+            return std::nullopt;
+        }
+
+        for (auto block = at; block; block = dominators.idom(block))
+        {
+            if (block->preds.size() != 1)
+            {
+                continue;
+            }
+
+            const auto branch = block->preds.front()->terminator();
+
+            if (!branch || branch->op != IrOp::BRANCH || branch->targets[0] != block || branch->targets[1] == block)
+            {
+                continue;
+            }
+
+            const auto condition = branch->operands[0];
+
+            if (!isBinary(condition->op))
+            {
+                continue;
+            }
+
+            const auto left = condition->operands[0];
+            const auto right = condition->operands[1];
+            std::optional<int64_t> high;
+
+            if (left == phi && isIntConstant(right))
+            {
+                if (condition->op == IrOp::LESS)
+                {
+                    high = static_cast<int64_t>(right->constant.asInt()) - 1;
+                }
+                else if (condition->op == IrOp::LESS_EQUAL)
+                {
+                    high = right->constant.asInt();
+                }
+            }
+            else if (right == phi && isIntConstant(left))
+            {
+                if (condition->op == IrOp::GREATER)
+                {
+                    high = static_cast<int64_t>(left->constant.asInt()) - 1;
+                }
+                else if (condition->op == IrOp::GREATER_EQUAL)
+                {
+                    high = left->constant.asInt();
+                }
+            }
+
+            if (high)
+            {
+                return Range{ initRange->low, *high };
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    // Range of the integer `value` holds where `at` runs, if known.
+    std::optional<Range> rangeOf(const IrInstr* value, const IrBlock* at, const IrDominators& dominators, int depth)
+    {
+        if (depth > 8)
+        {
+            return std::nullopt;
+        }
+
+        std::optional<Range> range;
+
+        switch (value->op)
+        {
+        case IrOp::CONSTANT:
+            if (value->constant.isInt())
+            {
+                range = Range{ value->constant.asInt(), value->constant.asInt() };
+            }
+            break;
+        case IrOp::ADD:
+        case IrOp::SUBTRACT:
+        {
+            const auto left = value->operands[0];
+            const auto right = value->operands[1];
+            const auto sign = value->op == IrOp::ADD ? 1 : -1;
+
+            if (isIntConstant(right))
+            {
+                range = rangeOf(left, at, dominators, depth + 1);
+
+                if (range)
+                {
+                    range->low += sign * right->constant.asInt();
+                    range->high += sign * right->constant.asInt();
+                }
+            }
+            else if (value->op == IrOp::ADD && isIntConstant(left))
+            {
+                range = rangeOf(right, at, dominators, depth + 1);
+
+                if (range)
+                {
+                    range->low += left->constant.asInt();
+                    range->high += left->constant.asInt();
+                }
+            }
+            break;
+        }
+        case IrOp::PHI:
+            range = inductionRange(value, at, dominators, depth);
+            break;
+        default:
+            break;
+        }
+
+        // Integer arithmetic turns to doubles past 32 bits.
+        if (range && (range->low < INT32_MIN || range->high > INT32_MAX))
+        {
+            return std::nullopt;
+        }
+
+        return range;
+    }
+}
+
+std::vector<IrType> pimentel::inferTypes(const IrFunction& function, const IrTypeAssumptions& assumptions)
+{
+    std::vector<IrType> types(function.idBound(), IrType::NONE);
+    const auto order = function.reversePostorder();
+    bool changed = true;
+
+    while (changed)
+    {
+        changed = false;
+
+        for (const auto block : order)
+        {
+            for (const auto instr : block->instrs)
+            {
+                const auto type = resultType(*instr, types, assumptions);
+
+                if (type != types[instr->id])
+                {
+                    types[instr->id] = type;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    return types;
+}
+
+std::optional<IrNumericTypes> pimentel::inferNumeric(const IrFunction& function, IrContext& context)
+{
+    IrTypeAssumptions assumptions;
+    assumptions.parameters.assign(function.arity(), IrType::NUMBER);
+    assumptions.call = [&context](const IrInstr& call, const std::vector<IrType>& types) {
+        const auto callee = call.operands[0];
+
+        if (callee->op != IrOp::CONSTANT)
+        {
+            return IrType::ANY;
+        }
+
+        for (size_t i = 1; i < call.operands.size(); i++)
+        {
+            const auto type = typeAt(*call.operands[i], types);
+
+            if (type == IrType::NONE)
+            {
+                return IrType::NONE;
+            }
+
+            if (type != IrType::NUMBER)
+            {
+                return IrType::ANY;
+            }
+        }
+
+        return context.numericResult(callee->constant).value_or(IrType::ANY);
+    };
+
+    auto types = inferTypes(function, assumptions);
+
+    const auto is = [&types](const IrInstr* instr, auto... expected) {
+        const auto type = typeAt(*instr, types);
+        return ((type == expected) || ...);
+    };
+    const auto isScalar = [&is](const IrInstr* instr) { return is(instr, IrType::NUMBER, IrType::BOOL); };
+
+    auto returnType = IrType::NONE;
+
+    for (const auto& block : function.blocks())
+    {
+        for (const auto instr : block->instrs)
+        {
+            switch (instr->op)
+            {
+            case IrOp::CONSTANT:
+            case IrOp::PARAMETER:
+            case IrOp::JUMP:
+                break;
+            case IrOp::PHI:
+            case IrOp::CALL:
+                if (!isScalar(instr))
+                {
+                    return std::nullopt;
+                }
+                break;
+            case IrOp::EQUAL:
+            case IrOp::NOT_EQUAL:
+                if (!(is(instr->operands[0], IrType::NUMBER) && is(instr->operands[1], IrType::NUMBER)) &&
+                    !(is(instr->operands[0], IrType::BOOL) && is(instr->operands[1], IrType::BOOL)))
+                {
+                    return std::nullopt;
+                }
+                break;
+            case IrOp::NEGATE:
+                if (!is(instr->operands[0], IrType::NUMBER))
+                {
+                    return std::nullopt;
+                }
+                break;
+            case IrOp::NOT:
+            case IrOp::TRUTHY:
+            case IrOp::STORE_GLOBAL:
+            case IrOp::PRINT:
+            case IrOp::BRANCH:
+                if (!isScalar(instr->operands[0]))
+                {
+                    return std::nullopt;
+                }
+                break;
+            case IrOp::RETURN:
+            {
+                const auto type = typeAt(*instr->operands[0], types);
+
+                if (!isScalar(instr->operands[0]) || (returnType != IrType::NONE && type != returnType))
+                {
+                    return std::nullopt;
+                }
+
+                returnType = type;
+                break;
+            }
+            default:
+                if (!isBinary(instr->op) || !is(instr->operands[0], IrType::NUMBER) ||
+                    !is(instr->operands[1], IrType::NUMBER))
+                {
+                    return std::nullopt;
+                }
+                break;
+            }
+        }
+    }
+
+    if (returnType == IrType::NONE)
+    {
+        return std::nullopt;
+    }
+
+    return IrNumericTypes{ std::move(types), returnType };
+}
+
+bool pimentel::canFault(const IrInstr& instr, const std::vector<IrType>& types)
+{
+    switch (instr.op)
+    {
+    case IrOp::EQUAL:
+        return false;
+    case IrOp::INDEX:
+    case IrOp::LOAD_GLOBAL:
+    case IrOp::STORE_GLOBAL:
+        return instr.checked;
+    case IrOp::CALL:
+    case IrOp::PRINT:
+        return true;
+    default:
+        break;
+    }
+
+    if (!isBinary(instr.op))
+    {
+        return false;
+    }
+
+    const auto left = typeAt(*instr.operands[0], types);
+
+    return !isKnown(left) || left != typeAt(*instr.operands[1], types);
+}
+
+size_t pimentel::foldConstants(IrFunction& function, IrContext& context)
+{
+    size_t changes = 0;
+    bool changed = true;
+
+    while (changed)
+    {
+        changed = false;
+
+        const auto types = inferTypes(function);
+        bool foldedBranch = false;
+
+        for (const auto block : function.reversePostorder())
+        {
+            const auto instrs = block->instrs;
+
+            for (const auto instr : instrs)
+            {
+                if (instr->op == IrOp::PHI)
+                {
+                    if (const auto value = trivialPhiValue(instr))
+                    {
+                        replace(function, instr, value);
+                        changed = true;
+                        changes++;
+                    }
+                    continue;
+                }
+
+                if (instr->op == IrOp::BRANCH)
+                {
+                    const auto condition = instr->operands[0];
+                    const auto taken = knownCondition(*condition, typeAt(*condition, types));
+
+                    if (!taken)
+                    {
+                        continue;
+                    }
+
+                    const auto target = instr->targets[*taken ? 0 : 1];
+                    const auto dropped = instr->targets[*taken ? 1 : 0];
+
+                    instr->op = IrOp::JUMP;
+                    instr->operands.clear();
+                    instr->targets = { target };
+                    function.removeEdge(block, dropped);
+
+                    foldedBranch = true;
+                    changed = true;
+                    changes++;
+                    continue;
+                }
+
+                if ((instr->op == IrOp::LOAD_GLOBAL || instr->op == IrOp::STORE_GLOBAL) && instr->checked &&
+                    context.globalValue(instr->symbol))
+                {
+                    instr->checked = false;
+                    changed = true;
+                    changes++;
+                }
+
+                if (const auto value = fold(*instr, context, types))
+                {
+                    replace(function, instr, constantOf(function, *value));
+                    changed = true;
+                    changes++;
+                }
+            }
+        }
+
+        if (foldedBranch)
+        {
+            function.removeUnreachableBlocks();
+        }
+    }
+
+    return changes + function.mergeBlocks();
+}
+
+size_t pimentel::inlineCalls(IrFunction& function, IrContext& context)
+{
+    std::vector<IrInstr*> calls;
+
+    for (const auto& block : function.blocks())
+    {
+        for (const auto instr : block->instrs)
+        {
+            if (instr->op == IrOp::CALL)
+            {
+                calls.push_back(instr);
+            }
+        }
+    }
+
+    size_t inlined = 0;
+
+    for (const auto call : calls)
+    {
+        if (function.instructionCount() > MAX_INLINED_SIZE)
+        {
+            break;
+        }
+
+        const auto callee = call->operands[0];
+        std::optional<Value> calleeValue;
+
+        if (callee->op == IrOp::CONSTANT)
+        {
+            calleeValue = callee->constant;
+        }
+        else if (callee->op == IrOp::LOAD_GLOBAL)
+        {
+            calleeValue = context.globalValue(callee->symbol);
+        }
+
+        if (!calleeValue)
+        {
+            continue;
+        }
+
+        const auto ir = context.inlineCandidate(*calleeValue);
+
+        if (!ir || ir->arity() != call->operands.size() - 1 || ir->instructionCount() > INLINE_BUDGET)
+        {
+            continue;
+        }
+
+        inlineCall(function, call, *calleeValue, *ir);
+        inlined++;
+    }
+
+    return inlined;
+}
+
+size_t pimentel::eliminateCommonSubexpressions(IrFunction& function)
+{
+    const auto types = inferTypes(function);
+    const IrDominators dominators{ function };
+    const auto clobbers = clobbersOf(function);
+
+    std::unordered_map<ValueKey, IrInstr*, ValueKeyHash> available;
+    size_t eliminated = 0;
+
+    const std::function<void(IrBlock*, std::unordered_map<Symbol, IrInstr*>)> walk =
+        [&](IrBlock* block, std::unordered_map<Symbol, IrInstr*> loads) {
+        std::vector<ValueKey> added;
+        const auto instrs = block->instrs;
+
+        for (const auto instr : instrs)
+        {
+            switch (instr->op)
+            {
+            case IrOp::LOAD_GLOBAL:
+                if (!instr->checked)
+                {
+                    if (const auto found = loads.find(instr->symbol); found != loads.end())
+                    {
+                        replace(function, instr, found->second);
+                        eliminated++;
+                    }
+                    else
+                    {
+                        loads[instr->symbol] = instr;
+                    }
+                }
+                continue;
+            case IrOp::STORE_GLOBAL:
+                // A store that can't fail is what the next load reads.
+                if (instr->checked)
+                {
+                    loads.erase(instr->symbol);
+                }
+                else
+                {
+                    loads[instr->symbol] = instr->operands[0];
+                }
+                continue;
+            case IrOp::CALL:
+                loads.clear();
+                continue;
+            default:
+                break;
+            }
+
+            if (!isPure(*instr, types))
+            {
+                continue;
+            }
+
+            const auto key = keyOf(*instr);
+
+            if (const auto found = available.find(key); found != available.end())
+            {
+                replace(function, instr, found->second);
+                eliminated++;
+                continue;
+            }
+
+            available.emplace(key, instr);
+            added.push_back(key);
+        }
+
+        for (const auto child : dominators.children(block))
+        {
+            auto childLoads = loads;
+            killLoads(childLoads, block, child, clobbers);
+            walk(child, std::move(childLoads));
+        }
+
+        for (const auto& key : added)
+        {
+            available.erase(key);
+        }
+    };
+
+    walk(function.entry(), {});
+
+    return eliminated;
+}
+
+size_t pimentel::hoistLoopInvariants(IrFunction& function)
+{
+    for (const auto& loop : findLoops(function, IrDominators{ function }))
+    {
+        addPreheader(function, loop);
+    }
+
+    // Preheaders are outside the loops, which stay the same.
+    const IrDominators dominators{ function };
+    const auto loops = findLoops(function, dominators);
+    const auto types = inferTypes(function);
+    const auto order = function.reversePostorder();
+    size_t hoisted = 0;
+
+    // Innermost loops first, what they hoist may leave the enclosing ones too.
+    for (const auto& loop : loops)
+    {
+        const auto entering = std::find_if(loop.header->preds.begin(), loop.header->preds.end(),
+            [&loop](const IrBlock* pred) { return !loop.contains[pred->id]; });
+
+        if (entering == loop.header->preds.end())
+        {
+            continue;
+        }
+
+        const auto preheader = *entering;
+
+        bool calls = false;
+        std::unordered_set<Symbol> stores;
+
+        for (const auto block : loop.blocks)
+        {
+            for (const auto instr : block->instrs)
+            {
+                calls |= instr->op == IrOp::CALL;
+
+                if (instr->op == IrOp::STORE_GLOBAL)
+                {
+                    stores.insert(instr->symbol);
+                }
+            }
+        }
+
+        for (const auto block : order)
+        {
+            if (!loop.contains[block->id])
+            {
+                continue;
+            }
+
+            const auto instrs = block->instrs;
+
+            for (const auto instr : instrs)
+            {
+                const auto invariantLoad = instr->op == IrOp::LOAD_GLOBAL && !instr->checked && !calls &&
+                    !stores.contains(instr->symbol);
+
+                if (!invariantLoad && !isPure(*instr, types))
+                {
+                    continue;
+                }
+
+                const auto definedOutside = std::all_of(instr->operands.begin(), instr->operands.end(),
+                    [&loop](const IrInstr* operand) { return !loop.contains[operand->block->id]; });
+
+                if (!definedOutside)
+                {
+                    continue;
+                }
+
+                function.remove(instr);
+                instr->block = preheader;
+                preheader->instrs.insert(preheader->instrs.end() - 1, instr);
+                hoisted++;
+            }
+        }
+    }
+
+    return hoisted;
+}
+
+size_t pimentel::eliminateBoundsChecks(IrFunction& function)
+{
+    const IrDominators dominators{ function };
+    size_t eliminated = 0;
+
+    for (const auto& block : function.blocks())
+    {
+        for (const auto instr : block->instrs)
+        {
+            if (instr->op != IrOp::INDEX || !instr->checked)
+            {
+                continue;
+            }
+
+            const auto indexee = instr->operands[0];
+
+            if (indexee->op != IrOp::CONSTANT || !indexee->constant.isString())
+            {
+                continue;
+            }
+
+            const auto length = static_cast<int64_t>(indexee->constant.asString()->str().size());
+            const auto range = rangeOf(instr->operands[1], block.get(), dominators, 0);
+
+            if (range && range->low >= 0 && range->high < length)
+            {
+                instr->checked = false;
+                eliminated++;
+            }
+        }
+    }
+
+    return eliminated;
+}
+
+size_t pimentel::eliminateDeadCode(IrFunction& function)
+{
+    const auto types = inferTypes(function);
+    std::vector<bool> live(function.idBound());
+    std::vector<IrInstr*> worklist;
+
+    for (const auto& block : function.blocks())
+    {
+        for (const auto instr : block->instrs)
+        {
+            if (hasSideEffects(instr->op) || canFault(*instr, types))
+            {
+                live[instr->id] = true;
+                worklist.push_back(instr);
+            }
+        }
+    }
+
+    while (!worklist.empty())
+    {
+        const auto instr = worklist.back();
+        worklist.pop_back();
+
+        for (const auto operand : instr->operands)
+        {
+            if (!live[operand->id])
+            {
+                live[operand->id] = true;
+                worklist.push_back(operand);
+            }
+        }
+    }
+
+    size_t removed = 0;
+
+    for (const auto& block : function.blocks())
+    {
+        removed += std::erase_if(block->instrs, [&live](IrInstr* instr) {
+            if (live[instr->id])
+            {
+                return false;
+            }
+
+            instr->block = nullptr;
+            return true;
+        });
+    }
+
+    return removed;
+}
+
+IrPipeline::IrPipeline()
+{
+    for (const auto name : { "lower", "fold", "inline", "cse", "licm", "bce", "dce" })
+    {
+        m_stats.push_back(IrPassStats{ name });
+    }
+}
+
+void IrPipeline::run(IrFunction& function, IrContext& context)
+{
+    timed("fold", [&] { return foldConstants(function, context); });
+    timed("inline", [&] { return inlineCalls(function, context); });
+    timed("fold", [&] { return foldConstants(function, context); });
+    timed("cse", [&] { return eliminateCommonSubexpressions(function); });
+    timed("licm", [&] { return hoistLoopInvariants(function); });
+    timed("bce", [&] { return eliminateBoundsChecks(function); });
+    timed("dce", [&] { return eliminateDeadCode(function); });
+}
+
+template<typename Pass>
+void IrPipeline::timed(const char* name, Pass&& pass)
+{
+    const auto start = std::chrono::steady_clock::now();
+    const auto changes = pass();
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    record(name, elapsed.count(), changes);
+}
+
+void IrPipeline::record(const char* name, double seconds, size_t changes)
+{
+    auto& entry = stats(name);
+    entry.runs++;
+    entry.changes += changes;
+    entry.seconds += seconds;
+}
+
+IrPassStats& IrPipeline::stats(const char* name)
+{
+    for (auto& entry : m_stats)
+    {
+        if (std::strcmp(entry.name, name) == 0)
+        {
+            return entry;
+        }
+    }
+
+    return m_stats.emplace_back(IrPassStats{ name });
+}
+
+void IrPipeline::printStats(std::ostream& stream) const
+{
+    for (const auto& entry : m_stats)
+    {
+        stream << "[IR] " << entry.name << ": " << entry.runs << " runs, " << entry.changes << " changes, "
+            << entry.seconds * 1000.0 << " ms" << std::endl;
+    }
+}
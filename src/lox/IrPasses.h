@@ -0,0 +1,119 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <ostream>
+#include <vector>
+#include "Ir.h"
+
+namespace pimentel
+{
+    // Static type of a value, as far as the passes can tell.
+    enum class IrType : uint8_t
+    {
+        NONE,   // not computed (yet), e.g. unreachable
+        NUMBER,
+        STRING,
+        BOOL,
+        NIL,
+        ANY
+    };
+
+    // What the passes may assume about the program the IR belongs to.
+    class IrContext
+    {
+    public:
+        virtual ~IrContext() = default;
+
+        // Current value of a global, nothing while it isn't defined. A
+        // defined global stays defined.
+        virtual std::optional<Value> globalValue(Symbol name) = 0;
+        // Whether any code loaded so far assigns the global. A global nothing
+        // assigns keeps the value it was first defined with.
+        virtual bool isAssigned(Symbol name) = 0;
+        // Optimized IR of the function `callee` holds, when small enough to
+        // be inlined.
+        virtual const IrFunction* inlineCandidate(const Value& callee) = 0;
+        // Type of what `callee` returns when called with numbers, when it
+        // then only computes numbers and booleans (see inferNumeric).
+        virtual std::optional<IrType> numericResult(const Value& callee) = 0;
+    };
+
+    // What inferTypes() may assume beyond the IR itself.
+    struct IrTypeAssumptions
+    {
+        // One per parameter, ANY when missing.
+        std::vector<IrType> parameters;
+        // Type of the value of a CALL given the types so far, ANY when unset.
+        std::function<IrType(const IrInstr& call, const std::vector<IrType>& types)> call;
+    };
+
+    // Indexed by instruction id.
+    std::vector<IrType> inferTypes(const IrFunction& function, const IrTypeAssumptions& assumptions = {});
+
+    struct IrNumericTypes
+    {
+        std::vector<IrType> types;
+        // NUMBER or BOOL.
+        IrType returnType;
+    };
+
+    // Types of `function`'s values when its parameters are numbers, if it
+    // then only computes numbers and booleans and only calls functions that
+    // do too: it can run on unboxed numbers. Calls are typed by the
+    // context's numericResult().
+    std::optional<IrNumericTypes> inferNumeric(const IrFunction& function, IrContext& context);
+
+    // Whether running `instr` may report an error, given the operand types.
+    bool canFault(const IrInstr& instr, const std::vector<IrType>& types);
+
+    // Each pass returns the number of changes it made.
+
+    // Folds operations on constants, globals nothing assigns anymore and
+    // branches on known conditions, removes trivial phis and unreachable code.
+    size_t foldConstants(IrFunction& function, IrContext& context);
+    // Inlines calls to small functions behind a guard on the callee, the
+    // call itself stays on the path the guard fails.
+    size_t inlineCalls(IrFunction& function, IrContext& context);
+    // Global value numbering over the dominator tree, plus reuse of global
+    // loads while nothing may have stored to the global since.
+    size_t eliminateCommonSubexpressions(IrFunction& function);
+    // Moves what doesn't change within a loop, and can't fail, in front of it.
+    size_t hoistLoopInvariants(IrFunction& function);
+    // Drops the checks of string indexing proven in bounds.
+    size_t eliminateBoundsChecks(IrFunction& function);
+    // Removes what computes unused values and can't fail.
+    size_t eliminateDeadCode(IrFunction& function);
+
+    struct IrPassStats
+    {
+        const char* name;
+        size_t runs = 0;
+        size_t changes = 0;
+        double seconds = 0.0;
+    };
+
+    // Runs the passes in order, timing each of them.
+    class IrPipeline
+    {
+    public:
+        IrPipeline();
+        ~IrPipeline() = default;
+
+        void run(IrFunction& function, IrContext& context);
+
+        // Accounts time spent outside of the passes, e.g. lowering.
+        void record(const char* name, double seconds, size_t changes);
+
+        void printStats(std::ostream& stream) const;
+
+    private:
+        template<typename Pass>
+        void timed(const char* name, Pass&& pass);
+
+        IrPassStats& stats(const char* name);
+
+    private:
+        std::vector<IrPassStats> m_stats;
+    };
+}
@@ -0,0 +1,628 @@
+#include "Jit.h"
+#include "IrExecutor.h"
+#include "X64Assembler.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define LOX_JIT_X64 1
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#define LOX_JIT_X64 0
+#endif
+
+using namespace pimentel;
+
+namespace
+{
+    // Native code calls these with the runtime in its first argument.
+    uint64_t jitCall(JitRuntime* runtime, const IrCode* code, uint64_t instr, const uint64_t* args)
+    {
+        return runtime->host->call(*code, static_cast<uint32_t>(instr), args);
+    }
+
+    uint64_t jitInterpret(JitRuntime* runtime, const IrCode* code, const uint64_t* args)
+    {
+        return runtime->host->interpret(*code, args);
+    }
+
+    void jitPrint(JitRuntime* runtime, uint64_t value)
+    {
+        runtime->host->print(value);
+    }
+
+    void jitStoreGlobal(JitRuntime* runtime, const IrCode* code, uint64_t instr, uint64_t value)
+    {
+        runtime->host->storeGlobal(*code, static_cast<uint32_t>(instr), value);
+    }
+
+    template<typename T>
+    uint64_t address(T* pointer)
+    {
+        return reinterpret_cast<uint64_t>(pointer);
+    }
+
+    // Of a register in the frame, which RBX points to.
+    int32_t slot(size_t reg)
+    {
+        return static_cast<int32_t>(reg * sizeof(uint64_t));
+    }
+
+    // Saves the registers native code keeps, checks the stack, then makes
+    // the frame. Arguments are still in RDI, the runtime in RSI.
+    void prologue(X64Assembler& a, X64Assembler::Label shortOfStack, int32_t frameBytes)
+    {
+        a.push(Reg::RBP);
+        a.mov(Reg::RBP, Reg::RSP);
+        a.push(Reg::RBX);
+        a.push(Reg::R12);
+        a.cmpLoad(Reg::RSP, Reg::RSI, static_cast<int32_t>(offsetof(JitRuntime, stackLimit)));
+        a.jcc(Condition::BELOW, shortOfStack);
+        a.mov(Reg::R12, Reg::RSI);
+        a.subImm(Reg::RSP, frameBytes);
+        a.mov(Reg::RBX, Reg::RSP);
+    }
+
+    void restoreRegisters(X64Assembler& a)
+    {
+        a.pop(Reg::R12);
+        a.pop(Reg::RBX);
+        a.pop(Reg::RBP);
+    }
+
+    // RAX = FALSE_BITS + AL, as a boolean Value in `dst`. Leaves FALSE_BITS
+    // in RCX.
+    void storeBool(X64Assembler& a, uint32_t dst)
+    {
+        a.movImm(Reg::RCX, Value::FALSE_BITS);
+        a.add(Reg::RAX, Reg::RCX);
+        a.movStore(Reg::RBX, slot(dst), Reg::RAX);
+    }
+}
+
+bool Jit::supported()
+{
+    return LOX_JIT_X64 != 0;
+}
+
+Jit::Jit(JitHost& host, const JitOptions& options)
+    :
+    m_options(options),
+    m_runtime{ 0, &host }
+{
+#if LOX_JIT_X64
+    m_pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    m_cacheSize = (m_options.cacheSize + m_pageSize - 1) / m_pageSize * m_pageSize;
+
+    if (m_cacheSize)
+    {
+        const auto cache = mmap(nullptr, m_cacheSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        m_cache = cache == MAP_FAILED ? nullptr : static_cast<uint8_t*>(cache);
+    }
+
+    // Native frames take up to half of the stack, what the interpreter and
+    // the IR need past them is on the other half.
+    pthread_attr_t attributes;
+    void* stack = nullptr;
+    size_t stackSize = 0;
+
+    if (pthread_getattr_np(pthread_self(), &attributes) == 0)
+    {
+        pthread_attr_getstack(&attributes, &stack, &stackSize);
+        pthread_attr_destroy(&attributes);
+    }
+
+    const auto here = reinterpret_cast<uintptr_t>(&attributes);
+    const auto bottom = reinterpret_cast<uintptr_t>(stack);
+    m_runtime.stackLimit = stack && here > bottom && here - bottom <= stackSize ?
+        bottom + (here - bottom) / 2 : here - std::min<uintptr_t>(here, 1024 * 1024);
+
+    if (m_options.perfMap)
+    {
+        m_perfMap.open("/tmp/perf-" + std::to_string(getpid()) + ".map", std::ios::app);
+    }
+#endif
+}
+
+Jit::~Jit()
+{
+#if LOX_JIT_X64
+    if (m_cache)
+    {
+        munmap(m_cache, m_cacheSize);
+    }
+#endif
+}
+
+bool Jit::compile(const IrCode& code)
+{
+    if (code.native)
+    {
+        return true;
+    }
+
+    if (!supported() || !m_cache)
+    {
+        return false;
+    }
+
+    const auto assembled = assemble(code);
+    const auto start = install(assembled.bytes);
+
+    if (!start)
+    {
+        m_stats.rejected++;
+        return false;
+    }
+
+    code.boxedNative = reinterpret_cast<JitEntry>(start + assembled.boxedEntry);
+    code.native = reinterpret_cast<JitEntry>(start + assembled.entry);
+    m_stats.compiled++;
+    m_stats.bytes += assembled.bytes.size();
+
+    if (m_perfMap.is_open())
+    {
+        m_perfMap << std::hex << address(start) << " " << assembled.bytes.size() << std::dec << " lox:"
+            << code.name << std::endl;
+    }
+
+    return true;
+}
+
+void Jit::reset()
+{
+    m_used = 0;
+}
+
+void Jit::printStats(std::ostream& stream) const
+{
+    stream << "[JIT] functions compiled: " << m_stats.compiled << " native bytes: " << m_stats.bytes
+        << " left to the IR, cache full: " << m_stats.rejected << std::endl;
+}
+
+Jit::Assembled Jit::assemble(const IrCode& code)
+{
+    X64Assembler a;
+    const auto& instrs = code.instrs;
+
+    std::vector<X64Assembler::Label> labels(instrs.size());
+    std::vector<bool> jumpedTo(instrs.size());
+
+    for (size_t i = 0; i < instrs.size(); i++)
+    {
+        labels[i] = a.newLabel();
+
+        if (instrs[i].op == IrOp::JUMP || instrs[i].op == IrOp::BRANCH)
+        {
+            jumpedTo[instrs[i].dst] = true;
+        }
+
+        if (instrs[i].op == IrOp::BRANCH)
+        {
+            jumpedTo[instrs[i].b] = true;
+        }
+    }
+
+    size_t maxArgs = 0;
+
+    for (const auto& site : code.callSites)
+    {
+        maxArgs = std::max<size_t>(maxArgs, site.argCount);
+    }
+
+    // The registers, then the arguments of the call being made, 16 byte
+    // aligned as calls need the stack to be.
+    const auto outgoing = code.registerCount;
+    const auto frameBytes = static_cast<int32_t>((outgoing + maxArgs + 1) / 2 * 16);
+
+    const auto shortOfStack = a.newLabel();
+    const auto boxedShortOfStack = a.newLabel();
+    const auto bail = a.newLabel();
+    const auto argsCopied = a.newLabel();
+    const auto entryLabel = a.newLabel();
+    const auto body = a.newLabel();
+
+    // Boxed entry: every argument has to be a number before anything runs.
+    const auto boxedEntry = a.offset();
+    a.movImm(Reg::R8, Value::QNAN);
+    a.movImm(Reg::R9, Value::SIGN_BIT | Value::QNAN | Value::TYPE_MASK);
+    a.movImm(Reg::R10, Value::INT_BITS);
+
+    for (size_t i = 0; i < code.arity; i++)
+    {
+        const auto isNumber = a.newLabel();
+        a.movLoad(Reg::RAX, Reg::RDI, slot(i));
+        a.mov(Reg::RCX, Reg::RAX);
+        a.andReg(Reg::RCX, Reg::R8);
+        a.cmp(Reg::RCX, Reg::R8);
+        a.jcc(Condition::NOT_EQUAL, isNumber);
+        a.mov(Reg::RCX, Reg::RAX);
+        a.andReg(Reg::RCX, Reg::R9);
+        a.cmp(Reg::RCX, Reg::R10);
+        a.jcc(Condition::NOT_EQUAL, bail);
+        a.bind(isNumber);
+    }
+
+    prologue(a, boxedShortOfStack, frameBytes);
+
+    for (size_t i = 0; i < code.arity; i++)
+    {
+        const auto isDouble = a.newLabel();
+        a.movLoad(Reg::RAX, Reg::RDI, slot(i));
+        a.movStore(Reg::RBX, slot(i), Reg::RAX);
+        a.mov(Reg::RCX, Reg::RAX);
+        a.andReg(Reg::RCX, Reg::R8);
+        a.cmp(Reg::RCX, Reg::R8);
+        a.jcc(Condition::NOT_EQUAL, isDouble);
+        a.cvtsi2sd(Xmm::XMM0, Reg::RAX);
+        a.movsdStore(Reg::RBX, slot(i), Xmm::XMM0);
+        a.bind(isDouble);
+    }
+
+    a.jmp(argsCopied);
+
+    // Returning BAIL, the caller runs the boxed IR.
+    a.bind(boxedShortOfStack);
+    restoreRegisters(a);
+    a.bind(bail);
+    a.movImm(Reg::RAX, BAIL);
+    a.ret();
+
+    const auto entry = a.offset();
+    a.bind(entryLabel);
+    prologue(a, shortOfStack, frameBytes);
+
+    for (size_t i = 0; i < code.arity; i++)
+    {
+        a.movLoad(Reg::RAX, Reg::RDI, slot(i));
+        a.movStore(Reg::RBX, slot(i), Reg::RAX);
+    }
+
+    a.bind(argsCopied);
+
+    for (size_t i = 0; i < code.constants.size(); i++)
+    {
+        a.movImm(Reg::RAX, code.constants[i].bits());
+        a.movStore(Reg::RBX, slot(code.arity + i), Reg::RAX);
+    }
+
+    a.bind(body);
+
+    // Register whose boolean is also in RAX, with FALSE_BITS in RCX.
+    auto boolInRax = static_cast<size_t>(-1);
+
+    for (size_t i = 0; i < instrs.size(); i++)
+    {
+        const auto& instr = instrs[i];
+        a.bind(labels[i]);
+
+        if (jumpedTo[i])
+        {
+            boolInRax = static_cast<size_t>(-1);
+        }
+
+        const auto compareDoubles = [&](uint32_t left, uint32_t right) {
+            a.zeroEax();
+            a.movsdLoad(Xmm::XMM0, Reg::RBX, slot(left));
+            a.ucomisd(Xmm::XMM0, Reg::RBX, slot(right));
+        };
+        const auto compareToZero = [&](uint32_t operand) {
+            a.zeroEax();
+            a.xorpd(Xmm::XMM0, Xmm::XMM0);
+            a.ucomisd(Xmm::XMM0, Reg::RBX, slot(operand));
+        };
+        const auto arithmetic = [&](auto op) {
+            a.movsdLoad(Xmm::XMM0, Reg::RBX, slot(instr.a));
+            (a.*op)(Xmm::XMM0, Reg::RBX, slot(instr.b));
+            a.movsdStore(Reg::RBX, slot(instr.dst), Xmm::XMM0);
+        };
+        const auto nextBool = instr.dst;
+        auto setsBool = true;
+
+        switch (instr.op)
+        {
+        case IrOp::ADD:
+            arithmetic(&X64Assembler::addsd);
+            setsBool = false;
+            break;
+        case IrOp::SUBTRACT:
+            arithmetic(&X64Assembler::subsd);
+            setsBool = false;
+            break;
+        case IrOp::MULTIPLY:
+            arithmetic(&X64Assembler::mulsd);
+            setsBool = false;
+            break;
+        case IrOp::DIVIDE:
+            arithmetic(&X64Assembler::divsd);
+            setsBool = false;
+            break;
+        // Unordered operands (NaN) leave CF set, so every comparison fails.
+        case IrOp::GREATER:
+            compareDoubles(instr.a, instr.b);
+            a.setcc(Condition::ABOVE, Reg::RAX);
+            storeBool(a, instr.dst);
+            break;
+        case IrOp::GREATER_EQUAL:
+            compareDoubles(instr.a, instr.b);
+            a.setcc(Condition::ABOVE_EQUAL, Reg::RAX);
+            storeBool(a, instr.dst);
+            break;
+        case IrOp::LESS:
+            compareDoubles(instr.b, instr.a);
+            a.setcc(Condition::ABOVE, Reg::RAX);
+            storeBool(a, instr.dst);
+            break;
+        case IrOp::LESS_EQUAL:
+            compareDoubles(instr.b, instr.a);
+            a.setcc(Condition::ABOVE_EQUAL, Reg::RAX);
+            storeBool(a, instr.dst);
+            break;
+        case IrOp::EQUAL:
+        case IrOp::NOT_EQUAL:
+        {
+            const auto equal = instr.op == IrOp::EQUAL;
+
+            if (instr.flag)
+            {
+                // Booleans, by bits.
+                a.zeroEax();
+                a.movLoad(Reg::RDX, Reg::RBX, slot(instr.a));
+                a.cmpLoad(Reg::RDX, Reg::RBX, slot(instr.b));
+                a.setcc(equal ? Condition::EQUAL : Condition::NOT_EQUAL, Reg::RAX);
+            }
+            else
+            {
+                compareDoubles(instr.a, instr.b);
+                a.setcc(equal ? Condition::EQUAL : Condition::NOT_EQUAL, Reg::RAX);
+                a.setcc(equal ? Condition::NOT_PARITY : Condition::PARITY, Reg::RCX);
+
+                if (equal)
+                {
+                    a.andAlCl();
+                }
+                else
+                {
+                    a.orAlCl();
+                }
+            }
+
+            storeBool(a, instr.dst);
+            break;
+        }
+        case IrOp::NOT:
+        case IrOp::TRUTHY:
+        {
+            const auto truthy = instr.op == IrOp::TRUTHY;
+
+            if (instr.flag)
+            {
+                a.zeroEax();
+                a.movImm(Reg::RCX, Value::FALSE_BITS);
+                a.cmpLoad(Reg::RCX, Reg::RBX, slot(instr.a));
+                a.setcc(truthy ? Condition::NOT_EQUAL : Condition::EQUAL, Reg::RAX);
+            }
+            else
+            {
+                // Numbers other than 0 and -0 are truthy, NaN too.
+                compareToZero(instr.a);
+                a.setcc(truthy ? Condition::NOT_EQUAL : Condition::EQUAL, Reg::RAX);
+                a.setcc(truthy ? Condition::PARITY : Condition::NOT_PARITY, Reg::RCX);
+
+                if (truthy)
+                {
+                    a.orAlCl();
+                }
+                else
+                {
+                    a.andAlCl();
+                }
+            }
+
+            storeBool(a, instr.dst);
+            break;
+        }
+        case IrOp::NEGATE:
+            a.movLoad(Reg::RAX, Reg::RBX, slot(instr.a));
+            a.flipSign(Reg::RAX);
+            a.movStore(Reg::RBX, slot(instr.dst), Reg::RAX);
+            setsBool = false;
+            break;
+        case IrOp::MOVE:
+            a.movLoad(Reg::RAX, Reg::RBX, slot(instr.a));
+            a.movStore(Reg::RBX, slot(instr.dst), Reg::RAX);
+            setsBool = false;
+            break;
+        case IrOp::JUMP:
+            if (instr.dst != i + 1)
+            {
+                a.jmp(labels[instr.dst]);
+            }
+            setsBool = false;
+            break;
+        case IrOp::BRANCH:
+            if (!instr.flag)
+            {
+                compareToZero(instr.a);
+                a.jcc(Condition::NOT_EQUAL, labels[instr.dst]);
+                a.jcc(Condition::PARITY, labels[instr.dst]);
+
+                if (instr.b != i + 1)
+                {
+                    a.jmp(labels[instr.b]);
+                }
+                setsBool = false;
+                break;
+            }
+
+            if (boolInRax != instr.a)
+            {
+                a.movLoad(Reg::RAX, Reg::RBX, slot(instr.a));
+                a.movImm(Reg::RCX, Value::FALSE_BITS);
+            }
+
+            a.cmp(Reg::RAX, Reg::RCX);
+
+            if (instr.b == i + 1)
+            {
+                a.jcc(Condition::NOT_EQUAL, labels[instr.dst]);
+            }
+            else
+            {
+                a.jcc(Condition::EQUAL, labels[instr.b]);
+
+                if (instr.dst != i + 1)
+                {
+                    a.jmp(labels[instr.dst]);
+                }
+            }
+            setsBool = false;
+            break;
+        case IrOp::RETURN:
+            a.movLoad(Reg::RAX, Reg::RBX, slot(instr.a));
+            a.lea(Reg::RSP, Reg::RBP, -16);
+            restoreRegisters(a);
+            a.ret();
+            setsBool = false;
+            break;
+        case IrOp::PRINT:
+            a.mov(Reg::RDI, Reg::R12);
+            a.movLoad(Reg::RSI, Reg::RBX, slot(instr.a));
+            a.movImm(Reg::RAX, address(&jitPrint));
+            a.call(Reg::RAX);
+            setsBool = false;
+            break;
+        case IrOp::STORE_GLOBAL:
+            a.mov(Reg::RDI, Reg::R12);
+            a.movImm(Reg::RSI, address(&code));
+            a.movImm(Reg::RDX, i);
+            a.movLoad(Reg::RCX, Reg::RBX, slot(instr.a));
+            a.movImm(Reg::RAX, address(&jitStoreGlobal));
+            a.call(Reg::RAX);
+            setsBool = false;
+            break;
+        case IrOp::CALL:
+        {
+            const auto& site = code.callSites[instr.c];
+            const auto args = code.callArgs.data() + site.firstArg;
+
+            for (size_t arg = 0; arg < site.argCount; arg++)
+            {
+                a.movLoad(Reg::RAX, Reg::RBX, slot(args[arg]));
+                a.movStore(Reg::RBX, slot(outgoing + arg), Reg::RAX);
+            }
+
+            const auto target = m_runtime.host->callTarget(code, static_cast<uint32_t>(i));
+
+            if (target == &code && instr.flag)
+            {
+                // Tail recursion loops in the same frame.
+                for (size_t arg = 0; arg < site.argCount; arg++)
+                {
+                    a.movLoad(Reg::RAX, Reg::RBX, slot(outgoing + arg));
+                    a.movStore(Reg::RBX, slot(arg), Reg::RAX);
+                }
+
+                a.jmp(body);
+                setsBool = false;
+                break;
+            }
+
+            a.lea(Reg::RDI, Reg::RBX, slot(outgoing));
+            a.mov(Reg::RSI, Reg::R12);
+
+            const auto done = a.newLabel();
+            const auto slowCall = a.newLabel();
+
+            if (target == &code)
+            {
+                a.call(entryLabel);
+            }
+            else
+            {
+                if (target)
+                {
+                    // Goes native once the callee gets compiled.
+                    a.movImm(Reg::RAX, address(&target->native));
+                    a.movLoad(Reg::RAX, Reg::RAX, 0);
+                    a.test(Reg::RAX, Reg::RAX);
+                    a.jcc(Condition::EQUAL, slowCall);
+                    a.call(Reg::RAX);
+                    a.jmp(done);
+                }
+
+                a.bind(slowCall);
+                a.mov(Reg::RCX, Reg::RDI);
+                a.mov(Reg::RDI, Reg::R12);
+                a.movImm(Reg::RSI, address(&code));
+                a.movImm(Reg::RDX, i);
+                a.movImm(Reg::RAX, address(&jitCall));
+                a.call(Reg::RAX);
+            }
+
+            a.bind(done);
+            a.movStore(Reg::RBX, slot(instr.dst), Reg::RAX);
+            setsBool = false;
+            break;
+        }
+        default:
+            // Not in unboxed code.
+            setsBool = false;
+            break;
+        }
+
+        boolInRax = setsBool ? nextBool : static_cast<size_t>(-1);
+    }
+
+    // Short of stack, the IR runs the function instead.
+    a.bind(shortOfStack);
+    a.mov(Reg::RDX, Reg::RDI);
+    a.mov(Reg::RDI, Reg::RSI);
+    a.movImm(Reg::RSI, address(&code));
+    a.movImm(Reg::RAX, address(&jitInterpret));
+    a.call(Reg::RAX);
+    restoreRegisters(a);
+    a.ret();
+
+    return Assembled{ a.finish(), boxedEntry, entry };
+}
+
+uint8_t* Jit::install(const std::vector<uint8_t>& bytes)
+{
+#if LOX_JIT_X64
+    const auto start = (m_used + 15) / 16 * 16;
+
+    if (start + bytes.size() > m_cacheSize)
+    {
+        return nullptr;
+    }
+
+    // Native code may be running further up the stack, but not while this
+    // runs: the pages can go writable for a moment.
+    const auto firstPage = start / m_pageSize * m_pageSize;
+    const auto endPage = (start + bytes.size() + m_pageSize - 1) / m_pageSize * m_pageSize;
+
+    if (mprotect(m_cache + firstPage, endPage - firstPage, PROT_READ | PROT_WRITE) != 0)
+    {
+        return nullptr;
+    }
+
+    std::memcpy(m_cache + start, bytes.data(), bytes.size());
+
+    if (mprotect(m_cache + firstPage, endPage - firstPage, PROT_READ | PROT_EXEC) != 0)
+    {
+        return nullptr;
+    }
+
+    m_used = start + bytes.size();
+    return m_cache + start;
+#else
+    static_cast<void>(bytes);
+    return nullptr;
+#endif
+}
@@ -0,0 +1,149 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <vector>
+#include "Value.h"
+
+namespace pimentel
+{
+    struct IrCode;
+
+    enum class JitMode
+    {
+        OFF,
+        // Compiles functions once they are hot.
+        ON,
+        // Compiles functions as soon as they are specialized.
+        EAGER
+    };
+
+    struct JitOptions
+    {
+        JitMode mode = JitMode::OFF;
+        // Bytes of native code at most, functions past it stay in the IR.
+        size_t cacheSize = 16 * 1024 * 1024;
+        // Appends the address, size and name of every function compiled to
+        // /tmp/perf-<pid>.map, where perf looks for them.
+        bool perfMap = false;
+    };
+
+    struct JitRuntime;
+
+    // Native code of a function, called with the raw bits of its arguments.
+    using JitEntry = uint64_t (*)(const uint64_t* args, JitRuntime* runtime);
+
+    // What native code calls back into, see IrExecutor. The instructions are
+    // indexes in `code`.
+    class JitHost
+    {
+    public:
+        virtual ~JitHost() = default;
+
+        // Unboxed code a CALL always goes to, null when it goes through
+        // call() instead.
+        virtual const IrCode* callTarget(const IrCode& code, uint32_t instr) = 0;
+        // A CALL whose target has no native code. Arguments and result are
+        // unboxed.
+        virtual uint64_t call(const IrCode& code, uint32_t instr, const uint64_t* args) = 0;
+        // Runs unboxed `code` in the IR, when native code is short of stack.
+        virtual uint64_t interpret(const IrCode& code, const uint64_t* args) = 0;
+        virtual void print(uint64_t value) = 0;
+        virtual void storeGlobal(const IrCode& code, uint32_t instr, uint64_t value) = 0;
+    };
+
+    struct JitRuntime
+    {
+        // Native frames don't go below, see JitHost::interpret().
+        uintptr_t stackLimit;
+        JitHost* host;
+    };
+
+    struct JitStats
+    {
+        size_t compiled = 0;
+        // Functions left to the IR because the code cache was full.
+        size_t rejected = 0;
+        size_t bytes = 0;
+    };
+
+    // Baseline compiler from the unboxed code of fully numeric functions
+    // (IrCode::unboxed) to x86-64, on Linux. Each IR instruction becomes a
+    // fixed sequence working on the registers of a frame on the machine
+    // stack, where every value is a double or a boolean; calls between
+    // compiled functions are native calls.
+    //
+    // Functions have two entry points. IrCode::native takes unboxed
+    // arguments, IrCode::boxedNative takes any Values and returns BAIL
+    // without running anything when one isn't a number, for the caller to
+    // run the boxed IR instead.
+    //
+    // Code lives in a fixed size mmap'd cache, writable only while a
+    // function is being installed.
+    class Jit
+    {
+    public:
+        // Calls plus backward jumps of unboxed code before JitMode::ON
+        // compiles it.
+        static constexpr uint32_t HOT_THRESHOLD = 1000;
+        // Never the bits of a Value.
+        static constexpr uint64_t BAIL = Value::QNAN | 0xba11;
+
+        // x86-64 Linux only, elsewhere nothing gets compiled.
+        static bool supported();
+
+        Jit(JitHost& host, const JitOptions& options);
+        Jit(const Jit&) = delete;
+        Jit& operator=(const Jit&) = delete;
+        ~Jit();
+
+        JitMode mode() const
+        {
+            return m_options.mode;
+        }
+
+        JitRuntime* runtime()
+        {
+            return &m_runtime;
+        }
+
+        // Sets the entry points of `code`, the unboxed code of a fully
+        // numeric function. False when it doesn't fit in the cache.
+        bool compile(const IrCode& code);
+
+        // Forgets every function compiled, none may be running.
+        void reset();
+
+        const JitStats& stats() const
+        {
+            return m_stats;
+        }
+
+        void printStats(std::ostream& stream) const;
+
+    private:
+        struct Assembled
+        {
+            std::vector<uint8_t> bytes;
+            size_t boxedEntry;
+            size_t entry;
+        };
+
+        Assembled assemble(const IrCode& code);
+        // Address of `bytes` copied in the cache, null when full.
+        uint8_t* install(const std::vector<uint8_t>& bytes);
+
+    private:
+        JitOptions m_options;
+        JitRuntime m_runtime;
+
+        uint8_t* m_cache = nullptr;
+        size_t m_cacheSize = 0;
+        size_t m_used = 0;
+        size_t m_pageSize = 0;
+
+        std::ofstream m_perfMap;
+        JitStats m_stats;
+    };
+}
@@ -3,7 +3,6 @@
 #include <sstream>
 #include <iostream>
 
-#include "ExpressionVisitor.hpp"
 
 #include "Scanner.h"
 
@@ -11,34 +10,12 @@
 
 #include "Parser.h"
 #include "AstPrinter.hpp"
+#include "Optimizer.h"
 
 using namespace pimentel;
 
 namespace
 {
-    void run(const std::string& code, Interpreter& interpreter)
-    {
-        Scanner scanner{code};
-
-        const auto tokens = scanner.scanTokens();
-
-        Parser p{tokens};
-
-        // AstPrinter astPrinter;
-
-        const auto stmts = p.parse();
-
-        if(!stmts.size() || ErrorManager::get().hasError())
-        {
-            std::cout << "Errors found, please fix." << std::endl;
-
-            return;
-        }
-
-        // std::cout << astPrinter.print(*stmts) << std::endl;
-        interpreter.interpret(stmts);
-    }
-
     std::string readAllTextFromFile(const std::string& filename)
     {
         std::ifstream file{filename, std::ios::binary | std::ios::ate};
@@ -64,14 +41,37 @@ namespace
 
 Lox::Lox()
     :
-    m_interpreter(std::cout)
+    Lox(Engine::INTERPRETER)
+{}
+
+Lox::Lox(Engine engine)
+    :
+    Lox(LoxOptions{ engine })
 {}
 
+Lox::Lox(const LoxOptions& options)
+    :
+    m_options(options),
+    m_interpreter(std::cout),
+    m_vm(std::cout),
+    m_closures(std::cout)
+{
+    if(m_options.engine == Engine::IR && !m_interpreter.enableIr(m_options.dumpIr, m_options.jit))
+    {
+        std::cerr << "[LOG] The JIT needs x86-64 Linux, running without it." << std::endl;
+    }
+
+    if(m_options.memoize)
+    {
+        m_interpreter.enableMemoization(m_options.memoizeCapacity);
+    }
+}
+
 void Lox::runFile(const std::string& filename)
 {
     auto dataStream = readAllTextFromFile(filename);
 
-    run(dataStream, m_interpreter);
+    run(dataStream);
 }
 
 void Lox::runPrompt()
@@ -90,8 +90,63 @@ void Lox::runPrompt()
             break;
         }
 
-        run(line, m_interpreter);
+        run(line);
 
         ErrorManager::get().resetError();
     }
-}
\ No newline at end of file
+}
+
+void Lox::printSpecializationStats(std::ostream& stream) const
+{
+    m_interpreter.printSpecializationStats(stream);
+}
+
+void Lox::printIrStats(std::ostream& stream) const
+{
+    m_interpreter.printIrStats(stream);
+}
+
+void Lox::printMemoStats(std::ostream& stream) const
+{
+    m_interpreter.printMemoStats(stream);
+}
+
+void Lox::run(const std::string& code)
+{
+    Scanner scanner{code};
+
+    const auto tokens = scanner.scanTokens();
+
+    Parser p{tokens};
+
+    const auto program = p.parse();
+
+    if(!program->size() || ErrorManager::get().hasError())
+    {
+        std::cout << "Errors found, please fix." << std::endl;
+
+        return;
+    }
+
+    Optimizer{*program}.optimize();
+
+    if(m_options.dumpOptimizedAst)
+    {
+        AstPrinter astPrinter;
+        std::cout << astPrinter.print(*program);
+    }
+
+    switch(m_options.engine)
+    {
+    case Engine::INTERPRETER:
+    case Engine::IR:
+        m_interpreter.interpret(*program);
+        break;
+    case Engine::VM:
+        m_vm.interpret(*program);
+        break;
+    case Engine::CLOSURE:
+        m_closures.interpret(*program);
+        break;
+    }
+}
@@ -1,21 +1,63 @@
 #pragma once
 #include <string>
 #include "Interpreter.h"
+#include "VM.h"
+#include "ClosureEngine.h"
+#include "Memoizer.h"
+#include "Jit.h"
 
 namespace pimentel
 {
 
+enum class Engine
+{
+    INTERPRETER,
+    VM,
+    // The interpreter, running the functions it can lower as optimized IR.
+    IR,
+    // Programs compiled to trees of closures, see ClosureEngine.
+    CLOSURE
+};
+
+struct LoxOptions
+{
+    Engine engine = Engine::INTERPRETER;
+
+    // Prints the program after the Optimizer ran, before executing it.
+    bool dumpOptimizedAst = false;
+    // Prints the IR of every function once optimized, with Engine::IR.
+    bool dumpIr = false;
+    // Native code for hot fully numeric functions, with Engine::IR.
+    JitOptions jit = {};
+    // Caches results of pure functions with the interpreter engines, up to
+    // memoizeCapacity of them.
+    bool memoize = false;
+    size_t memoizeCapacity = Memoizer::DEFAULT_CAPACITY;
+};
+
 class Lox
 {
 public:
     Lox();
+    Lox(Engine engine);
+    Lox(const LoxOptions& options);
     ~Lox() = default;
 
     void runFile(const std::string& filename);
     void runPrompt();
+
+    void printSpecializationStats(std::ostream& stream) const;
+    void printIrStats(std::ostream& stream) const;
+    void printMemoStats(std::ostream& stream) const;
+private:
+    void run(const std::string& code);
+
 private:
+    LoxOptions m_options;
     Interpreter m_interpreter;
+    VM m_vm;
+    ClosureEngine m_closures;
 
 };
 
-}
\ No newline at end of file
+}
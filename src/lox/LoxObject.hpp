@@ -1,10 +1,51 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
 
 namespace pimentel
 {
+    class Heap;
+
+    enum class ObjType : uint8_t
+    {
+        OBJECT,
+        STRING,
+        CALLABLE,
+        ENVIRONMENT
+    };
+
+    // Base of every heap allocated object. Objects are owned by the Heap and
+    // reclaimed by its mark-sweep collector, values only point to them.
     class LoxObject
     {
     public:
+        LoxObject(ObjType type = ObjType::OBJECT)
+            :
+            m_type(type)
+        {}
+        LoxObject(const LoxObject&) = delete;
+        LoxObject& operator=(const LoxObject&) = delete;
         virtual ~LoxObject() = default;
+
+        ObjType type() const
+        {
+            return m_type;
+        }
+
+        // Marks every object this one references.
+        virtual void trace(Heap&) {}
+
+        // Bytes accounted to this object for collection scheduling.
+        virtual size_t allocationSize() const
+        {
+            return sizeof(LoxObject);
+        }
+
+    private:
+        friend class Heap;
+
+        LoxObject* m_next = nullptr;
+        bool m_marked = false;
+        ObjType m_type;
     };
-}
\ No newline at end of file
+}
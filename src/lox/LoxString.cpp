@@ -0,0 +1,41 @@
+#include "LoxString.h"
+
+#include <array>
+
+using namespace pimentel;
+
+Value LoxString::concat(const LoxString& left, const LoxString& right)
+{
+    const auto length = left.m_length + right.m_length;
+
+    // Nobody has claimed the characters after `left` yet, take them. Appending
+    // a buffer to itself could reallocate under the source, so copy instead.
+    if (!left.m_shared && left.m_length == left.m_buffer->chars.size() && left.m_buffer != right.m_buffer)
+    {
+        left.m_buffer->append(right.str());
+        return Value{ Heap::get().allocate<LoxString>(left.m_buffer, length) };
+    }
+
+    std::string chars;
+    chars.reserve(length * 2);
+    chars.append(left.str());
+    chars.append(right.str());
+
+    return Value{ Heap::get().allocate<LoxString>(std::make_shared<Buffer>(std::move(chars)), length) };
+}
+
+const Value& pimentel::singleCharString(unsigned char c)
+{
+    static const auto table = []() {
+        std::array<Value, 256> chars;
+        for (size_t i = 0; i < chars.size(); i++)
+        {
+            chars[i] = makeString(std::string(1, static_cast<char>(i)));
+            chars[i].asString()->share();
+            Heap::get().pin(chars[i]);
+        }
+        return chars;
+    }();
+
+    return table[c];
+}
@@ -0,0 +1,142 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include "Heap.h"
+#include "Value.h"
+
+namespace pimentel
+{
+    // Strings are immutable once created, so values can share them freely.
+    //
+    // A string is a prefix of a character buffer that may be shared with
+    // longer strings. Concatenating onto a string that ends at the end of its
+    // buffer appends to the buffer in place instead of copying, which keeps
+    // `s = s + x` loops linear. The characters a string sees never change:
+    // appends only ever write past the end of every existing string.
+    //
+    // Strings kept alive for the whole run, literals and one character
+    // strings, are shared: concatenating onto them copies, or whatever the
+    // buffer grew to would never be freed.
+    //
+    // A buffer outlives the strings that wrote into it as long as one string
+    // uses it, so its memory is charged to the heap by the buffer itself, for
+    // its whole capacity, and not by the strings.
+    class LoxString : public LoxObject
+    {
+    public:
+        LoxString(std::string str)
+            :
+            LoxObject(ObjType::STRING),
+            m_buffer(std::make_shared<Buffer>(std::move(str))),
+            m_length(m_buffer->chars.size())
+        {}
+        ~LoxString() = default;
+
+        std::string_view str() const
+        {
+            return std::string_view{ m_buffer->chars.data(), m_length };
+        }
+
+        size_t size() const
+        {
+            return m_length;
+        }
+
+        // Computed on first use, strings that are never compared don't pay for it.
+        size_t hash() const
+        {
+            if (!m_hashed)
+            {
+                m_hash = std::hash<std::string_view>{}(str());
+                m_hashed = true;
+            }
+
+            return m_hash;
+        }
+
+        bool equals(const LoxString& other) const
+        {
+            if (this == &other)
+            {
+                return true;
+            }
+
+            return m_length == other.m_length && hash() == other.hash() && str() == other.str();
+        }
+
+        static Value concat(const LoxString& left, const LoxString& right);
+
+        void share()
+        {
+            m_shared = true;
+        }
+
+        size_t allocationSize() const override
+        {
+            return sizeof(LoxString);
+        }
+
+    private:
+        friend class Heap;
+
+        // Keeps the heap's count in step with the capacity of `chars`.
+        struct Buffer
+        {
+            Buffer(std::string str)
+                :
+                chars(std::move(str)),
+                heap(Heap::get())
+            {
+                heap.addExternalBytes(chars.capacity());
+            }
+            ~Buffer()
+            {
+                heap.removeExternalBytes(chars.capacity());
+            }
+
+            Buffer(const Buffer&) = delete;
+            Buffer& operator=(const Buffer&) = delete;
+
+            void append(std::string_view more)
+            {
+                const auto capacity = chars.capacity();
+                chars.append(more);
+                heap.addExternalBytes(chars.capacity() - capacity);
+            }
+
+            std::string chars;
+            // Buffers die while the heap sweeps or is destroyed, they don't
+            // look it up then.
+            Heap& heap;
+        };
+
+        LoxString(const std::shared_ptr<Buffer>& buffer, size_t length)
+            :
+            LoxObject(ObjType::STRING),
+            m_buffer(buffer),
+            m_length(length)
+        {}
+
+    private:
+        std::shared_ptr<Buffer> m_buffer;
+        const size_t m_length;
+        mutable size_t m_hash = 0;
+        mutable bool m_hashed = false;
+        bool m_shared = false;
+    };
+
+    inline Value::Value(LoxString* str)
+        :
+        Value(str, ObjType::STRING)
+    {}
+
+    inline Value makeString(std::string str)
+    {
+        return Value{ Heap::get().allocate<LoxString>(std::move(str)) };
+    }
+
+    // Preallocated one character strings, indexing a string never allocates.
+    const Value& singleCharString(unsigned char c);
+}
@@ -0,0 +1,316 @@
+#include "Memoizer.h"
+#include "AstDispatch.hpp"
+#include "Environment.h"
+#include "IrBuilder.h"
+#include "LoxString.h"
+#include "UserFunction.h"
+
+using namespace pimentel;
+
+namespace
+{
+    // Whether a function body does anything but compute a value from its
+    // arguments, and the globals it reads for the rest to check.
+    class PurityCheck
+    {
+    public:
+        void walk(const std::vector<StmtPtr>& stmts)
+        {
+            for (const auto& stmt : stmts)
+            {
+                walk(stmt);
+            }
+        }
+
+        void walk(const StmtPtr& stmt)
+        {
+            if (stmt && !m_impure)
+            {
+                dispatch(*stmt, [this](auto& node) { visit(node); });
+            }
+        }
+
+        void walk(const ExprPtr& expr)
+        {
+            if (expr && !m_impure)
+            {
+                dispatch(*expr, [this](auto& node) { visit(node); });
+            }
+        }
+
+        bool impure() const
+        {
+            return m_impure;
+        }
+
+        const std::unordered_set<Symbol>& globalsRead() const
+        {
+            return m_globalsRead;
+        }
+
+    private:
+        void visit(Binary& expr) { walk(expr.left); walk(expr.right); }
+        void visit(Grouping& expr) { walk(expr.expr); }
+        void visit(Literal&) {}
+        void visit(Unary& expr) { walk(expr.right); }
+        void visit(Logical& expr) { walk(expr.leftExpr); walk(expr.rightExpr); }
+        void visit(Indexing& expr) { walk(expr.indexee); walk(expr.index); }
+
+        void visit(Variable& expr)
+        {
+            if (expr.upvalue >= 0)
+            {
+                m_impure = true;
+            }
+            else if (expr.depth < 0)
+            {
+                m_globalsRead.insert(expr.name.getSymbol());
+            }
+        }
+
+        void visit(Assignment& expr)
+        {
+            if (expr.depth < 0)
+            {
+                m_impure = true;
+            }
+
+            walk(expr.value);
+        }
+
+        void visit(Call& expr)
+        {
+            // Only globals are known to hold pure functions.
+            if (expr.calee->kind != ExprKind::VARIABLE || static_cast<const Variable&>(*expr.calee).depth >= 0)
+            {
+                m_impure = true;
+            }
+
+            walk(expr.calee);
+
+            for (const auto& arg : expr.arguments)
+            {
+                walk(arg);
+            }
+        }
+
+        void visit(ExpressionStmt& stmt) { walk(stmt.expr); }
+        void visit(PrintStmt&) { m_impure = true; }
+        void visit(VarStmt& stmt) { walk(stmt.initializer); }
+        void visit(BlockStmt& stmt) { walk(stmt.stmts); }
+        void visit(IfStmt& stmt) { walk(stmt.expr); walk(stmt.block); walk(stmt.elseblock); }
+        void visit(WhileStmt& stmt) { walk(stmt.expr); walk(stmt.block); }
+        void visit(BreakStmt&) {}
+        void visit(ForStmt& stmt) { walk(stmt.variableDef); walk(stmt.expr); walk(stmt.incStmt); walk(stmt.block); }
+        // Every closure is a new object.
+        void visit(FunctionDeclStmt&) { m_impure = true; }
+        void visit(ReturnStmt& stmt) { walk(stmt.expr); }
+
+    private:
+        bool m_impure = false;
+        std::unordered_set<Symbol> m_globalsRead;
+    };
+
+    template<typename T>
+    void appendBytes(std::string& key, const T& value)
+    {
+        key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+}
+
+Memoizer::Memoizer(GlobalTable& globals, size_t capacity)
+    :
+    m_globals(globals),
+    m_capacity(capacity)
+{
+    Heap::get().addRootSource(this);
+}
+
+Memoizer::~Memoizer()
+{
+    Heap::get().removeRootSource(this);
+}
+
+void Memoizer::addProgram(const Program& program)
+{
+    const auto assigned = m_assigned.size();
+    collectAssignedGlobals(program.stmts, m_assigned);
+
+    if (m_assigned.size() != assigned)
+    {
+        m_declarations.clear();
+        m_results.clear();
+        m_index.clear();
+    }
+}
+
+bool Memoizer::isPure(const UserFunction& function)
+{
+    const auto found = m_declarations.find(function.declaration().get());
+
+    if (found != m_declarations.end())
+    {
+        return found->second.purity == Purity::PURE;
+    }
+
+    return checkPurity(function.declaration()) == Purity::PURE;
+}
+
+Memoizer::Purity Memoizer::checkPurity(const std::shared_ptr<const FunctionDeclStmt>& root)
+{
+    // Every function the root may end up calling has to be pure, cycles
+    // included.
+    std::vector<std::shared_ptr<const FunctionDeclStmt>> reached{ root };
+    std::unordered_set<const FunctionDeclStmt*> seen{ root.get() };
+
+    for (size_t i = 0; i < reached.size(); i++)
+    {
+        const auto declaration = reached[i];
+        const auto known = m_declarations.find(declaration.get());
+
+        if (known != m_declarations.end() && known->second.purity == Purity::PURE)
+        {
+            continue;
+        }
+
+        PurityCheck check;
+
+        if (known == m_declarations.end())
+        {
+            check.walk(declaration->block->stmts);
+
+            if (check.impure())
+            {
+                m_declarations[declaration.get()] = Declaration{ declaration, Purity::IMPURE };
+            }
+        }
+
+        if (known != m_declarations.end() || check.impure())
+        {
+            m_declarations[root.get()] = Declaration{ root, Purity::IMPURE };
+            return Purity::IMPURE;
+        }
+
+        for (const auto& global : check.globalsRead())
+        {
+            const auto value = m_assigned.contains(global) ? nullptr : m_globals.find(global);
+            const auto callee = value && value->isCallable() ? value->asCallable()->asUserFunction() : nullptr;
+
+            if (!callee)
+            {
+                m_declarations[root.get()] = Declaration{ root, Purity::IMPURE };
+                return Purity::IMPURE;
+            }
+
+            if (seen.insert(callee->declaration().get()).second)
+            {
+                reached.push_back(callee->declaration());
+            }
+        }
+    }
+
+    for (const auto& declaration : reached)
+    {
+        if (m_declarations.emplace(declaration.get(), Declaration{ declaration, Purity::PURE }).second)
+        {
+            m_stats.pureFunctions++;
+        }
+    }
+
+    return Purity::PURE;
+}
+
+std::optional<std::string> Memoizer::keyFor(const UserFunction& function, Environment* frame)
+{
+    if (!isPure(function))
+    {
+        return std::nullopt;
+    }
+
+    std::string key;
+    appendBytes(key, function.declaration().get());
+
+    for (size_t i = 0; i < function.arity(); i++)
+    {
+        const auto& arg = frame->getAt(0, i);
+
+        if (arg.isNumber())
+        {
+            // 2 and 2.0 are the same number.
+            key += 'n';
+            appendBytes(key, Value::number(arg.asNumber()).bits());
+        }
+        else if (arg.isString())
+        {
+            const auto str = arg.asString()->str();
+            key += 's';
+            appendBytes(key, str.size());
+            key += str;
+        }
+        else if (!arg.isHeapObject())
+        {
+            key += 'v';
+            appendBytes(key, arg.bits());
+        }
+        else
+        {
+            // Other objects are compared by address, which a collection
+            // may hand to a new one.
+            return std::nullopt;
+        }
+    }
+
+    return key;
+}
+
+std::optional<Value> Memoizer::find(const std::string& key)
+{
+    const auto found = m_index.find(key);
+
+    if (found == m_index.end())
+    {
+        m_stats.misses++;
+        return std::nullopt;
+    }
+
+    m_stats.hits++;
+    m_results.splice(m_results.begin(), m_results, found->second);
+
+    return found->second->second;
+}
+
+void Memoizer::insert(std::string key, const Value& result)
+{
+    const auto found = m_index.find(key);
+
+    if (found != m_index.end())
+    {
+        found->second->second = result;
+        m_results.splice(m_results.begin(), m_results, found->second);
+        return;
+    }
+
+    m_results.emplace_front(std::move(key), result);
+    m_index.emplace(m_results.front().first, m_results.begin());
+
+    if (m_results.size() > m_capacity)
+    {
+        m_index.erase(m_results.back().first);
+        m_results.pop_back();
+        m_stats.evictions++;
+    }
+}
+
+void Memoizer::markRoots(Heap& heap)
+{
+    for (const auto& [key, result] : m_results)
+    {
+        heap.mark(result);
+    }
+}
+
+void Memoizer::printStats(std::ostream& stream) const
+{
+    stream << "[Memo] pure functions: " << m_stats.pureFunctions << " hits: " << m_stats.hits
+        << " misses: " << m_stats.misses << " evictions: " << m_stats.evictions << std::endl;
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include "Heap.h"
+#include "GlobalTable.h"
+#include "Program.h"
+#include "Value.h"
+
+namespace pimentel
+{
+    class Environment;
+    struct UserFunction;
+
+    struct MemoStats
+    {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t evictions = 0;
+        size_t pureFunctions = 0;
+    };
+
+    // Caches the results of calls to pure functions, keyed by the arguments.
+    //
+    // A function is pure when it prints nothing, assigns no global, uses no
+    // variable captured from an enclosing function, declares no function and
+    // only reads globals that nothing assigns and that hold pure functions,
+    // i.e. only calls pure functions. Calling it again with the same
+    // arguments then gives the same result.
+    //
+    // The table holds a bounded number of results, the least recently used
+    // one goes first.
+    class Memoizer : public RootSource
+    {
+    public:
+        static constexpr size_t DEFAULT_CAPACITY = 64 * 1024;
+
+        Memoizer(GlobalTable& globals, size_t capacity);
+        Memoizer(const Memoizer&) = delete;
+        Memoizer& operator=(const Memoizer&) = delete;
+        ~Memoizer();
+
+        // Records the globals `program` assigns. Forgets every result when
+        // it assigns one that wasn't assigned before: functions may have been
+        // taken for pure because of it.
+        void addProgram(const Program& program);
+
+        bool isPure(const UserFunction& function);
+
+        // Key of a call to `function` with the arguments in `frame`'s first
+        // slots, nothing when the function isn't pure or an argument can't be
+        // compared by value.
+        std::optional<std::string> keyFor(const UserFunction& function, Environment* frame);
+
+        // Counts a hit or a miss.
+        std::optional<Value> find(const std::string& key);
+        void insert(std::string key, const Value& result);
+
+        void markRoots(Heap& heap) override;
+
+        const MemoStats& stats() const
+        {
+            return m_stats;
+        }
+
+        void printStats(std::ostream& stream) const;
+
+    private:
+        enum class Purity
+        {
+            PURE,
+            IMPURE
+        };
+
+        struct Declaration
+        {
+            // Keeps the declaration, whose address is part of the keys, alive.
+            std::shared_ptr<const FunctionDeclStmt> declaration;
+            Purity purity;
+        };
+
+        Purity checkPurity(const std::shared_ptr<const FunctionDeclStmt>& declaration);
+
+    private:
+        GlobalTable& m_globals;
+        std::unordered_set<Symbol> m_assigned;
+        std::unordered_map<const FunctionDeclStmt*, Declaration> m_declarations;
+
+        size_t m_capacity;
+        // Most recently used first.
+        std::list<std::pair<std::string, Value>> m_results;
+        std::unordered_map<std::string, std::list<std::pair<std::string, Value>>::iterator> m_index;
+
+        MemoStats m_stats;
+    };
+}
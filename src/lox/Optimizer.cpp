@@ -0,0 +1,414 @@
+#include "Optimizer.h"
+#include "AstDispatch.hpp"
+
+#include <optional>
+#include <string>
+
+using namespace pimentel;
+
+namespace
+{
+    const Token::LiteralType* literalOf(const ExprPtr& expr)
+    {
+        if (expr && expr->kind == ExprKind::LITERAL)
+        {
+            return &static_cast<const Literal&>(*expr).value;
+        }
+
+        return nullptr;
+    }
+
+    // Mirrors isTruthy() for the values a literal can hold.
+    bool isTruthyLiteral(const Token::LiteralType& literal)
+    {
+        if (const auto* boolean = std::get_if<bool>(&literal))
+        {
+            return *boolean;
+        }
+
+        if (const auto* number = std::get_if<double>(&literal))
+        {
+            return *number != 0.0;
+        }
+
+        return !std::holds_alternative<void*>(literal);
+    }
+
+    // Mirrors binaryOperation(), returning nothing where the runtime would
+    // report an error or produce a value no literal can represent.
+    std::optional<Token::LiteralType> foldBinary(TokenType op, const Token::LiteralType& left, const Token::LiteralType& right)
+    {
+        if (left.index() != right.index())
+        {
+            if (op == TokenType::EQUAL_EQUAL)
+            {
+                return Token::LiteralType{ false };
+            }
+
+            return std::nullopt;
+        }
+
+        if (const auto* leftNumber = std::get_if<double>(&left))
+        {
+            const auto l = *leftNumber;
+            const auto r = std::get<double>(right);
+
+            switch (op)
+            {
+            case TokenType::MINUS:
+                return Token::LiteralType{ l - r };
+            case TokenType::PLUS:
+                return Token::LiteralType{ l + r };
+            case TokenType::SLASH:
+                return Token::LiteralType{ l / r };
+            case TokenType::STAR:
+                return Token::LiteralType{ l * r };
+            case TokenType::GREATER:
+                return Token::LiteralType{ l > r };
+            case TokenType::GREATER_EQUAL:
+                return Token::LiteralType{ l >= r };
+            case TokenType::LESS:
+                return Token::LiteralType{ l < r };
+            case TokenType::LESS_EQUAL:
+                return Token::LiteralType{ l <= r };
+            case TokenType::BANG_EQUAL:
+                return Token::LiteralType{ l != r };
+            case TokenType::EQUAL_EQUAL:
+                return Token::LiteralType{ l == r };
+            default:
+                return std::nullopt;
+            }
+        }
+
+        if (const auto* leftStr = std::get_if<std::string>(&left))
+        {
+            const auto& rightStr = std::get<std::string>(right);
+
+            switch (op)
+            {
+            case TokenType::EQUAL_EQUAL:
+                return Token::LiteralType{ *leftStr == rightStr };
+            case TokenType::BANG_EQUAL:
+                return Token::LiteralType{ *leftStr != rightStr };
+            case TokenType::PLUS:
+                return Token::LiteralType{ *leftStr + rightStr };
+            default:
+                return std::nullopt;
+            }
+        }
+
+        if (const auto* leftBool = std::get_if<bool>(&left))
+        {
+            const auto rightBool = std::get<bool>(right);
+
+            switch (op)
+            {
+            case TokenType::EQUAL_EQUAL:
+                return Token::LiteralType{ *leftBool == rightBool };
+            case TokenType::BANG_EQUAL:
+                return Token::LiteralType{ *leftBool != rightBool };
+            default:
+                return std::nullopt;
+            }
+        }
+
+        return std::nullopt;
+    }
+}
+
+Optimizer::Optimizer(Program& program)
+    :
+    m_program(program)
+{}
+
+void Optimizer::optimize()
+{
+    optimize(m_program.stmts);
+}
+
+void Optimizer::optimize(std::vector<StmtPtr>& stmts)
+{
+    for (auto& stmt : stmts)
+    {
+        optimize(stmt);
+    }
+
+    std::erase(stmts, nullptr);
+}
+
+void Optimizer::optimize(StmtPtr& stmt)
+{
+    dispatch(*stmt, [this, &stmt](auto& node) { visit(stmt, node); });
+}
+
+void Optimizer::optimizeBody(StmtPtr& stmt)
+{
+    optimize(stmt);
+
+    if (!stmt)
+    {
+        stmt = m_program.make<BlockStmt>();
+    }
+}
+
+void Optimizer::optimize(ExprPtr& expr)
+{
+    dispatch(*expr, [this, &expr](auto& node) { visit(expr, node); });
+}
+
+void Optimizer::replaceWithLiteral(ExprPtr& slot, Token::LiteralType value)
+{
+    slot = m_program.make<Literal>(std::move(value));
+}
+
+void Optimizer::visit(ExprPtr& slot, Binary& expr)
+{
+    optimize(expr.left);
+    optimize(expr.right);
+
+    const auto* left = literalOf(expr.left);
+    const auto* right = literalOf(expr.right);
+
+    if (!left || !right)
+    {
+        return;
+    }
+
+    if (auto folded = foldBinary(expr.operatorType.getType(), *left, *right))
+    {
+        replaceWithLiteral(slot, std::move(*folded));
+    }
+}
+
+void Optimizer::visit(ExprPtr& slot, Grouping& expr)
+{
+    optimize(expr.expr);
+
+    slot = std::move(expr.expr);
+}
+
+void Optimizer::visit(ExprPtr&, Literal&)
+{}
+
+void Optimizer::visit(ExprPtr& slot, Unary& expr)
+{
+    optimize(expr.right);
+
+    const auto* right = literalOf(expr.right);
+
+    if (!right)
+    {
+        return;
+    }
+
+    switch (expr.operatorType.getType())
+    {
+    case TokenType::MINUS:
+        if (const auto* number = std::get_if<double>(right))
+        {
+            replaceWithLiteral(slot, -*number);
+        }
+        break;
+    case TokenType::BANG:
+        replaceWithLiteral(slot, !isTruthyLiteral(*right));
+        break;
+    default:
+        break;
+    }
+}
+
+void Optimizer::visit(ExprPtr&, Variable&)
+{}
+
+void Optimizer::visit(ExprPtr&, Assignment& expr)
+{
+    optimize(expr.value);
+}
+
+void Optimizer::visit(ExprPtr& slot, Logical& expr)
+{
+    optimize(expr.leftExpr);
+    optimize(expr.rightExpr);
+
+    const auto* left = literalOf(expr.leftExpr);
+
+    if (!left)
+    {
+        return;
+    }
+
+    const auto isAnd = expr.op.getType() == TokenType::AND;
+    const auto leftValue = isTruthyLiteral(*left);
+
+    // The left operand alone decides the result, the right one is never run.
+    if (isAnd != leftValue)
+    {
+        replaceWithLiteral(slot, leftValue);
+        return;
+    }
+
+    if (const auto* right = literalOf(expr.rightExpr))
+    {
+        replaceWithLiteral(slot, isTruthyLiteral(*right));
+    }
+}
+
+void Optimizer::visit(ExprPtr&, Call& expr)
+{
+    optimize(expr.calee);
+
+    for (auto& arg : expr.arguments)
+    {
+        optimize(arg);
+    }
+}
+
+void Optimizer::visit(ExprPtr& slot, Indexing& expr)
+{
+    optimize(expr.indexee);
+    optimize(expr.index);
+
+    const auto* indexee = literalOf(expr.indexee);
+    const auto* index = literalOf(expr.index);
+
+    if (!indexee || !index)
+    {
+        return;
+    }
+
+    const auto* str = std::get_if<std::string>(indexee);
+    const auto* i = std::get_if<double>(index);
+
+    // Indices the runtime rejects (fractional ones too) are left for it to
+    // report.
+    if (str && i && *i >= 0 && *i < str->size() && std::trunc(*i) == *i)
+    {
+        replaceWithLiteral(slot, std::string(1, (*str)[static_cast<size_t>(*i)]));
+    }
+}
+
+void Optimizer::visit(StmtPtr& slot, ExpressionStmt& stmt)
+{
+    optimize(stmt.expr);
+
+    if (literalOf(stmt.expr))
+    {
+        slot.reset();
+    }
+}
+
+void Optimizer::visit(StmtPtr&, PrintStmt& stmt)
+{
+    optimize(stmt.expr);
+}
+
+void Optimizer::visit(StmtPtr&, VarStmt& stmt)
+{
+    if (stmt.initializer)
+    {
+        optimize(stmt.initializer);
+    }
+}
+
+void Optimizer::visit(StmtPtr&, BlockStmt& stmt)
+{
+    optimize(stmt.stmts);
+}
+
+void Optimizer::visit(StmtPtr& slot, IfStmt& stmt)
+{
+    optimize(stmt.expr);
+
+    if (const auto* condition = literalOf(stmt.expr))
+    {
+        // if doesn't open a scope, so the taken branch can stand in for it.
+        auto& taken = isTruthyLiteral(*condition) ? stmt.block : stmt.elseblock;
+
+        if (taken)
+        {
+            optimize(taken);
+        }
+
+        slot = std::move(taken);
+        return;
+    }
+
+    optimizeBody(stmt.block);
+
+    if (stmt.elseblock)
+    {
+        optimize(stmt.elseblock);
+    }
+}
+
+void Optimizer::visit(StmtPtr& slot, WhileStmt& stmt)
+{
+    optimize(stmt.expr);
+
+    const auto* condition = literalOf(stmt.expr);
+
+    if (condition && !isTruthyLiteral(*condition))
+    {
+        slot.reset();
+        return;
+    }
+
+    optimizeBody(stmt.block);
+}
+
+void Optimizer::visit(StmtPtr&, BreakStmt&)
+{}
+
+void Optimizer::visit(StmtPtr& slot, ForStmt& stmt)
+{
+    if (stmt.variableDef)
+    {
+        optimize(stmt.variableDef);
+    }
+
+    if (stmt.expr)
+    {
+        optimize(stmt.expr);
+
+        if (const auto* condition = literalOf(stmt.expr))
+        {
+            if (!isTruthyLiteral(*condition))
+            {
+                // Only the initializer runs, still in a scope of its own.
+                if (!stmt.variableDef)
+                {
+                    slot.reset();
+                    return;
+                }
+
+                std::vector<StmtPtr> init;
+                init.push_back(std::move(stmt.variableDef));
+                slot = m_program.make<BlockStmt>(std::move(init));
+                return;
+            }
+
+            // Always true, same as no condition at all.
+            stmt.expr.reset();
+        }
+    }
+
+    if (stmt.incStmt)
+    {
+        optimize(stmt.incStmt);
+    }
+
+    optimizeBody(stmt.block);
+}
+
+void Optimizer::visit(StmtPtr&, FunctionDeclStmt& stmt)
+{
+    optimize(stmt.block->stmts);
+}
+
+void Optimizer::visit(StmtPtr&, ReturnStmt& stmt)
+{
+    if (stmt.expr)
+    {
+        optimize(stmt.expr);
+    }
+}
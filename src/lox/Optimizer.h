@@ -0,0 +1,60 @@
+#pragma once
+#include <vector>
+#include "Expression.h"
+#include "Statement.h"
+#include "Program.h"
+
+namespace pimentel
+{
+    // Rewrites a parsed program before it is resolved and run: folds
+    // arithmetic, comparisons, logical operators and string concatenation
+    // over literal operands, drops grouping nodes, and removes branches and
+    // loops whose condition is known to be false. Operations that would
+    // report an error at runtime are left in place so the error still shows
+    // up when (and only if) the code executes.
+    class Optimizer
+    {
+    public:
+        Optimizer(Program& program);
+        ~Optimizer() = default;
+
+        void optimize();
+
+    private:
+        void optimize(std::vector<StmtPtr>& stmts);
+
+        // May reset `stmt` when the statement has no effect.
+        void optimize(StmtPtr& stmt);
+
+        // Same, for the body of an if or a loop which can't be empty.
+        void optimizeBody(StmtPtr& stmt);
+
+        void optimize(ExprPtr& expr);
+
+        void visit(ExprPtr& slot, Binary& expr);
+        void visit(ExprPtr& slot, Grouping& expr);
+        void visit(ExprPtr& slot, Literal& expr);
+        void visit(ExprPtr& slot, Unary& expr);
+        void visit(ExprPtr& slot, Variable& expr);
+        void visit(ExprPtr& slot, Assignment& expr);
+        void visit(ExprPtr& slot, Logical& expr);
+        void visit(ExprPtr& slot, Call& expr);
+        void visit(ExprPtr& slot, Indexing& expr);
+
+        void visit(StmtPtr& slot, ExpressionStmt& stmt);
+        void visit(StmtPtr& slot, PrintStmt& stmt);
+        void visit(StmtPtr& slot, VarStmt& stmt);
+        void visit(StmtPtr& slot, BlockStmt& stmt);
+        void visit(StmtPtr& slot, IfStmt& stmt);
+        void visit(StmtPtr& slot, WhileStmt& stmt);
+        void visit(StmtPtr& slot, BreakStmt& stmt);
+        void visit(StmtPtr& slot, ForStmt& stmt);
+        void visit(StmtPtr& slot, FunctionDeclStmt& stmt);
+        void visit(StmtPtr& slot, ReturnStmt& stmt);
+
+        void replaceWithLiteral(ExprPtr& slot, Token::LiteralType value);
+
+    private:
+        Program& m_program;
+    };
+}
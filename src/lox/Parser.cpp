@@ -36,16 +36,16 @@ bool Parser::match(const T& tokenTypes)
     return false;
 }
 
-std::vector<StmtPtr> Parser::parse()
+ProgramPtr Parser::parse()
 {
-    std::vector<StmtPtr> stmts{};
+    m_program = std::make_shared<Program>();
 
     while (!isAtEnd())
     {
-        stmts.emplace_back(doDeclaration(ScopeType::GLOBAL));
+        m_program->stmts.emplace_back(doDeclaration(ScopeType::GLOBAL));
     }
 
-    return stmts;
+    return std::move(m_program);
 }
 
 StmtPtr Parser::doDeclaration(ScopeType scopeType)
@@ -69,7 +69,7 @@ StmtPtr Parser::doVarDecl()
     auto initExpr = match(TokenType::EQUAL) ? doExpression() :
         ExprPtr{};
 
-    auto varDecl = std::make_unique<VarStmt>(name, std::move(initExpr));
+    auto varDecl = makeNode<VarStmt>(name, std::move(initExpr));
 
     consume(TokenType::SEMICOLON, "Expect ';' after var decl.");
 
@@ -138,7 +138,10 @@ StmtPtr Parser::doFunctionDecl(ScopeType scopeType)
 
     auto block = doBlockStmt(newScopeType);
 
-    return std::make_unique<FunctionDeclStmt>(name, std::move(block), std::move(argList));
+    auto funDecl = makeNode<FunctionDeclStmt>(name, std::move(block), std::move(argList));
+    funDecl->program = m_program.get();
+
+    return funDecl;
 }
 
 StmtPtr Parser::doPrintStmt()
@@ -147,7 +150,7 @@ StmtPtr Parser::doPrintStmt()
 
     consume(TokenType::SEMICOLON, "Expect ';' after value.");
 
-    return std::make_unique<PrintStmt>(std::move(val));
+    return makeNode<PrintStmt>(std::move(val));
 }
 
 StmtPtr Parser::doExprStmt()
@@ -156,12 +159,12 @@ StmtPtr Parser::doExprStmt()
 
     consume(TokenType::SEMICOLON, "Expect ';' after value.");
 
-    return std::make_unique<ExpressionStmt>(std::move(val));
+    return makeNode<ExpressionStmt>(std::move(val));
 }
 
-std::unique_ptr<BlockStmt> Parser::doBlockStmt(ScopeType scopeType)
+NodePtr<BlockStmt> Parser::doBlockStmt(ScopeType scopeType)
 {
-    return std::make_unique<BlockStmt>(doScopeStmts(scopeType));
+    return makeNode<BlockStmt>(doScopeStmts(scopeType));
 }
 
 StmtPtr pimentel::Parser::doIfStmt(ScopeType scopeType)
@@ -174,7 +177,7 @@ StmtPtr pimentel::Parser::doIfStmt(ScopeType scopeType)
         advance();
         elseBlock = doStmt(scopeType);
     }
-    return std::make_unique<IfStmt>(std::move(expr), std::move(thenBlock), std::move(elseBlock));
+    return makeNode<IfStmt>(std::move(expr), std::move(thenBlock), std::move(elseBlock));
 }
 
 StmtPtr Parser::doWhileStmt(ScopeType scopeType)
@@ -185,7 +188,7 @@ StmtPtr Parser::doWhileStmt(ScopeType scopeType)
     auto expr = doExpression();
     auto block = doStmt(newScopeType);
 
-    return std::make_unique<WhileStmt>(std::move(expr), std::move(block));
+    return makeNode<WhileStmt>(std::move(expr), std::move(block));
 }
 
 StmtPtr pimentel::Parser::doForStmt(ScopeType scopeType)
@@ -217,7 +220,7 @@ StmtPtr pimentel::Parser::doForStmt(ScopeType scopeType)
 
     auto block = doStmt(newScopeType);
 
-    return std::make_unique<ForStmt>(std::move(variableDef), std::move(expr), std::move(incExpr), std::move(block));
+    return makeNode<ForStmt>(std::move(variableDef), std::move(expr), std::move(incExpr), std::move(block));
 }
 
 StmtPtr Parser::doBreakStmt(ScopeType scopeType)
@@ -230,7 +233,7 @@ StmtPtr Parser::doBreakStmt(ScopeType scopeType)
     }
 
     consume(TokenType::SEMICOLON, "Expect ';' after break.");
-    return std::make_unique<BreakStmt>();
+    return makeNode<BreakStmt>();
 }
 
 StmtPtr Parser::doReturnStmt(ScopeType scopeType)
@@ -249,7 +252,7 @@ StmtPtr Parser::doReturnStmt(ScopeType scopeType)
         consume(TokenType::SEMICOLON, "Expect ';' after return stmt.");
     }
 
-    return std::make_unique<ReturnStmt>(std::move(expr));
+    return makeNode<ReturnStmt>(std::move(expr));
 }
 
 std::vector<StmtPtr> Parser::doScopeStmts(ScopeType scopeType)
@@ -299,7 +302,7 @@ ExprPtr pimentel::Parser::doIndexing()
         auto index = doExpression();
 
         consume(TokenType::RIGHT_SQR_BRACKET, "Expected ']' after indexing.");
-        return std::make_unique<Indexing>(std::move(expr), previous(), std::move(index));
+        return makeNode<Indexing>(std::move(expr), previous(), std::move(index));
     }
 
     return expr;
@@ -324,7 +327,7 @@ ExprPtr pimentel::Parser::doArgumentListAndFinishCall(ExprPtr&& callExpr)
 
     auto paren = consume(TokenType::RIGHT_PAREN, "Expect ')' after arguments on call.");
 
-    return std::make_unique<Call>(std::move(callExpr), paren, std::move(argList));
+    return makeNode<Call>(std::move(callExpr), paren, std::move(argList));
 }
 
 ExprPtr Parser::doAssignment()
@@ -340,7 +343,7 @@ ExprPtr Parser::doAssignment()
         if (exprAsVar)
         {
             auto name = exprAsVar->name;
-            return std::make_unique<Assignment>(name, std::move(val));
+            return makeNode<Assignment>(name, std::move(val));
         }
 
         const auto equals = previous();
@@ -350,6 +353,48 @@ ExprPtr Parser::doAssignment()
     return expr;
 }
 
+ExprPtr Parser::makeBinary(ExprPtr left, const Token& op, ExprPtr right)
+{
+    switch (op.getType())
+    {
+    case TokenType::PLUS:
+        return makeNode<BinaryOp<ExprKind::ADD>>(std::move(left), op, std::move(right));
+    case TokenType::MINUS:
+        return makeNode<BinaryOp<ExprKind::SUBTRACT>>(std::move(left), op, std::move(right));
+    case TokenType::STAR:
+        return makeNode<BinaryOp<ExprKind::MULTIPLY>>(std::move(left), op, std::move(right));
+    case TokenType::SLASH:
+        return makeNode<BinaryOp<ExprKind::DIVIDE>>(std::move(left), op, std::move(right));
+    case TokenType::GREATER:
+        return makeNode<BinaryOp<ExprKind::GREATER>>(std::move(left), op, std::move(right));
+    case TokenType::GREATER_EQUAL:
+        return makeNode<BinaryOp<ExprKind::GREATER_EQUAL>>(std::move(left), op, std::move(right));
+    case TokenType::LESS:
+        return makeNode<BinaryOp<ExprKind::LESS>>(std::move(left), op, std::move(right));
+    case TokenType::LESS_EQUAL:
+        return makeNode<BinaryOp<ExprKind::LESS_EQUAL>>(std::move(left), op, std::move(right));
+    case TokenType::EQUAL_EQUAL:
+        return makeNode<BinaryOp<ExprKind::EQUAL_EQUAL>>(std::move(left), op, std::move(right));
+    case TokenType::BANG_EQUAL:
+        return makeNode<BinaryOp<ExprKind::BANG_EQUAL>>(std::move(left), op, std::move(right));
+    default:
+        return makeNode<Binary>(std::move(left), op, std::move(right));
+    }
+}
+
+ExprPtr Parser::makeUnary(const Token& op, ExprPtr right)
+{
+    switch (op.getType())
+    {
+    case TokenType::MINUS:
+        return makeNode<UnaryOp<ExprKind::NEGATE>>(op, std::move(right));
+    case TokenType::BANG:
+        return makeNode<UnaryOp<ExprKind::NOT>>(op, std::move(right));
+    default:
+        return makeNode<Unary>(op, std::move(right));
+    }
+}
+
 ExprPtr Parser::doEquality()
 {
     auto expr = doComparison();
@@ -358,7 +403,7 @@ ExprPtr Parser::doEquality()
     {
         Token op = previous();
         auto right = doComparison();
-        expr = std::make_unique<Binary>(std::move(expr), op, std::move(right));
+        expr = makeBinary(std::move(expr), op, std::move(right));
     }
 
     return expr;
@@ -374,7 +419,7 @@ ExprPtr Parser::doComparison()
         Token op = previous();
         auto right = doTerm();
 
-        expr = std::make_unique<Binary>(std::move(expr), op, std::move(right));
+        expr = makeBinary(std::move(expr), op, std::move(right));
     }
 
     return expr;
@@ -388,7 +433,7 @@ ExprPtr Parser::doTerm()
     {
         Token op = previous();
         auto right = doFactor();
-        expr = std::make_unique<Binary>(std::move(expr), op, std::move(right));
+        expr = makeBinary(std::move(expr), op, std::move(right));
     }
 
     return expr;
@@ -402,7 +447,7 @@ ExprPtr Parser::doFactor()
     {
         auto op = previous();
         auto right = doUnary();
-        expr = std::make_unique<Binary>(std::move(expr), op, std::move(right));
+        expr = makeBinary(std::move(expr), op, std::move(right));
     }
 
     return expr;
@@ -414,7 +459,7 @@ ExprPtr Parser::doUnary()
     {
         auto op = previous();
         auto right = doUnary();
-        return std::make_unique<Unary>(op, std::move(right));
+        return makeUnary(op, std::move(right));
     }
 
     return doIndexing();
@@ -422,25 +467,25 @@ ExprPtr Parser::doUnary()
 
 ExprPtr Parser::doPrimary()
 {
-    if (match(TokenType::FALSE)) return std::make_unique<Literal>(false);
-    if (match(TokenType::TRUE)) return std::make_unique<Literal>(true);
-    if (match(TokenType::NIL)) return std::make_unique<Literal>(nullptr);
+    if (match(TokenType::FALSE)) return makeNode<Literal>(false);
+    if (match(TokenType::TRUE)) return makeNode<Literal>(true);
+    if (match(TokenType::NIL)) return makeNode<Literal>(nullptr);
 
     if (match(std::array{ TokenType::NUMBER, TokenType::STRING }))
     {
-        return std::make_unique<Literal>(previous().getLiteral());
+        return makeNode<Literal>(previous().getLiteral());
     }
 
     if (match(TokenType::LEFT_PAREN))
     {
         auto expr = doExpression();
         consume(TokenType::RIGHT_PAREN, "Expect ')' after expression.");
-        return std::make_unique<Grouping>(std::move(expr));
+        return makeNode<Grouping>(std::move(expr));
     }
 
     if (match(TokenType::IDENTIFIER))
     {
-        return std::make_unique<Variable>(previous());
+        return makeNode<Variable>(previous());
     }
 
     ErrorManager::get().report(peek(), "Expected expression.");
@@ -464,7 +509,7 @@ ExprPtr pimentel::Parser::doLogicalOr()
 
         auto right = doLogicalAnd();
 
-        expr = std::make_unique<Logical>(std::move(expr), op, std::move(right));
+        expr = makeNode<Logical>(std::move(expr), op, std::move(right));
     }
 
     return expr;
@@ -480,7 +525,7 @@ ExprPtr pimentel::Parser::doLogicalAnd()
 
         auto right = doEquality();
 
-        expr = std::make_unique<Logical>(std::move(expr), op, std::move(right));
+        expr = makeNode<Logical>(std::move(expr), op, std::move(right));
     }
 
     return expr;
@@ -527,7 +572,7 @@ void Parser::error(Token token, const std::string& msg)
     ErrorManager::get().report(token, msg);
 }
 
-bool Parser::check(TokenType type)
+bool Parser::check(TokenType type) const
 {
     if (isAtEnd())
         return false;
@@ -535,22 +580,22 @@ bool Parser::check(TokenType type)
     return peek().getType() == type;
 }
 
-Token Parser::peek()
+const Token& Parser::peek() const
 {
     return m_tokens[m_current];
 }
 
-Token Parser::previous()
+const Token& Parser::previous() const
 {
     return m_tokens[m_current - 1];
 }
 
-bool Parser::isAtEnd()
+bool Parser::isAtEnd() const
 {
     return peek().getType() == TokenType::ENDOFFILE;
 }
 
-Token Parser::advance()
+const Token& Parser::advance()
 {
     if (!isAtEnd()) m_current++;
     return previous();
@@ -6,6 +6,7 @@
 #include <memory>
 #include "Expression.h"
 #include "Statement.h"
+#include "Program.h"
 #include "ErrorManager.h"
 
 namespace pimentel
@@ -16,7 +17,8 @@ namespace pimentel
         Parser(const std::vector<Token>& tokens);
         ~Parser() = default;
 
-        std::vector<StmtPtr> parse();
+        // Every node of the tree is placed in the returned program's arena.
+        ProgramPtr parse();
 
     private:
 
@@ -28,7 +30,7 @@ namespace pimentel
 
         StmtPtr doStmt(ScopeType scopeType);
         StmtPtr doFunctionDecl(ScopeType scopeType);
-        std::unique_ptr<BlockStmt> doBlockStmt(ScopeType scopeType);
+        NodePtr<BlockStmt> doBlockStmt(ScopeType scopeType);
         StmtPtr doIfStmt(ScopeType scopeType);
         StmtPtr doWhileStmt(ScopeType scopeType);
         StmtPtr doForStmt(ScopeType scopeType);
@@ -61,18 +63,29 @@ namespace pimentel
         template<typename T>
         bool match(const T& tokenTypes);
 
-        bool check(TokenType type);
+        template<typename T, typename... Args>
+        NodePtr<T> makeNode(Args&&... args)
+        {
+            return m_program->make<T>(std::forward<Args>(args)...);
+        }
 
-        Token peek();
+        // Picks the node specialized on the operator, if there is one.
+        ExprPtr makeBinary(ExprPtr left, const Token& op, ExprPtr right);
+        ExprPtr makeUnary(const Token& op, ExprPtr right);
 
-        Token previous();
+        bool check(TokenType type) const;
 
-        bool isAtEnd();
+        const Token& peek() const;
 
-        Token advance();
+        const Token& previous() const;
+
+        bool isAtEnd() const;
+
+        const Token& advance();
     
     private:
         std::vector<Token> m_tokens;
         int m_current;
+        ProgramPtr m_program;
     };
 }
\ No newline at end of file
@@ -0,0 +1,42 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include "Arena.h"
+#include "Statement.h"
+
+namespace pimentel
+{
+    // Result of parsing a script: its top level statements and the arena
+    // holding every node of the tree. Functions declared by the program keep
+    // it alive after the caller drops it.
+    class Program : public std::enable_shared_from_this<Program>
+    {
+    public:
+        Program() = default;
+        Program(const Program&) = delete;
+        Program& operator=(const Program&) = delete;
+        ~Program() = default;
+
+        template<typename T, typename... Args>
+        NodePtr<T> make(Args&&... args)
+        {
+            auto node = m_arena.make<T>(std::forward<Args>(args)...);
+            node->inArena = true;
+            return NodePtr<T>{ node };
+        }
+
+        size_t size() const
+        {
+            return stmts.size();
+        }
+
+    private:
+        // Declared first so it outlives the nodes placed in it.
+        Arena m_arena;
+
+    public:
+        std::vector<StmtPtr> stmts;
+    };
+
+    using ProgramPtr = std::shared_ptr<Program>;
+}
@@ -0,0 +1,521 @@
+#include "Resolver.h"
+#include "AstDispatch.hpp"
+
+#include <algorithm>
+#include <variant>
+
+using namespace pimentel;
+
+namespace
+{
+    bool declaresNames(const std::vector<StmtPtr>& stmts)
+    {
+        return std::ranges::any_of(stmts, [](const StmtPtr& stmt) {
+            return stmt->kind == StmtKind::VAR || stmt->kind == StmtKind::FUNCTION_DECL;
+        });
+    }
+
+    // Whether statements read or assign any variable called `name`, in
+    // nested functions too.
+    class NameUses
+    {
+    public:
+        NameUses(Symbol name)
+            :
+            m_name(name)
+        {}
+
+        void walk(const StmtPtr& stmt)
+        {
+            if (stmt)
+            {
+                dispatch(*stmt, [this](auto& node) { visit(node); });
+            }
+        }
+
+        void walk(const ExprPtr& expr)
+        {
+            if (expr)
+            {
+                dispatch(*expr, [this](auto& node) { visit(node); });
+            }
+        }
+
+        void walk(const std::vector<StmtPtr>& stmts)
+        {
+            for (const auto& stmt : stmts)
+            {
+                walk(stmt);
+            }
+        }
+
+        bool read = false;
+        bool assigned = false;
+
+    private:
+        void visit(Binary& expr) { walk(expr.left); walk(expr.right); }
+        void visit(Grouping& expr) { walk(expr.expr); }
+        void visit(Literal&) {}
+        void visit(Unary& expr) { walk(expr.right); }
+        void visit(Logical& expr) { walk(expr.leftExpr); walk(expr.rightExpr); }
+        void visit(Indexing& expr) { walk(expr.indexee); walk(expr.index); }
+        void visit(Variable& expr) { read = read || expr.name.getSymbol() == m_name; }
+
+        void visit(Assignment& expr)
+        {
+            assigned = assigned || expr.name.getSymbol() == m_name;
+            walk(expr.value);
+        }
+
+        void visit(Call& expr)
+        {
+            walk(expr.calee);
+
+            for (const auto& arg : expr.arguments)
+            {
+                walk(arg);
+            }
+        }
+
+        void visit(ExpressionStmt& stmt) { walk(stmt.expr); }
+        void visit(PrintStmt& stmt) { walk(stmt.expr); }
+        void visit(VarStmt& stmt) { walk(stmt.initializer); }
+        void visit(BlockStmt& stmt) { walk(stmt.stmts); }
+        void visit(IfStmt& stmt) { walk(stmt.expr); walk(stmt.block); walk(stmt.elseblock); }
+        void visit(WhileStmt& stmt) { walk(stmt.expr); walk(stmt.block); }
+        void visit(BreakStmt&) {}
+        void visit(ForStmt& stmt) { walk(stmt.variableDef); walk(stmt.expr); walk(stmt.incStmt); walk(stmt.block); }
+        void visit(FunctionDeclStmt& stmt) { walk(stmt.block->stmts); }
+        void visit(ReturnStmt& stmt) { walk(stmt.expr); }
+
+    private:
+        Symbol m_name;
+    };
+
+    // See ForStmt::CountedLoop, the loop is resolved already.
+    std::optional<ForStmt::CountedLoop> countedLoop(const ForStmt& forStmt)
+    {
+        if (!forStmt.variableDef || forStmt.variableDef->kind != StmtKind::VAR || !forStmt.expr || !forStmt.incStmt)
+        {
+            return std::nullopt;
+        }
+
+        const auto& counter = static_cast<const VarStmt&>(*forStmt.variableDef);
+
+        if (counter.slot < 0)
+        {
+            return std::nullopt;
+        }
+
+        const auto slot = static_cast<size_t>(counter.slot);
+        const auto isCounter = [slot](const Expression& expr) {
+            if (expr.kind != ExprKind::VARIABLE)
+            {
+                return false;
+            }
+
+            const auto& var = static_cast<const Variable&>(expr);
+            return var.depth == 0 && var.slot == slot && var.upvalue < 0;
+        };
+        const auto numberLiteral = [](const Expression& expr) -> const double* {
+            return expr.kind == ExprKind::LITERAL ? std::get_if<double>(&static_cast<const Literal&>(expr).value) : nullptr;
+        };
+
+        const auto comparison = forStmt.expr->kind;
+
+        if (comparison != ExprKind::GREATER && comparison != ExprKind::GREATER_EQUAL &&
+            comparison != ExprKind::LESS && comparison != ExprKind::LESS_EQUAL)
+        {
+            return std::nullopt;
+        }
+
+        const auto& condition = static_cast<const Binary&>(*forStmt.expr);
+        const auto bound = condition.right.get();
+
+        if (!isCounter(*condition.left) || isCounter(*bound) ||
+            (bound->kind != ExprKind::LITERAL && bound->kind != ExprKind::VARIABLE))
+        {
+            return std::nullopt;
+        }
+
+        if (forStmt.incStmt->kind != ExprKind::ASSIGNMENT)
+        {
+            return std::nullopt;
+        }
+
+        const auto& increment = static_cast<const Assignment&>(*forStmt.incStmt);
+
+        if (increment.depth != 0 || increment.slot != slot || increment.upvalue >= 0)
+        {
+            return std::nullopt;
+        }
+
+        const auto& value = *increment.value;
+        const double* step = nullptr;
+        double sign = 1.0;
+
+        if (value.kind == ExprKind::ADD || value.kind == ExprKind::SUBTRACT)
+        {
+            const auto& sum = static_cast<const Binary&>(value);
+
+            if (isCounter(*sum.left))
+            {
+                step = numberLiteral(*sum.right);
+                sign = value.kind == ExprKind::SUBTRACT ? -1.0 : 1.0;
+            }
+            else if (value.kind == ExprKind::ADD && isCounter(*sum.right))
+            {
+                step = numberLiteral(*sum.left);
+            }
+        }
+
+        if (!step)
+        {
+            return std::nullopt;
+        }
+
+        NameUses uses{ counter.name.getSymbol() };
+        uses.walk(forStmt.block);
+
+        if (uses.assigned)
+        {
+            return std::nullopt;
+        }
+
+        return ForStmt::CountedLoop{ slot, comparison, bound, sign * *step, uses.read };
+    }
+}
+
+Resolver::Resolver(ConstantPool& constants)
+    :
+    m_constants(constants)
+{}
+
+void Resolver::resolve(const std::vector<StmtPtr>& stmts)
+{
+    for (const auto& stmt : stmts)
+    {
+        resolve(*stmt);
+    }
+}
+
+Resolver::RetType_expr Resolver::visit(Binary& expr)
+{
+    resolve(*expr.left);
+    resolve(*expr.right);
+}
+
+Resolver::RetType_expr Resolver::visit(Grouping& expr)
+{
+    resolve(*expr.expr);
+}
+
+Resolver::RetType_expr Resolver::visit(Literal& expr)
+{
+    expr.constant = m_constants.materialize(expr.value);
+}
+
+Resolver::RetType_expr Resolver::visit(Unary& expr)
+{
+    resolve(*expr.right);
+}
+
+Resolver::RetType_expr Resolver::visit(Variable& var)
+{
+    resolveLocal(var.name.getSymbol(), var.depth, var.slot, var.upvalue);
+}
+
+Resolver::RetType_expr Resolver::visit(Assignment& expr)
+{
+    resolve(*expr.value);
+    resolveLocal(expr.name.getSymbol(), expr.depth, expr.slot, expr.upvalue);
+}
+
+Resolver::RetType_expr Resolver::visit(Logical& logical)
+{
+    resolve(*logical.leftExpr);
+    resolve(*logical.rightExpr);
+}
+
+Resolver::RetType_expr Resolver::visit(Call& callExpr)
+{
+    resolve(*callExpr.calee);
+
+    for (const auto& arg : callExpr.arguments)
+    {
+        resolve(*arg);
+    }
+}
+
+Resolver::RetType_expr Resolver::visit(Indexing& indexing)
+{
+    resolve(*indexing.indexee);
+    resolve(*indexing.index);
+}
+
+Resolver::RetType_stmt Resolver::visit(ExpressionStmt& exprStmt)
+{
+    resolve(*exprStmt.expr);
+}
+
+Resolver::RetType_stmt Resolver::visit(PrintStmt& printStmt)
+{
+    resolve(*printStmt.expr);
+}
+
+Resolver::RetType_stmt Resolver::visit(VarStmt& varStmt)
+{
+    // The initializer still sees an outer variable with the same name.
+    if (varStmt.initializer)
+    {
+        resolve(*varStmt.initializer);
+    }
+
+    varStmt.slot = declare(varStmt.name.getSymbol());
+}
+
+Resolver::RetType_stmt Resolver::visit(BlockStmt& blockStmt)
+{
+    blockStmt.hasScope = !canElideScope(declaresNames(blockStmt.stmts));
+
+    beginScope(blockStmt.hasScope);
+
+    resolve(blockStmt.stmts);
+
+    blockStmt.closeFrom = closeFrom();
+    blockStmt.localCount = endScope();
+}
+
+Resolver::RetType_stmt Resolver::visit(IfStmt& ifStmt)
+{
+    resolve(*ifStmt.expr);
+    resolve(*ifStmt.block);
+
+    if (ifStmt.elseblock)
+    {
+        resolve(*ifStmt.elseblock);
+    }
+}
+
+Resolver::RetType_stmt Resolver::visit(WhileStmt& whileStmt)
+{
+    resolve(*whileStmt.expr);
+    resolve(*whileStmt.block);
+}
+
+Resolver::RetType_stmt Resolver::visit(BreakStmt&)
+{}
+
+Resolver::RetType_stmt Resolver::visit(ForStmt& forStmt)
+{
+    forStmt.hasScope = !canElideScope(forStmt.variableDef != nullptr);
+
+    beginScope(forStmt.hasScope);
+
+    if (forStmt.variableDef)
+    {
+        resolve(*forStmt.variableDef);
+    }
+
+    if (forStmt.expr)
+    {
+        resolve(*forStmt.expr);
+    }
+
+    if (forStmt.incStmt)
+    {
+        resolve(*forStmt.incStmt);
+    }
+
+    resolve(*forStmt.block);
+
+    forStmt.counted = countedLoop(forStmt);
+    forStmt.closeFrom = closeFrom();
+    forStmt.localCount = endScope();
+}
+
+Resolver::RetType_stmt Resolver::visit(FunctionDeclStmt& funDecl)
+{
+    // Declared before the body so the function can call itself.
+    funDecl.slot = declare(funDecl.name.getSymbol());
+
+    funDecl.upvalues.clear();
+    m_functions.push_back({ &funDecl, m_scopes.size() });
+
+    // Arguments and the body's declarations share the call's environment.
+    beginScope();
+
+    for (const auto& arg : funDecl.argList)
+    {
+        declare(arg.getSymbol());
+    }
+
+    resolve(funDecl.block->stmts);
+
+    funDecl.localCount = endScope();
+    m_functions.pop_back();
+}
+
+Resolver::RetType_stmt Resolver::visit(ReturnStmt& retStmt)
+{
+    if (retStmt.expr)
+    {
+        resolve(*retStmt.expr);
+    }
+}
+
+void Resolver::resolve(Expression& expr)
+{
+    dispatch(expr, [this](auto& node) { visit(node); });
+}
+
+void Resolver::resolve(Statement& stmt)
+{
+    dispatch(stmt, [this](auto& node) { visit(node); });
+}
+
+void Resolver::beginScope(bool hasEnvironment)
+{
+    auto owner = m_scopes.rbegin();
+
+    while (owner != m_scopes.rend() && !owner->hasEnvironment)
+    {
+        ++owner;
+    }
+
+    const auto firstSlot = hasEnvironment || owner == m_scopes.rend() ? 0 : owner->count;
+
+    auto& scope = m_scopes.emplace_back();
+    scope.hasEnvironment = hasEnvironment;
+    scope.firstSlot = firstSlot;
+}
+
+size_t Resolver::endScope()
+{
+    const auto count = m_scopes.back().count;
+    m_scopes.pop_back();
+    return count;
+}
+
+int Resolver::declare(Symbol name)
+{
+    if (m_scopes.empty())
+    {
+        return -1;
+    }
+
+    // Redeclaring a name in the same scope shadows the previous variable.
+    auto& scope = m_scopes.back();
+    auto owner = m_scopes.rbegin();
+
+    while (!owner->hasEnvironment)
+    {
+        ++owner;
+    }
+
+    const auto slot = owner->count++;
+    scope.slots[name] = slot;
+
+    return static_cast<int>(slot);
+}
+
+bool Resolver::canElideScope(bool declares) const
+{
+    // Globals aren't slots, top level variables need an environment of their
+    // own. Every run of the scope reuses the same slots, closures still see
+    // a variable per run as its upvalues are closed when the scope exits.
+    return !declares || std::ranges::any_of(m_scopes, &Scope::hasEnvironment);
+}
+
+int Resolver::closeFrom() const
+{
+    const auto& scope = m_scopes.back();
+
+    return scope.captured ? static_cast<int>(scope.firstSlot) : -1;
+}
+
+void Resolver::resolveLocal(Symbol name, int& depth, size_t& slot, int& upvalue)
+{
+    depth = -1;
+    upvalue = -1;
+
+    // Locals of the running function, then variables it closes over.
+    const auto base = m_functions.empty() ? 0 : m_functions.back().scope;
+
+    for (size_t i = m_scopes.size(); i > base; i--)
+    {
+        const auto& slots = m_scopes[i - 1].slots;
+        const auto it = slots.find(name);
+
+        if (it != slots.end())
+        {
+            depth = environmentsBetween(m_scopes.size() - 1, i - 1);
+            slot = it->second;
+            return;
+        }
+    }
+
+    if (!m_functions.empty())
+    {
+        upvalue = resolveUpvalue(m_functions.size() - 1, name);
+    }
+}
+
+int Resolver::resolveUpvalue(size_t function, Symbol name)
+{
+    auto& decl = *m_functions[function].decl;
+    const auto scope = m_functions[function].scope;
+    const auto base = function == 0 ? 0 : m_functions[function - 1].scope;
+
+    const auto addUpvalue = [&decl](bool isLocal, size_t depth, size_t index) {
+        for (size_t i = 0; i < decl.upvalues.size(); i++)
+        {
+            const auto& upvalue = decl.upvalues[i];
+
+            if (upvalue.isLocal == isLocal && upvalue.depth == depth && upvalue.index == index)
+            {
+                return static_cast<int>(i);
+            }
+        }
+
+        decl.upvalues.push_back({ isLocal, depth, index });
+        return static_cast<int>(decl.upvalues.size() - 1);
+    };
+
+    // The declaration runs in the scope right outside the function's.
+    for (size_t i = scope; i > base; i--)
+    {
+        auto& outer = m_scopes[i - 1];
+        const auto it = outer.slots.find(name);
+
+        if (it != outer.slots.end())
+        {
+            outer.captured = true;
+            return addUpvalue(true, environmentsBetween(scope - 1, i - 1), it->second);
+        }
+    }
+
+    if (function == 0)
+    {
+        return -1;
+    }
+
+    const auto upvalue = resolveUpvalue(function - 1, name);
+
+    return upvalue < 0 ? -1 : addUpvalue(false, 0, static_cast<size_t>(upvalue));
+}
+
+int Resolver::environmentsBetween(size_t from, size_t to) const
+{
+    int environments = 0;
+
+    for (auto i = from; i > to; i--)
+    {
+        if (m_scopes[i].hasEnvironment)
+        {
+            environments++;
+        }
+    }
+
+    return environments;
+}
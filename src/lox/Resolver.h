@@ -0,0 +1,99 @@
+#pragma once
+#include "Expression.h"
+#include "Statement.h"
+#include "ConstantPool.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace pimentel
+{
+    // Static pass run before interpreting: binds every local variable access
+    // to a (depth, slot) pair, so the Interpreter never looks locals up by
+    // name, and materializes literals into values up front. Variables of an
+    // enclosing function are reached through upvalues, so closures only keep
+    // what they use. Function calls get an environment at runtime, blocks and
+    // for loops only at top level: elsewhere their scope is elided and their
+    // variables take slots of the enclosing environment instead.
+    class Resolver
+    {
+    public:
+        using RetType_expr = void;
+        using RetType_stmt = void;
+
+    public:
+        Resolver(ConstantPool& constants);
+        ~Resolver() = default;
+
+        void resolve(const std::vector<StmtPtr>& stmts);
+
+    private:
+        RetType_expr visit(Binary&);
+        RetType_expr visit(Grouping&);
+        RetType_expr visit(Literal&);
+        RetType_expr visit(Unary&);
+        RetType_expr visit(Variable&);
+        RetType_expr visit(Assignment&);
+        RetType_expr visit(Logical&);
+        RetType_expr visit(Call&);
+        RetType_expr visit(Indexing&);
+
+        RetType_stmt visit(ExpressionStmt&);
+        RetType_stmt visit(PrintStmt&);
+        RetType_stmt visit(VarStmt&);
+        RetType_stmt visit(BlockStmt&);
+        RetType_stmt visit(IfStmt&);
+        RetType_stmt visit(WhileStmt&);
+        RetType_stmt visit(BreakStmt&);
+        RetType_stmt visit(ForStmt&);
+        RetType_stmt visit(FunctionDeclStmt&);
+        RetType_stmt visit(ReturnStmt&);
+
+        void resolve(Expression& expr);
+        void resolve(Statement& stmt);
+
+        // An elided scope shares the environment of the closest scope that
+        // has one.
+        void beginScope(bool hasEnvironment = true);
+        size_t endScope();
+
+        // Whether a block or for loop declaring variables only if `declares`
+        // can be elided.
+        bool canElideScope(bool declares) const;
+        // BlockStmt::closeFrom of the innermost scope.
+        int closeFrom() const;
+
+        // Returns the slot of the new variable, or -1 at global scope.
+        int declare(Symbol name);
+        void resolveLocal(Symbol name, int& depth, size_t& slot, int& upvalue);
+        // Index of the upvalue of m_functions[function] capturing `name`, or
+        // -1 when it's a global.
+        int resolveUpvalue(size_t function, Symbol name);
+        // Number of environments between scope `from` and the outer scope
+        // `to`, i.e. the depth of a variable of `to` seen from `from`.
+        int environmentsBetween(size_t from, size_t to) const;
+
+    private:
+        struct Scope
+        {
+            std::unordered_map<Symbol, size_t> slots;
+            size_t count = 0;
+            bool hasEnvironment = true;
+            // Slot of the first variable declared in the scope.
+            size_t firstSlot = 0;
+            bool captured = false;
+        };
+
+        struct Function
+        {
+            FunctionDeclStmt* decl;
+            // Index in m_scopes of the scope holding the arguments.
+            size_t scope;
+        };
+
+        std::vector<Scope> m_scopes;
+        std::vector<Function> m_functions;
+        ConstantPool& m_constants;
+    };
+}
@@ -150,7 +150,7 @@ void Scanner::number(std::vector<Token>& out)
 
     if(peek() != '.' || !isDigit(peekNext()))
     {
-        const auto numberStr = m_code.substr(m_start, m_current);
+        const auto numberStr = getCurrentLexeme();
 
         const auto val = std::atof(numberStr.c_str());
 
@@ -165,7 +165,7 @@ void Scanner::number(std::vector<Token>& out)
         advance();
     }
 
-    const auto numberStr = m_code.substr(m_start, m_current);
+    const auto numberStr = getCurrentLexeme();
 
     const auto val = std::atof(numberStr.c_str());
 
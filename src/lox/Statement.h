@@ -1,10 +1,13 @@
 #pragma once
+#include <cstdint>
 #include <memory>
+#include <optional>
 #include "Expression.h"
-#include "StmtVisitor.hpp"
 
 namespace pimentel
 {
+    class Program;
+
     enum class ScopeType
     {
         FUNCTION,
@@ -13,37 +16,56 @@ namespace pimentel
         FOR_WHILE,
         FOR_WHILE_FUNCTION
     };
+    enum class StmtKind : uint8_t
+    {
+        EXPRESSION,
+        PRINT,
+        VAR,
+        BLOCK,
+        IF,
+        WHILE,
+        BREAK,
+        FOR,
+        FUNCTION_DECL,
+        RETURN
+    };
+
     struct Statement
     {
-        Statement() = default;
+        Statement(StmtKind kind) : kind(kind) {}
         virtual ~Statement() = default;
 
-        virtual StmtVisitor::RetType accept(StmtVisitor& visitor) = 0;
+        const StmtKind kind;
+        bool inArena = false;
     };
 
-    using StmtPtr = std::unique_ptr<Statement>;
+    template<StmtKind K>
+    struct StmtNode : public Statement
+    {
+        static constexpr StmtKind KIND = K;
 
-    struct ExpressionStmt : public Statement
+        StmtNode() : Statement(K) {}
+    };
+
+    using StmtPtr = NodePtr<Statement>;
+
+    struct ExpressionStmt : public StmtNode<StmtKind::EXPRESSION>
     {
         ExpressionStmt() = default;
         ExpressionStmt(ExprPtr expr): expr(std::move(expr)){};
 
-        ACCEPT_IMPL(StmtVisitor);
-
         ExprPtr expr;
     };
 
-    struct PrintStmt : public Statement
+    struct PrintStmt : public StmtNode<StmtKind::PRINT>
     {
         PrintStmt() = default;
         PrintStmt(ExprPtr expr): expr(std::move(expr)){};
 
-        ACCEPT_IMPL(StmtVisitor);
-
         ExprPtr expr;
     };
 
-    struct VarStmt : public Statement
+    struct VarStmt : public StmtNode<StmtKind::VAR>
     {
         VarStmt() = default;
         VarStmt(const Token& name)
@@ -56,13 +78,14 @@ namespace pimentel
             name(name)
         {}
 
-        ACCEPT_IMPL(StmtVisitor);
-
         ExprPtr initializer = nullptr;
         Token name;
+
+        // Slot of the declared variable in the current scope, negative for globals.
+        int slot = -1;
     };
 
-    struct BlockStmt : public Statement
+    struct BlockStmt : public StmtNode<StmtKind::BLOCK>
     {
         BlockStmt() = default;
         BlockStmt(std::vector<StmtPtr>&& stmts)
@@ -71,12 +94,18 @@ namespace pimentel
         {}
         ~BlockStmt() = default;
 
-        ACCEPT_IMPL(StmtVisitor);
-
         std::vector<StmtPtr> stmts;
+
+        size_t localCount = 0;
+        // False when the Resolver found no environment is needed: the block
+        // runs in the enclosing one, which also holds its variables.
+        bool hasScope = true;
+        // First slot of the block's variables when closures capture some of
+        // them, their upvalues are closed when the block exits. -1 otherwise.
+        int closeFrom = -1;
     };
 
-    struct IfStmt : public Statement
+    struct IfStmt : public StmtNode<StmtKind::IF>
     {
         IfStmt() = default;
         IfStmt(ExprPtr expr, StmtPtr block, StmtPtr elseblock)
@@ -87,14 +116,12 @@ namespace pimentel
         {}
         ~IfStmt() = default;
 
-        ACCEPT_IMPL(StmtVisitor);
-
         ExprPtr expr;
         StmtPtr block;
         StmtPtr elseblock;
     };
 
-    struct WhileStmt : public Statement
+    struct WhileStmt : public StmtNode<StmtKind::WHILE>
     {
         WhileStmt() = default;
 
@@ -106,13 +133,11 @@ namespace pimentel
 
         ~WhileStmt() = default;
 
-        ACCEPT_IMPL(StmtVisitor);
-
         ExprPtr expr;
         StmtPtr block;
     };
 
-    struct ForStmt : public Statement
+    struct ForStmt : public StmtNode<StmtKind::FOR>
     {
         ForStmt() = default;
         ForStmt(StmtPtr variableDef, ExprPtr expr, ExprPtr incStmt, StmtPtr block)
@@ -124,26 +149,47 @@ namespace pimentel
         {}
         ~ForStmt() = default;
 
-        ACCEPT_IMPL(StmtVisitor);
-
         StmtPtr variableDef;
         ExprPtr expr;
         ExprPtr incStmt;
         StmtPtr block;
+
+        size_t localCount = 0;
+        // See BlockStmt::hasScope and BlockStmt::closeFrom.
+        bool hasScope = true;
+        int closeFrom = -1;
+
+        // A loop of the shape `for (var i = a; i < n; i = i + c)`, where c
+        // is a number literal and n a literal or a variable, whose body never
+        // assigns i. Any comparison works, so does subtracting c.
+        struct CountedLoop
+        {
+            // Of the counter in the loop's environment.
+            size_t slot;
+            // GREATER, GREATER_EQUAL, LESS or LESS_EQUAL.
+            ExprKind comparison;
+            // A Literal or a Variable other than the counter.
+            Expression* bound;
+            double step;
+            // The body reads the counter.
+            bool observed;
+        };
+
+        // Filled by the Resolver, lets the interpreter count in a native
+        // double instead of evaluating the condition and increment.
+        std::optional<CountedLoop> counted;
     };
 
-    struct BreakStmt : public Statement
+    struct BreakStmt : public StmtNode<StmtKind::BREAK>
     {
         BreakStmt() = default;
         ~BreakStmt() = default;
-
-        ACCEPT_IMPL(StmtVisitor);
     };
 
-    struct FunctionDeclStmt : public Statement
+    struct FunctionDeclStmt : public StmtNode<StmtKind::FUNCTION_DECL>
     {
         FunctionDeclStmt() = default;
-        FunctionDeclStmt(Token name, std::unique_ptr<BlockStmt> block, std::vector<Token>&& argList)
+        FunctionDeclStmt(Token name, NodePtr<BlockStmt> block, std::vector<Token>&& argList)
             :
             name(name),
             block(std::move(block)),
@@ -151,15 +197,31 @@ namespace pimentel
         {}
         ~FunctionDeclStmt() = default;
 
-        ACCEPT_IMPL(StmtVisitor);
-
         Token name;
-        std::unique_ptr<BlockStmt> block;
+        NodePtr<BlockStmt> block;
+        // Program owning this node, UserFunctions created from this
+        // declaration keep it alive. Null for trees built by hand.
+        Program* program = nullptr;
         std::vector<Token> argList;
 
+        int slot = -1;
+        // Arguments plus the declarations made directly in the body.
+        size_t localCount = 0;
+
+        // A variable the function closes over, captured when the declaration
+        // runs: a slot of the environment `depth` scopes up from the one
+        // running the declaration, or an upvalue of the function running it.
+        struct Upvalue
+        {
+            bool isLocal;
+            size_t depth;
+            size_t index;
+        };
+
+        std::vector<Upvalue> upvalues;
     };
 
-    struct ReturnStmt : public Statement
+    struct ReturnStmt : public StmtNode<StmtKind::RETURN>
     {
         ReturnStmt() = default;
         ReturnStmt(ExprPtr expr)
@@ -168,8 +230,6 @@ namespace pimentel
         {}
         ~ReturnStmt() = default;
 
-        ACCEPT_IMPL(StmtVisitor);
-
         ExprPtr expr;
     };
 }
\ No newline at end of file
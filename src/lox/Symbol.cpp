@@ -0,0 +1,24 @@
+#include "Symbol.h"
+
+using namespace pimentel;
+
+SymbolTable& SymbolTable::get()
+{
+    static SymbolTable symbolTable;
+    return symbolTable;
+}
+
+Symbol SymbolTable::intern(std::string_view name)
+{
+    const auto it = m_index.find(name);
+
+    if (it != m_index.end())
+    {
+        return Symbol{ it->second };
+    }
+
+    const auto& data = m_symbols.emplace_back(SymbolData{ std::string{ name }, std::hash<std::string_view>{}(name), m_symbols.size() });
+    m_index.emplace(data.name, &data);
+
+    return Symbol{ &data };
+}
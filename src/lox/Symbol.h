@@ -0,0 +1,99 @@
+#pragma once
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace pimentel
+{
+    struct SymbolData
+    {
+        std::string name;
+        size_t hash;
+        // Dense index in interning order, lets tables keyed by symbol be
+        // plain vectors (see GlobalTable).
+        size_t id;
+    };
+
+    // An interned identifier. Two symbols with the same name always point to
+    // the same entry of the SymbolTable, so comparing them is a pointer
+    // comparison and hashing them reads the hash computed when interning.
+    class Symbol
+    {
+    public:
+        Symbol() = default;
+
+        const std::string& name() const
+        {
+            static const std::string empty;
+            return m_data ? m_data->name : empty;
+        }
+
+        size_t hash() const
+        {
+            return m_data ? m_data->hash : 0;
+        }
+
+        size_t id() const
+        {
+            return m_data ? m_data->id : 0;
+        }
+
+        bool isValid() const
+        {
+            return m_data != nullptr;
+        }
+
+        bool operator==(const Symbol& other) const
+        {
+            return m_data == other.m_data;
+        }
+
+        bool operator!=(const Symbol& other) const
+        {
+            return m_data != other.m_data;
+        }
+
+    private:
+        friend class SymbolTable;
+
+        explicit Symbol(const SymbolData* data)
+            :
+            m_data(data)
+        {}
+
+    private:
+        const SymbolData* m_data = nullptr;
+    };
+
+    // Process wide interner. Entries are never removed, the set of
+    // identifiers of a program is small and bounded by its source.
+    class SymbolTable
+    {
+    public:
+        ~SymbolTable() = default;
+
+        static SymbolTable& get();
+
+        Symbol intern(std::string_view name);
+
+    private:
+        SymbolTable() = default;
+
+    private:
+        // A deque never moves its elements, so the views used as keys stay valid.
+        std::deque<SymbolData> m_symbols;
+        std::unordered_map<std::string_view, const SymbolData*> m_index;
+    };
+}
+
+template<>
+struct std::hash<pimentel::Symbol>
+{
+    size_t operator()(const pimentel::Symbol& symbol) const
+    {
+        return symbol.hash();
+    }
+};
@@ -108,6 +108,7 @@ Token::Token(TokenType type, const std::string& lexeme, LiteralType literal, int
     :
     m_type(type),
     m_lexeme(lexeme),
+    m_symbol(type == TokenType::IDENTIFIER ? SymbolTable::get().intern(lexeme) : Symbol{}),
     m_literal(literal),
     m_line(line)
 {}
@@ -120,11 +121,16 @@ std::string Token::toString() const
     return res.str();
 }
 
-std::string Token::getLexeme() const
+const std::string& Token::getLexeme() const
 {
     return m_lexeme;
 }
 
+Symbol Token::getSymbol() const
+{
+    return m_symbol;
+}
+
 TokenType Token::getType() const
 {
     return m_type;
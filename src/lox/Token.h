@@ -3,6 +3,8 @@
 #include <string>
 #include <variant>
 
+#include "Symbol.h"
+
 namespace pimentel
 {
     enum class TokenType {
@@ -39,7 +41,9 @@ namespace pimentel
 
         std::string toString() const;
 
-        std::string getLexeme() const;
+        const std::string& getLexeme() const;
+        // Interned lexeme, only set for identifiers.
+        Symbol getSymbol() const;
         TokenType getType() const;
         LiteralType getLiteral() const;
         int getLine() const;
@@ -47,6 +51,7 @@ namespace pimentel
     private:
         TokenType m_type;
         std::string m_lexeme;
+        Symbol m_symbol;
         LiteralType m_literal = nullptr;
         int m_line;        
     };
@@ -0,0 +1,53 @@
+#pragma once
+#include "Heap.h"
+#include "LoxObject.hpp"
+#include "Value.h"
+
+namespace pimentel
+{
+    // A variable captured by a closure, shared by every closure capturing it,
+    // in any of the engines. While the variable's scope is alive the upvalue
+    // is open and `location` points at the variable's slot, in an
+    // environment or a value stack; once the scope exits the value moves into
+    // `closed` and `location` points there.
+    //
+    // Closures trace their upvalues, engines root the ones still open.
+    class Upvalue : public LoxObject
+    {
+    public:
+        Upvalue(Value* slot)
+            :
+            location(slot)
+        {}
+        ~Upvalue() = default;
+
+        Value& get()
+        {
+            return *location;
+        }
+
+        bool isOpen() const
+        {
+            return location != &closed;
+        }
+
+        void close()
+        {
+            closed = *location;
+            location = &closed;
+        }
+
+        void trace(Heap& heap) override
+        {
+            heap.mark(*location);
+        }
+
+        size_t allocationSize() const override
+        {
+            return sizeof(Upvalue);
+        }
+
+        Value* location;
+        Value closed;
+    };
+}
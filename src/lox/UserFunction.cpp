@@ -3,35 +3,35 @@
 
 using namespace pimentel;
 
-UserFunction::UserFunction(std::unique_ptr<BlockStmt>&& block, std::vector<std::string>&& argNames, const std::shared_ptr<Environment>& curEnv)
+UserFunction::UserFunction(const std::shared_ptr<const FunctionDeclStmt>& declaration,
+    std::vector<Upvalue*> upvalues)
         :
-        m_block(std::move(block)),
-        m_argNames(std::move(argNames)),
-        m_currEnv(curEnv)
+        m_declaration(declaration),
+        m_arity(declaration->argList.size()),
+        m_localCount(declaration->localCount),
+        m_upvalues(std::move(upvalues))
     {}
 
-LoxVal UserFunction::call(Interpreter& interpreter, const std::vector<LoxVal>& argList)
+Value UserFunction::call(Interpreter& interpreter, const std::vector<Value>& argList)
 {
-    auto fEnv = std::make_shared<Environment>(m_currEnv);
+    auto frame = interpreter.acquireFrame(*this);
 
-    for(size_t i = 0; i < argList.size(); i++)
+    for (size_t i = 0; i < argList.size(); i++)
     {
-        fEnv->define(m_argNames[i], argList[i]);
+        frame->define(i, argList[i]);
     }
 
-    interpreter.executeBlock(m_block->stmts, fEnv);
-
-    if(fEnv->returnFlagSet())
-    {
-        m_currEnv->setReturnFlag(false);
-        m_currEnv->setReturnVal({});
-        return fEnv->getReturnValue();
-    }
-
-    return {};
+    return interpreter.callFunction(*this, frame);
 }
 
 size_t UserFunction::arity() const
 {
-    return m_argNames.size();
-}
\ No newline at end of file
+    return m_arity;
+}
+void UserFunction::trace(Heap& heap)
+{
+    for (const auto& upvalue : m_upvalues)
+    {
+        heap.mark(upvalue);
+    }
+}
@@ -1,8 +1,9 @@
 #pragma once
 
-#include "LoxVal.h"
+#include "Value.h"
 #include "Statement.h"
 #include "Environment.h"
+#include "Upvalue.h"
 
 #include <memory>
 
@@ -12,18 +13,50 @@ namespace pimentel
 struct UserFunction : public LoxCallable
 {
 public:
-    UserFunction(std::unique_ptr<BlockStmt>&& block, std::vector<std::string>&& argNames, const std::shared_ptr<Environment>& curEnv);
+    UserFunction(const std::shared_ptr<const FunctionDeclStmt>& declaration,
+        std::vector<Upvalue*> upvalues);
     ~UserFunction() = default;
 
-    LoxVal call(Interpreter& interpreter, const std::vector<LoxVal>& argList) override;
+    Value call(Interpreter& interpreter, const std::vector<Value>& argList) override;
 
     size_t arity() const override;
 
-private:
-    std::unique_ptr<BlockStmt> m_block;
-    std::vector<std::string> m_argNames;
+    UserFunction* asUserFunction() override
+    {
+        return this;
+    }
+
+    void trace(Heap& heap) override;
+
+    const BlockStmt& body() const
+    {
+        return *m_declaration->block;
+    }
+
+    const std::shared_ptr<const FunctionDeclStmt>& declaration() const
+    {
+        return m_declaration;
+    }
 
-    std::shared_ptr<Environment> m_currEnv;
+    size_t localCount() const
+    {
+        return m_localCount;
+    }
+
+    Upvalue* upvalue(size_t index) const
+    {
+        return m_upvalues[index];
+    }
+
+private:
+    std::shared_ptr<const FunctionDeclStmt> m_declaration;
+    size_t m_arity;
+    // Slots of the call environment, the arguments come first.
+    size_t m_localCount;
+
+    // The variables of enclosing functions used by this one, see
+    // FunctionDeclStmt::upvalues.
+    std::vector<Upvalue*> m_upvalues;
 };
 
 
@@ -0,0 +1,544 @@
+#include "VM.h"
+#include "Compiler.h"
+#include "ErrorManager.h"
+#include "ValueUtils.h"
+#include "Arithmetic.hpp"
+#include "BuiltinFunctions.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+using namespace pimentel;
+
+namespace
+{
+    // Calls need room for the callee's locals and temporaries on top of the
+    // arguments already pushed.
+    constexpr size_t FRAME_SLOTS_MAX = 512;
+
+    Token operatorToken(OpCode op, int line)
+    {
+        switch (op)
+        {
+        case OpCode::EQUAL:
+            return Token{ TokenType::EQUAL_EQUAL, "==", nullptr, line };
+        case OpCode::NOT_EQUAL:
+            return Token{ TokenType::BANG_EQUAL, "!=", nullptr, line };
+        case OpCode::GREATER:
+            return Token{ TokenType::GREATER, ">", nullptr, line };
+        case OpCode::GREATER_EQUAL:
+            return Token{ TokenType::GREATER_EQUAL, ">=", nullptr, line };
+        case OpCode::LESS:
+            return Token{ TokenType::LESS, "<", nullptr, line };
+        case OpCode::LESS_EQUAL:
+            return Token{ TokenType::LESS_EQUAL, "<=", nullptr, line };
+        case OpCode::ADD:
+            return Token{ TokenType::PLUS, "+", nullptr, line };
+        case OpCode::SUBTRACT:
+            return Token{ TokenType::MINUS, "-", nullptr, line };
+        case OpCode::MULTIPLY:
+            return Token{ TokenType::STAR, "*", nullptr, line };
+        case OpCode::DIVIDE:
+            return Token{ TokenType::SLASH, "/", nullptr, line };
+        default:
+            return Token{ TokenType::ENDOFFILE, "", nullptr, line };
+        }
+    }
+
+    // numberOp takes any two numbers, doubleOp is the shortcut for two
+    // doubles which then skips the integer checks.
+    template<typename NumberOp, typename DoubleOp>
+    bool numericFastPath(Value& left, const Value& right, const NumberOp& numberOp, const DoubleOp& doubleOp)
+    {
+        if (left.isInt() && right.isInt())
+        {
+            left = numberOp(left, right);
+            return true;
+        }
+
+        if (left.isDouble() && right.isDouble())
+        {
+            left = Value{ doubleOp(left.asDouble(), right.asDouble()) };
+            return true;
+        }
+
+        if (!left.isNumber() || !right.isNumber())
+        {
+            return false;
+        }
+
+        left = numberOp(left, right);
+        return true;
+    }
+}
+
+Value VmClosure::call(Interpreter&, const std::vector<Value>&)
+{
+    ErrorManager::get().report(0, "VM closures can only be called by the VM.");
+    return {};
+}
+
+void VmClosure::trace(Heap& heap)
+{
+    for (const auto upvalue : upvalues)
+    {
+        heap.mark(upvalue);
+    }
+
+    // Nested functions are only turned into closures while this one runs,
+    // their constants have to survive until then.
+    std::vector<const VmFunction*> functions{ function.get() };
+    while (!functions.empty())
+    {
+        const auto current = functions.back();
+        functions.pop_back();
+
+        for (const auto& constant : current->chunk.constants)
+        {
+            heap.mark(constant);
+        }
+
+        for (const auto& nested : current->chunk.functions)
+        {
+            functions.push_back(nested.get());
+        }
+    }
+}
+
+VM::VM(std::ostream& printStream)
+    :
+    m_stack(STACK_INITIAL),
+    m_stackTop(0),
+    m_printStream(printStream)
+{
+    m_globals.define(SymbolTable::get().intern("clock"), Value{ Heap::get().allocate<ClockFnc>() });
+    Heap::get().addRootSource(this);
+}
+
+VM::~VM()
+{
+    Heap::get().removeRootSource(this);
+}
+
+VM::VM()
+    :
+    VM(std::cout)
+{}
+
+void VM::interpret(const Program& program)
+{
+    Compiler compiler;
+    const auto script = compiler.compile(program.stmts);
+
+    if (!script)
+    {
+        return;
+    }
+
+    const auto closure = Heap::get().allocate<VmClosure>(script);
+    push(Value{ closure });
+
+    if (!call(closure, 0))
+    {
+        return;
+    }
+
+    run();
+}
+
+void VM::run()
+{
+    auto* frame = &m_frames.back();
+    const uint8_t* ip = frame->ip;
+    const Chunk* chunk = &frame->closure->function->chunk;
+    Value* slots = &m_stack[frame->base];
+
+    const auto readByte = [&ip]() { return *ip++; };
+    const auto readShort = [&ip]() {
+        ip += 2;
+        return static_cast<uint16_t>((ip[-2] << 8) | ip[-1]);
+    };
+    const auto loadFrame = [&]() {
+        frame = &m_frames.back();
+        ip = frame->ip;
+        chunk = &frame->closure->function->chunk;
+        slots = &m_stack[frame->base];
+    };
+    const auto binary = [&](OpCode op, const auto& numberOp, const auto& doubleOp) {
+        const auto right = pop();
+        auto& left = peek(0);
+        if (!numericFastPath(left, right, numberOp, doubleOp))
+        {
+            left = binaryOperation(operatorToken(op, chunk->lines[ip - chunk->code.data() - 1]), left, right);
+        }
+    };
+
+    while (true)
+    {
+        const auto op = static_cast<OpCode>(readByte());
+
+        switch (op)
+        {
+        case OpCode::CONSTANT:
+            push(chunk->constants[readShort()]);
+            break;
+        case OpCode::NIL:
+            push(Value{ nullptr });
+            break;
+        case OpCode::NULL_OBJ:
+            push(Value{});
+            break;
+        case OpCode::TRUE:
+            push(Value{ true });
+            break;
+        case OpCode::FALSE:
+            push(Value{ false });
+            break;
+        case OpCode::POP:
+            m_stackTop--;
+            break;
+
+        case OpCode::GET_LOCAL:
+            push(slots[readByte()]);
+            break;
+        case OpCode::SET_LOCAL:
+            slots[readByte()] = peek(0);
+            break;
+        case OpCode::GET_UPVALUE:
+        {
+            push(frame->closure->upvalues[readByte()]->get());
+            break;
+        }
+        case OpCode::SET_UPVALUE:
+        {
+            frame->closure->upvalues[readByte()]->get() = peek(0);
+            break;
+        }
+        case OpCode::GET_GLOBAL:
+        {
+            const auto& name = chunk->names[readShort()];
+            const auto global = m_globals.find(name);
+            if (!global)
+            {
+                ErrorManager::get().report(0, "Variable does not exist: " + name.name());
+                push(Value{});
+                break;
+            }
+            push(*global);
+            break;
+        }
+        case OpCode::SET_GLOBAL:
+        {
+            const auto& name = chunk->names[readShort()];
+            const auto global = m_globals.find(name);
+            if (!global)
+            {
+                ErrorManager::get().report(0, "Undefined variable '" + name.name() + "'.");
+                break;
+            }
+            *global = peek(0);
+            break;
+        }
+        case OpCode::DEFINE_GLOBAL:
+            m_globals.define(chunk->names[readShort()], peek(0));
+            m_stackTop--;
+            break;
+
+        case OpCode::EQUAL:
+            binary(op,
+                [](const Value& a, const Value& b) { return Value{ numberEqual(a, b) }; },
+                [](double a, double b) { return a == b; });
+            break;
+        case OpCode::NOT_EQUAL:
+            binary(op,
+                [](const Value& a, const Value& b) { return Value{ !numberEqual(a, b) }; },
+                [](double a, double b) { return a != b; });
+            break;
+        case OpCode::GREATER:
+            binary(op,
+                [](const Value& a, const Value& b) { return Value{ numberGreater(a, b) }; },
+                [](double a, double b) { return a > b; });
+            break;
+        case OpCode::GREATER_EQUAL:
+            binary(op,
+                [](const Value& a, const Value& b) { return Value{ numberGreaterEqual(a, b) }; },
+                [](double a, double b) { return a >= b; });
+            break;
+        case OpCode::LESS:
+            binary(op,
+                [](const Value& a, const Value& b) { return Value{ numberLess(a, b) }; },
+                [](double a, double b) { return a < b; });
+            break;
+        case OpCode::LESS_EQUAL:
+            binary(op,
+                [](const Value& a, const Value& b) { return Value{ numberLessEqual(a, b) }; },
+                [](double a, double b) { return a <= b; });
+            break;
+        case OpCode::ADD:
+            binary(op,
+                [](const Value& a, const Value& b) { return numberAdd(a, b); },
+                [](double a, double b) { return a + b; });
+            break;
+        case OpCode::SUBTRACT:
+            binary(op,
+                [](const Value& a, const Value& b) { return numberSubtract(a, b); },
+                [](double a, double b) { return a - b; });
+            break;
+        case OpCode::MULTIPLY:
+            binary(op,
+                [](const Value& a, const Value& b) { return numberMultiply(a, b); },
+                [](double a, double b) { return a * b; });
+            break;
+        case OpCode::DIVIDE:
+            binary(op,
+                [](const Value& a, const Value& b) { return numberDivide(a, b); },
+                [](double a, double b) { return a / b; });
+            break;
+        case OpCode::NOT:
+            peek(0) = Value{ !isTruthy(peek(0)) };
+            break;
+        case OpCode::NEGATE:
+        {
+            auto& val = peek(0);
+            val = val.isNumber() ? numberNegate(val) : Value{};
+            break;
+        }
+        case OpCode::TRUTHY:
+            peek(0) = Value{ isTruthy(peek(0)) };
+            break;
+        case OpCode::INDEX:
+        {
+            const auto index = pop();
+            auto& indexee = peek(0);
+            indexee = indexOperation(indexee, index);
+            break;
+        }
+
+        case OpCode::PRINT:
+            printValue(m_printStream, pop());
+            break;
+
+        case OpCode::JUMP:
+        {
+            const auto offset = readShort();
+            ip += offset;
+            break;
+        }
+        case OpCode::JUMP_IF_FALSE:
+        {
+            const auto offset = readShort();
+            if (!isTruthy(pop()))
+            {
+                ip += offset;
+            }
+            break;
+        }
+        case OpCode::LOOP:
+        {
+            const auto offset = readShort();
+            ip -= offset;
+            Heap::get().safepoint();
+            break;
+        }
+
+        case OpCode::CALL:
+        {
+            const auto argCount = readByte();
+            frame->ip = ip;
+            Heap::get().safepoint();
+            if (!callValue(peek(argCount), argCount))
+            {
+                return;
+            }
+            loadFrame();
+            break;
+        }
+        case OpCode::CLOSURE:
+        {
+            const auto& function = chunk->functions[readShort()];
+            const auto closure = Heap::get().allocate<VmClosure>(function);
+            for (size_t i = 0; i < function->upvalueCount; i++)
+            {
+                const auto isLocal = readByte();
+                const auto index = readByte();
+                closure->upvalues.push_back(isLocal ?
+                    captureUpvalue(frame->base + index) :
+                    frame->closure->upvalues[index]);
+            }
+            push(Value{ closure });
+            break;
+        }
+        case OpCode::CLOSE_UPVALUE:
+            closeUpvalues(m_stackTop - 1);
+            m_stackTop--;
+            break;
+        case OpCode::RETURN:
+        {
+            auto result = pop();
+            const auto base = frame->base;
+            closeUpvalues(base);
+            m_frames.pop_back();
+
+            m_stackTop = base;
+
+            if (m_frames.empty())
+            {
+                return;
+            }
+
+            push(std::move(result));
+            loadFrame();
+            break;
+        }
+        }
+    }
+}
+
+bool VM::callValue(const Value& callee, uint8_t argCount)
+{
+
+    const auto callFailed = [this, argCount]() {
+        m_stackTop -= argCount + 1;
+        push(Value{});
+        return true;
+    };
+
+    if (!callee.isCallable())
+    {
+        ErrorManager::get().report({}, "Trying to call non callable!");
+        return callFailed();
+    }
+
+    auto& callable = *callee.asCallable();
+
+    if (callable.arity() != argCount)
+    {
+        std::string err = "Wrong number of args to function: ";
+        err += "got " + std::to_string(argCount) + " expected " + std::to_string(callable.arity());
+        ErrorManager::get().report({}, err);
+        return callFailed();
+    }
+
+    if (const auto closure = dynamic_cast<VmClosure*>(&callable))
+    {
+        return call(closure, argCount);
+    }
+
+    if (const auto native = dynamic_cast<NativeFunction*>(&callable))
+    {
+        const std::vector<Value> args(m_stack.begin() + (m_stackTop - argCount), m_stack.begin() + m_stackTop);
+        auto result = native->callNative(args);
+        m_stackTop -= argCount + 1;
+        push(std::move(result));
+        return true;
+    }
+
+    ErrorManager::get().report({}, "Trying to call non callable!");
+    return callFailed();
+}
+
+bool VM::call(VmClosure* closure, uint8_t argCount)
+{
+    // Reported like any other runtime error: the call gives nil and the
+    // script goes on.
+    if (m_frames.size() == FRAMES_MAX || m_stackTop + FRAME_SLOTS_MAX > STACK_MAX)
+    {
+        runtimeError("Stack overflow.");
+        m_stackTop -= argCount + 1;
+        push(Value{});
+        return true;
+    }
+
+    // Frames address their slots by index, run() reloads its pointer after
+    // a call. Open upvalues point into the stack and move with it.
+    if (m_stackTop + FRAME_SLOTS_MAX > m_stack.size())
+    {
+        std::vector<ptrdiff_t> slots;
+
+        for (const auto upvalue : m_openUpvalues)
+        {
+            slots.push_back(upvalue->location - m_stack.data());
+        }
+
+        m_stack.resize(std::min(m_stack.size() * 2, STACK_MAX));
+
+        for (size_t i = 0; i < slots.size(); i++)
+        {
+            m_openUpvalues[i]->location = m_stack.data() + slots[i];
+        }
+    }
+
+    const auto& code = closure->function->chunk.code;
+    // The closure stays alive through the callee slot at the frame's base.
+    m_frames.push_back(CallFrame{ closure, code.data(), m_stackTop - argCount - 1 });
+    return true;
+}
+
+Upvalue* VM::captureUpvalue(size_t slot)
+{
+    const auto location = &m_stack[slot];
+
+    auto it = m_openUpvalues.end();
+    while (it != m_openUpvalues.begin() && (*(it - 1))->location >= location)
+    {
+        --it;
+        if ((*it)->location == location)
+        {
+            return *it;
+        }
+    }
+
+    return *m_openUpvalues.insert(it, Heap::get().allocate<Upvalue>(location));
+}
+
+void VM::closeUpvalues(size_t lastSlot)
+{
+    while (!m_openUpvalues.empty() && m_openUpvalues.back()->location >= &m_stack[lastSlot])
+    {
+        m_openUpvalues.back()->close();
+        m_openUpvalues.pop_back();
+    }
+}
+
+void VM::push(Value val)
+{
+    m_stack[m_stackTop++] = std::move(val);
+}
+
+Value VM::pop()
+{
+    return std::move(m_stack[--m_stackTop]);
+}
+
+Value& VM::peek(size_t distance)
+{
+    return m_stack[m_stackTop - 1 - distance];
+}
+
+void VM::runtimeError(const std::string& message)
+{
+    int line = 0;
+    if (!m_frames.empty())
+    {
+        const auto& frame = m_frames.back();
+        const auto& chunk = frame.closure->function->chunk;
+        line = chunk.lines[frame.ip - chunk.code.data() - 1];
+    }
+
+    ErrorManager::get().report(line, message);
+}
+
+void VM::markRoots(Heap& heap)
+{
+    for (size_t i = 0; i < m_stackTop; i++)
+    {
+        heap.mark(m_stack[i]);
+    }
+
+    m_globals.mark(heap);
+
+    for (const auto upvalue : m_openUpvalues)
+    {
+        heap.mark(upvalue);
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "Statement.h"
+#include "Program.h"
+#include "VmObjects.h"
+#include "Heap.h"
+#include "GlobalTable.h"
+
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace pimentel
+{
+    // Stack based virtual machine executing the bytecode emitted by Compiler.
+    // Globals persist between calls to interpret, as with the Interpreter.
+    class VM : public RootSource
+    {
+    public:
+        VM(std::ostream& printStream);
+        VM();
+        ~VM();
+
+        VM(const VM&) = delete;
+        VM& operator=(const VM&) = delete;
+
+        void interpret(const Program& program);
+
+        void markRoots(Heap& heap) override;
+
+    private:
+        struct CallFrame
+        {
+            VmClosure* closure;
+            const uint8_t* ip;
+            size_t base;
+        };
+
+        // Frames and the stack grow on demand up to these, deeper than the
+        // Interpreter recurses on the native stack.
+        static constexpr size_t FRAMES_MAX = 64 * 1024;
+        static constexpr size_t STACK_MAX = FRAMES_MAX * 64;
+        static constexpr size_t STACK_INITIAL = 64 * 1024;
+
+    private:
+        void run();
+
+        bool callValue(const Value& callee, uint8_t argCount);
+        bool call(VmClosure* closure, uint8_t argCount);
+
+        Upvalue* captureUpvalue(size_t slot);
+        void closeUpvalues(size_t lastSlot);
+
+        void push(Value val);
+        Value pop();
+        Value& peek(size_t distance);
+
+        void runtimeError(const std::string& message);
+
+    private:
+        std::vector<Value> m_stack;
+        size_t m_stackTop;
+
+        std::vector<CallFrame> m_frames;
+
+        // Kept sorted by slot so closing a scope only looks at the tail.
+        std::vector<Upvalue*> m_openUpvalues;
+
+        GlobalTable m_globals;
+
+        std::ostream& m_printStream;
+    };
+}
@@ -0,0 +1,231 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+#include "LoxObject.hpp"
+
+namespace pimentel
+{
+    class LoxString;
+    class LoxCallable;
+    struct UserFunction;
+    class ClosureFunction;
+    class Interpreter;
+
+    enum class ValueType : uint8_t
+    {
+        OBJECT,     // also the value of uninitialized variables and failed operations
+        NIL,
+        NUMBER,
+        STRING,
+        BOOL,
+        CALLABLE
+    };
+
+    // A Lox value packed in 8 bytes using NaN boxing: any double that isn't
+    // one of our quiet NaNs is a number, the remaining NaN payloads encode
+    // 32 bit integers, nil, booleans, the null object, and pointers to heap
+    // objects. Heap pointers also carry their object type in bits 48-49 so
+    // type checks never dereference them. Values don't own what they point
+    // to, objects are reclaimed by the Heap's collector.
+    //
+    // Integers are an internal representation of integral numbers: both
+    // count as numbers and asNumber() works on either, see Arithmetic.hpp for
+    // the operations that keep integers exact.
+    class Value
+    {
+    public:
+        Value()
+            :
+            m_bits(NULL_OBJ_BITS)
+        {}
+
+        Value(double number)
+        {
+            std::memcpy(&m_bits, &number, sizeof(double));
+        }
+
+        Value(int32_t integer)
+            :
+            m_bits(INT_BITS | static_cast<uint32_t>(integer))
+        {}
+
+        // Integral numbers become integers, everything else (including -0)
+        // stays a double.
+        static Value number(double number)
+        {
+            if (number >= INT32_MIN && number <= INT32_MAX)
+            {
+                const auto integer = static_cast<int32_t>(number);
+
+                if (integer == number && (integer != 0 || !std::signbit(number)))
+                {
+                    return Value{ integer };
+                }
+            }
+
+            return Value{ number };
+        }
+
+        Value(bool boolean)
+            :
+            m_bits(boolean ? TRUE_BITS : FALSE_BITS)
+        {}
+
+        Value(std::nullptr_t)
+            :
+            m_bits(NIL_BITS)
+        {}
+
+        Value(LoxObject* obj)
+            :
+            Value(obj, ObjType::OBJECT)
+        {}
+
+        Value(LoxString* str);
+        Value(LoxCallable* callable);
+
+        // Would otherwise silently convert to bool.
+        Value(const char*) = delete;
+
+        bool isDouble() const { return (m_bits & QNAN) != QNAN; }
+        bool isInt() const { return (m_bits & (SIGN_BIT | QNAN | TYPE_MASK)) == INT_BITS; }
+        bool isNumber() const { return isDouble() || isInt(); }
+        bool isBool() const { return (m_bits | 1) == TRUE_BITS; }
+        bool isNil() const { return m_bits == NIL_BITS; }
+        bool isNullObj() const { return m_bits == NULL_OBJ_BITS; }
+        bool isHeapObject() const { return (m_bits & (SIGN_BIT | QNAN)) == (SIGN_BIT | QNAN); }
+        bool isString() const { return (m_bits & (SIGN_BIT | QNAN | TYPE_MASK)) == (SIGN_BIT | QNAN | typeBits(ObjType::STRING)); }
+        bool isCallable() const { return (m_bits & (SIGN_BIT | QNAN | TYPE_MASK)) == (SIGN_BIT | QNAN | typeBits(ObjType::CALLABLE)); }
+
+        int32_t asInt() const { return static_cast<int32_t>(static_cast<uint32_t>(m_bits)); }
+
+        // Only for values known to be doubles, asNumber() takes both kinds.
+        double asDouble() const
+        {
+            double number;
+            std::memcpy(&number, &m_bits, sizeof(double));
+            return number;
+        }
+
+        double asNumber() const
+        {
+            return isInt() ? asInt() : asDouble();
+        }
+
+        bool asBool() const { return m_bits == TRUE_BITS; }
+
+        LoxObject* asObject() const
+        {
+            return isHeapObject() ? reinterpret_cast<LoxObject*>(m_bits & POINTER_MASK) : nullptr;
+        }
+
+        LoxString* asString() const { return reinterpret_cast<LoxString*>(m_bits & POINTER_MASK); }
+        LoxCallable* asCallable() const { return reinterpret_cast<LoxCallable*>(m_bits & POINTER_MASK); }
+
+        ValueType type() const;
+
+        uint64_t bits() const { return m_bits; }
+
+        static Value fromBits(uint64_t bits)
+        {
+            Value value;
+            value.m_bits = bits;
+            return value;
+        }
+
+        // The encoding, public for code generators.
+        static constexpr uint64_t SIGN_BIT = 0x8000000000000000;
+        static constexpr uint64_t QNAN = 0x7ffc000000000000;
+        static constexpr uint64_t TYPE_MASK = 0x0003000000000000;
+        static constexpr uint64_t POINTER_MASK = 0x0000ffffffffffff;
+
+        static constexpr uint64_t NIL_BITS = QNAN | 1;
+        static constexpr uint64_t FALSE_BITS = QNAN | 2;
+        static constexpr uint64_t TRUE_BITS = QNAN | 3;
+        static constexpr uint64_t NULL_OBJ_BITS = QNAN | 4;
+        // Type bits without the sign bit, the low 32 bits hold the integer.
+        static constexpr uint64_t INT_BITS = QNAN | 0x0001000000000000;
+
+        static constexpr uint64_t typeBits(ObjType type)
+        {
+            return static_cast<uint64_t>(type) << 48;
+        }
+
+    private:
+        Value(LoxObject* obj, ObjType type);
+
+    private:
+        uint64_t m_bits;
+    };
+
+    static_assert(sizeof(Value) == 8);
+    static_assert(std::is_trivially_copyable_v<Value>);
+
+    class LoxCallable : public LoxObject
+    {
+    public:
+        LoxCallable()
+            :
+            LoxObject(ObjType::CALLABLE)
+        {}
+
+        virtual Value call(Interpreter& interpreter, const std::vector<Value>& argList) = 0;
+
+        virtual size_t arity() const = 0;
+
+        // Lets the interpreter take its fast call path without a dynamic_cast.
+        virtual UserFunction* asUserFunction()
+        {
+            return nullptr;
+        }
+
+        // Same for the ClosureEngine.
+        virtual ClosureFunction* asClosureFunction()
+        {
+            return nullptr;
+        }
+    };
+
+    inline Value::Value(LoxObject* obj, ObjType type)
+        :
+        m_bits(obj ? (SIGN_BIT | QNAN | typeBits(type) | reinterpret_cast<uint64_t>(obj)) : NULL_OBJ_BITS)
+    {}
+
+    inline Value::Value(LoxCallable* callable)
+        :
+        Value(callable, ObjType::CALLABLE)
+    {}
+
+    inline ValueType Value::type() const
+    {
+        if (isNumber())
+        {
+            return ValueType::NUMBER;
+        }
+
+        if (isHeapObject())
+        {
+            switch (static_cast<ObjType>((m_bits & TYPE_MASK) >> 48))
+            {
+            case ObjType::STRING:
+                return ValueType::STRING;
+            case ObjType::CALLABLE:
+                return ValueType::CALLABLE;
+            case ObjType::OBJECT:
+            case ObjType::ENVIRONMENT:
+                return ValueType::OBJECT;
+            }
+        }
+
+        if (isBool())
+        {
+            return ValueType::BOOL;
+        }
+
+        return isNil() ? ValueType::NIL : ValueType::OBJECT;
+    }
+}
@@ -0,0 +1,198 @@
+#include "ValueUtils.h"
+#include "CustomTraits.h"
+#include "ErrorManager.h"
+#include "LoxString.h"
+#include "Arithmetic.hpp"
+
+#include <cmath>
+
+using namespace pimentel;
+
+namespace
+{
+    Value handleMismatching(const Token& token)
+    {
+        if (token.getType() == TokenType::EQUAL_EQUAL)
+        {
+            return Value{ false };
+        }
+
+        ErrorManager::get().report(token, "Mismatch types - Could not find overloaded operator.");
+        return Value{};
+    }
+
+    Value handleNumeric(TokenType type, const Value& left, const Value& right)
+    {
+        switch (type)
+        {
+        case TokenType::MINUS:
+            return numberSubtract(left, right);
+        case TokenType::PLUS:
+            return numberAdd(left, right);
+        case TokenType::SLASH:
+            return numberDivide(left, right);
+        case TokenType::STAR:
+            return numberMultiply(left, right);
+        case TokenType::GREATER:
+            return Value{ numberGreater(left, right) };
+        case TokenType::GREATER_EQUAL:
+            return Value{ numberGreaterEqual(left, right) };
+        case TokenType::LESS:
+            return Value{ numberLess(left, right) };
+        case TokenType::LESS_EQUAL:
+            return Value{ numberLessEqual(left, right) };
+        case TokenType::BANG_EQUAL:
+            return Value{ !numberEqual(left, right) };
+        case TokenType::EQUAL_EQUAL:
+            return Value{ numberEqual(left, right) };
+        default:
+            return Value{};
+        }
+    }
+
+    Value handleString(TokenType type, const LoxString& leftStr, const LoxString& rightStr)
+    {
+        switch (type)
+        {
+        case TokenType::EQUAL_EQUAL:
+            return Value{ leftStr.equals(rightStr) };
+        case TokenType::BANG_EQUAL:
+            return Value{ !leftStr.equals(rightStr) };
+        case TokenType::PLUS:
+            return LoxString::concat(leftStr, rightStr);
+        default:
+            return Value{};
+        }
+    }
+
+    Value handleBoolean(TokenType type, bool leftV, bool rightV)
+    {
+        switch (type)
+        {
+        case TokenType::BANG_EQUAL:
+            return Value{ leftV != rightV };
+        case TokenType::EQUAL_EQUAL:
+            return Value{ leftV == rightV };
+        default:
+            return Value{};
+        }
+    }
+}
+
+bool pimentel::isTruthy(const Value& val)
+{
+    // Conditions are nearly always comparisons.
+    if (val.isBool())
+    {
+        return val.asBool();
+    }
+
+    switch (val.type())
+    {
+    case ValueType::BOOL:
+        return val.asBool();
+    case ValueType::NUMBER:
+        return val.asNumber() != 0.0;
+    case ValueType::NIL:
+        return false;
+    case ValueType::OBJECT:
+        return val.asObject() != nullptr;
+    default:
+        return true;
+    }
+}
+
+Value pimentel::binaryOperation(const Token& operatorType, const Value& left, const Value& right)
+{
+    if (left.isNumber() && right.isNumber())
+    {
+        return handleNumeric(operatorType.getType(), left, right);
+    }
+
+    const auto leftType = left.type();
+    if (leftType != right.type())
+    {
+        return handleMismatching(operatorType);
+    }
+
+    switch (leftType)
+    {
+    case ValueType::STRING:
+        return handleString(operatorType.getType(), *left.asString(), *right.asString());
+    case ValueType::BOOL:
+        return handleBoolean(operatorType.getType(), left.asBool(), right.asBool());
+    default:
+        return Value{};
+    }
+}
+
+Value pimentel::indexOperation(const Value& indexee, const Value& indexVal)
+{
+    if(!indexee.isString())
+    {
+        ErrorManager::get().report({}, "Trying to index non indexable obj (non string)!");
+        return {};
+    }
+
+    const auto str = indexee.asString()->str();
+
+    if(indexVal.isInt() && indexVal.asInt() >= 0 && static_cast<size_t>(indexVal.asInt()) < str.size())
+    {
+        return singleCharString(static_cast<unsigned char>(str[indexVal.asInt()]));
+    }
+
+    if(!indexVal.isNumber())
+    {
+        ErrorManager::get().report({}, "Trying to index with non index value (non double)!");
+        return {};
+    }
+
+    const auto i = indexVal.asNumber();
+
+    // Negative, fractional or NaN indices are out of bounds too: only whole
+    // numbers below the length convert to a position.
+    if(!(i >= 0 && i < static_cast<double>(str.size()) && std::trunc(i) == i))
+    {
+        std::string err = "Trying to access out of bounds!";
+        err += "i " + std::to_string(i) + " max val " + std::to_string(str.size());
+        ErrorManager::get().report({}, err);
+        return {};
+    }
+
+    return singleCharString(static_cast<unsigned char>(str[static_cast<size_t>(i)]));
+}
+
+Value pimentel::literalToValue(const Token::LiteralType& literal)
+{
+    return std::visit(overloaded{
+        [](void*) { return Value{ nullptr }; },
+        [](double number) { return Value::number(number); },
+        [](const std::string& str) { return makeString(str); },
+        [](const auto& val) { return Value{ val }; },
+        }, literal);
+}
+
+void pimentel::printValue(std::ostream& stream, const Value& val)
+{
+    switch (val.type())
+    {
+    case ValueType::OBJECT:
+        stream << "[Lox obj] = " << static_cast<const void*>(val.asObject()) << std::endl;
+        break;
+    case ValueType::STRING:
+        stream << val.asString()->str() << std::endl;
+        break;
+    case ValueType::NIL:
+        stream << std::string{"NULL"} << std::endl;
+        break;
+    case ValueType::CALLABLE:
+        stream << std::string{"[LoxCallable]"} << std::endl;
+        break;
+    case ValueType::BOOL:
+        stream << std::string{val.asBool() ? "true" : "false"} << std::endl;
+        break;
+    case ValueType::NUMBER:
+        stream << std::to_string(val.asNumber()) << std::endl;
+        break;
+    }
+}
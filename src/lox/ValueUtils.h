@@ -0,0 +1,18 @@
+#pragma once
+#include <ostream>
+#include "Value.h"
+#include "Token.h"
+
+namespace pimentel
+{
+    // Value semantics shared by every execution engine, so the tree-walker
+    // and the VM agree on truthiness, operators and printing.
+    bool isTruthy(const Value& val);
+
+    Value binaryOperation(const Token& operatorType, const Value& left, const Value& right);
+    Value indexOperation(const Value& indexee, const Value& index);
+
+    Value literalToValue(const Token::LiteralType& literal);
+
+    void printValue(std::ostream& stream, const Value& val);
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "Chunk.h"
+#include "Upvalue.h"
+#include "Value.h"
+
+namespace pimentel
+{
+    class VmFunction
+    {
+    public:
+        VmFunction(const std::string& name)
+            :
+            name(name)
+        {}
+        ~VmFunction() = default;
+
+        std::string name;
+        size_t arity = 0;
+        size_t upvalueCount = 0;
+        Chunk chunk;
+    };
+
+    class VmClosure : public LoxCallable
+    {
+    public:
+        VmClosure(const std::shared_ptr<VmFunction>& function)
+            :
+            function(function)
+        {
+            upvalues.reserve(function->upvalueCount);
+        }
+        ~VmClosure() = default;
+
+        // Closures are only ever invoked by the VM's dispatch loop.
+        Value call(Interpreter& interpreter, const std::vector<Value>& argList) override;
+
+        size_t arity() const override
+        {
+            return function->arity;
+        }
+
+        void trace(Heap& heap) override;
+
+        std::shared_ptr<VmFunction> function;
+        std::vector<Upvalue*> upvalues;
+    };
+}
@@ -0,0 +1,314 @@
+#include "X64Assembler.h"
+
+#include <cstring>
+#include <limits>
+
+using namespace pimentel;
+
+namespace
+{
+    uint8_t code(Reg reg)
+    {
+        return static_cast<uint8_t>(reg);
+    }
+
+    uint8_t code(Xmm reg)
+    {
+        return static_cast<uint8_t>(reg);
+    }
+}
+
+X64Assembler::Label X64Assembler::newLabel()
+{
+    m_labels.push_back(std::numeric_limits<size_t>::max());
+    return m_labels.size() - 1;
+}
+
+void X64Assembler::bind(Label label)
+{
+    m_labels[label] = m_code.size();
+}
+
+void X64Assembler::movLoad(Reg dst, Reg base, int32_t disp)
+{
+    rex(true, code(dst), code(base));
+    byte(0x8b);
+    modrmMem(code(dst), base, disp);
+}
+
+void X64Assembler::movStore(Reg base, int32_t disp, Reg src)
+{
+    rex(true, code(src), code(base));
+    byte(0x89);
+    modrmMem(code(src), base, disp);
+}
+
+void X64Assembler::movImm(Reg dst, uint64_t imm)
+{
+    rex(true, 0, code(dst));
+    byte(static_cast<uint8_t>(0xb8 + (code(dst) & 7)));
+
+    for (int i = 0; i < 8; i++)
+    {
+        byte(static_cast<uint8_t>(imm >> (8 * i)));
+    }
+}
+
+void X64Assembler::mov(Reg dst, Reg src)
+{
+    rex(true, code(src), code(dst));
+    byte(0x89);
+    modrmReg(code(src), code(dst));
+}
+
+void X64Assembler::lea(Reg dst, Reg base, int32_t disp)
+{
+    rex(true, code(dst), code(base));
+    byte(0x8d);
+    modrmMem(code(dst), base, disp);
+}
+
+void X64Assembler::add(Reg dst, Reg src)
+{
+    rex(true, code(src), code(dst));
+    byte(0x01);
+    modrmReg(code(src), code(dst));
+}
+
+void X64Assembler::andReg(Reg dst, Reg src)
+{
+    rex(true, code(src), code(dst));
+    byte(0x21);
+    modrmReg(code(src), code(dst));
+}
+
+void X64Assembler::cmp(Reg left, Reg right)
+{
+    rex(true, code(right), code(left));
+    byte(0x39);
+    modrmReg(code(right), code(left));
+}
+
+void X64Assembler::cmpLoad(Reg left, Reg base, int32_t disp)
+{
+    rex(true, code(left), code(base));
+    byte(0x3b);
+    modrmMem(code(left), base, disp);
+}
+
+void X64Assembler::subImm(Reg dst, int32_t imm)
+{
+    rex(true, 0, code(dst));
+    byte(0x81);
+    modrmReg(5, code(dst));
+    imm32(static_cast<uint32_t>(imm));
+}
+
+void X64Assembler::flipSign(Reg reg)
+{
+    // btc reg, 63
+    rex(true, 0, code(reg));
+    byte(0x0f);
+    byte(0xba);
+    modrmReg(7, code(reg));
+    byte(63);
+}
+
+void X64Assembler::zeroEax()
+{
+    byte(0x31);
+    byte(0xc0);
+}
+
+void X64Assembler::setcc(Condition condition, Reg dst8)
+{
+    byte(0x0f);
+    byte(static_cast<uint8_t>(0x90 | static_cast<uint8_t>(condition)));
+    modrmReg(0, code(dst8));
+}
+
+void X64Assembler::andAlCl()
+{
+    byte(0x20);
+    byte(0xc8);
+}
+
+void X64Assembler::orAlCl()
+{
+    byte(0x08);
+    byte(0xc8);
+}
+
+void X64Assembler::test(Reg left, Reg right)
+{
+    rex(true, code(right), code(left));
+    byte(0x85);
+    modrmReg(code(right), code(left));
+}
+
+void X64Assembler::movsdLoad(Xmm dst, Reg base, int32_t disp)
+{
+    sse(0xf2, 0x10, dst, base, disp);
+}
+
+void X64Assembler::movsdStore(Reg base, int32_t disp, Xmm src)
+{
+    sse(0xf2, 0x11, src, base, disp);
+}
+
+void X64Assembler::addsd(Xmm dst, Reg base, int32_t disp)
+{
+    sse(0xf2, 0x58, dst, base, disp);
+}
+
+void X64Assembler::subsd(Xmm dst, Reg base, int32_t disp)
+{
+    sse(0xf2, 0x5c, dst, base, disp);
+}
+
+void X64Assembler::mulsd(Xmm dst, Reg base, int32_t disp)
+{
+    sse(0xf2, 0x59, dst, base, disp);
+}
+
+void X64Assembler::divsd(Xmm dst, Reg base, int32_t disp)
+{
+    sse(0xf2, 0x5e, dst, base, disp);
+}
+
+void X64Assembler::ucomisd(Xmm left, Reg base, int32_t disp)
+{
+    sse(0x66, 0x2e, left, base, disp);
+}
+
+void X64Assembler::xorpd(Xmm dst, Xmm src)
+{
+    byte(0x66);
+    rex(false, code(dst), code(src));
+    byte(0x0f);
+    byte(0x57);
+    modrmReg(code(dst), code(src));
+}
+
+void X64Assembler::cvtsi2sd(Xmm dst, Reg src)
+{
+    byte(0xf2);
+    rex(false, code(dst), code(src));
+    byte(0x0f);
+    byte(0x2a);
+    modrmReg(code(dst), code(src));
+}
+
+void X64Assembler::push(Reg reg)
+{
+    rex(false, 0, code(reg));
+    byte(static_cast<uint8_t>(0x50 + (code(reg) & 7)));
+}
+
+void X64Assembler::pop(Reg reg)
+{
+    rex(false, 0, code(reg));
+    byte(static_cast<uint8_t>(0x58 + (code(reg) & 7)));
+}
+
+void X64Assembler::jmp(Label label)
+{
+    byte(0xe9);
+    rel32(label);
+}
+
+void X64Assembler::jcc(Condition condition, Label label)
+{
+    byte(0x0f);
+    byte(static_cast<uint8_t>(0x80 | static_cast<uint8_t>(condition)));
+    rel32(label);
+}
+
+void X64Assembler::call(Label label)
+{
+    byte(0xe8);
+    rel32(label);
+}
+
+void X64Assembler::call(Reg target)
+{
+    rex(false, 0, code(target));
+    byte(0xff);
+    modrmReg(2, code(target));
+}
+
+void X64Assembler::ret()
+{
+    byte(0xc3);
+}
+
+std::vector<uint8_t> X64Assembler::finish()
+{
+    for (const auto& [at, label] : m_fixups)
+    {
+        // Relative to the end of the field.
+        const auto rel = static_cast<int32_t>(static_cast<int64_t>(m_labels[label]) - static_cast<int64_t>(at + 4));
+        std::memcpy(m_code.data() + at, &rel, sizeof(rel));
+    }
+
+    m_fixups.clear();
+
+    return std::move(m_code);
+}
+
+void X64Assembler::byte(uint8_t value)
+{
+    m_code.push_back(value);
+}
+
+void X64Assembler::imm32(uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        byte(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+void X64Assembler::rex(bool wide, uint8_t reg, uint8_t base)
+{
+    const auto prefix = static_cast<uint8_t>(0x40 | (wide ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((base & 8) ? 1 : 0));
+
+    // A bare 0x40 would only matter for byte registers past BL.
+    if (prefix != 0x40)
+    {
+        byte(prefix);
+    }
+}
+
+void X64Assembler::modrmMem(uint8_t reg, Reg base, int32_t disp)
+{
+    // Always a 32 bit displacement, RSP and R12 as a base need a SIB byte.
+    byte(static_cast<uint8_t>(0x80 | ((reg & 7) << 3) | (code(base) & 7)));
+
+    if ((code(base) & 7) == 4)
+    {
+        byte(0x24);
+    }
+
+    imm32(static_cast<uint32_t>(disp));
+}
+
+void X64Assembler::modrmReg(uint8_t reg, uint8_t rm)
+{
+    byte(static_cast<uint8_t>(0xc0 | ((reg & 7) << 3) | (rm & 7)));
+}
+
+void X64Assembler::sse(uint8_t prefix, uint8_t opcode, Xmm reg, Reg base, int32_t disp)
+{
+    byte(prefix);
+    rex(false, code(reg), code(base));
+    byte(0x0f);
+    byte(opcode);
+    modrmMem(code(reg), base, disp);
+}
+
+void X64Assembler::rel32(Label label)
+{
+    m_fixups.emplace_back(m_code.size(), label);
+    imm32(0);
+}
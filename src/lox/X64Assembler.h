@@ -0,0 +1,101 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace pimentel
+{
+    enum class Reg : uint8_t
+    {
+        RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+        R8, R9, R10, R11, R12, R13, R14, R15
+    };
+
+    enum class Xmm : uint8_t
+    {
+        XMM0, XMM1
+    };
+
+    // Low nibble of the Jcc and SETcc opcodes.
+    enum class Condition : uint8_t
+    {
+        BELOW = 0x2,
+        ABOVE_EQUAL = 0x3,
+        EQUAL = 0x4,
+        NOT_EQUAL = 0x5,
+        ABOVE = 0x7,
+        PARITY = 0xa,
+        NOT_PARITY = 0xb
+    };
+
+    // Encodes the few x86-64 instructions the JIT emits into a byte buffer.
+    // Memory operands are a base register plus a 32 bit displacement, jumps
+    // and calls to labels are rel32 patched once the label is bound, so the
+    // code can be copied anywhere.
+    class X64Assembler
+    {
+    public:
+        using Label = size_t;
+
+        Label newLabel();
+        void bind(Label label);
+        size_t offset() const { return m_code.size(); }
+
+        void movLoad(Reg dst, Reg base, int32_t disp);
+        void movStore(Reg base, int32_t disp, Reg src);
+        void movImm(Reg dst, uint64_t imm);
+        void mov(Reg dst, Reg src);
+        void lea(Reg dst, Reg base, int32_t disp);
+        void add(Reg dst, Reg src);
+        void andReg(Reg dst, Reg src);
+        void cmp(Reg left, Reg right);
+        void cmpLoad(Reg left, Reg base, int32_t disp);
+        void subImm(Reg dst, int32_t imm);
+        // Flips bit 63, the sign of a double.
+        void flipSign(Reg reg);
+        void zeroEax();
+        void setcc(Condition condition, Reg dst8);
+        void andAlCl();
+        void orAlCl();
+        void test(Reg left, Reg right);
+
+        void movsdLoad(Xmm dst, Reg base, int32_t disp);
+        void movsdStore(Reg base, int32_t disp, Xmm src);
+        void addsd(Xmm dst, Reg base, int32_t disp);
+        void subsd(Xmm dst, Reg base, int32_t disp);
+        void mulsd(Xmm dst, Reg base, int32_t disp);
+        void divsd(Xmm dst, Reg base, int32_t disp);
+        void ucomisd(Xmm left, Reg base, int32_t disp);
+        void xorpd(Xmm dst, Xmm src);
+        // From a 32 bit integer.
+        void cvtsi2sd(Xmm dst, Reg src);
+
+        void push(Reg reg);
+        void pop(Reg reg);
+        void jmp(Label label);
+        void jcc(Condition condition, Label label);
+        void call(Label label);
+        void call(Reg target);
+        void ret();
+
+        // Patches the jumps, every label they use must be bound.
+        std::vector<uint8_t> finish();
+
+    private:
+        void byte(uint8_t value);
+        void imm32(uint32_t value);
+        void rex(bool wide, uint8_t reg, uint8_t base);
+        void modrmMem(uint8_t reg, Reg base, int32_t disp);
+        void modrmReg(uint8_t reg, uint8_t rm);
+        void sse(uint8_t prefix, uint8_t opcode, Xmm reg, Reg base, int32_t disp);
+        void rel32(Label label);
+
+    private:
+        std::vector<uint8_t> m_code;
+        // Offset of every label, SIZE_MAX until bound.
+        std::vector<size_t> m_labels;
+        // Offsets of the rel32 fields to patch, with their label.
+        std::vector<std::pair<size_t, Label>> m_fixups;
+    };
+}
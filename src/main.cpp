@@ -1,29 +1,158 @@
 #include <iostream>
+#include <cstdlib>
+#include <string>
 #include <lox/Lox.h>
 
 #include <lox/ErrorManager.h>
+#include <lox/Heap.h>
 
-#include <lox/ExpressionVisitor.hpp>
 #include <lox/Expression.h>
 #include <lox/AstPrinter.hpp>
 
+namespace
+{
+    void printUsage()
+    {
+        std::cout << "Usage: cpplox [--engine=interpreter|vm|ir|closure] [--dump-optimized-ast] [--dump-ir] [--ir-timing] [--jit=off|on|eager] [--jit-cache=<KiB>] [--perf-map] [--memoize[=<entries>]] [--memo-stats] [--gc-stats] [--gc-growth=<factor>] [--gc-stress] [--specialization-stats] [script]" << std::endl;
+    }
+}
+
 int main(int argc, char** argv)
 {
-    if(argc > 2)
+    pimentel::LoxOptions options;
+    std::string script;
+    bool gcStats = false;
+    bool specializationStats = false;
+    bool irTiming = false;
+    bool memoStats = false;
+
+    for(int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+
+        if(arg == "--engine=interpreter")
+        {
+            options.engine = pimentel::Engine::INTERPRETER;
+        }
+        else if(arg == "--engine=vm")
+        {
+            options.engine = pimentel::Engine::VM;
+        }
+        else if(arg == "--engine=ir")
+        {
+            options.engine = pimentel::Engine::IR;
+        }
+        else if(arg == "--engine=closure")
+        {
+            options.engine = pimentel::Engine::CLOSURE;
+        }
+        else if(arg == "--dump-ir")
+        {
+            options.dumpIr = true;
+        }
+        else if(arg == "--ir-timing")
+        {
+            irTiming = true;
+        }
+        else if(arg == "--jit=off")
+        {
+            options.jit.mode = pimentel::JitMode::OFF;
+        }
+        else if(arg == "--jit=on")
+        {
+            options.jit.mode = pimentel::JitMode::ON;
+        }
+        else if(arg == "--jit=eager")
+        {
+            options.jit.mode = pimentel::JitMode::EAGER;
+        }
+        else if(arg.rfind("--jit-cache=", 0) == 0)
+        {
+            options.jit.cacheSize = std::strtoul(arg.c_str() + 12, nullptr, 10) * 1024;
+        }
+        else if(arg == "--perf-map")
+        {
+            options.jit.perfMap = true;
+        }
+        else if(arg == "--memoize")
+        {
+            options.memoize = true;
+        }
+        else if(arg.rfind("--memoize=", 0) == 0)
+        {
+            options.memoize = true;
+            options.memoizeCapacity = std::strtoul(arg.c_str() + 10, nullptr, 10);
+        }
+        else if(arg == "--memo-stats")
+        {
+            memoStats = true;
+        }
+        else if(arg == "--dump-optimized-ast")
+        {
+            options.dumpOptimizedAst = true;
+        }
+        else if(arg == "--gc-stats")
+        {
+            gcStats = true;
+        }
+        else if(arg.rfind("--gc-growth=", 0) == 0)
+        {
+            pimentel::Heap::get().setGrowthFactor(std::atof(arg.c_str() + 12));
+        }
+        else if(arg == "--gc-stress")
+        {
+            pimentel::Heap::get().setStressMode(true);
+        }
+        else if(arg == "--specialization-stats")
+        {
+            specializationStats = true;
+        }
+        else if(arg.rfind("--", 0) == 0 || !script.empty())
+        {
+            printUsage();
+            return 64;
+        }
+        else
+        {
+            script = arg;
+        }
+    }
+
+    pimentel::Lox lox{options};
+
+    if(!script.empty())
+    {
+        lox.runFile(script);
+    }
+    else
+    {
+        lox.runPrompt();
+    }
+
+    if(gcStats)
     {
-        std::cout << "Usage: cpplox [script]" << std::endl;
-        return 64;
+        pimentel::Heap::get().printStats(std::cerr);
     }
 
-    pimentel::Lox lox{};
+    if(specializationStats)
+    {
+        lox.printSpecializationStats(std::cerr);
+    }
 
-    if(argc == 2)
+    if(irTiming)
     {
-        lox.runFile(argv[1]);    
-        return 0;    
+        lox.printIrStats(std::cerr);
     }
 
-    lox.runPrompt();
+    if(memoStats)
+    {
+        lox.printMemoStats(std::cerr);
+    }
+
+    if(!script.empty())
+    {
+        return 0;
+    }
 
     const auto& errorMngr = pimentel::ErrorManager::get();
     if(errorMngr.hasError())
@@ -32,4 +161,4 @@ int main(int argc, char** argv)
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -1,5 +1,8 @@
 #include <gtest/gtest.h>
 #include <lox/AstPrinter.hpp>
+#include <lox/Scanner.h>
+#include <lox/Parser.h>
+#include <lox/Optimizer.h>
 
 using namespace pimentel;
 
@@ -21,4 +24,43 @@ TEST(AstVisitor, BasicPrint)
     const auto expectedOutput = std::string{"(* (- 123.000000) (group 45.670000))"};
 
     ASSERT_EQ(output, expectedOutput);
-}
\ No newline at end of file
+}
+
+TEST(AstVisitor, PrintOptimizedProgram)
+{
+    Scanner scanner{"var size = 8 - 1; if (size > 2 * 3) { print \"a\" + \"b\"; } while (false) print size; if (!true) print 1; else print (size);"};
+    Parser parser{scanner.scanTokens()};
+
+    const auto program = parser.parse();
+    Optimizer{*program}.optimize();
+
+    AstPrinter astPrinter;
+
+    const auto output = astPrinter.print(*program);
+    const auto expectedOutput = std::string{
+        "(var size 7.000000)\n"
+        "(if (> size 6.000000) (block (print ab)))\n"
+        "(print size)\n"};
+
+    ASSERT_EQ(output, expectedOutput);
+}
+
+TEST(AstVisitor, LeavesIndicesOutOfBoundsToTheRuntime)
+{
+    Scanner scanner{"print \"abc\"[1]; print \"abc\"[1.5]; print \"abc\"[3]; print \"abc\"[-1];"};
+    Parser parser{scanner.scanTokens()};
+
+    const auto program = parser.parse();
+    Optimizer{*program}.optimize();
+
+    AstPrinter astPrinter;
+
+    const auto output = astPrinter.print(*program);
+    const auto expectedOutput = std::string{
+        "(print b)\n"
+        "(print ([] abc 1.500000))\n"
+        "(print ([] abc 3.000000))\n"
+        "(print ([] abc -1.000000))\n"};
+
+    ASSERT_EQ(output, expectedOutput);
+}
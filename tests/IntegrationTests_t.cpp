@@ -2,23 +2,39 @@
 
 #include <memory>
 
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
 #include <lox/Scanner.h>
 #include <lox/Parser.h>
 #include <lox/Interpreter.h>
+#include <lox/VM.h>
+#include <lox/ClosureEngine.h>
+#include <lox/Lox.h>
+#include <lox/Optimizer.h>
+#include <lox/Memoizer.h>
 
 using namespace pimentel;
 
 class BasicIntegrationFixture : 
-    public ::testing::TestWithParam<std::tuple<std::string, std::string>>
+    public ::testing::TestWithParam<std::tuple<std::tuple<std::string, std::string>, Engine>>
 {
 protected:
     void SetUp() override
-    {}
+    {
+        ErrorManager::get().resetError();
+
+        if(std::get<Engine>(GetParam()) == Engine::IR)
+        {
+            m_interpreter.enableIr(false);
+        }
+    }
 
     void TearDown() override
     {}
 
-    void runCode(const std::string& code)
+    void runCode(const std::string& code, bool optimize = false)
     {
         Scanner scanner{code};
 
@@ -28,31 +44,663 @@ protected:
 
         // AstPrinter astPrinter;
 
-        const auto stmts = p.parse();
+        const auto program = p.parse();
 
-        if(!stmts.size() || ErrorManager::get().hasError())
+        if(!program->size() || ErrorManager::get().hasError())
         {
             std::cout << "Errors found, please fix." << std::endl;
 
             return;
         }
 
-        // std::cout << astPrinter.print(*stmts) << std::endl;
-        m_interpreter.interpret(stmts);
+        if(optimize)
+        {
+            Optimizer{*program}.optimize();
+        }
+
+        switch(std::get<Engine>(GetParam()))
+        {
+        case Engine::INTERPRETER:
+        case Engine::IR:
+            m_interpreter.interpret(*program);
+            break;
+        case Engine::VM:
+            m_vm.interpret(*program);
+            break;
+        case Engine::CLOSURE:
+            m_closures.interpret(*program);
+            break;
+        }
     }
     
     std::stringstream outStream;
     Interpreter m_interpreter{outStream};
+    VM m_vm{outStream};
+    ClosureEngine m_closures{outStream};
 };
 
 TEST_P(BasicIntegrationFixture, PrintTest)
 {
-    const auto [code, expectedOutput] = GetParam();
+    const auto [code, expectedOutput] = std::get<0>(GetParam());
     runCode(code);
 
     EXPECT_EQ(outStream.str(), expectedOutput);
 }
 
+TEST_P(BasicIntegrationFixture, GcStressTest)
+{
+    const auto [code, expectedOutput] = std::get<0>(GetParam());
+
+    Heap::get().setStressMode(true);
+    runCode(code);
+    Heap::get().setStressMode(false);
+
+    EXPECT_EQ(outStream.str(), expectedOutput);
+}
+
+TEST_P(BasicIntegrationFixture, OptimizedTest)
+{
+    const auto [code, expectedOutput] = std::get<0>(GetParam());
+    runCode(code, true);
+
+    EXPECT_EQ(outStream.str(), expectedOutput);
+}
+
+TEST(ProgramTest, FunctionsOutliveTheirProgram)
+{
+    std::stringstream out;
+    Interpreter interpreter{out};
+
+    {
+        const auto program = Parser{Scanner{"fun add(a, b) { var s = \"sum \"; return a + b; }"}.scanTokens()}.parse();
+        interpreter.interpret(*program);
+    }
+
+    const auto program = Parser{Scanner{"print add(1, 2);"}.scanTokens()}.parse();
+    interpreter.interpret(*program);
+
+    EXPECT_EQ(out.str(), "3.000000\n");
+}
+
+TEST(GcTest, ReclaimsClosureCycles)
+{
+    std::stringstream out;
+    Interpreter interpreter{out};
+
+    const auto program = Parser{Scanner{R"STR(
+        fun makeCounter() {
+            var count = 0;
+            fun counter() { count = count + 1; return count; }
+            return counter;
+        }
+        for (var i = 0; i < 1000; i = i + 1) { makeCounter()(); }
+        )STR"}.scanTokens()}.parse();
+
+    Heap::get().collect();
+    const auto before = Heap::get().stats().objectCount;
+
+    interpreter.interpret(*program);
+    Heap::get().collect();
+
+    EXPECT_FALSE(ErrorManager::get().hasError());
+    EXPECT_LE(Heap::get().stats().objectCount, before + 16);
+}
+
+TEST(CallFrameTest, CallsDontAllocate)
+{
+    std::stringstream out;
+    Interpreter interpreter{out};
+
+    const auto program = Parser{Scanner{R"STR(
+        fun fib(n) { if (n <= 1) return n; return fib(n - 2) + fib(n - 1); }
+        print fib(15);
+        )STR"}.scanTokens()}.parse();
+    interpreter.interpret(*program);
+
+    const auto allocations = [] { return Heap::get().stats().objectCount + Heap::get().stats().freedObjects; };
+    const auto before = allocations();
+
+    const auto again = Parser{Scanner{"print fib(15);"}.scanTokens()}.parse();
+    interpreter.interpret(*again);
+
+    EXPECT_FALSE(ErrorManager::get().hasError());
+    EXPECT_EQ(out.str(), "610.000000\n610.000000\n");
+    EXPECT_EQ(allocations(), before);
+}
+
+TEST(ScopeElisionTest, LoopsDontAllocate)
+{
+    std::stringstream out;
+    Interpreter interpreter{out};
+
+    const auto program = Parser{Scanner{R"STR(
+        fun sum(n) {
+            var s = 0;
+            for (var i = 0; i < n; i = i + 1) { var sq = i * i; { s = s + sq; } }
+            return s;
+        }
+        print sum(10);
+        )STR"}.scanTokens()}.parse();
+    interpreter.interpret(*program);
+
+    const auto allocations = [] { return Heap::get().stats().objectCount + Heap::get().stats().freedObjects; };
+    const auto before = allocations();
+
+    const auto again = Parser{Scanner{"print sum(1000);"}.scanTokens()}.parse();
+    interpreter.interpret(*again);
+
+    EXPECT_FALSE(ErrorManager::get().hasError());
+    EXPECT_EQ(out.str(), "285.000000\n332833500.000000\n");
+    EXPECT_EQ(allocations(), before);
+}
+
+TEST(GcTest, ClosuresOnlyKeepCapturedVariables)
+{
+    std::stringstream out;
+    Interpreter interpreter{out};
+
+    const auto program = Parser{Scanner{R"STR(
+        fun makeCounter() {
+            var unused = "not " + "captured";
+            var count = 0;
+            fun counter() { count = count + 1; return count; }
+            return counter;
+        }
+        makeCounter()();
+        )STR"}.scanTokens()}.parse();
+    interpreter.interpret(*program);
+
+    Heap::get().collect();
+    const auto before = Heap::get().stats().objectCount;
+
+    const auto run = Parser{Scanner{"var c = makeCounter(); c(); print c();"}.scanTokens()}.parse();
+    interpreter.interpret(*run);
+    Heap::get().collect();
+
+    // Only the closure and the upvalue of `count` are left, neither the
+    // call's environment nor `unused`.
+    EXPECT_FALSE(ErrorManager::get().hasError());
+    EXPECT_EQ(out.str(), "2.000000\n");
+    EXPECT_EQ(Heap::get().stats().objectCount, before + 2);
+}
+
+TEST(GcTest, AppendingToLiteralsDoesntGrowThem)
+{
+#ifdef __GLIBC__
+    std::stringstream out;
+    Interpreter interpreter{out};
+
+    // Both loops start from strings kept for the whole run: a literal and a
+    // one character string.
+    const auto program = Parser{Scanner{R"STR(
+        var s = "";
+        for (var i = 0; i < 50000; i = i + 1) { s = s + "0123456789"; }
+        var t = "x"[0];
+        for (var i = 0; i < 50000; i = i + 1) { t = t + "0123456789"; }
+        print s == t;
+        s = nil;
+        t = nil;
+        )STR"}.scanTokens()}.parse();
+
+    // Large blocks are mapped on their own.
+    const auto inUse = [] { return mallinfo2().uordblks + mallinfo2().hblkhd; };
+
+    Heap::get().collect();
+    const auto before = inUse();
+
+    interpreter.interpret(*program);
+    Heap::get().collect();
+
+    EXPECT_FALSE(ErrorManager::get().hasError());
+    EXPECT_EQ(out.str(), "false\n");
+    EXPECT_LT(inUse(), before + 64 * 1024);
+#else
+    GTEST_SKIP() << "Needs glibc's mallinfo2";
+#endif
+}
+
+TEST(GcTest, ChargesStringBuffersWhileTheyLive)
+{
+    std::stringstream out;
+    Interpreter interpreter{out};
+
+    const auto build = Parser{Scanner{R"STR(
+        var s = "";
+        for (var i = 0; i < 50000; i = i + 1) { s = s + "0123456789"; }
+        )STR"}.scanTokens()}.parse();
+    const auto drop = Parser{Scanner{"s = nil;"}.scanTokens()}.parse();
+
+    Heap::get().collect();
+    const auto before = Heap::get().stats().bytesAllocated;
+
+    // Only the last string survives, its buffer holds all 500000 characters.
+    interpreter.interpret(*build);
+    Heap::get().collect();
+    EXPECT_GE(Heap::get().stats().bytesAllocated, before + 500000);
+
+    interpreter.interpret(*drop);
+    Heap::get().collect();
+    EXPECT_LT(Heap::get().stats().bytesAllocated, before + 1024);
+}
+
+TEST(SpecializationTest, DeoptimizesOnTypeChange)
+{
+    std::stringstream out;
+    Interpreter interpreter{out};
+
+    const auto program = Parser{Scanner{R"STR(
+        fun add(a, b) { return a + b; }
+        fun first(s) { return s[0]; }
+        print add(1, 2);
+        print add(3, 4);
+        print add("a", "b");
+        print first("xy");
+        print first("zw");
+        )STR"}.scanTokens()}.parse();
+
+    interpreter.interpret(*program);
+
+    EXPECT_EQ(out.str(), "3.000000\n7.000000\nab\nx\nz\n");
+
+    // a + b, s[0] and the five call sites specialize, only a + b sees a new type.
+    const auto& stats = interpreter.specializationStats();
+    EXPECT_EQ(stats.specialized, 7u);
+    EXPECT_EQ(stats.deoptimized, 1u);
+}
+
+TEST(TailCallTest, DeepTailRecursionRunsInConstantSpace)
+{
+    std::stringstream out;
+    Interpreter interpreter{out};
+
+    const auto program = Parser{Scanner{R"STR(
+        fun count(n, acc) { if (n == 0) return acc; return count(n - 1, acc + 1); }
+        fun isEven(n) { if (n == 0) return true; return isOdd(n - 1); }
+        fun isOdd(n) { if (n == 0) return false; return isEven(n - 1); }
+        print count(500000, 0);
+        print isEven(200001);
+        )STR"}.scanTokens()}.parse();
+
+    interpreter.interpret(*program);
+
+    EXPECT_FALSE(ErrorManager::get().hasError());
+    EXPECT_EQ(out.str(), "500000.000000\nfalse\n");
+}
+
+TEST(VmTest, DeepRecursionGrowsTheStackAndOverflowIsRecoverable)
+{
+    std::stringstream out;
+    VM vm{out};
+
+    const auto program = Parser{Scanner{R"STR(
+        fun depth(n) { if (n == 0) return 0; return 1 + depth(n - 1); }
+        fun down(n) { if (n == 0) return 0; down(n - 1); return n; }
+        print depth(20000);
+        print down(100000);
+        print "after";
+        )STR"}.scanTokens()}.parse();
+
+    vm.interpret(*program);
+
+    // down(100000) runs out of frames, the call reporting it gives nil.
+    EXPECT_TRUE(ErrorManager::get().hasError());
+    ErrorManager::get().resetError();
+    EXPECT_EQ(out.str(), "20000.000000\n100000.000000\nafter\n");
+}
+
+TEST(CountedLoopTest, NativeCounterKeepsLoxSemantics)
+{
+    std::stringstream out;
+    Interpreter interpreter{out};
+
+    const auto program = Parser{Scanner{R"STR(
+        var n = 3;
+        for (var i = 0; i < n; i = i + 1) { print i; n = n - 0.5; }
+        var fs = "";
+        for (var i = 5; i >= 0; i = i - 2) { fun f() { return i; } fs = fs + "x"; if (f() < 2) break; }
+        var b = 2;
+        for (var i = 0; i <= b; i = 1 + i) { b = "stop"; }
+        for (var i = 0; i < 10; i = i + 1) { i = i + 4; print i; }
+        print fs;
+        )STR"}.scanTokens()}.parse();
+
+    interpreter.interpret(*program);
+
+    const auto counted = [&](size_t index) { return static_cast<const ForStmt&>(*program->stmts[index]).counted; };
+
+    ASSERT_TRUE(counted(1).has_value());
+    EXPECT_TRUE(counted(1)->observed);
+    ASSERT_TRUE(counted(3).has_value());
+    EXPECT_EQ(counted(3)->step, -2.0);
+    ASSERT_TRUE(counted(5).has_value());
+    EXPECT_FALSE(counted(5)->observed);
+    // The body assigns the counter.
+    EXPECT_FALSE(counted(6).has_value());
+
+    // The bound turning into a string hands the loop back to the generic
+    // path, which reports comparing it.
+    EXPECT_TRUE(ErrorManager::get().hasError());
+    ErrorManager::get().resetError();
+    EXPECT_EQ(out.str(), "0.000000\n1.000000\n4.000000\n9.000000\nxxx\n");
+}
+
+TEST(IrTest, DropsProvenBoundsChecksAndInlinesCalls)
+{
+    std::stringstream out;
+    Interpreter interpreter{out};
+    interpreter.enableIr(true);
+
+    const auto program = Parser{Scanner{R"STR(
+        fun twice(x) { return x + x; }
+        fun letters() {
+            var s = "";
+            for (var i = 0; i < 5; i = i + 1) { s = s + "hello"[i]; }
+            return s;
+        }
+        fun sum(n) {
+            var total = 0;
+            for (var i = 0; i < n; i = i + 1) { total = total + twice(i); }
+            return total;
+        }
+        print letters();
+        print sum(4);
+        )STR"}.scanTokens()}.parse();
+
+    interpreter.interpret(*program);
+
+    const auto output = out.str();
+    EXPECT_FALSE(ErrorManager::get().hasError());
+    EXPECT_NE(output.find("function letters(0)"), std::string::npos);
+    EXPECT_NE(output.find("index"), std::string::npos);
+    EXPECT_NE(output.find("unchecked"), std::string::npos);
+    // twice() is never reassigned, its inlined body needs no guard.
+    EXPECT_EQ(output.find("call"), std::string::npos);
+    EXPECT_NE(output.find("hello\n"), std::string::npos);
+    EXPECT_NE(output.find("12.000000\n"), std::string::npos);
+}
+
+TEST(IrTest, ReassignedGlobalsArentConstants)
+{
+    std::stringstream out;
+    Interpreter interpreter{out};
+    interpreter.enableIr(false);
+
+    const auto first = Parser{Scanner{R"STR(
+        var step = 1;
+        fun f(n) { return n + step; }
+        fun g(n) { return f(n) * 2; }
+        print g(1);
+        )STR"}.scanTokens()}.parse();
+    interpreter.interpret(*first);
+
+    const auto second = Parser{Scanner{R"STR(
+        step = 10;
+        print g(1);
+        )STR"}.scanTokens()}.parse();
+    interpreter.interpret(*second);
+
+    EXPECT_FALSE(ErrorManager::get().hasError());
+    EXPECT_EQ(out.str(), "4.000000\n22.000000\n");
+}
+
+TEST(IrTest, KeepsCodeAcrossProgramsUntilAGlobalItUsesIsAssigned)
+{
+    std::stringstream out;
+    Interpreter interpreter{out};
+    interpreter.enableIr(false);
+
+    const auto run = [&interpreter](const std::string& code) {
+        const auto program = Parser{Scanner{code}.scanTokens()}.parse();
+        interpreter.interpret(*program);
+    };
+    const auto compiled = [&interpreter]() {
+        std::stringstream stats;
+        interpreter.printIrStats(stats);
+        const auto line = stats.str();
+        const auto start = line.find("functions compiled: ") + 20;
+        return line.substr(start, line.find(' ', start) - start);
+    };
+
+    // g() inlines f(), which takes step for a constant.
+    run(R"STR(
+        var step = 1;
+        var other = 0;
+        fun f(n) { return n + step; }
+        fun g(n) { return f(n) * 2; }
+        fun h(n) { return n * 3; }
+        print g(1);
+        print h(1);
+        )STR");
+    EXPECT_EQ(compiled(), "3");
+
+    run("other = 5; print g(1); print h(2);");
+    EXPECT_EQ(compiled(), "3");
+
+    // Only f() and g() are compiled again.
+    run("step = 10; print g(1); print h(3);");
+    EXPECT_EQ(compiled(), "5");
+
+    EXPECT_FALSE(ErrorManager::get().hasError());
+    EXPECT_EQ(out.str(), "4.000000\n3.000000\n4.000000\n6.000000\n22.000000\n9.000000\n");
+}
+
+TEST(IrTest, NumericFunctionsRunUnboxed)
+{
+    std::stringstream out;
+    Interpreter interpreter{out};
+    interpreter.enableIr(false);
+
+    const auto program = Parser{Scanner{R"STR(
+        fun fib(n) { if (n <= 1) return n; return fib(n - 2) + fib(n - 1); }
+        fun greet(name) { return "hi " + name; }
+        fun twice(n) { return n + n; }
+        print fib(15);
+        print twice(1.5);
+        print twice("ab");
+        print greet("bob");
+        )STR"}.scanTokens()}.parse();
+
+    interpreter.interpret(*program);
+
+    std::stringstream stats;
+    interpreter.printIrStats(stats);
+
+    EXPECT_FALSE(ErrorManager::get().hasError());
+    // twice("ab") takes the boxed code.
+    EXPECT_EQ(out.str(), "610.000000\n3.000000\nabab\nhi bob\n");
+    EXPECT_NE(stats.str().find("fully numeric functions: fib twice\n"), std::string::npos);
+}
+
+TEST(JitTest, RunsNumericFunctionsNativelyAndBailsOnOtherTypes)
+{
+    if (!Jit::supported())
+    {
+        GTEST_SKIP() << "The JIT needs x86-64 Linux";
+    }
+
+    std::stringstream out;
+    Interpreter interpreter{out};
+    ASSERT_TRUE(interpreter.enableIr(false, JitOptions{ JitMode::EAGER }));
+
+    const auto program = Parser{Scanner{R"STR(
+        fun fib(n) { if (n < 2) return n; return fib(n - 1) + fib(n - 2); }
+        fun pick(x) { if (x < 0 or x != x) return -x; return x / 4; }
+        var total = 0;
+        fun count(n) { var i = 0; var s = 0; while (i < n) { s = s + i; i = i + 1; } print i; total = s; return s >= 6; }
+        print fib(20);
+        print pick(-2.5);
+        print pick(0 / 0) == pick(0 / 0);
+        print count(4);
+        print total;
+        print pick(nil);
+        )STR"}.scanTokens()}.parse();
+    interpreter.interpret(*program);
+
+    // pick(nil) isn't a number: the native code bails and the IR reports.
+    EXPECT_TRUE(ErrorManager::get().hasError());
+    ErrorManager::get().resetError();
+    EXPECT_EQ(out.str().rfind("6765.000000\n2.500000\nfalse\n4.000000\ntrue\n6.000000\n", 0), 0u);
+
+    std::stringstream stats;
+    interpreter.printIrStats(stats);
+    EXPECT_NE(stats.str().find("[JIT] functions compiled: 3 "), std::string::npos);
+}
+
+TEST(JitTest, ZeroAndNegativeZeroAreFalsy)
+{
+    if (!Jit::supported())
+    {
+        GTEST_SKIP() << "The JIT needs x86-64 Linux";
+    }
+
+    std::stringstream out;
+    Interpreter interpreter{out};
+    ASSERT_TRUE(interpreter.enableIr(false, JitOptions{ JitMode::EAGER }));
+
+    const auto program = Parser{Scanner{R"STR(
+        fun negate(x) { return !x; }
+        fun both(x) { return x and 2; }
+        fun pick(x) { if (x) return 1; return 2; }
+        var nan = 0 / 0;
+        print negate(0); print negate(-0); print negate(nan); print negate(3);
+        print both(0); print both(-0); print both(nan);
+        print pick(0); print pick(-0); print pick(nan); print pick(0.5);
+        )STR"}.scanTokens()}.parse();
+    interpreter.interpret(*program);
+
+    EXPECT_FALSE(ErrorManager::get().hasError());
+    EXPECT_EQ(out.str(), "true\ntrue\nfalse\nfalse\nfalse\nfalse\ntrue\n"
+        "2.000000\n2.000000\n1.000000\n1.000000\n");
+
+    std::stringstream stats;
+    interpreter.printIrStats(stats);
+    EXPECT_NE(stats.str().find("[JIT] functions compiled: 3 "), std::string::npos);
+}
+
+TEST(MemoTest, CachesPureFunctionsOnly)
+{
+    std::stringstream out;
+    Interpreter interpreter{out};
+    interpreter.enableMemoization(Memoizer::DEFAULT_CAPACITY);
+
+    const auto program = Parser{Scanner{R"STR(
+        fun fib(n) { if (n <= 1) return n; return fib(n - 2) + fib(n - 1); }
+        var calls = 0;
+        fun counted(n) { calls = calls + 1; return n; }
+        fun shout(s) { print s; return s + "!"; }
+        print fib(50);
+        counted(1); counted(1);
+        print calls;
+        print shout("a") + shout("a");
+        )STR"}.scanTokens()}.parse();
+
+    Heap::get().setStressMode(true);
+    interpreter.interpret(*program);
+    Heap::get().setStressMode(false);
+
+    EXPECT_FALSE(ErrorManager::get().hasError());
+    EXPECT_EQ(out.str(), "12586269025.000000\n2.000000\na\na\na!a!\n");
+
+    // fib(0) to fib(50) miss once each, fib(2) to fib(50) make two calls.
+    const auto& stats = interpreter.memoStats();
+    EXPECT_EQ(stats.pureFunctions, 1u);
+    EXPECT_EQ(stats.misses, 51u);
+    EXPECT_EQ(stats.hits, 1u + 2u * 49u - 51u);
+}
+
+TEST(MemoTest, TailCallsInTheIrDontNest)
+{
+    std::stringstream out;
+    Interpreter interpreter{out};
+    interpreter.enableMemoization(Memoizer::DEFAULT_CAPACITY);
+    interpreter.enableIr(false);
+
+    const auto program = Parser{Scanner{R"STR(
+        fun sum(n, acc) { if (n == 0) return acc; return sum(n - 1, acc + n); }
+        fun isEven(n) { if (n == 0) return true; return isOdd(n - 1); }
+        fun isOdd(n) { if (n == 0) return false; return isEven(n - 1); }
+        print sum(200000, 0);
+        print isEven(200001);
+        print sum(200000, 0);
+        )STR"}.scanTokens()}.parse();
+
+    interpreter.interpret(*program);
+
+    // Only the outermost calls are cached, the second sum() hits.
+    EXPECT_FALSE(ErrorManager::get().hasError());
+    EXPECT_EQ(out.str(), "20000100000.000000\nfalse\n20000100000.000000\n");
+    EXPECT_EQ(interpreter.memoStats().hits, 1u);
+}
+
+TEST(MemoTest, EvictsLeastRecentlyUsed)
+{
+    std::stringstream out;
+    Interpreter interpreter{out};
+    interpreter.enableMemoization(2);
+
+    const auto program = Parser{Scanner{R"STR(
+        fun square(n) { return n * n; }
+        square(1); square(2); square(1); square(3); square(1); square(2);
+        )STR"}.scanTokens()}.parse();
+
+    interpreter.interpret(*program);
+
+    // square(2) is evicted by square(3), square(1) stays in use.
+    const auto& stats = interpreter.memoStats();
+    EXPECT_EQ(stats.hits, 2u);
+    EXPECT_EQ(stats.misses, 4u);
+    EXPECT_EQ(stats.evictions, 2u);
+}
+
+TEST(ClosureEngineTest, KeepsTailCallsFlatAndGlobalsAcrossPrograms)
+{
+    std::stringstream out;
+    ClosureEngine engine{out};
+
+    const auto first = Parser{Scanner{R"STR(
+        fun count(n, acc) { if (n == 0) return acc; return count(n - 1, acc + 1); }
+        var counter;
+        {
+            var hits = 0;
+            fun hit() { hits = hits + 1; return hits; }
+            counter = hit;
+        }
+        print count(500000, 0);
+        )STR"}.scanTokens()}.parse();
+    const auto second = Parser{Scanner{"counter(); counter(); print counter();"}.scanTokens()}.parse();
+
+    engine.interpret(*first);
+    engine.interpret(*second);
+
+    EXPECT_FALSE(ErrorManager::get().hasError());
+    EXPECT_EQ(out.str(), "500000.000000\n3.000000\n");
+}
+
+TEST(ClosureEngineTest, RecursesUntilTheNativeStackRunsOut)
+{
+    std::stringstream out;
+    ClosureEngine engine{out};
+
+    const auto program = Parser{Scanner{R"STR(
+        fun deep(n) { if (n == 0) return 0; return 1 + deep(n - 1); }
+        fun runaway(n) { runaway(n + 1); return n; }
+        print deep(10000);
+        print runaway(0);
+        print "after";
+        )STR"}.scanTokens()}.parse();
+
+    const auto errors = ErrorManager::get().errorCount();
+    testing::internal::CaptureStdout();
+    engine.interpret(*program);
+    const auto reported = testing::internal::GetCapturedStdout();
+
+    // Only runaway() runs out, its call reports it and gives nil.
+    ErrorManager::get().resetError();
+    EXPECT_EQ(ErrorManager::get().errorCount(), errors + 1);
+    EXPECT_EQ(reported, "[line 3] Error: Stack overflow.\n");
+    EXPECT_EQ(out.str(), "10000.000000\n0.000000\nafter\n");
+}
+
 static const auto testParams = std::vector{
     std::tuple{std::string{"print(1);"}, std::string{"1.000000\n"}},
     std::tuple{
@@ -154,7 +802,107 @@ static const auto testParams = std::vector{
                     counter(); // "2".)STR"},
         std::string{"1.000000\n2.000000\n"},
     },
+    std::tuple{
+        std::string{"fun fib(n) { if (n <= 1) return n; return fib(n - 2) + fib(n - 1); }"
+        "for (var i = 0; i < 5; i = i + 1) { print fib(i); }"},
+        std::string{"0.000000\n1.000000\n1.000000\n2.000000\n3.000000\n"}
+    },
+    std::tuple{
+        std::string{"var s = \"abc\"; var r = \"\"; for (var i = 2; i >= 0; i = i - 1) { r = r + s[i]; } print r;"},
+        std::string{"cba\n"}
+    },
+    std::tuple{
+        std::string{"var a = \"global\"; { var a = \"outer\"; { var a = \"inner\"; print a; } print a; } print a;"},
+        std::string{"inner\nouter\nglobal\n"}
+    },
+    std::tuple{
+        std::string{"var abc = 1; { var abc = abc + 1; print(abc); } print(abc);"},
+        std::string{"2.000000\n1.000000\n"}
+    },
+    std::tuple{
+        std::string{R"STR(fun makeCounter() {
+                    var i = 0;
+                    fun count() {
+                        i = i + 1;
+                        return i;
+                    }
+                    return count;
+                    }
+                    var c1 = makeCounter();
+                    var c2 = makeCounter();
+                    print c1(); print c1(); print c2();)STR"},
+        std::string{"1.000000\n2.000000\n1.000000\n"},
+    },
+    std::tuple{
+        std::string{"{ var x = 1; fun addX(y) { return x + y; } x = 10; print addX(5); }"},
+        std::string{"15.000000\n"}
+    },
+    std::tuple{
+        std::string{"var a = 1; var ab = 2; var b = 3; a = a + ab + b; print a; print ab;"},
+        std::string{"6.000000\n2.000000\n"}
+    },
+    std::tuple{
+        std::string{"var s = \"abc\"; print s[1] == \"b\"; print \"ab\" + \"c\" == s; print s[0] != s[2];"},
+        std::string{"true\ntrue\ntrue\n"}
+    },
+    std::tuple{
+        std::string{"var a = \"x\"; var b = a + \"y\"; var c = a + \"z\"; var d = b + b; print a; print b; print c; print d;"},
+        std::string{"x\nxy\nxz\nxyxy\n"}
+    },
+    std::tuple{
+        std::string{"print 2 * (3 + 4) - 1 > 10; print -(1 - 3); print !nil and \"x\"; print \"ab\" + \"cd\"; print \"abc\"[2]; print 1 == \"1\";"},
+        std::string{"true\n2.000000\ntrue\nabcd\nc\nfalse\n"}
+    },
+    std::tuple{
+        std::string{"if (1 > 2) print \"then\"; else print \"else\"; var x = 1; if (true) x = 3; print x; while (false) print \"never\";"
+        "for (var i = 7; false;) print i; var j = 0; for (; true; j = j + 1) { if (j == 2) break; print j; }"},
+        std::string{"else\n3.000000\n0.000000\n1.000000\n"}
+    },
+    std::tuple{
+        std::string{"var s = \"a\"; var n = 3; print s + \"b\" == \"ab\"; print s != \"a\"; print -s; print !s; print n - 1 >= 2; print n / 2 * -n;"},
+        std::string{"true\nfalse\n[Lox obj] = 0\nfalse\ntrue\n-4.500000\n"}
+    },
+    std::tuple{
+        std::string{"var big = 2147483647; var zero = 0; var m = 1; print big + 1; print zero * -m; print -zero; print 7 / 2; print 6 / 3;"
+        "print (big + 1) / 2 == 1073741824; print 1 == 1.0; print \"abc\"[m]; for (var i = 0; i < 3; i = i + 1) print i * 2;"},
+        std::string{"2147483648.000000\n-0.000000\n-0.000000\n3.500000\n2.000000\ntrue\ntrue\nb\n0.000000\n2.000000\n4.000000\n"}
+    },
+    std::tuple{
+        std::string{"fun outer() { var x = \"x\"; fun inner(n, s) { if (n == 0) { return s; } return inner(n - 1, s + x); } return inner(3, \"\"); }"
+        "fun id(v) { return v; } fun twice(n) { return id(id(n)) + 1; } print outer(); print twice(4); print clock() > 0;"},
+        std::string{"xxx\n5.000000\ntrue\n"}
+    },
+    std::tuple{
+        std::string{"var a = \"g\"; { var a = \"outer\"; for (var i = 0; i < 2; i = i + 1) { var a = i; { var a = 10 - i; print a; } print a; } print a; } print a;"
+        "fun find(n) { for (var i = 0; i < 10; i = i + 1) { var sq = i * i; if (sq >= n) return i; } return nil; } print find(50);"},
+        std::string{"10.000000\n0.000000\n9.000000\n1.000000\nouter\ng\n8.000000\n"}
+    },
+    std::tuple{
+        std::string{"var j = 0; for (; j < 10; j = j + 1) { if (j == 2) break; } print j;"
+        "fun f() { while (true) { for (var i = 0; ; i = i + 1) { if (i == 3) return i; } } } print f(); fun g() { return; } print g();"},
+        std::string{"2.000000\n3.000000\n[Lox obj] = 0\n"}
+    },
+    std::tuple{
+        std::string{"fun f() { var a; var b; for (var i = 0; i < 2; i = i + 1) { var j = i; fun g() { return j; } if (i == 0) a = g; else b = g; } print a(); print b(); } f();"
+        "fun outer() { var x = 1; fun mid() { fun inner() { x = x + 1; return x; } return inner; } return mid(); } var h = outer(); print h(); print h();"
+        "fun pair() { var n = 0; fun inc() { n = n + 1; } fun get() { return n; } inc(); inc(); return get; } print pair()();"
+        "{ var t = \"blk\"; fun show() { print t; } show(); } fun wrap() { fun fact(n) { if (n <= 1) return 1; return n * fact(n - 1); } return fact(5); } print wrap();"},
+        std::string{"0.000000\n1.000000\n2.000000\n3.000000\n2.000000\nblk\n120.000000\n"}
+    },
+    std::tuple{
+        std::string{"var f; var g; var h; { var a = 1; var b = 2; { var c = 3; fun sum() { return c + b; } f = sum; { var d = 4;"
+        "fun all() { return d + a + c; } g = all; fun bd() { return b + d; } h = bd; d = 40; } c = 30; } a = 10; b = 20; }"
+        "print f(); print g(); print h();"},
+        std::string{"50.000000\n80.000000\n60.000000\n"}
+    },
+    std::tuple{
+        std::string{"var s = \"abc\"; var n = 3; print s[n]; print s[-1]; print s[1.5]; print s[n / 3]; print \"abc\"[3]; print \"abc\"[1.5];"
+        "fun at(t, i) { return t[i]; } print at(s, 2); print at(s, n); print at(s, -1); print at(s, 1.5); print at(s, 0);"},
+        std::string{"[Lox obj] = 0\n[Lox obj] = 0\n[Lox obj] = 0\nb\n[Lox obj] = 0\n[Lox obj] = 0\n"
+        "c\n[Lox obj] = 0\n[Lox obj] = 0\n[Lox obj] = 0\na\n"}
+    },
 };
 
 INSTANTIATE_TEST_SUITE_P(BasicNumberTest, BasicIntegrationFixture,
-    ::testing::ValuesIn(testParams));
\ No newline at end of file
+    ::testing::Combine(::testing::ValuesIn(testParams),
+        ::testing::Values(Engine::INTERPRETER, Engine::VM, Engine::IR, Engine::CLOSURE)));
\ No newline at end of file